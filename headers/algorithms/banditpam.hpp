@@ -9,8 +9,38 @@
 
 
 #include "kmedoids_algorithm.hpp"
+#include "swap_arms.hpp"
 
 namespace km {
+/**
+ * @brief Buffers that are reused by every bandit round of a BanditPAM fit,
+ * so that the rounds themselves do not allocate once the buffers have grown
+ * to their largest size.
+ */
+struct BanditWorkspace {
+  /// Reference points of the current batch
+  arma::uvec referencePoints;
+
+  /// Targets that are sampled in the current round
+  arma::uvec targets;
+
+  /// Targets that are computed exactly in the current round
+  arma::uvec exactTargets;
+
+  /// Estimated change in loss of each BUILD target
+  arma::frowvec buildResults;
+
+  /// Estimated change in loss of each SWAP arm, nMedoids x targets
+  arma::fmat swapResults;
+
+  /// Partial sums of the chunks of a round's shard, one per column; only
+  /// the leading rows and columns in use by the round are meaningful
+  arma::fmat partials;
+
+  /// State of the arms of the current SWAP step
+  SwapArms arms;
+};
+
 /**
  * @brief Contains all necessary BanditPAM functions
  */
@@ -19,48 +49,158 @@ class BanditPAM : public km::KMedoids {
   /**
    * @brief Runs BanditPAM to identify a dataset's medoids.
    *
-   * @param inputData Input data to cluster
+   * @param data Data to cluster, with one datapoint per column
+   * @param initialMedoids Medoids to start SWAP from instead of running BUILD
    */
   void fitBanditPAM(
-    const arma::fmat& inputData,
-    std::optional<std::reference_wrapper<const arma::fmat>> distMat);
+    const arma::fmat& data,
+    std::optional<std::reference_wrapper<const arma::urowvec>> initialMedoids);
+
+  /**
+   * @brief Runs BanditPAM for every number of medoids from kMin to kMax. The
+   * BUILD step is run once, up to kMax, and the SWAP step is run for each k
+   * starting from the first k BUILD medoids, sharing the distance cache and
+   * the permutation.
+   *
+   * @param data Data to cluster, with one datapoint per column
+   * @param kMin Smallest number of medoids to fit
+   * @param kMax Largest number of medoids to fit
+   * @param results Result of each k in increasing order, appended in place;
+   * may be nullptr
+   * @param initialMedoids kMax medoids to use instead of running BUILD; only
+   * supported when kMin == kMax
+   */
+  void fitBanditPAMRange(
+    const arma::fmat& data,
+    const size_t kMin,
+    const size_t kMax,
+    std::vector<FitResult>* results = nullptr,
+    std::optional<std::reference_wrapper<const arma::urowvec>> initialMedoids =
+      std::nullopt);
+
+  /**
+   * @brief Draws the reference points of the next batch, either from the
+   * precomputed permutation or uniformly at random.
+   *
+   * @param N Number of points in the dataset
+   * @param count Number of reference points to draw; N to use every point
+   * @param referencePoints Reference points that are overwritten in place
+   */
+  void sampleReferencePoints(
+    const size_t N,
+    const size_t count,
+    arma::uvec* referencePoints);
+
+  /**
+   * @brief Returns the number of reference points of each chunk of a
+   * round's shard. Unless the schedule is static, the shard of a round with
+   * few blocks of targets is split, so that the threads have (block, chunk)
+   * pairs to share. The chunks do not depend on the number of threads.
+   *
+   * @param numBlocks Number of blocks of targets of the round
+   * @param shardSize Number of reference points of this rank's shard
+   *
+   * @returns The number of reference points per chunk; shardSize, or more,
+   * if the shard is not split
+   */
+  size_t numChunkReferences(
+    const size_t numBlocks,
+    const size_t shardSize) const;
+
+  /**
+   * @brief Zeroes the partial sums of a round's chunks, growing the buffer
+   * only when the round needs more of it than any previous round
+   *
+   * @param rows Number of sums per chunk
+   * @param numChunks Number of chunks of the round
+   * @param partials Buffer whose leading rows x numChunks block is zeroed
+   */
+  static void zeroPartials(
+    const size_t rows,
+    const size_t numChunks,
+    arma::fmat* partials);
+
+  /**
+   * @brief Returns the number of reference points to sample in a round.
+   * With the adaptive schedule, the batch grows as the surviving targets
+   * shrink, so that the round has at least one batch per thread.
+   *
+   * @param numTargets Number of targets sampled in the round
+   * @param N Number of points in the dataset
+   *
+   * @returns The batch size of the round, at most N
+   */
+  size_t roundBatchSize(const size_t numTargets, const size_t N) const;
+
+  /**
+   * @brief Runs task(0), ..., task(numTasks - 1) across threads. Unless the
+   * schedule is static, threads pick up the next task as they finish, so
+   * tasks of uneven cost do not leave threads idle.
+   *
+   * @param numTasks Number of tasks
+   * @param task Called with the index of each task
+   */
+  template <typename Task>
+  void runTasks(const size_t numTasks, const Task& task) {
+    if (schedule == "static") {
+      #pragma omp parallel for if (this->parallelize) \
+        num_threads(this->threadCount())
+      for (size_t i = 0; i < numTasks; i++) {
+        task(i);
+      }
+    } else {
+      #pragma omp parallel for schedule(dynamic) if (this->parallelize) \
+        num_threads(this->threadCount())
+      for (size_t i = 0; i < numTasks; i++) {
+        task(i);
+      }
+    }
+  }
 
   /**
    * @brief Empirical estimation of standard deviation of arm returns
    * in the BUILD step.
    *
    * @param data Transposed input data to cluster
+   * @param referencePoints Reference points used to estimate the deviations
    * @param bestDistances Contains best distances from each point to medoids
    * @param useAbsolute Flag to use the absolute distance to each arm instead
    * of improvement over prior loss; necessary for the first BUILD step
-   *
-   * @returns Estimate of each arm's standard deviation
+   * @param sigma Estimate of each arm's standard deviation, set in place
+   * @param loss Loss policy used to compute distances
    */
-  arma::frowvec buildSigma(
+  template <typename LossFunction>
+  void buildSigma(
     const arma::fmat& data,
-    std::optional<std::reference_wrapper<const arma::fmat>> distMat,
+    const arma::uvec& referencePoints,
     const arma::frowvec& bestDistances,
-    const bool useAbsolute);
+    const bool useAbsolute,
+    arma::frowvec* sigma,
+    const LossFunction& loss);
 
   /**
    * @brief Estimates the mean reward for each arm in the BUILD steps.
    *
    * @param data Transposed input data to cluster
+   * @param referencePoints Reference points to average the rewards over
    * @param target Candidate datapoints to consider adding as medoids
    * @param bestDistances Contains best distances from each point to medoids
    * @param useAbsolute Flag to use the absolute distance to each arm instead
    * of improvement over prior loss; necessary for the first BUILD step
-   * @param exact 0 if using standard batch size; size of dataset otherwise
-   *
-   * @returns Estimate of each arm's change in loss
+   * @param results Estimate of each arm's change in loss, set in place
+   * @param partials Buffer for the partial sums of the shard's chunks
+   * @param loss Loss policy used to compute distances
    */
-  arma::frowvec buildTarget(
+  template <typename LossFunction>
+  void buildTarget(
     const arma::fmat& data,
-    std::optional<std::reference_wrapper<const arma::fmat>> distMat,
+    const arma::uvec& referencePoints,
     const arma::uvec* target,
     const arma::frowvec* bestDistances,
     const bool useAbsolute,
-    const size_t exact);
+    arma::frowvec* results,
+    arma::fmat* partials,
+    const LossFunction& loss);
 
   /**
    * @brief Performs the BUILD step of BanditPAM.
@@ -75,54 +215,64 @@ class BanditPAM : public km::KMedoids {
    * @param medoidIndices Array of medoids that is modified in place
    * as medoids are identified
    * @param medoids Matrix that contains the coordinates of each medoid
+   * @param workspace Buffers reused across the bandit rounds
+   * @param loss Loss policy used to compute distances
    */
+  template <typename LossFunction>
   void build(
     const arma::fmat& data,
-    std::optional<std::reference_wrapper<const arma::fmat>> distMat,
     arma::urowvec* medoidIndices,
-    arma::fmat* medoids);
+    arma::fmat* medoids,
+    BanditWorkspace* workspace,
+    const LossFunction& loss);
 
   /**
    * @brief Empirical estimation of standard deviation of arm returns
    * in the SWAP step.
    *
    * @param data Transposed input data to cluster
+   * @param referencePoints Reference points used to estimate the deviations
    * @param bestDistances Contains best distances from each point to medoids
    * @param secondBestDistances Contains second best distances from each point to medoids
    * @param assignments Assignments of datapoints to their closest medoid
-   *
-   * @returns Estimate of each arm's standard deviation
+   * @param arms SWAP arms whose standard deviations are set
+   * @param loss Loss policy used to compute distances
    */
-  arma::fmat swapSigma(
+  template <typename LossFunction>
+  void swapSigma(
     const arma::fmat& data,
-    std::optional<std::reference_wrapper<const arma::fmat>> distMat,
+    const arma::uvec& referencePoints,
     const arma::frowvec* bestDistances,
     const arma::frowvec* secondBestDistances,
-    const arma::urowvec* assignments);
+    const arma::urowvec* assignments,
+    SwapArms* arms,
+    const LossFunction& loss);
 
   /**
    * @brief Estimates the mean reward for each arm in SWAP step.
    *
    * @param data Transposed input data to cluster
-   * @param medoidIndices Array of medoids that is modified in place
-   * as medoids are swapped in and out
+   * @param referencePoints Reference points to average the rewards over
    * @param targets Set of potential swaps to be evaluated
    * @param bestDistances Contains best distances from each point to medoids
    * @param secondBestDistances Contains second best distances from each point to medoids
    * @param assignments Assignments of datapoints to their closest medoid
-   * @param exact 0 if using standard batch size; size of dataset otherwise
-   *
-   * @returns Estimate of each arm's change in loss
+   * @param results Estimate of each arm's change in loss, of size
+   * nMedoids x targets, set in place
+   * @param partials Buffer for the partial sums of the shard's chunks
+   * @param loss Loss policy used to compute distances
    */
-  arma::fmat swapTarget(
+  template <typename LossFunction>
+  void swapTarget(
     const arma::fmat& data,
-    std::optional<std::reference_wrapper<const arma::fmat>> distMat,
-    const arma::urowvec* medoidIndices,
+    const arma::uvec& referencePoints,
     const arma::uvec* targets,
     const arma::frowvec* bestDistances,
     const arma::frowvec* secondBestDistances,
     const arma::urowvec* assignments,
-    const size_t exact);
+    arma::fmat* results,
+    arma::fmat* partials,
+    const LossFunction& loss);
 
   /**
   * @brief Performs the SWAP step of BanditPAM.
@@ -139,13 +289,17 @@ class BanditPAM : public km::KMedoids {
   * @param medoids Matrix of possible medoids that is updated as the bandit
   * learns which datapoints will be unlikely to be good candidates
   * @param assignments Array of containing the medoid each point is closest to
+  * @param workspace Buffers reused across the bandit rounds
+  * @param loss Loss policy used to compute distances
   */
+  template <typename LossFunction>
   void swap(
     const arma::fmat& data,
-    std::optional<std::reference_wrapper<const arma::fmat>> distMat,
     arma::urowvec* medoidIndices,
     arma::fmat* medoids,
-    arma::urowvec* assignments);
+    arma::urowvec* assignments,
+    BanditWorkspace* workspace,
+    const LossFunction& loss);
 };
 }  // namespace km
 #endif  // HEADERS_ALGORITHMS_BANDITPAM_HPP_
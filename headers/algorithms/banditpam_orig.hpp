@@ -19,11 +19,10 @@ class BanditPAM_orig : public km::KMedoids {
   /**
    * @brief Runs BanditPAM_orig to identify a dataset's medoids.
    *
-   * @param inputData Input data to cluster
+   * @param data Data to cluster, with one datapoint per column
    */
   void fitBanditPAM_orig(
-      const arma::fmat& inputData,
-      std::optional<std::reference_wrapper<const arma::fmat>> distMat);
+      const arma::fmat& data);
 
   /**
    * @brief Empirical estimation of standard deviation of arm returns
@@ -38,7 +37,6 @@ class BanditPAM_orig : public km::KMedoids {
    */
   arma::frowvec buildSigma(
     const arma::fmat& data,
-    std::optional<std::reference_wrapper<const arma::fmat>> distMat,
     const arma::frowvec& bestDistances,
     const bool useAbsolute);
 
@@ -56,7 +54,6 @@ class BanditPAM_orig : public km::KMedoids {
    */
   arma::frowvec buildTarget(
     const arma::fmat& data,
-    std::optional<std::reference_wrapper<const arma::fmat>> distMat,
     const arma::uvec* target,
     const arma::frowvec* bestDistances,
     const bool useAbsolute,
@@ -78,7 +75,6 @@ class BanditPAM_orig : public km::KMedoids {
    */
   void build(
     const arma::fmat& data,
-    std::optional<std::reference_wrapper<const arma::fmat>> distMat,
     arma::urowvec* medoidIndices,
     arma::fmat* medoids);
 
@@ -95,7 +91,6 @@ class BanditPAM_orig : public km::KMedoids {
    */
   arma::fmat swapSigma(
     const arma::fmat& data,
-    std::optional<std::reference_wrapper<const arma::fmat>> distMat,
     const arma::frowvec* bestDistances,
     const arma::frowvec* secondBestDistances,
     const arma::urowvec* assignments);
@@ -117,7 +112,6 @@ class BanditPAM_orig : public km::KMedoids {
    */
   arma::fvec swapTarget(
     const arma::fmat& data,
-    std::optional<std::reference_wrapper<const arma::fmat>> distMat,
     const arma::urowvec* medoidIndices,
     const arma::uvec* targets,
     const arma::frowvec* bestDistances,
@@ -143,7 +137,6 @@ class BanditPAM_orig : public km::KMedoids {
   */
   void swap(
     const arma::fmat& data,
-    std::optional<std::reference_wrapper<const arma::fmat>> distMat,
     arma::urowvec* medoidIndices,
     arma::fmat* medoids,
     arma::urowvec* assignments);
@@ -0,0 +1,114 @@
+#ifndef HEADERS_ALGORITHMS_COMMUNICATOR_HPP_
+#define HEADERS_ALGORITHMS_COMMUNICATOR_HPP_
+
+#include <cstddef>
+
+namespace km {
+/**
+ * @brief The processes (ranks) that share the compute of a distributed fit.
+ *
+ * The data is not partitioned: every rank holds the whole dataset, e.g., by
+ * memory-mapping the same .npy file, and runs the same sequence of bandit
+ * rounds. Within each round, a
+ * rank only computes the distances to its shard of the reference points,
+ * and the per-arm partial sums are added up across ranks. All ranks then
+ * see the same estimates and take the same decisions, so no other state has
+ * to be exchanged.
+ *
+ * Without MPI, or before join() is called, the communicator has a single
+ * rank, its shard is every reference point, and sums are left unchanged.
+ * MPI support is compiled in with -DBANDITPAM_MPI=ON.
+ */
+class Communicator {
+ public:
+  /**
+   * @brief Returns whether BanditPAM was built with MPI support
+   *
+   * @returns Whether MPI support is available
+   */
+  static bool isAvailable();
+
+  /**
+   * @brief Joins MPI_COMM_WORLD, initializing MPI if the caller has not.
+   *
+   * @throws if BanditPAM was built without MPI support.
+   */
+  void join();
+
+  /**
+   * @brief Goes back to a single rank, e.g., to fit locally after a
+   * distributed fit. MPI itself is left running.
+   */
+  void leave();
+
+  /**
+   * @brief Returns whether join() has been called since the last leave()
+   *
+   * @returns Whether the communicator is distributed
+   */
+  bool isJoined() const {
+    return joined;
+  }
+
+  /**
+   * @brief Returns the index of this process among the ranks
+   *
+   * @returns The rank of this process, 0 when not distributed
+   */
+  size_t getRank() const {
+    return rank;
+  }
+
+  /**
+   * @brief Returns the number of ranks
+   *
+   * @returns The number of ranks, 1 when not distributed
+   */
+  size_t getSize() const {
+    return size;
+  }
+
+  /**
+   * @brief Returns the contiguous range of count items, e.g., reference
+   * points, that this rank is responsible for
+   *
+   * @param count Number of items shared by all ranks
+   * @param begin Set to the first item of this rank
+   * @param end Set to one past the last item of this rank
+   */
+  void shard(const size_t count, size_t* begin, size_t* end) const {
+    *begin = count * rank / size;
+    *end = count * (rank + 1) / size;
+  }
+
+  /**
+   * @brief Replaces values with their elementwise sum over all ranks. Must be
+   * called by every rank, outside of parallel regions.
+   *
+   * @param values Partial sums of this rank
+   * @param n Number of values
+   */
+  void allReduceSum(float* values, const size_t n) const;
+
+  /**
+   * @brief Returns whether the value is true on any rank. Must be called by
+   * every rank, outside of parallel regions.
+   *
+   * @param value The value of this rank
+   *
+   * @returns The logical or of the values of all ranks
+   */
+  bool anyRank(const bool value) const;
+
+ private:
+  /// Whether the communicator spans MPI_COMM_WORLD
+  bool joined = false;
+
+  /// Index of this process among the ranks
+  size_t rank = 0;
+
+  /// Number of ranks
+  size_t size = 1;
+};
+}  // namespace km
+#endif  // HEADERS_ALGORITHMS_COMMUNICATOR_HPP_
@@ -0,0 +1,149 @@
+#ifndef HEADERS_ALGORITHMS_CUDA_BACKEND_HPP_
+#define HEADERS_ALGORITHMS_CUDA_BACKEND_HPP_
+
+#include <armadillo>
+#include <cstddef>
+#include <memory>
+
+namespace km {
+/**
+ * @brief Distances of the CUDA backend
+ */
+enum class CudaLoss {
+  l1,
+  l2,
+  lp,
+  lInf,
+  cosine
+};
+
+/**
+ * @brief Evaluates the bandit rounds of BanditPAM and the assignment of the
+ * points to their medoids on a CUDA device.
+ *
+ * The data, the weights and the best distances, second best distances and
+ * assignments of the points stay resident on the device for the whole fit.
+ * Each call uploads only the indices of its targets and reference points,
+ * computes their distances and reduces them on the device, and downloads
+ * the per-target (and per-arm) sums that the bandit logic on the host
+ * needs. A thread of the device owns each target and adds up its reference
+ * points in order, so the sums do not depend on the launch configuration.
+ *
+ * Without CUDA, the backend is unavailable and every other member throws.
+ * CUDA support is compiled in with -DBANDITPAM_CUDA=ON.
+ */
+class CudaBackend {
+ public:
+  /**
+   * @brief Returns whether BanditPAM was built with CUDA support and a
+   * device is present
+   *
+   * @returns Whether the backend can be used
+   */
+  static bool isAvailable();
+
+  CudaBackend();
+
+  ~CudaBackend();
+
+  CudaBackend(const CudaBackend&) = delete;
+
+  CudaBackend& operator=(const CudaBackend&) = delete;
+
+  /**
+   * @brief Copies the data of a fit to the device
+   *
+   * @param points Data to cluster, with one datapoint per column
+   * @param weights Weight of each point
+   * @param loss Distance between the points
+   * @param p The value of p of an Lp distance
+   *
+   * @throws if the device runs out of memory or fails.
+   */
+  void reset(
+    const arma::fmat& points,
+    const arma::frowvec& weights,
+    const CudaLoss loss,
+    const size_t p);
+
+  /**
+   * @brief Frees the device memory of the fit
+   */
+  void release();
+
+  /**
+   * @brief Copies the best distances of the points to the device, e.g.,
+   * after the host added a medoid in BUILD
+   *
+   * @param bestDistances Distance from each point to its closest medoid
+   */
+  void setBestDistances(const arma::frowvec& bestDistances);
+
+  /**
+   * @brief Assigns every point to its closest medoid on the device, and
+   * copies the results back to the host
+   *
+   * @param medoidIndices Indices of the medoids
+   * @param bestDistances Distance from each point to its closest medoid, set
+   * in place
+   * @param secondBestDistances Distance from each point to its second
+   * closest medoid, set in place
+   * @param assignments Closest medoid of each point, set in place
+   */
+  void assign(
+    const arma::urowvec& medoidIndices,
+    arma::frowvec* bestDistances,
+    arma::frowvec* secondBestDistances,
+    arma::urowvec* assignments);
+
+  /**
+   * @brief Sums the BUILD samples of each target over the reference points
+   *
+   * @param targets Candidate medoids
+   * @param referencePoints Reference points to sum over
+   * @param useAbsolute Whether the samples are the weighted distances, as in
+   * the first BUILD step, or the weighted improvements of the best distances
+   * @param sums Sum of the samples of each target, set in place
+   * @param sumSquares If not null, sum of the squared samples of each
+   * target, set in place
+   */
+  void buildSums(
+    const arma::uvec& targets,
+    const arma::uvec& referencePoints,
+    const bool useAbsolute,
+    arma::vec* sums,
+    arma::vec* sumSquares);
+
+  /**
+   * @brief Sums the SWAP samples of each target over the reference points.
+   * The sample of arm (k, t) is the sample of target t for reference points
+   * that are not assigned to medoid k, plus an adjustment for those that are.
+   *
+   * @param targets Candidate points to swap in
+   * @param referencePoints Reference points to sum over
+   * @param nMedoids Number of medoids
+   * @param sums Sum of the unadjusted samples of each target, set in place
+   * @param sumSquares If not null, sum of their squares, set in place
+   * @param adjustments Adjustment of each arm's sum, of size nMedoids x
+   * targets, set in place
+   * @param squareAdjustments If not null, adjustment of each arm's sum of
+   * squares, set in place
+   */
+  void swapSums(
+    const arma::uvec& targets,
+    const arma::uvec& referencePoints,
+    const size_t nMedoids,
+    arma::vec* sums,
+    arma::vec* sumSquares,
+    arma::mat* adjustments,
+    arma::mat* squareAdjustments);
+
+ private:
+  /// Device buffers, defined by the CUDA implementation
+  struct Device;
+
+  /// The device buffers of the current fit, if any
+  std::unique_ptr<Device> device;
+};
+}  // namespace km
+#endif  // HEADERS_ALGORITHMS_CUDA_BACKEND_HPP_
@@ -0,0 +1,133 @@
+#ifndef HEADERS_ALGORITHMS_DISTANCE_CACHE_HPP_
+#define HEADERS_ALGORITHMS_DISTANCE_CACHE_HPP_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace km {
+/**
+ * @brief Owns the n x m table of cached pairwise distances used by BanditPAM.
+ *
+ * The table is allocated lazily and reused by later fits whenever it is large
+ * enough, so repeated calls to fit() do not grow memory usage. On Linux, large
+ * tables are mapped directly and marked as candidates for transparent huge
+ * pages. Slots are reset in parallel, so each page is first touched (and, on
+ * NUMA systems, placed) by one of the threads that will read it.
+ *
+ * Empty slots hold NaN. Slots are atomics so that threads can fill and read
+ * the cache concurrently without locks.
+ *
+ * The cache can also be attached to a file, which keeps its distances across
+ * fits and shares them with every process that maps the same file. Such
+ * processes fill the same slots with the same values, just as threads do.
+ */
+class DistanceCache {
+ public:
+  DistanceCache() = default;
+
+  ~DistanceCache();
+
+  DistanceCache(const DistanceCache&) = delete;
+
+  DistanceCache& operator=(const DistanceCache&) = delete;
+
+  /**
+   * @brief Prepares the cache to hold m distances for each of n points and
+   * marks every slot as empty. The existing allocation is reused if it can
+   * hold n * m slots.
+   *
+   * @param n Number of points with cached distances
+   * @param m Number of cached distances per point
+   * @param numThreads Number of threads with which to reset the slots
+   */
+  void reset(const size_t n, const size_t m, const int numThreads);
+
+  /**
+   * @brief Maps the cache from the given file. A file that holds a cache
+   * with the same fingerprint and shape is attached with its distances;
+   * otherwise, a new file with empty slots and the given points replaces it.
+   * New files are written in full before they are renamed over the path, so
+   * processes that still map the previous file are unaffected.
+   *
+   * @param path Path of the cache file
+   * @param n Number of points with cached distances
+   * @param m Number of cached distances per point
+   * @param fingerprint Identifies the data and loss of the distances
+   * @param points The m cached points, replaced by those stored in the file
+   * if it is attached
+   * @param numThreads Number of threads with which to reset the slots of a
+   * new file
+   *
+   * @returns Whether an existing file was attached
+   *
+   * @throws if the file cannot be created or mapped, or if files cannot be
+   * mapped on this platform.
+   */
+  bool attach(
+    const std::string& path,
+    const size_t n,
+    const size_t m,
+    const uint64_t fingerprint,
+    std::vector<uint64_t>* points,
+    const int numThreads);
+
+  /**
+   * @brief Frees the memory held by the cache.
+   */
+  void release();
+
+  /**
+   * @brief Returns the slot holding the distance between point i and the
+   * cached point at the given position.
+   *
+   * @param i Index of the point
+   * @param position Position of the other point among the cached points
+   *
+   * @returns The slot holding the distance
+   */
+  std::atomic<float>& at(const size_t i, const size_t position) const {
+    return slots[width * i + position];
+  }
+
+  /**
+   * @brief Returns the number of cached distances per point
+   *
+   * @returns The number of cached distances per point
+   */
+  size_t getWidth() const {
+    return width;
+  }
+
+  /**
+   * @brief Returns the number of bytes currently allocated for the cache
+   *
+   * @returns The number of bytes allocated for the cache
+   */
+  size_t getAllocatedBytes() const {
+    return allocatedBytes;
+  }
+
+ private:
+  /// Storage for the table of distances, in row-major order
+  std::atomic<float>* slots = nullptr;
+
+  /// The number of cached distances per point, i.e., m
+  size_t width = 0;
+
+  /// The number of bytes allocated for slots
+  size_t allocatedBytes = 0;
+
+  /// Whether slots was obtained from mmap rather than operator new
+  bool mapped = false;
+
+  /// The mapping of the attached file, which slots points into, if any
+  void* fileMapping = nullptr;
+
+  /// The number of bytes of fileMapping
+  size_t fileBytes = 0;
+};
+}  // namespace km
+#endif  // HEADERS_ALGORITHMS_DISTANCE_CACHE_HPP_
@@ -0,0 +1,44 @@
+#ifndef HEADERS_ALGORITHMS_DISTANCE_KERNELS_HPP_
+#define HEADERS_ALGORITHMS_DISTANCE_KERNELS_HPP_
+
+#include <cstddef>
+
+namespace km {
+/**
+ * @brief Table of raw distance kernels used by the loss policies.
+ *
+ * Every kernel takes two contiguous float arrays of length d and computes
+ * the distance between them in a single fused, allocation-free pass. The
+ * table is selected once per process from the instruction sets supported by
+ * the CPU (AVX-512, AVX2 + FMA, NEON, or a portable fallback), so that
+ * portable binaries still use the widest vectors available at runtime.
+ */
+struct DistanceKernels {
+  /// Name of the instruction set the kernels were selected for
+  const char* name;
+
+  /// Sum of absolute differences
+  float (*l1)(const float* x, const float* y, size_t d);
+
+  /// Sum of squared differences, i.e., the squared L2 distance
+  float (*l2Squared)(const float* x, const float* y, size_t d);
+
+  /// Maximum absolute difference
+  float (*lInf)(const float* x, const float* y, size_t d);
+
+  /// Inner product <x, y>
+  float (*dot)(const float* x, const float* y, size_t d);
+
+  /// Cosine distance, 1 - <x, y> / (||x|| ||y||)
+  float (*cosine)(const float* x, const float* y, size_t d);
+};
+
+/**
+ * @brief Returns the distance kernels for the current CPU. The choice is
+ * made on the first call and reused afterwards.
+ *
+ * @returns The distance kernel table for the current CPU
+ */
+const DistanceKernels& distanceKernels();
+}  // namespace km
+#endif  // HEADERS_ALGORITHMS_DISTANCE_KERNELS_HPP_
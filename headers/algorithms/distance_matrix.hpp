@@ -0,0 +1,225 @@
+#ifndef HEADERS_ALGORITHMS_DISTANCE_MATRIX_HPP_
+#define HEADERS_ALGORITHMS_DISTANCE_MATRIX_HPP_
+
+#include <armadillo>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace km {
+/**
+ * @brief Read-only access to a user-provided matrix of pairwise distances.
+ *
+ * The matrix may be given either as a full n x n float32 matrix or in
+ * condensed form: a vector of the n * (n - 1) / 2 distances above the
+ * diagonal, row by row, as returned by scipy.spatial.distance.pdist. Either
+ * form is viewed without a copy when it is stored as float32. With float16
+ * or bfloat16 precision, the condensed distances are instead packed into 16
+ * bits each, so that a float32 n x n matrix takes a quarter of the memory.
+ *
+ * Lookups are not bounds-checked; the dimensions are validated once, when
+ * the matrix is reset for a fit. Distances are assumed to be symmetric and
+ * zero on the diagonal.
+ */
+class DistanceMatrix {
+ public:
+  /**
+   * @brief Prepares the matrix for a fit on n points.
+   *
+   * @param distMat Full n x n matrix, or condensed row or column vector of
+   * distances, which must outlive the fit when stored as float32
+   * @param n Number of points in the data
+   * @param precision Storage of the distances: "float32", "float16" or
+   * "bfloat16"
+   * @param numThreads Number of threads with which to pack the distances
+   *
+   * @throws if the matrix does not have the shape of a full or condensed
+   * matrix for n points, the precision is unknown, or a distance exceeds
+   * the range of float16.
+   */
+  void reset(
+    const arma::fmat& distMat,
+    const size_t n,
+    const std::string& precision,
+    const int numThreads);
+
+  /**
+   * @brief Frees any packed distances and forgets the viewed matrix.
+   */
+  void release();
+
+  /**
+   * @brief Returns the distance between points i and j
+   *
+   * @param i Index of the first point
+   * @param j Index of the second point
+   *
+   * @returns The distance between points i and j
+   */
+  float operator()(const size_t i, const size_t j) const {
+    switch (storage) {
+      case Storage::full:
+        return values[n * j + i];
+      case Storage::condensed:
+        return DistanceMatrix::lookup(i, j, values);
+      case Storage::float16:
+        return fromFloat16(DistanceMatrix::lookup(i, j, packed.data()));
+      case Storage::bfloat16:
+        return fromBFloat16(DistanceMatrix::lookup(i, j, packed.data()));
+    }
+    return 0;
+  }
+
+  /**
+   * @brief Writes the distances between the given targets and a single
+   * reference point, resolving the storage once for the whole column.
+   *
+   * @param targets Indices of the targets
+   * @param reference Index of the reference point
+   * @param column Output of length targets.n_elem
+   */
+  void column(
+    const arma::uvec& targets,
+    const size_t reference,
+    float* column) const {
+    const size_t T = targets.n_elem;
+    switch (storage) {
+      case Storage::full: {
+        // Distances are symmetric, so the column of the reference point is
+        // read instead of its row
+        const float* distances = values + n * reference;
+        for (size_t t = 0; t < T; t++) {
+          column[t] = distances[targets(t)];
+        }
+        break;
+      }
+      case Storage::condensed:
+        for (size_t t = 0; t < T; t++) {
+          column[t] = DistanceMatrix::lookup(targets(t), reference, values);
+        }
+        break;
+      case Storage::float16:
+        for (size_t t = 0; t < T; t++) {
+          column[t] = fromFloat16(
+            DistanceMatrix::lookup(targets(t), reference, packed.data()));
+        }
+        break;
+      case Storage::bfloat16:
+        for (size_t t = 0; t < T; t++) {
+          column[t] = fromBFloat16(
+            DistanceMatrix::lookup(targets(t), reference, packed.data()));
+        }
+        break;
+    }
+  }
+
+  /**
+   * @brief Returns the number of bytes of distances owned by the matrix,
+   * i.e., 0 unless the distances were packed to 16 bits
+   *
+   * @returns The number of bytes of packed distances
+   */
+  size_t getPackedBytes() const {
+    return packed.size() * sizeof(uint16_t);
+  }
+
+  /**
+   * @brief Converts a float to the nearest float16, rounding ties to even.
+   * Values beyond the float16 range become infinite.
+   *
+   * @param value Value to convert
+   *
+   * @returns The bits of the float16
+   */
+  static uint16_t toFloat16(const float value);
+
+  /**
+   * @brief Converts a float to the nearest bfloat16, rounding ties to even
+   *
+   * @param value Value to convert
+   *
+   * @returns The bits of the bfloat16
+   */
+  static uint16_t toBFloat16(const float value);
+
+  /**
+   * @brief Converts a float16 to a float, exactly
+   *
+   * @param half Bits of the float16
+   *
+   * @returns The value of the float16
+   */
+  static float fromFloat16(const uint16_t half) {
+    const uint32_t sign = static_cast<uint32_t>(half & 0x8000) << 16;
+    const uint32_t exponent = (half >> 10) & 0x1F;
+    const uint32_t mantissa = half & 0x3FF;
+    uint32_t bits;
+    if (exponent == 0) {
+      // Zero or subnormal: mantissa * 2^-24
+      const float magnitude = static_cast<float>(mantissa) * 5.9604645e-8f;
+      std::memcpy(&bits, &magnitude, sizeof(bits));
+      bits |= sign;
+    } else if (exponent == 0x1F) {
+      bits = sign | 0x7F800000 | (mantissa << 13);
+    } else {
+      bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+    }
+    float value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+  }
+
+  /**
+   * @brief Converts a bfloat16 to a float, exactly
+   *
+   * @param half Bits of the bfloat16
+   *
+   * @returns The value of the bfloat16
+   */
+  static float fromBFloat16(const uint16_t half) {
+    const uint32_t bits = static_cast<uint32_t>(half) << 16;
+    float value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+  }
+
+ private:
+  /// Layout and precision of the distances
+  enum class Storage { full, condensed, float16, bfloat16 };
+
+  /**
+   * @brief Returns the position of the distance between points i < j in the
+   * condensed distances
+   */
+  size_t condensedIndex(const size_t i, const size_t j) const {
+    return i * (2 * n - i - 1) / 2 + (j - i - 1);
+  }
+
+  /**
+   * @brief Returns the condensed distance between points i and j, which is
+   * 0 when they are the same point
+   */
+  template <typename T>
+  T lookup(const size_t i, const size_t j, const T* distances) const {
+    if (i == j) {
+      return 0;
+    }
+    return distances[i < j ? condensedIndex(i, j) : condensedIndex(j, i)];
+  }
+
+  /// Layout and precision of the distances
+  Storage storage = Storage::full;
+
+  /// Number of points
+  size_t n = 0;
+
+  /// Viewed float32 distances, full or condensed; not owned
+  const float* values = nullptr;
+
+  /// Condensed distances packed to 16 bits
+  std::vector<uint16_t> packed;
+};
+}  // namespace km
+#endif  // HEADERS_ALGORITHMS_DISTANCE_MATRIX_HPP_
@@ -0,0 +1,76 @@
+#ifndef HEADERS_ALGORITHMS_FASTERPAM_HPP_
+#define HEADERS_ALGORITHMS_FASTERPAM_HPP_
+
+#include <armadillo>
+#include <omp.h>
+#include <iostream>
+#include <fstream>
+#include <vector>
+
+#include "fastpam1.hpp"
+
+
+namespace km {
+/**
+ * @brief Contains all necessary FasterPAM functions.
+ *
+ * FasterPAM (Schubert and Rousseeuw, 2021) starts from the FastPAM1 BUILD
+ * and then, instead of performing one swap per full pass over the
+ * candidates, applies every improving swap as soon as it is found. It
+ * usually converges in far fewer passes.
+ */
+class FasterPAM : public km::FastPAM1 {
+ public:
+  /**
+   * @brief Runs the FasterPAM algorithm to identify a dataset's medoids.
+   *
+   * @param data Data to cluster, with one datapoint per column
+   * @param initialMedoids Medoids to start SWAP from instead of running BUILD
+   */
+  void fitFasterPAM(
+    const arma::fmat& data,
+    std::optional<std::reference_wrapper<const arma::urowvec>> initialMedoids);
+
+  /**
+   * @brief Performs the eager SWAP step of FasterPAM.
+   *
+   * Visits the candidates cyclically and swaps each one in, in place of the
+   * medoid whose removal loses the least, as soon as that lowers the loss.
+   * Stops once a full cycle of candidates has passed without a swap, or
+   * after maxIter passes. Each pass is one SWAP step.
+   *
+   * The distances to a tile of upcoming candidates are computed in parallel;
+   * they stay valid across swaps, so only the cheap evaluation of each
+   * candidate is sequential.
+   *
+   * @param data Transposed input data to cluster
+   * @param medoidIndices Array of medoid indices created from the BUILD step
+   * that is modified in place as better medoids are identified
+   * @param assignments Array of containing the medoid each point is closest to
+   * @param loss Loss policy used to compute each distance
+   */
+  template <typename LossFunction>
+  void swapFasterPAM(
+    const arma::fmat& data,
+    arma::urowvec* medoidIndices,
+    arma::urowvec* assignments,
+    const LossFunction& loss);
+
+  /**
+   * @brief Computes the distances from every point to each of the given
+   * candidates, splitting the points across threads.
+   *
+   * @param data Transposed input data to cluster
+   * @param candidates Indices of the candidates
+   * @param loss Loss policy used to compute each distance
+   * @param distances Set to the N x candidates.n_elem matrix of distances
+   */
+  template <typename LossFunction>
+  void candidateTile(
+    const arma::fmat& data,
+    const arma::uvec& candidates,
+    const LossFunction& loss,
+    arma::fmat* distances);
+};
+}  // namespace km
+#endif  // HEADERS_ALGORITHMS_FASTERPAM_HPP_
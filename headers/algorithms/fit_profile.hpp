@@ -0,0 +1,98 @@
+#ifndef HEADERS_ALGORITHMS_FIT_PROFILE_HPP_
+#define HEADERS_ALGORITHMS_FIT_PROFILE_HPP_
+
+#include <chrono>
+#include <ctime>
+#include <string>
+#include <vector>
+
+namespace km {
+/**
+ * @brief Accumulated wall-clock and CPU time of one phase of a fit.
+ */
+struct PhaseTiming {
+  /// Wall-clock milliseconds spent in the phase
+  double wallMilliseconds = 0;
+
+  /// CPU milliseconds spent in the phase, summed over all threads
+  double cpuMilliseconds = 0;
+
+  /// Number of times the phase was entered
+  size_t calls = 0;
+};
+
+/**
+ * @brief Adds the wall-clock and CPU time between its construction and its
+ * destruction to the given PhaseTiming.
+ */
+class ScopedPhaseTimer {
+ public:
+  /**
+   * @brief Starts timing a phase
+   *
+   * @param timing The timing to add to when the timer goes out of scope
+   */
+  explicit ScopedPhaseTimer(PhaseTiming* timing);
+
+  ~ScopedPhaseTimer();
+
+  ScopedPhaseTimer(const ScopedPhaseTimer&) = delete;
+
+  ScopedPhaseTimer& operator=(const ScopedPhaseTimer&) = delete;
+
+ private:
+  /// The timing to add to
+  PhaseTiming* timing;
+
+  /// Wall-clock time at construction
+  std::chrono::steady_clock::time_point wallStart;
+
+  /// Process CPU time at construction
+  std::clock_t cpuStart;
+};
+
+/**
+ * @brief Timings of the phases of the last call to fit(), and the number of
+ * arms that survived each bandit round.
+ */
+struct FitProfile {
+  /// The BUILD step
+  PhaseTiming build;
+
+  /// The SWAP step, over all SWAP iterations
+  PhaseTiming swap;
+
+  /// Each SWAP iteration, in order
+  std::vector<PhaseTiming> swapSteps;
+
+  /// Estimation of the arms' standard deviations, in BUILD and SWAP
+  PhaseTiming sigma;
+
+  /// Sampled evaluation of the candidate arms, in BUILD and SWAP
+  PhaseTiming targets;
+
+  /// Exact evaluation of the arms that were sampled as often as there are
+  /// datapoints, in BUILD and SWAP
+  PhaseTiming exactTargets;
+
+  /// Number of candidate arms at the start of each BUILD bandit round
+  std::vector<size_t> buildArmsPerRound;
+
+  /// Number of candidate arms at the start of each SWAP bandit round
+  std::vector<size_t> swapArmsPerRound;
+
+  /**
+   * @brief Resets the profile before a new fit.
+   */
+  void clear();
+
+  /**
+   * @brief Returns the profile as a JSON object, with the same keys as the
+   * dictionary returned by the Python bindings.
+   *
+   * @returns The JSON representation of the profile
+   */
+  std::string toJson() const;
+};
+}  // namespace km
+#endif  // HEADERS_ALGORITHMS_FIT_PROFILE_HPP_
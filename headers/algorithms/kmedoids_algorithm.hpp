@@ -3,22 +3,114 @@
 
 #include <omp.h>
 #include <armadillo>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <limits>
 #include <optional>
 #include <vector>
 #include <fstream>
 #include <iostream>
 #include <tuple>
 #include <functional>
+#include <stdexcept>
 #include <unordered_map>
 #include <string>
 
+#include "communicator.hpp"
+#include "cuda_backend.hpp"
+#include "distance_cache.hpp"
+#include "distance_matrix.hpp"
+#include "fit_profile.hpp"
+#include "loss_functions.hpp"
+#include "quantized_matrix.hpp"
+#include "random_stream.hpp"
+#include "sparse_loss_functions.hpp"
+#include "tile_workspace.hpp"
+
 namespace km {
+/**
+ * @brief Distance computation and cache counters of a single thread. Each
+ * thread increments its own copy, which is padded to a full cache line so
+ * that counting does not cause false sharing between threads. The copies are
+ * merged into the totals reported by KMedoids once fit() finishes.
+ */
+struct alignas(64) ThreadCounters {
+  /// Distance computations per category: 0 for MISC, 1 for BUILD, 2 for SWAP
+  size_t distanceComputations[3] = {0, 0, 0};
+
+  /// Number of times this thread wrote to the cache
+  size_t cacheWrites = 0;
+
+  /// Number of cache hits on this thread
+  size_t cacheHits = 0;
+
+  /// Number of cache misses on this thread
+  size_t cacheMisses = 0;
+};
+
+/**
+ * @brief Result of fitting a single number of medoids during
+ * KMedoids::fitRange.
+ */
+struct FitResult {
+  /// Number of medoids
+  size_t k;
+
+  /// Medoids at the end of the BUILD step
+  arma::urowvec medoidsBuild;
+
+  /// Medoids after all SWAP steps have been run
+  arma::urowvec medoidsFinal;
+
+  /// Cluster assignment of each point
+  arma::urowvec labels;
+
+  /// Number of SWAP steps performed
+  size_t steps;
+
+  /// Average distance from each point to its nearest medoid
+  float loss;
+
+  /// Number of milliseconds taken by the SWAP step
+  double swapMilliseconds;
+};
+
+/**
+ * @brief Result of a single restart of KMedoids::fitRestarts.
+ */
+struct RestartResult {
+  /// Random seed of the restart
+  size_t seed;
+
+  /// Medoids after all SWAP steps have been run
+  arma::urowvec medoidsFinal;
+
+  /// Number of SWAP steps performed
+  size_t steps;
+
+  /// Average distance from each point to its nearest medoid
+  float loss;
+
+  /// Number of milliseconds taken by the SWAP step
+  double swapMilliseconds;
+
+  /// Number of distance computations, as in getDistanceComputations()
+  size_t distanceComputations;
+
+  /// Number of distances that were read from the cache
+  size_t cacheHits;
+};
+
 /**
  * @brief KMedoids class. Creates a KMedoids object that can be used to find the medoids
  * for a particular set of input data.
  *
  * @param nMedoids Number of medoids to use and clusters to create
- * @param algorithm Algorithm used to find medoids: "BanditPAM", "PAM", or "FastPAM1"
+ * @param algorithm Algorithm used to find medoids: "BanditPAM", "PAM",
+ * "FastPAM1", or "FasterPAM"
  * @param maxIter The maximum number of SWAP steps the algorithm runs
  * @param buildConfidence Parameter that affects the width of BUILD confidence intervals
  * @param swapConfidence Parameter that affects the width of SWAP confidence intervals
@@ -47,14 +139,305 @@ class KMedoids {
    *
    * @param inputData Input data to cluster
    * @param loss The loss function used during medoid computation
+   * @param initialMedoids Indices of nMedoids distinct points to start SWAP
+   * from, e.g., the medoids of a previous fit. BUILD is skipped and the
+   * build medoids are set to these indices. Not supported by BanditPAM_orig.
+   * @param weights Non-negative weight of each point, e.g., the number of
+   * times it occurs, in the loss and in the sampling of reference points.
+   * Points are weighted equally if none are given. Not supported by
+   * BanditPAM_orig.
    * 
-   * @throws if the input data is empty.
+   * @throws if the input data is empty, or the initial medoids or weights
+   * are invalid.
    */
   void fit(
     const arma::fmat& inputData,
     const std::string& loss,
+    std::optional<std::reference_wrapper<const arma::fmat>> distMat,
+    std::optional<std::reference_wrapper<const arma::urowvec>> initialMedoids =
+      std::nullopt,
+    std::optional<std::reference_wrapper<const arma::frowvec>> weights =
+      std::nullopt);
+
+  /**
+   * @brief Same as fit(), for data that is already stored with one datapoint
+   * per column, which is the layout used by the algorithms. The data is
+   * used in place and is not copied or kept after the call, so it may be a
+   * non-owning view of the caller's memory. If duplicates are collapsed,
+   * the fit runs on a copy of the distinct points.
+   *
+   * @param points Data to cluster, with one datapoint per column
+   * @param loss The loss function used during medoid computation
+   * @param initialMedoids Indices of the medoids to start SWAP from, as in
+   * fit()
+   * @param weights Weight of each point, as in fit()
+   *
+   * @throws if the input data is empty, or the initial medoids or weights
+   * are invalid.
+   */
+  void fitTransposed(
+    const arma::fmat& points,
+    const std::string& loss,
+    std::optional<std::reference_wrapper<const arma::fmat>> distMat,
+    std::optional<std::reference_wrapper<const arma::urowvec>> initialMedoids =
+      std::nullopt,
+    std::optional<std::reference_wrapper<const arma::frowvec>> weights =
+      std::nullopt);
+
+  /**
+   * @brief Same as fit(), for sparse data. Distances are computed from the
+   * non-zeros of each point, so the cost of a fit scales with the number of
+   * non-zeros rather than with the number of features. Only the L1, L2 and
+   * cosine losses are supported, and not by BanditPAM_orig.
+   *
+   * @param inputData Sparse input data to cluster, one point per row
+   * @param loss The loss function used during medoid computation
+   * @param initialMedoids Indices of the medoids to start SWAP from, as in
+   * fit()
+   * @param weights Weight of each point, as in fit()
+   *
+   * @throws if the input data is empty, the loss or algorithm are not
+   * supported for sparse data, or the initial medoids are invalid.
+   */
+  void fitSparse(
+    const arma::sp_fmat& inputData,
+    const std::string& loss,
+    std::optional<std::reference_wrapper<const arma::urowvec>> initialMedoids =
+      std::nullopt,
+    std::optional<std::reference_wrapper<const arma::frowvec>> weights =
+      std::nullopt);
+
+  /**
+   * @brief Same as fitSparse(), for sparse data stored with one datapoint
+   * per column. This is the compressed sparse column layout of SciPy's CSR
+   * matrices of one point per row, so those can be converted without a
+   * transpose.
+   *
+   * @param points Sparse data to cluster, with one datapoint per column
+   * @param loss The loss function used during medoid computation
+   * @param initialMedoids Indices of the medoids to start SWAP from, as in
+   * fit()
+   * @param weights Weight of each point, as in fit()
+   *
+   * @throws if the input data is empty, the loss or algorithm are not
+   * supported for sparse data, or the initial medoids are invalid.
+   */
+  void fitSparseTransposed(
+    const arma::sp_fmat& points,
+    const std::string& loss,
+    std::optional<std::reference_wrapper<const arma::urowvec>> initialMedoids =
+      std::nullopt,
+    std::optional<std::reference_wrapper<const arma::frowvec>> weights =
+      std::nullopt);
+
+  /**
+   * @brief Finds medoids for every number of medoids from kMin to kMax.
+   *
+   * For BanditPAM, BUILD is greedy, so the BUILD medoids for k are the first
+   * k medoids of a single BUILD run up to kMax. BUILD is therefore run once,
+   * and SWAP is run for each k, reusing the same distance cache and
+   * permutation. Other algorithms fit each k independently.
+   *
+   * Afterwards, the fitted state (medoids, labels, steps, loss) is that of
+   * kMax and nMedoids is set to kMax. For BanditPAM, the counters and the
+   * profile cover the whole range; otherwise they cover kMax only.
+   *
+   * @param inputData Input data to cluster
+   * @param loss The loss function used during medoid computation
+   * @param kMin Smallest number of medoids to fit
+   * @param kMax Largest number of medoids to fit
+   *
+   * @throws if the range is empty, kMin is 0, or kMax exceeds the number of
+   * points.
+   */
+  void fitRange(
+    const arma::fmat& inputData,
+    const std::string& loss,
+    const size_t kMin,
+    const size_t kMax,
+    std::optional<std::reference_wrapper<const arma::fmat>> distMat);
+
+  /**
+   * @brief Same as fitRange(), for data stored with one datapoint per
+   * column; see fitTransposed().
+   *
+   * @param points Data to cluster, with one datapoint per column
+   * @param loss The loss function used during medoid computation
+   * @param kMin Smallest number of medoids to fit
+   * @param kMax Largest number of medoids to fit
+   *
+   * @throws if the range is empty, kMin is 0, or kMax exceeds the number of
+   * points.
+   */
+  void fitRangeTransposed(
+    const arma::fmat& points,
+    const std::string& loss,
+    const size_t kMin,
+    const size_t kMax,
     std::optional<std::reference_wrapper<const arma::fmat>> distMat);
 
+  /**
+   * @brief Returns the result for each number of medoids of the last call to
+   * fitRange, in increasing order of k.
+   *
+   * @returns The result for each number of medoids
+   */
+  const std::vector<FitResult>& getRangeResults() const;
+
+  /**
+   * @brief Finds medoids for data that is too large to fit directly, in the
+   * manner of CLARA: the current algorithm is run on several random samples
+   * of the data, the medoids of each sample are scored against the full
+   * data in a single streamed pass, and the best medoids are kept. Each
+   * sample after the first contains the best medoids so far, so the loss
+   * never increases from one sample to the next.
+   *
+   * Only the samples are copied; the full data is only read in batches, so
+   * it can be a memory-mapped view larger than memory, e.g., a
+   * MappedMatrix. The labels and loss are those of the full data. The
+   * counters cover every fit; the profile and steps are those of the last
+   * fit.
+   *
+   * @param inputData Input data to cluster, one point per row
+   * @param loss The loss function used during medoid computation
+   * @param numSamples Number of samples to cluster
+   * @param sampleSize Number of points per sample, or 0 for 80 + 4k
+   * @param refineIter If nonzero, the best medoids are refined by at most
+   * this many SWAP steps on the full data, which then has to be transposed
+   * unless fitClaraTransposed is used
+   *
+   * @throws if numSamples is 0, or the data has fewer points than medoids.
+   */
+  void fitClara(
+    const arma::fmat& inputData,
+    const std::string& loss,
+    const size_t numSamples,
+    const size_t sampleSize = 0,
+    const size_t refineIter = 0);
+
+  /**
+   * @brief Same as fitClara(), for data stored with one datapoint per
+   * column; see fitTransposed().
+   *
+   * @param points Data to cluster, with one datapoint per column
+   * @param loss The loss function used during medoid computation
+   * @param numSamples Number of samples to cluster
+   * @param sampleSize Number of points per sample, or 0 for 80 + 4k
+   * @param refineIter If nonzero, the best medoids are refined by at most
+   * this many SWAP steps on the full data
+   *
+   * @throws if numSamples is 0, or the data has fewer points than medoids.
+   */
+  void fitClaraTransposed(
+    const arma::fmat& points,
+    const std::string& loss,
+    const size_t numSamples,
+    const size_t sampleSize = 0,
+    const size_t refineIter = 0);
+
+  /**
+   * @brief Fits the data once for each of the seeds seed, seed + 1, ...,
+   * seed + nRestarts - 1, and keeps the medoids with the lowest loss.
+   *
+   * The restarts run one after the other, each with all threads, on a
+   * single transposed copy of the data. They also share the distance cache:
+   * every restart caches the same points, in its own random order, so the
+   * cached distances do not depend on the seed, and each one is computed
+   * once for all restarts.
+   *
+   * The medoids, labels, loss, steps and profile are those of the best
+   * restart, the counters cover every restart, and getRestartResults()
+   * returns the results of each one. The seed is left unchanged.
+   *
+   * @param inputData Input data to cluster, one point per row
+   * @param loss The loss function used during medoid computation
+   * @param nRestarts Number of fits to run
+   *
+   * @throws if nRestarts is 0, or the input data is invalid.
+   */
+  void fitRestarts(
+    const arma::fmat& inputData,
+    const std::string& loss,
+    const size_t nRestarts,
+    std::optional<std::reference_wrapper<const arma::fmat>> distMat =
+      std::nullopt);
+
+  /**
+   * @brief Same as fitRestarts(), for data stored with one datapoint per
+   * column; see fitTransposed().
+   *
+   * @param points Data to cluster, with one datapoint per column
+   * @param loss The loss function used during medoid computation
+   * @param nRestarts Number of fits to run
+   *
+   * @throws if nRestarts is 0, or the input data is invalid.
+   */
+  void fitRestartsTransposed(
+    const arma::fmat& points,
+    const std::string& loss,
+    const size_t nRestarts,
+    std::optional<std::reference_wrapper<const arma::fmat>> distMat =
+      std::nullopt);
+
+  /**
+   * @brief Returns the result of each restart of the last call to
+   * fitRestarts(), in the order of their seeds.
+   *
+   * @returns The results of the last fitRestarts()
+   */
+  const std::vector<RestartResult>& getRestartResults() const;
+
+  /**
+   * @brief Assigns each point of new data to its nearest medoid of the last
+   * fit, using the loss function of that fit.
+   *
+   * @param newData New data with the same number of features (columns) as
+   * the fitted data, one point per row
+   *
+   * @returns The index of the nearest medoid of each point, as in getLabels()
+   *
+   * @throws if no model has been fit or the number of features differs.
+   */
+  arma::urowvec predict(const arma::fmat& newData);
+
+  /**
+   * @brief Assigns each point of new data to its nearest medoid of the last
+   * fit, like predict(), with one point per column, so that the batches are
+   * contiguous slices of the data
+   *
+   * @param points New data, one point per column
+   *
+   * @returns The index of the nearest medoid of each point
+   *
+   * @throws if no model has been fit or the number of features differs.
+   */
+  arma::urowvec predictTransposed(const arma::fmat& points);
+
+  /**
+   * @brief Computes the distance from each point of new data to each medoid
+   * of the last fit, using the loss function of that fit.
+   *
+   * @param newData New data with the same number of features (columns) as
+   * the fitted data, one point per row
+   *
+   * @returns The newData.n_rows x nMedoids matrix of distances
+   *
+   * @throws if no model has been fit or the number of features differs.
+   */
+  arma::fmat transform(const arma::fmat& newData);
+
+  /**
+   * @brief Computes the distance from each point of new data to each medoid
+   * of the last fit, like transform(), with one point per column
+   *
+   * @param points New data, one point per column
+   *
+   * @returns The points.n_cols x nMedoids matrix of distances
+   *
+   * @throws if no model has been fit or the number of features differs.
+   */
+  arma::fmat transformTransposed(const arma::fmat& points);
+
   /**
    * @brief Returns the medoids at the end of the BUILD step.
    * 
@@ -107,7 +490,8 @@ class KMedoids {
   /**
    * @brief Sets the algorithm being used for k-medoids clustering.
    *
-   * @param newAlgorithm The new algorithm to use: "BanditPAM", "PAM", or "FastPAM1"
+   * @param newAlgorithm The new algorithm to use: "BanditPAM", "PAM",
+   * "FastPAM1", or "FasterPAM"
    */
   void setAlgorithm(const std::string& newAlgorithm);
 
@@ -243,6 +627,172 @@ class KMedoids {
    */
   void setCacheWidth(size_t newCacheWidth);
 
+  /**
+   * @brief Returns the maximum number of bytes the distance cache may use
+   *
+   * @return The cache budget in bytes, or 0 if only the cache width applies
+   */
+  size_t getCacheBudget() const;
+
+  /**
+   * @brief Sets the maximum number of bytes the distance cache may use. The
+   * number of cached distances per point is reduced below the cache width
+   * when needed to stay within the budget.
+   *
+   * @param newCacheBudget The new cache budget in bytes, or 0 for no budget
+   */
+  void setCacheBudget(size_t newCacheBudget);
+
+  /**
+   * @brief Returns the file the distance cache of BanditPAM is kept in
+   *
+   * @return The path of the cache file, or "" if the cache is not persisted
+   */
+  std::string getCacheFile() const;
+
+  /**
+   * @brief Sets a file to keep the distance cache of BanditPAM in. The file
+   * is memory-mapped, and stores the cached points and a fingerprint of the
+   * data, the loss and the data precision. Later fits on the same data, from
+   * this or any other process, reattach it and reuse its distances instead
+   * of recomputing them; fits on other data, or with another cache width,
+   * replace it. Ignored with a distance matrix or sparse data.
+   *
+   * @param newCacheFile The path of the cache file, or "" to keep the cache
+   * in memory only
+   */
+  void setCacheFile(const std::string& newCacheFile);
+
+  /**
+   * @brief Returns how points are admitted as columns of the distance cache
+   *
+   * @return "permutation" or "survivors"
+   */
+  std::string getCacheAdmission() const;
+
+  /**
+   * @brief Sets how points are admitted as columns of the distance cache.
+   * With "permutation", the columns are the first points of the permutation
+   * the reference points are sampled from. With "survivors", only half of
+   * the columns are, and the others are admitted during the fit to the arms
+   * of BanditPAM that survive until they are evaluated exactly; since the
+   * distances are symmetric, such columns also serve the distances from
+   * those arms to every point, which later SWAP steps evaluate again. Cache
+   * files always use "permutation".
+   *
+   * @param newCacheAdmission "permutation" or "survivors"
+   *
+   * @throws if the admission policy is unknown.
+   */
+  void setCacheAdmission(const std::string& newCacheAdmission);
+
+  /**
+   * @brief Returns the precision in which a user-provided distance matrix
+   * is stored during fitting
+   *
+   * @return "float32", "float16" or "bfloat16"
+   */
+  std::string getDistMatPrecision() const;
+
+  /**
+   * @brief Sets the precision in which a user-provided distance matrix is
+   * stored during fitting. With float32, the matrix is used in place; with
+   * float16 or bfloat16, its condensed upper triangle is packed into 16 bits
+   * per distance, trading precision for a quarter of the memory of a full
+   * float32 matrix.
+   *
+   * @param newDistMatPrecision "float32", "float16" or "bfloat16"
+   *
+   * @throws if the precision is unknown.
+   */
+  void setDistMatPrecision(const std::string& newDistMatPrecision);
+
+  /**
+   * @brief Returns the precision in which the data is stored during fitting
+   *
+   * @return "float32", "float16", "bfloat16" or "int8"
+   */
+  std::string getDataPrecision() const;
+
+  /**
+   * @brief Sets the precision in which the data is stored during fitting.
+   * With float32, the data is used in place; otherwise, each fit first
+   * quantizes it, and computes every distance from the quantized points
+   * with float accumulation. This halves (float16, bfloat16) or quarters
+   * (int8, with a scale per feature) the memory traffic of each distance
+   * when the data does not fit in cache. The labels and loss of the final
+   * medoids are then recomputed from the float32 data. Ignored with a
+   * distance matrix or sparse data.
+   *
+   * @param newDataPrecision "float32", "float16", "bfloat16" or "int8"
+   *
+   * @throws if the precision is unknown.
+   */
+  void setDataPrecision(const std::string& newDataPrecision);
+
+  /**
+   * @brief Returns the time budget of each fit
+   *
+   * @return The time budget in milliseconds, or 0 if fits are unbounded
+   */
+  double getTimeBudget() const;
+
+  /**
+   * @brief Sets a time budget for each fit. It is checked between the
+   * bandit rounds of BanditPAM, and between the SWAP steps of every
+   * algorithm, or the candidate tiles of FasterPAM. Once the budget is
+   * spent, BanditPAM picks each remaining BUILD medoid after a single round
+   * and every algorithm stops swapping, keeping the medoids it had. BUILD of
+   * PAM, FastPAM1 and FasterPAM always completes. A fit can therefore run
+   * over its budget by about one round or step.
+   *
+   * @param newTimeBudget The time budget in milliseconds, or 0 for none
+   *
+   * @throws if the budget is negative.
+   */
+  void setTimeBudget(double newTimeBudget);
+
+  /**
+   * @brief Returns whether the last fit stopped because it ran out of time.
+   * Its medoids are then those it had reached, and its labels and loss are
+   * those of these medoids.
+   *
+   * @return Whether the last fit was truncated by the time budget
+   */
+  bool getTruncated() const;
+
+  /**
+   * @brief Sets a function to call after each BUILD medoid and each SWAP
+   * step, e.g., to report progress. It is called from the thread that called
+   * fit(), outside of parallel regions.
+   *
+   * @param newProgressCallback Called as callback(phase, step), where phase
+   * is "build" or "swap" and step counts from 1, or empty for none
+   */
+  void setProgressCallback(
+    std::function<void(const std::string&, size_t)> newProgressCallback);
+
+  /**
+   * @brief Returns whether fits are distributed over the MPI ranks
+   *
+   * @return Whether fits are distributed
+   */
+  bool getDistributed() const;
+
+  /**
+   * @brief Sets whether fits are distributed over the ranks of
+   * MPI_COMM_WORLD. Every rank must then call fit() with the same data and
+   * settings. BanditPAM splits the reference points of each bandit round
+   * across ranks and adds up the per-arm sums; the other algorithms run in
+   * full on every rank. This shards the compute only: every rank holds the
+   * whole dataset, which is not partitioned across ranks.
+   *
+   * @param newDistributed Whether to distribute fits
+   *
+   * @throws if BanditPAM was built without MPI support.
+   */
+  void setDistributed(bool newDistributed);
+
   /**
    * @brief Whether the algorithm is parallelized via OpenMP
    *
@@ -257,6 +807,89 @@ class KMedoids {
    */
   void setParallelize(bool newParallelize);
 
+  /**
+   * @brief Whether fit() collapses identical points into one weighted point
+   *
+   * @returns Whether duplicates are collapsed
+   */
+  bool getCollapseDuplicates() const;
+
+  /**
+   * @brief Sets whether fit() collapses identical points into one point,
+   * weighted by its number of copies, before BUILD. This shrinks the arms,
+   * the cache and the work of each step with the number of distinct points.
+   * The medoids and labels still index the input data; each medoid is the
+   * first copy of its point. Duplicates are not collapsed for distance
+   * matrices and sparse data.
+   *
+   * @param newCollapseDuplicates Whether to collapse duplicates
+   */
+  void setCollapseDuplicates(const bool newCollapseDuplicates);
+
+  /**
+   * @brief Returns the number of threads used by the fits of this object
+   *
+   * @returns The number of threads, or 0 for the OpenMP default
+   */
+  size_t getNumThreads() const;
+
+  /**
+   * @brief Sets the number of threads used by the fits of this object,
+   * independently of other KMedoids objects, so that concurrent fits can
+   * split the cores between them instead of oversubscribing them
+   *
+   * @param newNumThreads The number of threads, or 0 for the OpenMP default
+   */
+  void setNumThreads(const size_t newNumThreads);
+
+  /**
+   * @brief Returns how the bandit rounds of BanditPAM split their work
+   *
+   * @returns "static", "dynamic" or "adaptive"
+   */
+  std::string getSchedule() const;
+
+  /**
+   * @brief Sets how the bandit rounds of BanditPAM split their work across
+   * threads. With "static", each thread owns a block of targets. With
+   * "dynamic", a round with few target blocks also splits its reference
+   * points into chunks, and threads pick up (block, chunk) pairs as they
+   * finish, so the last few arms of BUILD and SWAP keep every thread busy.
+   * The blocks and chunks do not depend on the number of threads, so with
+   * either schedule the results are the same for any number of threads.
+   * "adaptive" also grows the batch of each round as the surviving arms
+   * shrink, so that a round has at least one batch of reference points per
+   * thread; it takes fewer, larger rounds at the cost of sampling some arms
+   * a little past the point where they are decided, and its results depend
+   * on the number of threads.
+   *
+   * @param newSchedule "static", "dynamic" or "adaptive"
+   *
+   * @throws if the schedule is unknown.
+   */
+  void setSchedule(const std::string& newSchedule);
+
+  /**
+   * @brief Returns the backend on which fits compute their distances
+   *
+   * @returns "cpu" or "cuda"
+   */
+  std::string getBackend() const;
+
+  /**
+   * @brief Sets the backend on which fits compute their distances. With
+   * "cuda", the data stays on the GPU for the whole fit, and the bandit
+   * rounds of BanditPAM and the assignment of the points to their medoids
+   * run there; only the per-arm sums are copied back. Distance matrices,
+   * sparse data and quantized data always use the CPU.
+   *
+   * @param newBackend "cpu" or "cuda"
+   *
+   * @throws if the backend is unknown, or if "cuda" is requested from a
+   * build without CUDA support or a machine without a GPU.
+   */
+  void setBackend(const std::string& newBackend);
+
   /**
    * @brief Get total sample complexity of .fit() call
    *
@@ -320,8 +953,18 @@ class KMedoids {
    */
   float getTimePerSwap() const;
 
-  /// The cache which stores pairwise distance computations
-  float* cache;
+  /**
+   * @brief Get the timings of the phases of the last fit, and the number of
+   * arms that survived each bandit round
+   *
+   * @return The profile of the last fit
+   */
+  const FitProfile& getProfile() const;
+
+  /// The cache which stores pairwise distance computations. Empty slots hold
+  /// NaN; slots are read and written with relaxed atomics so that threads
+  /// can share the cache without locks or torn values.
+  DistanceCache cache;
 
   /// The permutation in which to sample the reference points
   arma::uvec permutation;
@@ -329,12 +972,84 @@ class KMedoids {
   /// The index of our current position in the permutated points
   size_t permutationIdx;
 
-  /// A map from permutation index of each point to its original index
-  std::unordered_map<size_t, size_t> reindex;
+  /// Draws the reference points of BanditPAM when the permutation is not
+  /// used; restarted from the seed by every fit, so that fits with the same
+  /// seed match
+  RandomStream referenceStream;
+
+  /// The position of each point among the cached columns, i.e., its index
+  /// in the permutation, or -1 if distances to the point are not cached
+  std::vector<int32_t> reindex;
+
+  /// The point of each cached column, as set by the last initializeCache()
+  arma::uvec cachedPoints;
+
+  /// The distance between each pair of the current medoids, if the loss is a
+  /// metric; empty otherwise
+  arma::fmat medoidTable;
+
+  /// The distance from each point to each current medoid, if
+  /// useMedoidDistances, with one column per medoid; NaN where not computed
+  /// yet. Only the column of a swapped medoid is emptied. It takes N x K
+  /// floats, which count against cacheWidth and cacheBudget.
+  arma::fmat medoidDistances;
+
+  /// The medoid of each column of medoidDistances
+  arma::urowvec medoidDistancePoints;
+
+  /// Whether the current fit keeps the distances to the medoids in
+  /// medoidDistances
+  bool useMedoidDistances = false;
+
+  /// How points are admitted as columns of the cache
+  std::string cacheAdmission = "permutation";
+
+  /// Whether initializeCache() left columns of the cache free for the arms
+  /// that survive until they are evaluated exactly
+  bool admitSurvivors = false;
+
+  /// Weight of each point of the current fit, scaled to a mean of 1 so that
+  /// weighted sums over the points are on the scale of unweighted ones;
+  /// all ones unless the fit was given weights
+  arma::frowvec weights;
+
+  /// Whether fit() collapses identical points into one weighted point
+  bool collapseDuplicates = false;
+
+  /// Whether initializeCache() keeps the cached distances of the previous
+  /// fit, which must be on the same data with the same cache width
+  bool reuseCache = false;
+
+  /// The file the cache is kept in, or "" to keep it in memory only
+  std::string cacheFile;
+
+  /// Whether initializeCache() attaches the cache to cacheFile in this fit
+  bool persistCache = false;
+
+  /// Identifies the data, loss and precision of the current fit, if
+  /// persistCache
+  uint64_t dataFingerprint = 0;
 
   /// Determines whether we use a user-provided distance matrix
   bool useDistMat = false;
 
+  /// Unchecked access to the user-provided distance matrix of the current
+  /// fit, if any
+  DistanceMatrix distances;
+
+  /// The sparse data of the current fit, if any. The dense data passed to
+  /// the algorithms then only has the number of points as its number of
+  /// columns, and the loss policies read the points from here instead.
+  const arma::sp_fmat* sparsePoints = nullptr;
+
+  /// The quantized data of the current fit, if the data precision is not
+  /// float32
+  QuantizedMatrix quantized;
+
+  /// Points to quantized while a fit uses it. The loss policies then read
+  /// the points from there instead of from the dense data.
+  const QuantizedMatrix* quantizedPoints = nullptr;
+
 
  protected:
   /**
@@ -351,13 +1066,129 @@ class KMedoids {
    */
   void calcBestDistancesSwap(
     const arma::fmat& data,
-    std::optional<std::reference_wrapper<const arma::fmat>> distMat,
     const arma::urowvec* medoidIndices,
     arma::frowvec* bestDistances,
     arma::frowvec* secondBestDistances,
     arma::urowvec* assignments,
     const bool swapPerformed = true);
 
+  /**
+   * @brief Updates the best and second best distances of each datapoint
+   * after a single medoid was swapped out. Points whose best and second best
+   * medoids are both still in place only need their distance to the new
+   * medoid; only the points that were assigned to the swapped out medoid,
+   * or had it as their second best medoid, are compared against all medoids
+   * again.
+   *
+   * @param data Transposed data to cluster
+   * @param medoidIndices Array of medoid indices, already containing the new
+   * medoid at index swappedMedoid
+   * @param swappedMedoid Index into medoidIndices of the medoid that changed
+   * @param bestDistances Array of best distances from each point to the
+   * medoids, as computed for the previous set of medoids
+   * @param secondBestDistances Array of second smallest distances from each
+   * point to the medoids, as computed for the previous set of medoids
+   * @param assignments Assignments of datapoints to their closest medoid
+   * @param swapPerformed Whether a swap was performed. If not, nothing has
+   * changed and only the final loss is updated.
+   */
+  void updateBestDistancesSwap(
+    const arma::fmat& data,
+    const arma::urowvec* medoidIndices,
+    const size_t swappedMedoid,
+    arma::frowvec* bestDistances,
+    arma::frowvec* secondBestDistances,
+    arma::urowvec* assignments,
+    const bool swapPerformed = true);
+
+  /**
+   * @brief Empties the columns of medoidDistances whose medoid is no longer
+   * the medoid at the same position, or all of it if the number of points
+   * or medoids changed. The table is dropped for the rest of the fit if it
+   * has more columns than cacheWidth, or if it does not fit in cacheBudget
+   * next to the cache.
+   *
+   * @param data Transposed data to cluster
+   * @param medoidIndices Indices of the medoids in the data
+   */
+  void syncMedoidDistances(
+    const arma::fmat& data,
+    const arma::urowvec* medoidIndices);
+
+  /**
+   * @brief Returns the distance between datapoint i and the k-th medoid,
+   * from medoidDistances if it holds it. Concurrent calls must have
+   * different i.
+   *
+   * @param data Transposed data to cluster
+   * @param medoidIndices Indices of the medoids in the data
+   * @param i Index of the datapoint
+   * @param k Position of the medoid in medoidIndices
+   * @param loss Loss policy used to compute distances
+   *
+   * @returns The distance between the datapoint and the medoid
+   */
+  template <typename LossFunction>
+  float medoidLoss(
+    const arma::fmat& data,
+    const arma::urowvec* medoidIndices,
+    const size_t i,
+    const size_t k,
+    const LossFunction& loss);
+
+  /**
+   * @brief Admits the given points as columns of the cache, while columns
+   * are free, if the cache admits survivors. Must not be called concurrently
+   * with reads of the cache.
+   *
+   * @param points Points whose arms survived until exact evaluation
+   */
+  void admitCacheColumns(const arma::uvec& points);
+
+  /**
+   * @brief Computes the distances between every pair of the current medoids
+   * into medoidTable, if the loss is a metric, so that scanMedoids() and
+   * updateBestDistancesSwap() can skip medoids by the triangle inequality.
+   * Otherwise, medoidTable is emptied.
+   *
+   * @param data Transposed data to cluster
+   * @param medoidIndices Indices of the medoids in the data
+   * @param loss Loss policy used to compute distances
+   */
+  template <typename LossFunction>
+  void computeMedoidTable(
+    const arma::fmat& data,
+    const arma::urowvec* medoidIndices,
+    const LossFunction& loss);
+
+  /**
+   * @brief Computes the best and second best distances of datapoint i to the
+   * current medoids, and the indices of those medoids.
+   *
+   * If medoidTable is set, the distance to the medoid a the point was
+   * assigned to is computed first, and every other medoid k with
+   * |d(a, k) - d(i, a)| above the second smallest distance found so far is
+   * skipped, since it cannot be among the two closest. The result is the
+   * same as that of a full scan.
+   *
+   * @param data Transposed data to cluster
+   * @param medoidIndices Array of medoid indices corresponding to dataset entries
+   * @param i Index of the datapoint
+   * @param loss Loss policy used to compute distances
+   * @param bestDistances Array of best distances, updated at i
+   * @param secondBestDistances Array of second best distances, updated at i
+   * @param assignments Assignments to the closest medoid, updated at i
+   */
+  template <typename LossFunction>
+  void scanMedoids(
+    const arma::fmat& data,
+    const arma::urowvec* medoidIndices,
+    const size_t i,
+    const LossFunction& loss,
+    arma::frowvec* bestDistances,
+    arma::frowvec* secondBestDistances,
+    arma::urowvec* assignments);
+
   /**
    * @brief Calculate the average loss for the given choice of medoids. 
    * 
@@ -369,7 +1200,6 @@ class KMedoids {
    */
   float calcLoss(
     const arma::fmat& data,
-    std::optional<std::reference_wrapper<const arma::fmat>> distMat,
     const arma::urowvec* medoidIndices);
 
   /**
@@ -387,12 +1217,385 @@ class KMedoids {
    */
   float cachedLoss(
     const arma::fmat& data,
-    std::optional<std::reference_wrapper<const arma::fmat>> distMat,
     const size_t i,
     const size_t j,
     const size_t category,
     const bool useCacheFunctionOverride = true);
 
+  /**
+   * @brief A wrapper around the given loss policy that caches distances
+   * between the given points. Unlike the untemplated overload, the loss
+   * computation is resolved at compile time and can be inlined into the
+   * calling loop.
+   *
+   * @param data Transposed data to cluster
+   * @param i Index of first datapoint
+   * @param j Index of second datapoint
+   * @param category 0 for MISC, 1 for BUILD, 2 for SWAP
+   * @param loss Loss policy used to compute the distance, e.g. L2Loss
+   *
+   * @returns The distance between points i and j
+   */
+  template <typename LossFunction>
+  float cachedLoss(
+    const arma::fmat& data,
+    const size_t i,
+    const size_t j,
+    const size_t category,
+    const LossFunction& loss);
+
+  /**
+   * @brief Computes the distances between every target and every reference
+   * point as a single targets-by-referencePoints tile. Distances to cached
+   * reference points, and from admitted arms, are read from (and written
+   * to) the cache; all other distances are evaluated together with the loss
+   * policy's batched tile(), e.g., a single matrix product for L2 and cosine
+   * losses.
+   *
+   * @param data Transposed data to cluster
+   * @param targets Indices of the points along the rows of the tile
+   * @param referencePoints Indices of the points along the columns of the tile
+   * @param category 0 for MISC, 1 for BUILD, 2 for SWAP
+   * @param loss Loss policy used to compute the distances, e.g. L2Loss
+   * @param tile Output tile of size targets.n_elem x referencePoints.n_elem
+   */
+  template <typename LossFunction>
+  void cachedLossTile(
+    const arma::fmat& data,
+    const arma::uvec& targets,
+    const arma::uvec& referencePoints,
+    const size_t category,
+    const LossFunction& loss,
+    arma::fmat* tile);
+
+  /**
+   * @brief Validates the input of a fit and resets the state shared by all
+   * algorithms: random generator, counters, profile, loss function, norms,
+   * weights and cache positions.
+   *
+   * @param points Data to cluster, with one datapoint per column
+   * @param loss The loss function used during medoid computation
+   * @param pointWeights Weight of each point, or none for equal weights
+   *
+   * @throws if the input data is empty, the distance matrix is malformed, or
+   * the weights are invalid.
+   */
+  void prepareFit(
+    const arma::fmat& points,
+    const std::string& loss,
+    std::optional<std::reference_wrapper<const arma::fmat>> distMat,
+    std::optional<std::reference_wrapper<const arma::frowvec>> pointWeights =
+      std::nullopt);
+
+  /**
+   * @brief Fits the given points with the current algorithm; fitTransposed()
+   * once duplicates have been collapsed, if they are
+   *
+   * @param points Data to cluster, with one datapoint per column
+   * @param loss The loss function used during medoid computation
+   * @param distMat Optional distance matrix of the points
+   * @param initialMedoids Indices of the medoids to start SWAP from
+   * @param pointWeights Weight of each point, if any
+   */
+  void fitPoints(
+    const arma::fmat& points,
+    const std::string& loss,
+    std::optional<std::reference_wrapper<const arma::fmat>> distMat,
+    std::optional<std::reference_wrapper<const arma::urowvec>> initialMedoids,
+    std::optional<std::reference_wrapper<const arma::frowvec>> pointWeights);
+
+  /**
+   * @brief Fits the distinct points of the data, each weighted by its number
+   * of copies (times its weight, if given), and maps the medoids and labels
+   * back to the data
+   *
+   * @param points Data to cluster, with one datapoint per column
+   * @param loss The loss function used during medoid computation
+   * @param initialMedoids Indices of the medoids to start SWAP from
+   * @param pointWeights Weight of each point, if any
+   */
+  void fitCollapsed(
+    const arma::fmat& points,
+    const std::string& loss,
+    std::optional<std::reference_wrapper<const arma::urowvec>> initialMedoids,
+    std::optional<std::reference_wrapper<const arma::frowvec>> pointWeights);
+
+  /**
+   * @brief Returns the average of the given distances of all points,
+   * weighted by the weights of the current fit
+   *
+   * @param bestDistances Distance from each point to its closest medoid
+   *
+   * @returns The weighted average distance
+   */
+  float weightedMean(const arma::frowvec& bestDistances) const;
+
+  /**
+   * @brief Adds the distance computation and cache counters, and the SWAP
+   * time, of the last fit to the given totals, for the methods that run
+   * several fits, each of which resets them.
+   *
+   * @param totals Running totals, in the order misc, BUILD and SWAP
+   * distance computations, cache writes, hits and misses, SWAP time
+   */
+  void addCountersTo(std::array<size_t, 7>* totals) const;
+
+  /**
+   * @brief Replaces the counters and the SWAP time with the given totals
+   *
+   * @param totals Totals in the order of addCountersTo()
+   */
+  void setCounters(const std::array<size_t, 7>& totals);
+
+  /**
+   * @brief Ends the use of the quantized data, if any. If the fit used it or
+   * ran out of time, recomputes the labels and the loss of the final medoids
+   * from the float32 data, so they carry no quantization error and match
+   * the medoids the fit stopped at.
+   *
+   * @param points Data to cluster, with one datapoint per column
+   */
+  void finishFit(
+    const arma::fmat& points);
+
+  /**
+   * @brief Releases the state that only lasts for one fit: the distance
+   * matrix, the CUDA buffers, the quantized data and the medoid-distance
+   * table. Called when a fit returns, or throws.
+   */
+  void releaseFitState();
+
+  /**
+   * @brief Returns whether the time budget of the current fit is spent. Once
+   * it is, the fit is marked as truncated and this keeps returning true.
+   * In a distributed fit, the budget is spent once it is on any rank, so
+   * that every rank leaves its loops at the same round; every rank must
+   * then call this at the same points.
+   *
+   * @returns Whether the fit should stop
+   */
+  bool budgetExhausted();
+
+  /**
+   * @brief Calls the progress callback, if any
+   *
+   * @param phase "build" or "swap"
+   * @param step Number of medoids found by BUILD, or of SWAP steps
+   */
+  void reportProgress(const std::string& phase, const size_t step);
+
+  /**
+   * @brief Returns the number of threads of each parallel region of a fit
+   *
+   * @returns 1 if the fit is not parallelized, and otherwise numThreads or
+   * the OpenMP default
+   */
+  int threadCount() const;
+
+  /**
+   * @brief Returns the number of per-thread buffers a parallel region may
+   * index, which covers both threadCount() and the OpenMP default
+   *
+   * @returns The number of per-thread buffers
+   */
+  size_t threadSlots() const;
+
+  /**
+   * @brief Grows the per-thread counters and tile workspaces to
+   * threadSlots(), if needed, keeping their contents. Must be called before
+   * any parallel region that uses localCounters() or localTileWorkspace().
+   */
+  void reserveThreadBuffers();
+
+  /**
+   * @brief Checks that the initial medoids of a warm-started fit are nMedoids
+   * distinct indices into the data.
+   *
+   * @param initialMedoids Indices of the initial medoids
+   * @param n Number of points in the data
+   *
+   * @throws if the initial medoids are invalid.
+   */
+  void checkInitialMedoids(
+    const arma::urowvec& initialMedoids,
+    const size_t n) const;
+
+  /**
+   * @brief Prepares the distance cache for the current data: resizes (or
+   * reuses) the cache and records the position of the first cached points
+   * of the permutation. Every point is left uncached if the cache is off.
+   *
+   * @param n Number of points in the data
+   */
+  void initializeCache(const size_t n);
+
+  /**
+   * @brief Prepares the distance cache for PAM and FastPAM1, which evaluate
+   * every point as a candidate medoid, so the columns of the first points
+   * are cached instead of those of a random permutation. The cache is not
+   * used with a distance matrix.
+   *
+   * @param n Number of points in the data
+   */
+  void initializeCandidateCache(const size_t n);
+
+  /**
+   * @brief Returns the counters of the calling thread
+   *
+   * @returns The counters of the calling OpenMP thread
+   */
+  ThreadCounters& localCounters() {
+    return threadCounters[omp_get_thread_num()];
+  }
+
+  /**
+   * @brief Returns the cache slot that holds the distance between points i
+   * and j: in the column of j if j is cached, otherwise, when survivors are
+   * admitted, in the column of i if i is
+   *
+   * @param i Index of first datapoint
+   * @param j Index of second datapoint
+   *
+   * @returns The slot, or nullptr if neither column is cached
+   */
+  std::atomic<float>* cacheSlot(const size_t i, const size_t j) {
+    if (reindex[j] >= 0) {
+      return &cache.at(i, reindex[j]);
+    }
+    if (admitSurvivors && reindex[i] >= 0) {
+      // Distances are symmetric, so the column of an admitted arm also holds
+      // the distances from it
+      return &cache.at(j, reindex[i]);
+    }
+    return nullptr;
+  }
+
+  /**
+   * @brief Returns the tile scratch buffers of the calling thread
+   *
+   * @returns The scratch buffers of the calling OpenMP thread
+   */
+  TileWorkspace& localTileWorkspace() {
+    return tileWorkspaces[omp_get_thread_num()];
+  }
+
+  /**
+   * @brief Clears the distance computation and cache counters, and allocates
+   * one set of per-thread counters for each of the threadSlots().
+   */
+  void resetCounters();
+
+  /**
+   * @brief Adds the per-thread counters into the totals returned by the
+   * getters, and clears the per-thread counters.
+   */
+  void mergeCounters();
+
+  /**
+   * @brief Returns the number of targets per distance tile, so that the
+   * targets are split into about tileBlocks tiles of minTileTargets to
+   * maxTileTargets rows. The tiles do not depend on the number of threads,
+   * so neither do the distances computed with them.
+   *
+   * @param numTargets Total number of targets to evaluate
+   *
+   * @returns The number of targets per tile
+   */
+  size_t numTileTargets(const size_t numTargets) const;
+
+  /**
+   * @brief Calls the given function once with the loss policy that
+   * corresponds to the current loss function, e.g. L2Loss when the loss
+   * is "L2". This lets callers resolve the loss once per call into the
+   * algorithm instead of once per distance computation.
+   *
+   * @param function Generic callable accepting a loss policy
+   *
+   * @throws If the loss function is undefined
+   */
+  template <typename Function>
+  void dispatchLossFn(Function&& function) const;
+
+  /**
+   * @brief Same as dispatchLossFn(function), but with the cosine and L2
+   * policies reading the given per-column norms of another matrix instead of
+   * those of the fitted data.
+   *
+   * @param columnNorms L2 norm of each column, used by the cosine loss
+   * @param columnSquaredNorms Squared L2 norm of each column, used by L2
+   * @param function Generic callable accepting a loss policy
+   *
+   * @throws If the loss function is undefined
+   */
+  template <typename Function>
+  void dispatchLossFn(
+    const float* columnNorms,
+    const float* columnSquaredNorms,
+    Function&& function) const;
+
+  /**
+   * @brief Computes the distances from new data to the medoids of the last
+   * fit in batches of points. Each thread packs the medoids and a batch of
+   * points into a single column-major matrix, so the tiled, vectorized loss
+   * kernels apply unchanged.
+   *
+   * @param newData New data, one point per row, or one point per column if
+   * transposed is set
+   * @param transposed Whether newData has one point per column
+   * @param onBatch Called as onBatch(start, tile) by the thread of each
+   * batch, where tile(b, k) is the distance between point start + b and
+   * medoid k
+   *
+   * @throws if no model has been fit or the number of features differs.
+   */
+  template <typename Function>
+  void medoidDistanceBatches(
+    const arma::fmat& newData,
+    const bool transposed,
+    Function&& onBatch);
+
+  /**
+   * @brief Implements fitClara() and fitClaraTransposed().
+   *
+   * @param data Data to cluster, one point per row, or one point per column
+   * if transposed is set
+   * @param transposed Whether data has one point per column
+   * @param loss The loss function used during medoid computation
+   * @param numSamples Number of samples to cluster
+   * @param sampleSize Number of points per sample, or 0 for 80 + 4k
+   * @param refineIter Maximum number of SWAP steps on the full data
+   */
+  void fitClaraImpl(
+    const arma::fmat& data,
+    const bool transposed,
+    const std::string& loss,
+    const size_t numSamples,
+    size_t sampleSize,
+    const size_t refineIter);
+
+  /**
+   * @brief Computes the distance from every point to every candidate medoid,
+   * i.e., every point, which is the access pattern of the exhaustive BUILD
+   * and SWAP steps of PAM and FastPAM1. Candidates are split into tiles of
+   * consecutive points that are spread across threads, and distances go
+   * through the distance matrix, the cache and the tiled loss kernels as in
+   * BanditPAM.
+   *
+   * @param data Transposed data to cluster
+   * @param category Category of the distance computations: 1 for BUILD, 2
+   * for SWAP
+   * @param loss Loss policy used to compute each distance
+   * @param onCandidate Called as onCandidate(i, distances) by the thread of
+   * candidate i, where distances[j] is the distance between point j and the
+   * candidate
+   */
+  template <typename LossFunction, typename Function>
+  void candidateDistances(
+    const arma::fmat& data,
+    const size_t category,
+    const LossFunction& loss,
+    Function&& onCandidate);
+
   /// If using an L_p loss, the value of p
   size_t lp;
 
@@ -453,9 +1656,31 @@ class KMedoids {
     const size_t i,
     const size_t j) const;
 
+  /**
+   * @brief Returns a fingerprint of the given points together with the loss
+   * and the data precision, which determine the cached distances
+   *
+   * @param points Data of the fit, with one datapoint per column
+   *
+   * @returns The 64-bit fingerprint
+   */
+  uint64_t cacheFingerprint(const arma::fmat& points) const;
+
+  /**
+   * @brief Precomputes the per-point norms used by the cosine and L2
+   * losses, so they are not recomputed for every pair of points. Norms
+   * that the current loss function does not use are cleared. The norms of
+   * sparse or quantized data are computed from sparsePoints or
+   * quantizedPoints instead.
+   *
+   * @param points Data to cluster, with one datapoint per column
+   */
+  void computeNorms(const arma::fmat& points);
+
   /**
    * @brief Checks whether algorithm choice is valid. The given 
-   * algorithm must be either "BanditPAM", "PAM", or "FastPAM1". 
+   * algorithm must be either "BanditPAM", "PAM", "FastPAM1", or
+   * "FasterPAM".
    *
    * @param algorithm Name of the k-medoids algorithm to use
    * 
@@ -472,12 +1697,23 @@ class KMedoids {
   /// Maximum number of SWAP steps to perform
   size_t maxIter;
 
-  /// Data to be clustered
-  arma::fmat data;
+  /// Coordinates of the final medoids of the last fit, one per column. The
+  /// data itself is not kept after fitting.
+  arma::fmat medoidPoints;
+
+  /// The L2 norm of each datapoint, precomputed in fit() for cosine loss
+  arma::frowvec norms;
+
+  /// The squared L2 norm of each datapoint, precomputed in fit() for L2 loss
+  arma::frowvec squaredNorms;
 
   /// Cluster assignments of each point
   arma::urowvec labels;
 
+  /// Index into the medoids of each point's second closest medoid, kept up to
+  /// date by calcBestDistancesSwap and updateBestDistancesSwap
+  arma::urowvec secondAssignments;
+
   /// Indices of the medoids after BUILD step
   arma::urowvec medoidIndicesBuild;
 
@@ -509,9 +1745,48 @@ class KMedoids {
   /// The cache will be of size cacheWidth*n
   size_t cacheWidth = 1000;
 
+  /// If nonzero, the maximum number of bytes used by the cache
+  size_t cacheBudget = 0;
+
+  /// Precision in which a user-provided distance matrix is stored
+  std::string distMatPrecision = "float32";
+
+  /// Precision in which the data is stored during fitting
+  std::string dataPrecision = "float32";
+
+  /// Time budget of each fit in milliseconds, or 0 for none
+  double timeBudget = 0;
+
+  /// Time at which the current fit runs out of its budget
+  std::chrono::steady_clock::time_point deadline;
+
+  /// Whether the last fit ran out of its time budget
+  bool truncated = false;
+
+  /// Called after each BUILD medoid and SWAP step, if set
+  std::function<void(const std::string&, size_t)> progressCallback;
+
+  /// The ranks that share each fit; a single rank unless distributed
+  Communicator communicator;
+
   /// Determines whether we parallelize the algorithm with OpenMP
   bool parallelize = true;
 
+  /// Number of threads of each parallel region, or 0 for the OpenMP default
+  size_t numThreads = 0;
+
+  /// How the bandit rounds of BanditPAM split their work across threads
+  std::string schedule = "dynamic";
+
+  /// Backend on which fits compute their distances
+  std::string backend = "cpu";
+
+  /// The device copy of the data of the current fit, if it uses CUDA
+  CudaBackend cuda;
+
+  /// Whether the current fit computes its distances with cuda
+  bool useCuda = false;
+
   /// The random seed with which to perform the clustering
   size_t seed = 0;
 
@@ -548,8 +1823,411 @@ class KMedoids {
   /// need to compute. For debugging only.
   size_t numCacheMisses = 0;
 
-  /// The number of milliseconds taken per swap step, on average
+  /// Per-thread counters, indexed by OpenMP thread number
+  std::vector<ThreadCounters> threadCounters;
+
+  /// Per-thread tile scratch buffers, indexed by OpenMP thread number and
+  /// kept across fits
+  std::vector<TileWorkspace> tileWorkspaces;
+
+  /// The number of milliseconds taken by the whole SWAP step
   size_t totalSwapTime = 0;
+
+  /// Timings and bandit statistics of the last fit
+  FitProfile profile;
+
+  /// Result for each number of medoids of the last call to fitRange
+  std::vector<FitResult> rangeResults;
+
+  /// Result of each restart of the last call to fitRestarts
+  std::vector<RestartResult> restartResults;
+
+  /// Maximum number of targets per distance tile in BanditPAM
+  const size_t maxTileTargets = 256;
+
+  /// Minimum number of targets per distance tile in BanditPAM
+  const size_t minTileTargets = 16;
+
+  /// Number of tiles the targets of a round are split into, within the
+  /// bounds on their rows, to give the threads work to share
+  const size_t tileBlocks = 64;
+
+  /// Maximum number of reference points per distance tile in BanditPAM
+  const size_t maxTileReferences = 1024;
+
+  /// Number of candidate medoids per distance tile in PAM, FastPAM1 and
+  /// FasterPAM
+  const size_t candidatesPerTile = 32;
 };
+
+template <typename LossFunction>
+float KMedoids::cachedLoss(
+  const arma::fmat& data,
+  const size_t i,
+  const size_t j,
+  const size_t category,
+  const LossFunction& loss) {
+  ThreadCounters& counters = KMedoids::localCounters();
+  // TODO(@motiwari): Change category to an enum
+  counters.distanceComputations[category]++;
+
+  if (this->useDistMat) {
+    return distances(i, j);
+  }
+
+  if (!useCache) {
+    return loss(data, i, j);
+  }
+
+  // test this is one of the early points in the permutation
+  std::atomic<float>* slot = KMedoids::cacheSlot(i, j);
+  if (slot) {
+    // A slot only ever goes from NaN to the distance between i and j, so
+    // threads racing to fill it store the same value and readers see either
+    // NaN or the complete distance
+    float distance = slot->load(std::memory_order_relaxed);
+    if (std::isnan(distance)) {
+      counters.cacheWrites++;
+      distance = loss(data, i, j);
+      slot->store(distance, std::memory_order_relaxed);
+    }
+    counters.cacheHits++;
+    return distance;
+  }
+
+  counters.cacheMisses++;
+  return loss(data, i, j);
+}
+
+template <typename LossFunction>
+void KMedoids::cachedLossTile(
+  const arma::fmat& data,
+  const arma::uvec& targets,
+  const arma::uvec& referencePoints,
+  const size_t category,
+  const LossFunction& loss,
+  arma::fmat* tile) {
+  const size_t T = targets.n_elem;
+  const size_t R = referencePoints.n_elem;
+  tile->set_size(T, R);
+
+  // The tile is read column by column, i.e., grouped by reference point
+  if (this->useDistMat) {
+    KMedoids::localCounters().distanceComputations[category] += T * R;
+    for (size_t r = 0; r < R; r++) {
+      distances.column(targets, referencePoints(r), tile->colptr(r));
+    }
+    return;
+  }
+
+  // Admitted arms have their rows cached as well as the columns of the
+  // cached reference points. The cells in neither are evaluated as a single
+  // tile; every other cell is served from, or filled into, its slot one
+  // distance at a time, so that each distance is computed and counted once
+  // and a cached value does not depend on the tile it was first seen in
+  if (admitSurvivors) {
+    TileWorkspace& workspace = KMedoids::localTileWorkspace();
+    size_t numRows = 0;
+    for (size_t t = 0; t < T; t++) {
+      numRows += reindex[targets(t)] < 0;
+    }
+    if (numRows < T) {
+      workspace.uncachedRows.set_size(numRows);
+      workspace.uncachedTargets.set_size(numRows);
+      for (size_t t = 0, idx = 0; t < T; t++) {
+        if (reindex[targets(t)] < 0) {
+          workspace.uncachedRows(idx) = t;
+          workspace.uncachedTargets(idx) = targets(t);
+          idx++;
+        }
+      }
+      size_t numColumns = 0;
+      for (size_t r = 0; r < R; r++) {
+        numColumns += reindex[referencePoints(r)] < 0;
+      }
+      workspace.uncached.set_size(numColumns);
+      workspace.uncachedReferences.set_size(numColumns);
+      for (size_t r = 0, idx = 0; r < R; r++) {
+        if (reindex[referencePoints(r)] < 0) {
+          workspace.uncached(idx) = r;
+          workspace.uncachedReferences(idx) = referencePoints(r);
+          idx++;
+        }
+      }
+
+      // The counters of the cells with a slot are updated by cachedLoss
+      for (size_t r = 0; r < R; r++) {
+        const bool cachedColumn = reindex[referencePoints(r)] >= 0;
+        for (size_t t = 0; t < T; t++) {
+          if (cachedColumn || reindex[targets(t)] >= 0) {
+            (*tile)(t, r) = KMedoids::cachedLoss(
+              data,
+              targets(t),
+              referencePoints(r),
+              category,
+              loss);
+          }
+        }
+      }
+
+      const size_t numComputed = numRows * numColumns;
+      if (numComputed > 0) {
+        ThreadCounters& counters = KMedoids::localCounters();
+        counters.distanceComputations[category] += numComputed;
+        counters.cacheMisses += numComputed;
+        loss.tile(
+          data,
+          workspace.uncachedTargets,
+          workspace.uncachedReferences,
+          &workspace.scratch,
+          &workspace.uncachedTile);
+        for (size_t r = 0; r < numColumns; r++) {
+          for (size_t t = 0; t < numRows; t++) {
+            (*tile)(workspace.uncachedRows(t), workspace.uncached(r)) =
+              workspace.uncachedTile(t, r);
+          }
+        }
+      }
+      return;
+    }
+  }
+
+  // Fill the columns of the tile that can be served from the cache; the
+  // counters for those are updated by cachedLoss
+  auto isCached = [this](const arma::uword reference) {
+    return useCache && reindex[reference] >= 0;
+  };
+  size_t numUncached = 0;
+  for (size_t r = 0; r < R; r++) {
+    const arma::uword reference = referencePoints(r);
+    if (isCached(reference)) {
+      for (size_t t = 0; t < T; t++) {
+        (*tile)(t, r) =
+          KMedoids::cachedLoss(data, targets(t), reference, category,
+            loss);
+      }
+    } else {
+      numUncached++;
+    }
+  }
+
+  if (numUncached == 0) {
+    return;
+  }
+
+  const size_t numComputed = T * numUncached;
+  ThreadCounters& counters = KMedoids::localCounters();
+  counters.distanceComputations[category] += numComputed;
+  if (useCache) {
+    counters.cacheMisses += numComputed;
+  }
+
+  TileWorkspace& workspace = KMedoids::localTileWorkspace();
+  if (numUncached == R) {
+    loss.tile(data, targets, referencePoints, &workspace.scratch, tile);
+    return;
+  }
+
+  workspace.uncached.set_size(numUncached);
+  workspace.uncachedReferences.set_size(numUncached);
+  size_t idx = 0;
+  for (size_t r = 0; r < R; r++) {
+    if (!isCached(referencePoints(r))) {
+      workspace.uncached(idx) = r;
+      workspace.uncachedReferences(idx) = referencePoints(r);
+      idx++;
+    }
+  }
+  loss.tile(
+    data,
+    targets,
+    workspace.uncachedReferences,
+    &workspace.scratch,
+    &workspace.uncachedTile);
+  tile->cols(workspace.uncached) = workspace.uncachedTile;
+}
+
+template <typename Function>
+void KMedoids::dispatchLossFn(Function&& function) const {
+  KMedoids::dispatchLossFn(
+    norms.memptr(),
+    squaredNorms.memptr(),
+    std::forward<Function>(function));
+}
+
+template <typename Function>
+void KMedoids::dispatchLossFn(
+  const float* columnNorms,
+  const float* columnSquaredNorms,
+  Function&& function) const {
+  if (sparsePoints) {
+    if (lossFn == &KMedoids::manhattan
+      || (lossFn == &KMedoids::LP && lp == 1)) {
+      function(SparseL1Loss{sparsePoints});
+    } else if (lossFn == &KMedoids::LP && lp == 2) {
+      function(SparseL2Loss{sparsePoints});
+    } else if (lossFn == &KMedoids::cos) {
+      function(SparseCosLoss{sparsePoints, columnNorms});
+    } else {
+      throw std::invalid_argument(
+        "Sparse data only supports the L1, L2 and cosine losses");
+    }
+    return;
+  }
+  if (quantizedPoints) {
+    if (lossFn == &KMedoids::manhattan) {
+      function(QuantizedLoss<QuantizedL1>{quantizedPoints, {}});
+    } else if (lossFn == &KMedoids::cos) {
+      function(QuantizedLoss<QuantizedCos>{quantizedPoints, {columnNorms}});
+    } else if (lossFn == &KMedoids::LINF) {
+      function(QuantizedLoss<QuantizedLInf>{quantizedPoints, {}});
+    } else if (lossFn == &KMedoids::LP) {
+      if (lp == 1) {
+        function(QuantizedLoss<QuantizedL1>{quantizedPoints, {}});
+      } else if (lp == 2) {
+        function(QuantizedLoss<QuantizedL2>{quantizedPoints, {}});
+      } else {
+        function(QuantizedLoss<QuantizedLP>{quantizedPoints, {lp}});
+      }
+    } else {
+      throw std::invalid_argument("Error: Loss Function Undefined!");
+    }
+    return;
+  }
+  if (lossFn == &KMedoids::manhattan) {
+    function(L1Loss{});
+  } else if (lossFn == &KMedoids::cos) {
+    function(CosLoss{columnNorms});
+  } else if (lossFn == &KMedoids::LINF) {
+    function(LInfLoss{});
+  } else if (lossFn == &KMedoids::LP) {
+    if (lp == 1) {
+      function(L1Loss{});
+    } else if (lp == 2) {
+      function(L2Loss{columnSquaredNorms});
+    } else {
+      function(LPLoss{lp});
+    }
+  } else {
+    throw std::invalid_argument("Error: Loss Function Undefined!");
+  }
+}
+
+template <typename Function>
+void KMedoids::medoidDistanceBatches(
+  const arma::fmat& newData,
+  const bool transposed,
+  Function&& onBatch) {
+  if (medoidPoints.n_cols == 0) {
+    throw std::invalid_argument("Model has not been fit");
+  }
+  const size_t features = transposed ? newData.n_rows : newData.n_cols;
+  if (features != medoidPoints.n_rows) {
+    throw std::invalid_argument(
+      "New data must have the same number of features as the fitted data");
+  }
+  // Check the loss function here, since exceptions cannot leave the
+  // parallel region below
+  KMedoids::dispatchLossFn(nullptr, nullptr, [](const auto&) {});
+
+  const size_t K = medoidPoints.n_cols;
+  const size_t N = transposed ? newData.n_cols : newData.n_rows;
+  const size_t d = medoidPoints.n_rows;
+  const size_t pointsPerBatch = maxTileTargets;
+  const size_t numBatches = (N + pointsPerBatch - 1) / pointsPerBatch;
+  // predict and transform may run with more threads than the last fit
+  KMedoids::reserveThreadBuffers();
+  #pragma omp parallel for if (this->parallelize) \
+    num_threads(this->threadCount())
+  for (size_t batch = 0; batch < numBatches; batch++) {
+    const size_t start = batch * pointsPerBatch;
+    const size_t B = std::min(N, start + pointsPerBatch) - start;
+    TileWorkspace& workspace = KMedoids::localTileWorkspace();
+
+    // The medoids are the first K columns, followed by the batch of points
+    arma::fmat& points = workspace.points;
+    points.set_size(d, K + B);
+    points.cols(0, K - 1) = medoidPoints;
+    if (transposed) {
+      points.cols(K, K + B - 1) = newData.cols(start, start + B - 1);
+    }
+    // Rows are gathered one feature at a time, so that newData is read
+    // along its contiguous columns
+    for (size_t j = 0; j < d && !transposed; j++) {
+      const float* feature = newData.colptr(j) + start;
+      for (size_t b = 0; b < B; b++) {
+        points(j, K + b) = feature[b];
+      }
+    }
+
+    workspace.pointNorms.set_size(K + B);
+    workspace.pointSquaredNorms.set_size(K + B);
+    for (size_t c = 0; c < K + B; c++) {
+      const float* column = points.colptr(c);
+      float squaredNorm = 0;
+      for (size_t j = 0; j < d; j++) {
+        squaredNorm += column[j] * column[j];
+      }
+      workspace.pointSquaredNorms(c) = squaredNorm;
+      workspace.pointNorms(c) = std::sqrt(squaredNorm);
+    }
+
+    workspace.targets.set_size(B);
+    for (size_t b = 0; b < B; b++) {
+      workspace.targets(b) = K + b;
+    }
+    workspace.referencePoints.set_size(K);
+    for (size_t k = 0; k < K; k++) {
+      workspace.referencePoints(k) = k;
+    }
+    KMedoids::dispatchLossFn(
+      workspace.pointNorms.memptr(),
+      workspace.pointSquaredNorms.memptr(),
+      [&](const auto& loss) {
+        loss.tile(
+          points,
+          workspace.targets,
+          workspace.referencePoints,
+          &workspace.scratch,
+          &workspace.tile);
+      });
+    onBatch(start, static_cast<const arma::fmat&>(workspace.tile));
+  }
+}
+
+template <typename LossFunction, typename Function>
+void KMedoids::candidateDistances(
+  const arma::fmat& data,
+  const size_t category,
+  const LossFunction& loss,
+  Function&& onCandidate) {
+  const size_t N = data.n_cols;
+  arma::uvec allPoints(N);
+  for (size_t j = 0; j < N; j++) {
+    allPoints(j) = j;
+  }
+  const size_t numTiles = (N + candidatesPerTile - 1) / candidatesPerTile;
+  #pragma omp parallel for if (this->parallelize) \
+    num_threads(this->threadCount())
+  for (size_t tile = 0; tile < numTiles; tile++) {
+    const size_t start = tile * candidatesPerTile;
+    const size_t C = std::min(N, start + candidatesPerTile) - start;
+    TileWorkspace& workspace = KMedoids::localTileWorkspace();
+    workspace.referencePoints.set_size(C);
+    for (size_t c = 0; c < C; c++) {
+      workspace.referencePoints(c) = start + c;
+    }
+    KMedoids::cachedLossTile(
+      data,
+      allPoints,
+      workspace.referencePoints,
+      category,
+      loss,
+      &workspace.tile);
+    for (size_t c = 0; c < C; c++) {
+      onCandidate(start + c, workspace.tile.colptr(c));
+    }
+  }
+}
 }  // namespace km
 #endif  // HEADERS_ALGORITHMS_KMEDOIDS_ALGORITHM_HPP_
@@ -0,0 +1,247 @@
+#ifndef HEADERS_ALGORITHMS_LOSS_FUNCTIONS_HPP_
+#define HEADERS_ALGORITHMS_LOSS_FUNCTIONS_HPP_
+
+#include <armadillo>
+#include <algorithm>
+#include <cmath>
+
+#include "distance_kernels.hpp"
+
+namespace km {
+/**
+ * Loss policies used by the templated hot paths of the k-medoids algorithms.
+ *
+ * Each policy is a small function object with the signature
+ * float operator()(const arma::fmat& data, size_t i, size_t j) const
+ * that computes the distance between columns i and j of the (transposed)
+ * data. Because the policy type is a template parameter of the calling
+ * function, the distance computation can be inlined into the innermost
+ * loops instead of going through a member-function pointer for every pair.
+ *
+ * The L1, L2, L-infinity and cosine policies forward to the vectorized
+ * kernels selected for the current CPU (see distance_kernels.hpp). The
+ * kernel table is looked up once, when the policy is constructed, so each
+ * distance costs a single call into a fused kernel.
+ *
+ * Policies also provide
+ * void tile(const arma::fmat& data, const arma::uvec& targets,
+ *   const arma::uvec& referencePoints, TileScratch* scratch,
+ *   arma::fmat* tile) const
+ * which fills tile(t, r) with the distance between targets(t) and
+ * referencePoints(r). L2 and cosine evaluate the whole tile with a single
+ * matrix product; the other losses use a cache-blocked loop over pairs.
+ */
+
+/**
+ * @brief Scratch space for the tile() computations of the loss policies, so
+ * that repeated tiles of similar sizes reuse the same memory.
+ */
+struct TileScratch {
+  /// Columns of the data at the targets of the tile
+  arma::fmat targetPoints;
+
+  /// Columns of the data at the reference points of the tile
+  arma::fmat references;
+};
+
+/**
+ * @brief Fills a targets-by-referencePoints tile of distances by looping
+ * over small blocks of pairs, so the columns of each block stay in cache
+ * while they are reused.
+ *
+ * @param loss Loss policy used to compute each distance
+ * @param data Transposed data to cluster
+ * @param targets Indices of the points along the rows of the tile
+ * @param referencePoints Indices of the points along the columns of the tile
+ * @param tile Output tile of size targets.n_elem x referencePoints.n_elem
+ */
+template <typename LossFunction>
+void blockedLossTile(
+  const LossFunction& loss,
+  const arma::fmat& data,
+  const arma::uvec& targets,
+  const arma::uvec& referencePoints,
+  arma::fmat* tile) {
+  // 2 * blockSize columns of a few hundred floats fit comfortably in L2
+  const size_t blockSize = 16;
+  const size_t T = targets.n_elem;
+  const size_t R = referencePoints.n_elem;
+  tile->set_size(T, R);
+  for (size_t rBlock = 0; rBlock < R; rBlock += blockSize) {
+    const size_t rEnd = std::min(R, rBlock + blockSize);
+    for (size_t tBlock = 0; tBlock < T; tBlock += blockSize) {
+      const size_t tEnd = std::min(T, tBlock + blockSize);
+      for (size_t r = rBlock; r < rEnd; r++) {
+        for (size_t t = tBlock; t < tEnd; t++) {
+          (*tile)(t, r) = loss(data, targets(t), referencePoints(r));
+        }
+      }
+    }
+  }
+}
+
+/**
+ * @brief Loss policy for the L1 (Manhattan) distance.
+ */
+struct L1Loss {
+  /// Vectorized kernels for the current CPU
+  const DistanceKernels* kernels = &distanceKernels();
+
+  float operator()(
+    const arma::fmat& data,
+    const size_t i,
+    const size_t j) const {
+    return kernels->l1(data.colptr(i), data.colptr(j), data.n_rows);
+  }
+
+  void tile(
+    const arma::fmat& data,
+    const arma::uvec& targets,
+    const arma::uvec& referencePoints,
+    TileScratch* /* scratch */,
+    arma::fmat* tile) const {
+    blockedLossTile(*this, data, targets, referencePoints, tile);
+  }
+};
+
+/**
+ * @brief Loss policy for the L2 (Euclidean) distance.
+ */
+struct L2Loss {
+  /// The squared L2 norm of each column of the data; only used by tile()
+  const float* squaredNorms;
+
+  /// Vectorized kernels for the current CPU
+  const DistanceKernels* kernels = &distanceKernels();
+
+  float operator()(
+    const arma::fmat& data,
+    const size_t i,
+    const size_t j) const {
+    return std::sqrt(
+      kernels->l2Squared(data.colptr(i), data.colptr(j), data.n_rows));
+  }
+
+  /**
+   * Uses ||x - y||^2 = ||x||^2 + ||y||^2 - 2<x, y> so that the whole tile is
+   * a single matrix product. The identity can go slightly negative for
+   * (nearly) identical points, so it is clamped at 0, and the distance of a
+   * point to itself is set to exactly 0.
+   */
+  void tile(
+    const arma::fmat& data,
+    const arma::uvec& targets,
+    const arma::uvec& referencePoints,
+    TileScratch* scratch,
+    arma::fmat* tile) const {
+    scratch->targetPoints = data.cols(targets);
+    scratch->references = data.cols(referencePoints);
+    *tile = arma::trans(scratch->targetPoints) * scratch->references;
+    for (size_t r = 0; r < referencePoints.n_elem; r++) {
+      const arma::uword reference = referencePoints(r);
+      for (size_t t = 0; t < targets.n_elem; t++) {
+        const float squaredDistance = squaredNorms[targets(t)]
+          + squaredNorms[reference] - 2 * (*tile)(t, r);
+        (*tile)(t, r) = (targets(t) == reference)
+          ? 0 : std::sqrt(std::max(squaredDistance, 0.0f));
+      }
+    }
+  }
+};
+
+/**
+ * @brief Loss policy for a general Lp distance. L1 and L2 have their own
+ * policies and should be preferred for those values of p.
+ */
+struct LPLoss {
+  /// The value of p in the Lp distance
+  size_t p;
+
+  float operator()(
+    const arma::fmat& data,
+    const size_t i,
+    const size_t j) const {
+    const float* x = data.colptr(i);
+    const float* y = data.colptr(j);
+    const float exponent = static_cast<float>(p);
+    float total = 0;
+    for (size_t d = 0; d < data.n_rows; d++) {
+      total += std::pow(std::fabs(x[d] - y[d]), exponent);
+    }
+    return std::pow(total, 1.0f / exponent);
+  }
+
+  void tile(
+    const arma::fmat& data,
+    const arma::uvec& targets,
+    const arma::uvec& referencePoints,
+    TileScratch* /* scratch */,
+    arma::fmat* tile) const {
+    blockedLossTile(*this, data, targets, referencePoints, tile);
+  }
+};
+
+/**
+ * @brief Loss policy for the L-infinity distance.
+ */
+struct LInfLoss {
+  /// Vectorized kernels for the current CPU
+  const DistanceKernels* kernels = &distanceKernels();
+
+  float operator()(
+    const arma::fmat& data,
+    const size_t i,
+    const size_t j) const {
+    return kernels->lInf(data.colptr(i), data.colptr(j), data.n_rows);
+  }
+
+  void tile(
+    const arma::fmat& data,
+    const arma::uvec& targets,
+    const arma::uvec& referencePoints,
+    TileScratch* /* scratch */,
+    arma::fmat* tile) const {
+    blockedLossTile(*this, data, targets, referencePoints, tile);
+  }
+};
+
+/**
+ * @brief Loss policy for the cosine distance, using per-point norms that
+ * were precomputed once per fit. Each distance then only needs a single
+ * dot product.
+ */
+struct CosLoss {
+  /// The L2 norm of each column of the data
+  const float* norms;
+
+  /// Vectorized kernels for the current CPU
+  const DistanceKernels* kernels = &distanceKernels();
+
+  float operator()(
+    const arma::fmat& data,
+    const size_t i,
+    const size_t j) const {
+    return 1 - kernels->dot(data.colptr(i), data.colptr(j), data.n_rows)
+      / (norms[i] * norms[j]);
+  }
+
+  void tile(
+    const arma::fmat& data,
+    const arma::uvec& targets,
+    const arma::uvec& referencePoints,
+    TileScratch* scratch,
+    arma::fmat* tile) const {
+    scratch->targetPoints = data.cols(targets);
+    scratch->references = data.cols(referencePoints);
+    *tile = arma::trans(scratch->targetPoints) * scratch->references;
+    for (size_t r = 0; r < referencePoints.n_elem; r++) {
+      const float referenceNorm = norms[referencePoints(r)];
+      for (size_t t = 0; t < targets.n_elem; t++) {
+        (*tile)(t, r) =
+          1 - (*tile)(t, r) / (norms[targets(t)] * referenceNorm);
+      }
+    }
+  }
+};
+}  // namespace km
+#endif  // HEADERS_ALGORITHMS_LOSS_FUNCTIONS_HPP_
@@ -0,0 +1,124 @@
+#ifndef HEADERS_ALGORITHMS_MAPPED_MATRIX_HPP_
+#define HEADERS_ALGORITHMS_MAPPED_MATRIX_HPP_
+
+#include <armadillo>
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace km {
+/**
+ * @brief Read-only view of a float32 NumPy .npy file, for datasets and
+ * precomputed distance matrices.
+ *
+ * The file is memory-mapped and viewed as an Armadillo matrix without
+ * copying, so opening it costs time proportional to the pages that are
+ * actually read, and processes that map the same file share one copy in the
+ * page cache. On platforms without mmap, the file is read into memory
+ * instead.
+ *
+ * Supported files are .npy versions 1.0 to 3.0 with dtype '<f4' and one or
+ * two dimensions; a 1-D array of N values is treated as N x 1. Files can be
+ * written with numpy.save(path, array.astype(numpy.float32)).
+ *
+ * Armadillo matrices are column-major, so a C-ordered (row-major) array of
+ * N points x d features is viewed as its d x N transpose: one point per
+ * column, which is the layout expected by KMedoids::fitTransposed. A
+ * Fortran-ordered array is viewed as stored.
+ */
+class MappedMatrix {
+ public:
+  /**
+   * @brief Maps the given .npy file.
+   *
+   * @param path Path to the .npy file
+   *
+   * @throws std::invalid_argument if the file cannot be opened or is not a
+   * supported .npy file
+   */
+  explicit MappedMatrix(const std::string& path);
+
+  ~MappedMatrix();
+
+  MappedMatrix(const MappedMatrix&) = delete;
+
+  MappedMatrix& operator=(const MappedMatrix&) = delete;
+
+  /**
+   * @brief Returns the mapped data as a matrix. It is the transpose of the
+   * stored array if isTransposed(), and the array itself otherwise.
+   *
+   * @returns The non-owning view of the data
+   */
+  const arma::fmat& getView() const {
+    return *view;
+  }
+
+  /**
+   * @brief Returns whether the view is the transpose of the stored array,
+   * i.e., whether the file is C-ordered.
+   *
+   * @returns Whether the view is transposed
+   */
+  bool isTransposed() const {
+    return !fortranOrder;
+  }
+
+  /**
+   * @brief Returns the number of rows of the stored array
+   *
+   * @returns The number of rows, e.g., the number of points of a dataset
+   */
+  size_t getRows() const {
+    return rows;
+  }
+
+  /**
+   * @brief Returns the number of columns of the stored array
+   *
+   * @returns The number of columns, e.g., the number of features of a dataset
+   */
+  size_t getCols() const {
+    return cols;
+  }
+
+ private:
+  /**
+   * @brief Parses the .npy header at the start of the file
+   *
+   * @param header First bytes of the file
+   * @param size Number of bytes of header
+   * @param path Path of the file, for error messages
+   */
+  void parseHeader(
+    const char* header,
+    const size_t size,
+    const std::string& path);
+
+  /// Number of rows of the stored array
+  size_t rows = 0;
+
+  /// Number of columns of the stored array
+  size_t cols = 0;
+
+  /// Whether the stored array is column-major
+  bool fortranOrder = false;
+
+  /// Offset of the data from the start of the file, in bytes
+  size_t dataOffset = 0;
+
+  /// Start of the mapping of the whole file, or nullptr if it is not mapped
+  void* mapping = nullptr;
+
+  /// Size of the mapping in bytes
+  size_t mappingSize = 0;
+
+  /// Copy of the data when the file could not be mapped
+  std::vector<float> buffer;
+
+  /// Non-owning view of the data
+  std::optional<arma::fmat> view;
+};
+}  // namespace km
+#endif  // HEADERS_ALGORITHMS_MAPPED_MATRIX_HPP_
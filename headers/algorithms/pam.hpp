@@ -19,11 +19,12 @@ class PAM : public km::KMedoids {
   /**
   * @brief Runs PAM to identify a dataset's medoids.
   *
-  * @param inputData Input data to cluster
+  * @param data Data to cluster, with one datapoint per column
+  * @param initialMedoids Medoids to start SWAP from instead of running BUILD
   */
   void fitPAM(
-  const arma::fmat& inputData,
-    std::optional<std::reference_wrapper<const arma::fmat>> distMat);
+  const arma::fmat& data,
+    std::optional<std::reference_wrapper<const arma::urowvec>> initialMedoids);
 
   /**
   * @brief Performs the BUILD step of PAM.
@@ -31,6 +32,7 @@ class PAM : public km::KMedoids {
   * Loops over all datapoint and checks each's distance to every other
   * datapoint in the dataset, then adds the point with the lowest overall
   * loss to the set of medoids.
+  * Candidates are evaluated in parallel, in tiles.
   *
   * @param data Transposed input data to cluster
   * @param medoidIndices Array of medoids that is modified in place
@@ -38,7 +40,6 @@ class PAM : public km::KMedoids {
   */
   void buildPAM(
     const arma::fmat& data,
-    std::optional<std::reference_wrapper<const arma::fmat>> distMat,
     arma::urowvec* medoidIndices);
 
   /**
@@ -48,6 +49,8 @@ class PAM : public km::KMedoids {
   * when the points are swapped in and out of the medoid set. Then updates
   * the list of medoids by performing the swap that would lower the overall
   * loss the most, provided at least one such swap would reduce the loss.
+  * The distances to each candidate are computed once per step, in
+  * parallel, and shared by every medoid the candidate could replace.
   *
   * @param data Transposed input data to cluster
   * @param medoidIndices Array of medoid indices created from the BUILD step
@@ -56,7 +59,6 @@ class PAM : public km::KMedoids {
   */
   void swapPAM(
     const arma::fmat& data,
-    std::optional<std::reference_wrapper<const arma::fmat>> distMat,
     arma::urowvec* medoidIndices,
     arma::urowvec* assignments);
 };
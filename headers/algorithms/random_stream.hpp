@@ -0,0 +1,85 @@
+#ifndef HEADERS_ALGORITHMS_RANDOM_STREAM_HPP_
+#define HEADERS_ALGORITHMS_RANDOM_STREAM_HPP_
+
+#include <armadillo>
+#include <cstddef>
+#include <cstdint>
+
+namespace km {
+/**
+ * @brief Streams of the random draws of a fit. Each consumer draws from its
+ * own stream, so adding draws to one does not change the others.
+ */
+enum RandomStreamId : uint64_t {
+  /// Reference points of BanditPAM sampled without the permutation
+  referencePointStream = 1,
+
+  /// Points of the samples of fitClara()
+  claraSampleStream = 2
+};
+
+/**
+ * @brief Counter-based random numbers: the n-th draw of a stream is a hash
+ * of the seed, the stream and n, computed with the SplitMix64 mixer.
+ *
+ * A stream holds no state besides its key and counter, so any thread can
+ * derive the same stream from the seed, or jump to any draw with at(),
+ * without sharing a generator with other threads. The draws are the same on
+ * every platform and for any number of threads.
+ */
+class RandomStream {
+ public:
+  /**
+   * @brief Creates the stream of the given seed and stream id, at its first
+   * draw
+   *
+   * @param seed Seed of the fit
+   * @param stream Id of the stream
+   */
+  explicit RandomStream(const uint64_t seed = 0, const uint64_t stream = 0);
+
+  /**
+   * @brief Returns the draw at the given position of the stream, without
+   * moving the stream
+   *
+   * @param position Position of the draw
+   *
+   * @returns 64 uniformly random bits
+   */
+  uint64_t at(const uint64_t position) const;
+
+  /**
+   * @brief Returns the next draw of the stream
+   *
+   * @returns 64 uniformly random bits
+   */
+  uint64_t next();
+
+  /**
+   * @brief Returns a uniformly random integer below n, without modulo bias
+   *
+   * @param n Number of possible values; must be positive
+   *
+   * @returns An integer in [0, n)
+   */
+  uint64_t below(const uint64_t n);
+
+  /**
+   * @brief Draws distinct uniformly random integers below n, with Floyd's
+   * algorithm, in expected O(count) time and memory
+   *
+   * @param n Number of possible values
+   * @param count Number of integers to draw; at most n
+   * @param indices The integers, set in place
+   */
+  void sample(const size_t n, const size_t count, arma::uvec* indices);
+
+ private:
+  /// Hash of the seed and the stream id
+  uint64_t key;
+
+  /// Position of the next draw
+  uint64_t counter = 0;
+};
+}  // namespace km
+#endif  // HEADERS_ALGORITHMS_RANDOM_STREAM_HPP_
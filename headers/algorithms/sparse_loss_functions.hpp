@@ -0,0 +1,206 @@
+#ifndef HEADERS_ALGORITHMS_SPARSE_LOSS_FUNCTIONS_HPP_
+#define HEADERS_ALGORITHMS_SPARSE_LOSS_FUNCTIONS_HPP_
+
+#include <armadillo>
+#include <cmath>
+
+#include "loss_functions.hpp"
+
+namespace km {
+/**
+ * Loss policies for sparse data, e.g., TF-IDF or one-hot features.
+ *
+ * They have the same interface as the dense policies in loss_functions.hpp,
+ * so every algorithm runs on them unchanged, but they read the points from
+ * the compressed columns of a sparse matrix instead of from the dense data
+ * they are passed, which only has to have the right number of columns. Each
+ * distance merges the non-zeros of two columns, so its cost is proportional
+ * to their number of non-zeros rather than to the number of features.
+ *
+ * The row indices of each column must be sorted and unique, as they are in
+ * an arma::sp_fmat after sync().
+ */
+
+/**
+ * @brief The non-zeros of one column of a sparse matrix
+ */
+struct SparseColumn {
+  /// Row index of each non-zero, in increasing order
+  const arma::uword* rows;
+
+  /// Value of each non-zero
+  const float* values;
+
+  /// Number of non-zeros
+  size_t nnz;
+};
+
+/**
+ * @brief Returns the non-zeros of column i of the given sparse matrix
+ *
+ * @param points Sparse data, with one datapoint per column
+ * @param i Index of the column
+ *
+ * @returns A view of the non-zeros of the column
+ */
+inline SparseColumn sparseColumn(const arma::sp_fmat& points, const size_t i) {
+  const arma::uword start = points.col_ptrs[i];
+  return SparseColumn{
+    points.row_indices + start,
+    points.values + start,
+    points.col_ptrs[i + 1] - start};
+}
+
+/**
+ * @brief Adds up a function of the coordinates of x and y over the union of
+ * their non-zeros, by merging the two sorted lists of row indices.
+ *
+ * @param x First column
+ * @param y Second column
+ * @param both Called as both(xValue, yValue) where both are non-zero
+ * @param one Called as one(value) where only one of them is non-zero
+ *
+ * @returns The sum of the terms
+ */
+template <typename Both, typename One>
+float mergeSparseColumns(
+  const SparseColumn& x,
+  const SparseColumn& y,
+  Both&& both,
+  One&& one) {
+  float total = 0;
+  size_t a = 0;
+  size_t b = 0;
+  while (a < x.nnz && b < y.nnz) {
+    if (x.rows[a] == y.rows[b]) {
+      total += both(x.values[a++], y.values[b++]);
+    } else if (x.rows[a] < y.rows[b]) {
+      total += one(x.values[a++]);
+    } else {
+      total += one(y.values[b++]);
+    }
+  }
+  for (; a < x.nnz; a++) {
+    total += one(x.values[a]);
+  }
+  for (; b < y.nnz; b++) {
+    total += one(y.values[b]);
+  }
+  return total;
+}
+
+/**
+ * @brief Computes the inner product of two sparse columns, which only
+ * depends on the rows where both are non-zero.
+ *
+ * @param x First column
+ * @param y Second column
+ *
+ * @returns The inner product <x, y>
+ */
+inline float sparseDot(const SparseColumn& x, const SparseColumn& y) {
+  float total = 0;
+  size_t a = 0;
+  size_t b = 0;
+  while (a < x.nnz && b < y.nnz) {
+    if (x.rows[a] == y.rows[b]) {
+      total += x.values[a++] * y.values[b++];
+    } else if (x.rows[a] < y.rows[b]) {
+      a++;
+    } else {
+      b++;
+    }
+  }
+  return total;
+}
+
+/**
+ * @brief Loss policy for the L1 (Manhattan) distance between sparse points.
+ */
+struct SparseL1Loss {
+  /// The sparse data, with one datapoint per column
+  const arma::sp_fmat* points;
+
+  float operator()(
+    const arma::fmat& /* data */,
+    const size_t i,
+    const size_t j) const {
+    return mergeSparseColumns(
+      sparseColumn(*points, i),
+      sparseColumn(*points, j),
+      [](const float x, const float y) { return std::fabs(x - y); },
+      [](const float value) { return std::fabs(value); });
+  }
+
+  void tile(
+    const arma::fmat& data,
+    const arma::uvec& targets,
+    const arma::uvec& referencePoints,
+    TileScratch* /* scratch */,
+    arma::fmat* tile) const {
+    blockedLossTile(*this, data, targets, referencePoints, tile);
+  }
+};
+
+/**
+ * @brief Loss policy for the L2 (Euclidean) distance between sparse points.
+ *
+ * The squared differences are summed directly rather than derived from the
+ * norms and the inner product, which costs the same merge and does not lose
+ * precision to cancellation between nearby points.
+ */
+struct SparseL2Loss {
+  /// The sparse data, with one datapoint per column
+  const arma::sp_fmat* points;
+
+  float operator()(
+    const arma::fmat& /* data */,
+    const size_t i,
+    const size_t j) const {
+    return std::sqrt(mergeSparseColumns(
+      sparseColumn(*points, i),
+      sparseColumn(*points, j),
+      [](const float x, const float y) { return (x - y) * (x - y); },
+      [](const float value) { return value * value; }));
+  }
+
+  void tile(
+    const arma::fmat& data,
+    const arma::uvec& targets,
+    const arma::uvec& referencePoints,
+    TileScratch* /* scratch */,
+    arma::fmat* tile) const {
+    blockedLossTile(*this, data, targets, referencePoints, tile);
+  }
+};
+
+/**
+ * @brief Loss policy for the cosine distance between sparse points, using
+ * per-point norms that were precomputed once per fit.
+ */
+struct SparseCosLoss {
+  /// The sparse data, with one datapoint per column
+  const arma::sp_fmat* points;
+
+  /// The L2 norm of each column of the data
+  const float* norms;
+
+  float operator()(
+    const arma::fmat& /* data */,
+    const size_t i,
+    const size_t j) const {
+    return 1 - sparseDot(sparseColumn(*points, i), sparseColumn(*points, j))
+      / (norms[i] * norms[j]);
+  }
+
+  void tile(
+    const arma::fmat& data,
+    const arma::uvec& targets,
+    const arma::uvec& referencePoints,
+    TileScratch* /* scratch */,
+    arma::fmat* tile) const {
+    blockedLossTile(*this, data, targets, referencePoints, tile);
+  }
+};
+}  // namespace km
+#endif  // HEADERS_ALGORITHMS_SPARSE_LOSS_FUNCTIONS_HPP_
@@ -0,0 +1,230 @@
+#ifndef HEADERS_ALGORITHMS_SWAP_ARMS_HPP_
+#define HEADERS_ALGORITHMS_SWAP_ARMS_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace km {
+/**
+ * @brief Compact state of the nMedoids x N arms of a BanditPAM SWAP step.
+ *
+ * Arm (k, n) corresponds to swapping medoid k for point n. All arms of a
+ * point n (a "column") are sampled together, so sample counts and exactness
+ * are kept per column, while the estimate and standard deviation of each arm
+ * are stored next to each other. Candidate arms are tracked with a bitset
+ * and the columns that still hold a candidate are kept in a compact list, so
+ * each bandit round only touches the surviving columns. Confidence bounds
+ * are derived from the rest of the state when needed instead of stored.
+ *
+ * Once an arm is eliminated it stays eliminated; its upper confidence bound
+ * at that time still counts towards the minimum UCB, as do the values of the
+ * arms that were computed exactly.
+ */
+class SwapArms {
+ public:
+  /// Running estimate and standard deviation of one arm
+  struct Arm {
+    /// Estimated change in loss of the swap
+    float estimate;
+
+    /// Estimated standard deviation of a single sample of the arm
+    float sigma;
+  };
+
+  /**
+   * @brief Resets the state for a new SWAP step. Every arm becomes a
+   * candidate with no samples. Memory from previous steps is reused.
+   *
+   * @param numMedoids Number of medoids, i.e., arms per point
+   * @param numPoints Number of points that could be swapped in
+   * @param numThreads Number of threads with which to update the arms
+   */
+  void reset(
+    const size_t numMedoids,
+    const size_t numPoints,
+    const int numThreads);
+
+  /**
+   * @brief Returns the estimate and standard deviation of arm (k, n)
+   *
+   * @param k Index of the medoid to swap out
+   * @param n Index of the point to swap in
+   *
+   * @returns The state of the arm
+   */
+  Arm& arm(const size_t k, const size_t n) {
+    return arms[n * numMedoids + k];
+  }
+
+  /**
+   * @brief Returns whether arm (k, n) is still a candidate
+   *
+   * @param k Index of the medoid to swap out
+   * @param n Index of the point to swap in
+   *
+   * @returns Whether the arm is a candidate
+   */
+  bool isCandidate(const size_t k, const size_t n) const {
+    return (candidateBits[n * wordsPerColumn + k / 64] >> (k % 64)) & 1;
+  }
+
+  /**
+   * @brief Returns the number of samples taken for each arm of column n
+   *
+   * @param n Index of the point to swap in
+   *
+   * @returns The number of samples of the column
+   */
+  uint32_t getNumSamples(const size_t n) const {
+    return numSamples[n];
+  }
+
+  /**
+   * @brief Adds samples to every arm of column n
+   *
+   * @param n Index of the point to swap in
+   * @param count Number of samples taken
+   */
+  void addSamples(const size_t n, const size_t count) {
+    numSamples[n] += count;
+  }
+
+  /**
+   * @brief Returns whether the arms of column n were computed exactly
+   *
+   * @param n Index of the point to swap in
+   *
+   * @returns Whether the column was computed exactly
+   */
+  bool isExact(const size_t n) const {
+    return (exactBits[n / 64] >> (n % 64)) & 1;
+  }
+
+  /**
+   * @brief Marks the arms of column n as computed exactly, with their exact
+   * values already stored as estimates. Such arms are no longer candidates.
+   *
+   * @param n Index of the point to swap in
+   */
+  void setExact(const size_t n);
+
+  /**
+   * @brief Removes candidates whose lower confidence bound is not below the
+   * minimum upper confidence bound over all arms, and drops columns without
+   * candidates from the active columns.
+   *
+   * @param adjust Logarithmic confidence term of the bounds, e.g.,
+   * swapConfidence + log(N)
+   */
+  void eliminate(const float adjust);
+
+  /**
+   * @brief Same as eliminate(adjust), for callers that already know the
+   * minimum upper confidence bound over the candidate arms, e.g., because
+   * they just updated every candidate. Saves a pass over the arms.
+   *
+   * @param adjust Logarithmic confidence term of the bounds
+   * @param candidateMinUcb Minimum upper confidence bound over the
+   * candidate arms
+   */
+  void eliminate(const float adjust, const float candidateMinUcb);
+
+  /**
+   * @brief Returns the upper confidence bound of arm (k, n)
+   *
+   * @param k Index of the medoid to swap out
+   * @param n Index of the point to swap in
+   * @param adjust Logarithmic confidence term of the bounds
+   *
+   * @returns The upper confidence bound of the arm
+   */
+  float upperConfidenceBound(
+    const size_t k,
+    const size_t n,
+    const float adjust) const {
+    return arms[n * numMedoids + k].estimate
+      + confidenceWidth(k, n, adjust);
+  }
+
+  /**
+   * @brief Returns the candidate or exact arm with the smallest lower
+   * confidence bound, as an index n * numMedoids + k. If every arm was
+   * eliminated, returns the arm with the smallest estimate.
+   *
+   * @param adjust Logarithmic confidence term of the bounds
+   *
+   * @returns The index of the best arm
+   */
+  size_t bestArm(const float adjust) const;
+
+  /**
+   * @brief Returns the number of candidate arms
+   *
+   * @returns The number of candidate arms
+   */
+  size_t getNumCandidates() const {
+    return numCandidates;
+  }
+
+  /**
+   * @brief Returns the columns that hold at least one candidate, in
+   * increasing order
+   *
+   * @returns The active columns
+   */
+  const std::vector<uint32_t>& getActiveColumns() const {
+    return activeColumns;
+  }
+
+ private:
+  /**
+   * @brief Returns the half-width of the confidence interval of arm (k, n)
+   */
+  float confidenceWidth(
+    const size_t k,
+    const size_t n,
+    const float adjust) const;
+
+  /**
+   * @brief Drops the columns without candidates from activeColumns
+   */
+  void removeInactiveColumns();
+
+  /// Number of medoids, i.e., arms per column
+  size_t numMedoids = 0;
+
+  /// Number of threads with which to update the arms
+  int numThreads = 1;
+
+  /// Number of 64-bit words of candidateBits per column. Columns start on a
+  /// word boundary, so threads can update different columns concurrently.
+  size_t wordsPerColumn = 0;
+
+  /// Estimate and standard deviation of each arm, column by column
+  std::vector<Arm> arms;
+
+  /// Number of samples taken for each arm of each column
+  std::vector<uint32_t> numSamples;
+
+  /// Number of candidate arms in each column
+  std::vector<uint32_t> columnCandidates;
+
+  /// One bit per arm, set while the arm is a candidate
+  std::vector<uint64_t> candidateBits;
+
+  /// One bit per column, set once the column was computed exactly
+  std::vector<uint64_t> exactBits;
+
+  /// Columns with at least one candidate, in increasing order
+  std::vector<uint32_t> activeColumns;
+
+  /// Total number of candidate arms
+  size_t numCandidates = 0;
+
+  /// Minimum upper confidence bound over the arms that are no longer
+  /// candidates, frozen at the time they stopped being candidates
+  float frozenMinUcb = 0;
+};
+}  // namespace km
+#endif  // HEADERS_ALGORITHMS_SWAP_ARMS_HPP_
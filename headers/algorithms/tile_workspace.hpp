@@ -0,0 +1,67 @@
+#ifndef HEADERS_ALGORITHMS_TILE_WORKSPACE_HPP_
+#define HEADERS_ALGORITHMS_TILE_WORKSPACE_HPP_
+
+#include <armadillo>
+
+#include "loss_functions.hpp"
+
+namespace km {
+/**
+ * @brief Scratch buffers of one thread for evaluating distance tiles, and
+ * for the statistics computed from them.
+ *
+ * Armadillo keeps the memory of a matrix that is resized to the same or a
+ * smaller number of elements, so once the buffers have grown to the largest
+ * tile of a fit, later tiles no longer allocate.
+ */
+struct TileWorkspace {
+  /// Targets along the rows of the current tile
+  arma::uvec targets;
+
+  /// Reference points along the columns of the current tile
+  arma::uvec referencePoints;
+
+  /// Distances between the targets and the reference points
+  arma::fmat tile;
+
+  /// Columns of the tile that are not served by the cache
+  arma::uvec uncached;
+
+  /// Reference points of the columns that are not served by the cache
+  arma::uvec uncachedReferences;
+
+  /// Distances to the reference points that are not served by the cache
+  arma::fmat uncachedTile;
+
+  /// Rows of the tile whose targets are not admitted to the cache
+  arma::uvec uncachedRows;
+
+  /// Targets of the rows that are not admitted to the cache
+  arma::uvec uncachedTargets;
+
+  /// Scratch space of the loss policy's tile()
+  TileScratch scratch;
+
+  /// Medoids followed by a batch of new points, for predict and transform
+  arma::fmat points;
+
+  /// L2 norm of each column of points
+  arma::frowvec pointNorms;
+
+  /// Squared L2 norm of each column of points
+  arma::frowvec pointSquaredNorms;
+
+  /// Sum of the samples of each target, used to estimate sigma
+  arma::vec sums;
+
+  /// Sum of the squared samples of each target, used to estimate sigma
+  arma::vec sumSquares;
+
+  /// Per-medoid adjustments of sums in the SWAP step
+  arma::mat sumAdjustments;
+
+  /// Per-medoid adjustments of sumSquares in the SWAP step
+  arma::mat sumSquareAdjustments;
+};
+}  // namespace km
+#endif  // HEADERS_ALGORITHMS_TILE_WORKSPACE_HPP_
@@ -6,7 +6,10 @@
 #include <pybind11/numpy.h>
 #include <carma>
 #include <armadillo>
+#include <atomic>
+#include <optional>
 #include <string>
+#include <utility>
 
 #include "kmedoids_algorithm.hpp"
 
@@ -24,15 +27,152 @@ class KMedoidsWrapper : public km::KMedoids {
    * This is the primary function of the KMedoids module: this finds the build and swap
    * medoids for the desired data
    *
-   * @param inputData Input data to find the medoids of
+   * @param inputData Input data to find the medoids of, either an array or
+   * a SciPy sparse matrix
    * @param loss The loss function used during medoid computation
    * @param k The number of medoids to compute
+   * @param initial_medoids Indices of the medoids to start SWAP from instead
+   * of running BUILD, e.g., the medoids of a previous fit
+   * @param weights Non-negative weight of each point
    */
   void fitPython(
+    const pybind11::object& inputData,
+    const std::string& loss,
+    pybind11::kwargs kw);
+
+  /**
+   * @brief Python binding for fitting a KMedoids object on a thread of its
+   * own, with the same arguments as fitPython
+   *
+   * Until the fit is done, any other call on the object, including a
+   * second fit_async and reading or setting its properties, raises a
+   * ValueError.
+   *
+   * @param self The Python KMedoids object to fit
+   * @param inputData Input data to find the medoids of
+   * @param loss The loss function used during medoid computation
+   *
+   * @returns A concurrent.futures.Future whose result is self once it is
+   * fitted
+   */
+  static pybind11::object fitAsyncPython(
+    const pybind11::object& self,
+    const pybind11::object& inputData,
+    const std::string& loss,
+    pybind11::kwargs kw);
+
+  /**
+   * @brief Views a NumPy array of points, one per row, as a matrix with one
+   * point per column, which is the layout used by the algorithms
+   *
+   * C-contiguous float32 arrays already have that layout and are aliased
+   * without a copy; the array must then outlive the view. Fortran-ordered
+   * and strided arrays are copied once, transposing on the way.
+   *
+   * @param inputData Points to view, one per row
+   * @param points Set to the view
+   */
+  static void transposedView(
+    const pybind11::array_t<float>& inputData,
+    std::optional<arma::fmat>* points);
+
+  /**
+   * @brief Views a 2-D NumPy array, such as a distance matrix, as an
+   * Armadillo matrix. Fortran-ordered float32 arrays are aliased without a
+   * copy; other arrays are copied once. A 1-D array, such as a condensed
+   * distance matrix, is viewed as a column vector.
+   *
+   * @param matrix Array to view
+   * @param view Set to the view
+   */
+  static void matrixView(
+    const pybind11::array_t<float>& matrix,
+    std::optional<arma::fmat>* view);
+
+  /**
+   * @brief Converts a SciPy sparse matrix with one point per row into a
+   * sparse matrix with one point per column. The CSR arrays of the former
+   * are the CSC arrays of the latter, so no transpose is needed.
+   *
+   * @param matrix SciPy sparse matrix, in any of SciPy's formats
+   * @param points Set to the converted matrix
+   */
+  static void sparseTransposedView(
+    const pybind11::object& matrix,
+    std::optional<arma::sp_fmat>* points);
+
+  /**
+   * @brief Python binding for fitting every number of medoids from kMin to
+   * kMax, sharing a single BUILD step
+   *
+   * @param inputData Input data to find the medoids of
+   * @param loss The loss function used during medoid computation
+   * @param kMin Smallest number of medoids to fit
+   * @param kMax Largest number of medoids to fit
+   *
+   * @returns A list with a dictionary of results for each k
+   */
+  pybind11::list fitRangePython(
+    const pybind11::array_t<float>& inputData,
+    const std::string& loss,
+    const size_t kMin,
+    const size_t kMax,
+    pybind11::kwargs kw);
+
+  /**
+   * @brief Python binding for fitting the data with several seeds, sharing
+   * the distance cache, and keeping the best medoids
+   *
+   * @param inputData Input data to find the medoids of
+   * @param loss The loss function used during medoid computation
+   * @param nRestarts Number of fits to run
+   *
+   * @returns A list with a dictionary of results for each restart
+   */
+  pybind11::list fitRestartsPython(
     const pybind11::array_t<float>& inputData,
     const std::string& loss,
+    const size_t nRestarts,
     pybind11::kwargs kw);
 
+  /**
+   * @brief Python binding for fitting random samples of the data and keeping
+   * the medoids that are best on the whole data
+   *
+   * @param inputData Input data to find the medoids of
+   * @param loss The loss function used during medoid computation
+   * @param numSamples Number of samples to cluster
+   * @param sampleSize Number of points per sample, or 0 for 80 + 4k
+   * @param refineIter Maximum number of SWAP steps on the whole data
+   */
+  void fitClaraPython(
+    const pybind11::array_t<float>& inputData,
+    const std::string& loss,
+    const size_t numSamples,
+    const size_t sampleSize,
+    const size_t refineIter);
+
+  /**
+   * @brief Python binding for assigning new points to the fitted medoids
+   *
+   * @param newData New points, one per row
+   *
+   * @returns The index of the nearest medoid of each point
+   */
+  pybind11::array_t<arma::uword> predictPython(
+    const pybind11::array_t<float>& newData);
+
+  /**
+   * @brief Python binding for the distances from new points to the fitted
+   * medoids
+   *
+   * @param newData New points, one per row
+   *
+   * @returns The distance from each point (row) to each medoid (column)
+   */
+  pybind11::array_t<float> transformPython(
+    const pybind11::array_t<float>& newData);
+
   /**
    * @brief Returns the build medoids
    *
@@ -123,8 +263,83 @@ class KMedoidsWrapper : public km::KMedoids {
    * The average time per swap step by the last call to .fit()
    */
   float getTimePerSwapPython();
+
+  /**
+   * @brief Returns the timings of the phases of the last call to .fit(), and
+   * the number of arms that survived each bandit round
+   *
+   * A dictionary with the same keys as KMedoids::getProfile().toJson()
+   */
+  pybind11::dict getProfilePython();
+
+  /**
+   * @brief Marks the object as in use, so that calls that would overlap with
+   * a running fit are rejected instead of racing with it
+   *
+   * @throws pybind11::value_error if the object is already in use
+   */
+  void acquire();
+
+  /**
+   * @brief Marks the object as no longer in use
+   */
+  void release();
+
+ private:
+  /// Whether a call, or a fit started by fit_async, is using the object
+  std::atomic<bool> inUse{false};
 };
 
+/**
+ * @brief Holds a KMedoidsWrapper in use for the lifetime of the guard
+ */
+class InUseGuard {
+ public:
+  explicit InUseGuard(KMedoidsWrapper* wrapper) : wrapper(wrapper) {
+    wrapper->acquire();
+  }
+
+  ~InUseGuard() { wrapper->release(); }
+
+  InUseGuard(const InUseGuard&) = delete;
+  InUseGuard& operator=(const InUseGuard&) = delete;
+
+ private:
+  KMedoidsWrapper* wrapper;
+};
+
+/**
+ * @brief Wraps a method for binding so that it holds the object in use while
+ * it runs; see KMedoidsWrapper::fitAsyncPython
+ *
+ * @param method The method to wrap
+ *
+ * @returns A callable taking the object and then the method's arguments
+ */
+template <typename Class, typename Return, typename... Args>
+auto guarded(Return (Class::*method)(Args...)) {
+  return [method](KMedoidsWrapper& self, Args... args) -> Return {
+    const InUseGuard guard(&self);
+    return (self.*method)(std::forward<Args>(args)...);
+  };
+}
+
+/**
+ * @brief Wraps a const method for binding so that it holds the object in use
+ * while it runs
+ *
+ * @param method The method to wrap
+ *
+ * @returns A callable taking the object and then the method's arguments
+ */
+template <typename Class, typename Return, typename... Args>
+auto guarded(Return (Class::*method)(Args...) const) {
+  return [method](KMedoidsWrapper& self, Args... args) -> Return {
+    const InUseGuard guard(&self);
+    return (self.*method)(std::forward<Args>(args)...);
+  };
+}
+
 // TODO(@motiwari): Encapsulate these
 
 /**
@@ -132,6 +347,27 @@ class KMedoidsWrapper : public km::KMedoids {
  */
 void fit_python(pybind11::class_<km::KMedoidsWrapper> *);
 
+/**
+ * @brief Binding for the C++ function KMedoids::fitRange
+ */
+void fit_range_python(pybind11::class_<km::KMedoidsWrapper> *);
+
+/**
+ * @brief Binding for the C++ function KMedoids::fitClara
+ */
+void fit_clara_python(pybind11::class_<km::KMedoidsWrapper> *);
+
+/**
+ * @brief Binding for the C++ function KMedoids::fitRestarts
+ */
+void fit_restarts_python(pybind11::class_<km::KMedoidsWrapper> *);
+
+/**
+ * @brief Binding for the C++ functions KMedoids::predict and
+ * KMedoids::transform
+ */
+void predict_python(pybind11::class_<km::KMedoidsWrapper> *);
+
 /**
  * @brief Binding for the C++ function KMedoids::getMedoidsBuild()
  */
@@ -196,5 +432,10 @@ void total_swap_time_python(pybind11::class_<km::KMedoidsWrapper> *);
  * @brief Binding for the C++ function KMedoids::getTimePerSwap()
  */
 void time_per_swap_python(pybind11::class_<km::KMedoidsWrapper> *);
+
+/**
+ * @brief Binding for the C++ function KMedoids::getProfile()
+ */
+void profile_python(pybind11::class_<km::KMedoidsWrapper> *);
 }  // namespace km
 #endif  // HEADERS_PYTHON_BINDINGS_KMEDOIDS_PYWRAPPER_HPP_
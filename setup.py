@@ -483,18 +483,37 @@ def main():
                 os.path.join("src", "algorithms", "banditpam.cpp"),
                 os.path.join("src", "algorithms", "banditpam_orig.cpp"),
                 os.path.join("src", "algorithms", "fastpam1.cpp"),
+                os.path.join("src", "algorithms", "fasterpam.cpp"),
+                os.path.join("src", "algorithms", "distance_kernels.cpp"),
+                os.path.join("src", "algorithms", "distance_cache.cpp"),
+                os.path.join("src", "algorithms", "fit_profile.cpp"),
+                os.path.join("src", "algorithms", "swap_arms.cpp"),
+                os.path.join("src", "algorithms", "mapped_matrix.cpp"),
+                os.path.join("src", "algorithms", "distance_matrix.cpp"),
+                os.path.join("src", "algorithms", "quantized_matrix.cpp"),
+                os.path.join("src", "algorithms", "communicator.cpp"),
+                os.path.join("src", "algorithms", "cuda_backend.cpp"),
+                os.path.join("src", "algorithms", "random_stream.cpp"),
                 os.path.join("src", "python_bindings",
                              "kmedoids_pywrapper.cpp"),
                 os.path.join("src", "python_bindings", "medoids_python.cpp"),
                 os.path.join("src", "python_bindings",
                              "build_medoids_python.cpp"),
                 os.path.join("src", "python_bindings", "fit_python.cpp"),
+                os.path.join("src", "python_bindings",
+                             "fit_range_python.cpp"),
+                os.path.join("src", "python_bindings",
+                             "fit_clara_python.cpp"),
+                os.path.join("src", "python_bindings",
+                             "fit_restarts_python.cpp"),
+                os.path.join("src", "python_bindings", "predict_python.cpp"),
                 os.path.join("src", "python_bindings", "labels_python.cpp"),
                 os.path.join("src", "python_bindings", "steps_python.cpp"),
                 os.path.join("src", "python_bindings", "loss_python.cpp"),
                 os.path.join("src", "python_bindings", "cache_python.cpp"),
                 os.path.join("src", "python_bindings",
                              "swap_times_python.cpp"),
+                os.path.join("src", "python_bindings", "profile_python.cpp"),
             ],
             include_dirs=include_dirs,
             library_dirs=[
@@ -540,8 +559,22 @@ def main():
         ],
         headers=[
             os.path.join("headers", "algorithms", "kmedoids_algorithm.hpp"),
+            os.path.join("headers", "algorithms", "loss_functions.hpp"),
+            os.path.join(
+                "headers", "algorithms", "sparse_loss_functions.hpp"
+            ),
+            os.path.join("headers", "algorithms", "distance_kernels.hpp"),
+            os.path.join("headers", "algorithms", "distance_cache.hpp"),
+            os.path.join("headers", "algorithms", "fit_profile.hpp"),
+            os.path.join("headers", "algorithms", "swap_arms.hpp"),
+            os.path.join("headers", "algorithms", "tile_workspace.hpp"),
+            os.path.join("headers", "algorithms", "mapped_matrix.hpp"),
+            os.path.join("headers", "algorithms", "distance_matrix.hpp"),
+            os.path.join("headers", "algorithms", "quantized_matrix.hpp"),
+            os.path.join("headers", "algorithms", "communicator.hpp"),
             os.path.join("headers", "algorithms", "banditpam.hpp"),
             os.path.join("headers", "algorithms", "fastpam1.hpp"),
+            os.path.join("headers", "algorithms", "fasterpam.hpp"),
             os.path.join("headers", "algorithms", "pam.hpp"),
             os.path.join("headers", "python_bindings",
                          "kmedoids_pywrapper.hpp"),
@@ -8,158 +8,372 @@
 #include "banditpam.hpp"
 
 #include <armadillo>
+#include <algorithm>
 #include <unordered_map>
 #include <cmath>
 #include <vector>
 
 namespace km {
+namespace {
+/**
+ * @brief Returns the sample standard deviation (normalized by n - 1, as in
+ * arma::stddev) of n samples, given their sum and sum of squares.
+ *
+ * @param sum Sum of the samples
+ * @param sumSquares Sum of the squares of the samples
+ * @param n Number of samples
+ *
+ * @returns The sample standard deviation
+ */
+float sampleStddev(const double sum, const double sumSquares, const size_t n) {
+  if (n < 2) {
+    return 0;
+  }
+  const double variance = (sumSquares - sum * sum / n) / (n - 1);
+  return variance > 0 ? std::sqrt(variance) : 0;
+}
+
+// Fewest reference points of a chunk; below this, the partial sums of the
+// chunks cost more than the balance they buy
+constexpr size_t minChunkReferences = 32;
+
+// Number of (block, chunk) tasks that a round with few target blocks is
+// split into, when its shard is large enough
+constexpr size_t roundTasks = 256;
+}  // namespace
+
 void BanditPAM::fitBanditPAM(
-  const arma::fmat& inputData,
-  std::optional<std::reference_wrapper<const arma::fmat>> distMat) {
-  data = arma::trans(inputData);
+  const arma::fmat& data,
+  std::optional<std::reference_wrapper<const arma::urowvec>> initialMedoids) {
+  BanditPAM::fitBanditPAMRange(
+    data, nMedoids, nMedoids, nullptr, initialMedoids);
+}
 
+void BanditPAM::fitBanditPAMRange(
+  const arma::fmat& data,
+  const size_t kMin,
+  const size_t kMax,
+  std::vector<FitResult>* results,
+  std::optional<std::reference_wrapper<const arma::urowvec>> initialMedoids) {
   // Note: even if we are using a distance matrix, we compute the permutation
   // in the block below because it is used elsewhere in the call stack
   // TODO(@motiwari): Remove need for data or permutation through when using
   //  a distance matrix
   if (this->useCache) {
-    size_t n = data.n_cols;
-    size_t m = fmin(n, cacheWidth);
-    cache = new float[n * m];
+    permutation = arma::randperm(data.n_cols);
+    permutationIdx = 0;
+    KMedoids::initializeCache(data.n_cols);
+  }
+  referenceStream = RandomStream(seed, referencePointStream);
 
-    #pragma omp parallel for if (this->parallelize)
-    for (size_t idx = 0; idx < m*n; idx++) {
-      cache[idx] = -1;  // TODO(@motiwari): need better value here
+  arma::fmat buildMatrix(data.n_rows, kMax);
+  arma::urowvec buildIndices(kMax);
+  arma::urowvec assignments(data.n_cols);
+  BanditWorkspace workspace;
+
+  // Resolve the loss function once so that build and swap are compiled
+  // against a concrete loss policy, instead of dispatching per distance
+  KMedoids::dispatchLossFn([&](const auto& loss) {
+    nMedoids = kMax;
+    if (initialMedoids) {
+      buildIndices = initialMedoids->get();
+      buildMatrix = data.cols(buildIndices);
+    } else {
+      ScopedPhaseTimer timer(&profile.build);
+      BanditPAM::build(
+        data,
+        &buildIndices,
+        &buildMatrix,
+        &workspace,
+        loss);
     }
 
-    permutation = arma::randperm(n);
-    permutationIdx = 0;
-    reindex = {};  // TODO(@motiwari): Can this intialization be removed?
-    // TODO(@motiwari): Can we parallelize this?
-    for (size_t counter = 0; counter < m; counter++) {
-      reindex[permutation[counter]] = counter;
+    // BUILD adds medoids greedily, so the BUILD medoids for k are the first
+    // k medoids found for kMax
+    for (size_t k = kMin; k <= kMax; k++) {
+      nMedoids = k;
+      steps = 0;
+      medoidIndicesBuild = buildIndices.cols(0, k - 1);
+      arma::urowvec medoidIndices = medoidIndicesBuild;
+      arma::fmat medoidMatrix = buildMatrix.cols(0, k - 1);
+      const double swapStart = profile.swap.wallMilliseconds;
+      {
+        ScopedPhaseTimer timer(&profile.swap);
+        BanditPAM::swap(
+          data,
+          &medoidIndices,
+          &medoidMatrix,
+          &assignments,
+          &workspace,
+          loss);
+      }
+      medoidIndicesFinal = medoidIndices;
+      labels = assignments;
+      if (results) {
+        results->push_back(FitResult{
+          k,
+          medoidIndicesBuild,
+          medoidIndicesFinal,
+          labels,
+          steps,
+          averageLoss,
+          profile.swap.wallMilliseconds - swapStart});
+      }
     }
-  }
+  });
+}
 
-  arma::fmat medoidMatrix(data.n_rows, nMedoids);
-  arma::urowvec medoidIndices(nMedoids);
-  steps = 0;
-  BanditPAM::build(data, distMat, &medoidIndices, &medoidMatrix);
+void BanditPAM::sampleReferencePoints(
+  const size_t N,
+  const size_t count,
+  arma::uvec* referencePoints) {
+  // TODO(@motiwari): Make this wraparound properly
+  //  as last batch_size elements are dropped
+  if (usePerm) {
+    if ((permutationIdx + count - 1) >= N) {
+      permutationIdx = 0;
+    }
+    referencePoints->set_size(count);
+    for (size_t r = 0; r < count; r++) {
+      (*referencePoints)(r) = permutation(permutationIdx + r);
+    }
+    permutationIdx += count;
+  } else {
+    referenceStream.sample(N, count, referencePoints);
+  }
+}
 
-  medoidIndicesBuild = medoidIndices;
-  arma::urowvec assignments(data.n_cols);
+size_t BanditPAM::numChunkReferences(
+  const size_t numBlocks,
+  const size_t shardSize) const {
+  // Independent of the number of threads, so that the partial sums, and
+  // thus the results, are too
+  if (schedule == "static" || numBlocks == 0 || numBlocks >= roundTasks) {
+    return std::max(static_cast<size_t>(1), shardSize);
+  }
+  const size_t chunksPerBlock = (roundTasks + numBlocks - 1) / numBlocks;
+  return std::max(
+    minChunkReferences,
+    (shardSize + chunksPerBlock - 1) / chunksPerBlock);
+}
 
-  BanditPAM::swap(data, distMat, &medoidIndices, &medoidMatrix, &assignments);
+void BanditPAM::zeroPartials(
+  const size_t rows,
+  const size_t numChunks,
+  arma::fmat* partials) {
+  if (partials->n_rows < rows || partials->n_cols < numChunks) {
+    partials->set_size(
+      std::max(static_cast<size_t>(partials->n_rows), rows),
+      std::max(static_cast<size_t>(partials->n_cols), numChunks));
+  }
+  for (size_t chunk = 0; chunk < numChunks; chunk++) {
+    std::fill_n(partials->colptr(chunk), rows, 0.0f);
+  }
+}
 
-  medoidIndicesFinal = medoidIndices;
-  labels = assignments;
+size_t BanditPAM::roundBatchSize(
+  const size_t numTargets,
+  const size_t N) const {
+  if (schedule != "adaptive" || numTargets == 0) {
+    return batchSize;
+  }
+  const size_t threads = KMedoids::threadCount();
+  const size_t batchesPerTarget = (threads + numTargets - 1) / numTargets;
+  return std::min(N, batchSize * batchesPerTarget);
 }
 
-arma::frowvec BanditPAM::buildSigma(
+template <typename LossFunction>
+void BanditPAM::buildSigma(
   const arma::fmat& data,
-  std::optional<std::reference_wrapper<const arma::fmat>> distMat,
+  const arma::uvec& referencePoints,
   const arma::frowvec& bestDistances,
-  const bool useAbsolute) {
-  size_t N = data.n_cols;
-  arma::uvec referencePoints;
-  // TODO(@motiwari): Make this wraparound properly as
-  //  last batch_size elements are dropped
-  if (usePerm) {
-    if ((permutationIdx + batchSize - 1) >= N) {
-      permutationIdx = 0;
+  const bool useAbsolute,
+  arma::frowvec* sigma,
+  const LossFunction& loss) {
+  const size_t N = data.n_cols;
+  const size_t R = referencePoints.n_elem;
+
+  sigma->set_size(N);
+  if (useCuda) {
+    arma::vec sums;
+    arma::vec sumSquares;
+    cuda.buildSums(
+      arma::regspace<arma::uvec>(0, N - 1),
+      referencePoints,
+      useAbsolute,
+      &sums,
+      &sumSquares);
+    for (size_t t = 0; t < N; t++) {
+      (*sigma)(t) = sampleStddev(sums(t), sumSquares(t), R);
     }
-    // inclusive of both indices
-    referencePoints = permutation.subvec(
-      permutationIdx,
-      permutationIdx + batchSize - 1);
-    permutationIdx += batchSize;
-  } else {
-    referencePoints = arma::randperm(N, batchSize);
+    // 0 for MISC
+    KMedoids::localCounters().distanceComputations[0] += N * R;
+    return;
   }
 
-  arma::fvec sample(batchSize);
-  arma::frowvec updated_sigma(N);
-  #pragma omp parallel for if (this->parallelize)
-  for (size_t i = 0; i < N; i++) {
-    for (size_t j = 0; j < batchSize; j++) {
-      // 0 for MISC
-      float cost =
-          KMedoids::cachedLoss(data, distMat, i, referencePoints(j), 0);
-      if (useAbsolute) {
-        sample(j) = cost;
-      } else {
-        sample(j) = cost < bestDistances(referencePoints(j))
-                          ? cost : bestDistances(referencePoints(j));
-        sample(j) -= bestDistances(referencePoints(j));
+  // Each thread owns a block of targets, and accumulates the sum and sum of
+  // squares of its targets' samples in its own workspace
+  const size_t tileTargets = KMedoids::numTileTargets(N);
+  const size_t numBlocks = (N + tileTargets - 1) / tileTargets;
+  #pragma omp parallel for if (this->parallelize) \
+    num_threads(this->threadCount())
+  for (size_t block = 0; block < numBlocks; block++) {
+    const size_t tStart = block * tileTargets;
+    const size_t T = std::min(N, tStart + tileTargets) - tStart;
+    TileWorkspace& tileWorkspace = KMedoids::localTileWorkspace();
+    tileWorkspace.targets.set_size(T);
+    for (size_t t = 0; t < T; t++) {
+      tileWorkspace.targets(t) = tStart + t;
+    }
+    // 0 for MISC
+    KMedoids::cachedLossTile(
+      data,
+      tileWorkspace.targets,
+      referencePoints,
+      0,
+      loss,
+      &tileWorkspace.tile);
+
+    arma::vec& sums = tileWorkspace.sums;
+    arma::vec& sumSquares = tileWorkspace.sumSquares;
+    sums.zeros(T);
+    sumSquares.zeros(T);
+    for (size_t r = 0; r < R; r++) {
+      const float bestDistance = bestDistances(referencePoints(r));
+      const float weight = weights(referencePoints(r));
+      for (size_t t = 0; t < T; t++) {
+        const float cost = tileWorkspace.tile(t, r);
+        const double sample = weight * (useAbsolute
+          ? cost : (cost < bestDistance ? cost : bestDistance) - bestDistance);
+        sums(t) += sample;
+        sumSquares(t) += sample * sample;
       }
     }
-    updated_sigma(i) = arma::stddev(sample);
+    for (size_t t = 0; t < T; t++) {
+      (*sigma)(tStart + t) = sampleStddev(sums(t), sumSquares(t), R);
+    }
   }
-  return updated_sigma;
 }
 
-arma::frowvec BanditPAM::buildTarget(
+template <typename LossFunction>
+void BanditPAM::buildTarget(
   const arma::fmat& data,
-  std::optional<std::reference_wrapper<const arma::fmat>> distMat,
+  const arma::uvec& referencePoints,
   const arma::uvec* target,
   const arma::frowvec* bestDistances,
   const bool useAbsolute,
-  const size_t exact = 0) {
-  size_t N = data.n_cols;
-  size_t tmpBatchSize = batchSize;
-  if (exact > 0) {
-    tmpBatchSize = N;
-  }
-  arma::frowvec results(target->n_rows, arma::fill::zeros);
-  arma::uvec referencePoints;
-  // TODO(@motiwari): Make this wraparound properly
-  //  as last batch_size elements are dropped
-  if (usePerm) {
-    if ((permutationIdx + tmpBatchSize - 1) >= N) {
-      permutationIdx = 0;
+  arma::frowvec* results,
+  arma::fmat* partials,
+  const LossFunction& loss) {
+  const size_t T = target->n_rows;
+  const size_t R = referencePoints.n_elem;
+  results->zeros(T);
+  // Each rank of a distributed fit only samples its shard of the reference
+  // points; the partial sums of all ranks are added up below
+  size_t shardBegin;
+  size_t shardEnd;
+  communicator.shard(R, &shardBegin, &shardEnd);
+
+  if (useCuda) {
+    if (shardEnd > shardBegin) {
+      arma::vec sums;
+      cuda.buildSums(
+        *target,
+        arma::uvec(referencePoints.subvec(shardBegin, shardEnd - 1)),
+        useAbsolute,
+        &sums,
+        nullptr);
+      for (size_t t = 0; t < T; t++) {
+        (*results)(t) = sums(t);
+      }
+      // 1 for BUILD
+      KMedoids::localCounters().distanceComputations[1] +=
+        T * (shardEnd - shardBegin);
     }
-    // inclusive of both indices
-    referencePoints = permutation.subvec(
-      permutationIdx,
-      permutationIdx + tmpBatchSize - 1);
-    permutationIdx += tmpBatchSize;
-  } else {
-    referencePoints = arma::randperm(N, tmpBatchSize);
+    communicator.allReduceSum(results->memptr(), results->n_elem);
+    *results /= R;
+    return;
   }
 
-  #pragma omp parallel for if (this->parallelize)
-  for (size_t i = 0; i < target->n_rows; i++) {
-    float total = 0;
-    for (size_t j = 0; j < referencePoints.n_rows; j++) {
-      float cost =
-        KMedoids::cachedLoss(
-            data,
-            distMat,
-            (*target)(i),
-            referencePoints(j),
-            1);  // 1 for BUILD
-      if (useAbsolute) {
-        total += cost;
-      } else {
-        total += cost < (*bestDistances)(referencePoints(j))
-                      ? cost : (*bestDistances)(referencePoints(j));
-        total -= (*bestDistances)(referencePoints(j));
+  // Distances are evaluated in tiles of targets x reference points. Each
+  // task covers a block of targets and a chunk of the shard; chunks other
+  // than the whole shard sum into their own partials, which are added up in
+  // order below so that the result does not depend on the thread schedule
+  const size_t tileTargets = KMedoids::numTileTargets(T);
+  const size_t numBlocks = (T + tileTargets - 1) / tileTargets;
+  const size_t shardSize = shardEnd - shardBegin;
+  const size_t chunkReferences =
+    BanditPAM::numChunkReferences(numBlocks, shardSize);
+  const size_t numChunks = std::max(
+    static_cast<size_t>(1),
+    (shardSize + chunkReferences - 1) / chunkReferences);
+  if (numChunks > 1) {
+    BanditPAM::zeroPartials(T, numChunks, partials);
+  }
+  const auto evaluateTask = [&](const size_t task) {
+    const size_t block = task / numChunks;
+    const size_t chunk = task % numChunks;
+    float* sums =
+      numChunks > 1 ? partials->colptr(chunk) : results->memptr();
+    const size_t tStart = block * tileTargets;
+    const size_t tEnd = std::min(T, tStart + tileTargets);
+    const size_t chunkBegin = shardBegin + chunk * chunkReferences;
+    const size_t chunkEnd = std::min(shardEnd, chunkBegin + chunkReferences);
+    TileWorkspace& tileWorkspace = KMedoids::localTileWorkspace();
+    tileWorkspace.targets.set_size(tEnd - tStart);
+    for (size_t t = tStart; t < tEnd; t++) {
+      tileWorkspace.targets(t - tStart) = (*target)(t);
+    }
+    const arma::fmat& tile = tileWorkspace.tile;
+    for (size_t rStart = chunkBegin; rStart < chunkEnd;
+      rStart += maxTileReferences) {
+      const size_t rEnd = std::min(chunkEnd, rStart + maxTileReferences);
+      tileWorkspace.referencePoints.set_size(rEnd - rStart);
+      for (size_t r = rStart; r < rEnd; r++) {
+        tileWorkspace.referencePoints(r - rStart) = referencePoints(r);
       }
+      KMedoids::cachedLossTile(
+        data,
+        tileWorkspace.targets,
+        tileWorkspace.referencePoints,
+        1,  // 1 for BUILD
+        loss,
+        &tileWorkspace.tile);
+      for (size_t t = 0; t < tile.n_rows; t++) {
+        float total = sums[tStart + t];
+        for (size_t r = 0; r < tile.n_cols; r++) {
+          float cost = tile(t, r);
+          const arma::uword j = referencePoints(rStart + r);
+          if (useAbsolute) {
+            total += weights(j) * cost;
+          } else {
+            total += weights(j) * ((cost < (*bestDistances)(j)
+              ? cost : (*bestDistances)(j)) - (*bestDistances)(j));
+          }
+        }
+        sums[tStart + t] = total;
+      }
+    }
+  };
+  BanditPAM::runTasks(numBlocks * numChunks, evaluateTask);
+  for (size_t chunk = 0; numChunks > 1 && chunk < numChunks; chunk++) {
+    const float* sums = partials->colptr(chunk);
+    for (size_t t = 0; t < T; t++) {
+      (*results)(t) += sums[t];
     }
-    results(i) = total / tmpBatchSize;
   }
-  return results;
+  communicator.allReduceSum(results->memptr(), results->n_elem);
+  *results /= R;
 }
 
+template <typename LossFunction>
 void BanditPAM::build(
   const arma::fmat& data,
-  std::optional<std::reference_wrapper<const arma::fmat>> distMat,
   arma::urowvec* medoidIndices,
-  arma::fmat* medoids) {
+  arma::fmat* medoids,
+  BanditWorkspace* workspace,
+  const LossFunction& loss) {
   size_t N = data.n_cols;
-  arma::frowvec N_mat(N);
-  N_mat.fill(N);
-  size_t p = N;
   bool useAbsolute = true;
   arma::frowvec estimates(N, arma::fill::zeros);
   arma::frowvec bestDistances(N);
@@ -169,161 +383,326 @@ void BanditPAM::build(
   arma::frowvec lcbs(N);
   arma::frowvec ucbs(N);
   arma::frowvec numSamples(N, arma::fill::zeros);
-  arma::frowvec exactMask(N, arma::fill::zeros);
+  arma::urowvec exactMask(N, arma::fill::zeros);
+  // Assume buildConfidence is given in logspace
+  const float adjust = buildConfidence + std::log(static_cast<float>(N));
+  arma::uvec& referencePoints = workspace->referencePoints;
+  arma::uvec& targets = workspace->targets;
+  arma::uvec& exactTargets = workspace->exactTargets;
+  arma::frowvec& results = workspace->buildResults;
 
   // TODO(@motiwari): #pragma omp parallel for if (this->parallelize)?
   for (size_t k = 0; k < nMedoids; k++) {
     // instantiate medoids one-by-one
     permutationIdx = 0;
+    if (useCuda) {
+      cuda.setBestDistances(bestDistances);
+    }
     candidates.fill(1);
     numSamples.fill(0);
     exactMask.fill(0);
     estimates.fill(0);
+    size_t numCandidates = N;
     // compute std dev amongst batch of reference points
-    sigma = buildSigma(data, distMat, bestDistances, useAbsolute);
-
-    while (arma::sum(candidates) > precision) {
-      // TODO(@motiwari): Do not need a matrix for this comparison,
-      //  use broadcasting
-      arma::umat compute_exactly =
-        ((numSamples + batchSize) >= N_mat) != exactMask;
-      if (arma::accu(compute_exactly) > 0) {
-        arma::uvec targets = find(compute_exactly);
-        arma::frowvec result = buildTarget(
+    {
+      ScopedPhaseTimer timer(&profile.sigma);
+      BanditPAM::sampleReferencePoints(N, batchSize, &referencePoints);
+      buildSigma(
+        data,
+        referencePoints,
+        bestDistances,
+        useAbsolute,
+        &sigma,
+        loss);
+    }
+
+    while (numCandidates > precision) {
+      profile.buildArmsPerRound.push_back(numCandidates);
+      const size_t roundBatch =
+        BanditPAM::roundBatchSize(numCandidates, N);
+      // compute exactly if it's been samples more than N times and
+      // hasn't been computed exactly already
+      size_t numExact = 0;
+      for (size_t i = 0; i < N; i++) {
+        numExact += !exactMask(i) && (numSamples(i) + roundBatch >= N);
+      }
+      if (numExact > 0) {
+        exactTargets.set_size(numExact);
+        for (size_t i = 0, t = 0; i < N; i++) {
+          if (!exactMask(i) && (numSamples(i) + roundBatch >= N)) {
+            exactTargets(t++) = i;
+          }
+        }
+        {
+          ScopedPhaseTimer timer(&profile.exactTargets);
+          // These arms survived every round so far, and are likely to be
+          // evaluated again
+          KMedoids::admitCacheColumns(exactTargets);
+          BanditPAM::sampleReferencePoints(N, N, &referencePoints);
+          buildTarget(
+            data,
+            referencePoints,
+            &exactTargets,
+            &bestDistances,
+            useAbsolute,
+            &results,
+            &workspace->partials,
+            loss);
+        }
+        for (size_t t = 0; t < numExact; t++) {
+          const size_t i = exactTargets(t);
+          estimates(i) = results(t);
+          ucbs(i) = results(t);
+          lcbs(i) = results(t);
+          exactMask(i) = 1;
+          numSamples(i) += N;
+          numCandidates -= candidates(i);
+          candidates(i) = 0;
+        }
+      }
+      if (numCandidates < precision) {
+        break;
+      }
+      targets.set_size(numCandidates);
+      for (size_t i = 0, t = 0; i < N; i++) {
+        if (candidates(i)) {
+          targets(t++) = i;
+        }
+      }
+      {
+        ScopedPhaseTimer timer(&profile.targets);
+        BanditPAM::sampleReferencePoints(N, roundBatch, &referencePoints);
+        buildTarget(
           data,
-          distMat,
+          referencePoints,
           &targets,
           &bestDistances,
           useAbsolute,
-          N);
-        estimates.cols(targets) = result;
-        ucbs.cols(targets) = result;
-        lcbs.cols(targets) = result;
-        exactMask.cols(targets).fill(1);
-        numSamples.cols(targets) += N;
-        candidates.cols(targets).fill(0);
+          &results,
+          &workspace->partials,
+          loss);
+      }
+
+      // update the running average and the confidence bounds of the targets
+      #pragma omp parallel for if (this->parallelize) \
+        num_threads(this->threadCount())
+      for (size_t t = 0; t < numCandidates; t++) {
+        const size_t i = targets(t);
+        estimates(i) = ((numSamples(i) * estimates(i)) +
+          (results(t) * roundBatch)) / (roundBatch + numSamples(i));
+        numSamples(i) += roundBatch;
+        const float confBoundDelta =
+          sigma(i) * std::sqrt(adjust / numSamples(i));
+        ucbs(i) = estimates(i) + confBoundDelta;
+        lcbs(i) = estimates(i) - confBoundDelta;
       }
-      if (arma::sum(candidates) < precision) {
+
+      // Points that were not sampled keep their bounds and can become
+      // candidates again, so both passes cover every point
+      float minUcb = std::numeric_limits<float>::infinity();
+      #pragma omp parallel for reduction(min:minUcb) if (this->parallelize) \
+        num_threads(this->threadCount())
+      for (size_t i = 0; i < N; i++) {
+        minUcb = std::min(minUcb, ucbs(i));
+      }
+      numCandidates = 0;
+      #pragma omp parallel for reduction(+:numCandidates) \
+        if (this->parallelize) num_threads(this->threadCount())
+      for (size_t i = 0; i < N; i++) {
+        candidates(i) = (lcbs(i) < minUcb) && !exactMask(i);
+        numCandidates += candidates(i);
+      }
+      if (KMedoids::budgetExhausted()) {
         break;
       }
-      arma::uvec targets = arma::find(candidates);
-      arma::frowvec result = buildTarget(
-        data,
-        distMat,
-        &targets,
-        &bestDistances,
-        useAbsolute,
-        0);
-      // update the running average
-      estimates.cols(targets) =
-        ((numSamples.cols(targets) % estimates.cols(targets)) +
-        (result * batchSize)) /
-        (batchSize + numSamples.cols(targets));
-      numSamples.cols(targets) += batchSize;
-      arma::frowvec adjust(targets.n_rows);
-      adjust.fill(p);
-      // Assume buildConfidence is given in logspace
-      adjust = buildConfidence + arma::log(adjust);
-      arma::frowvec confBoundDelta =
-        sigma.cols(targets) %
-        arma::sqrt(adjust / numSamples.cols(targets));
-      ucbs.cols(targets) = estimates.cols(targets) + confBoundDelta;
-      lcbs.cols(targets) = estimates.cols(targets) - confBoundDelta;
-      candidates = (lcbs < ucbs.min()) && (exactMask == 0);
     }
 
-    medoidIndices->at(k) = lcbs.index_min();
+    // Out of time, the best estimate is a better guess than the best lower
+    // bound, which favors the arms with the fewest samples. The estimates of
+    // the medoids found so far may be as low as any other, e.g., if no round
+    // ran, so they are excluded.
+    if (truncated) {
+      for (size_t m = 0; m < k; m++) {
+        estimates((*medoidIndices)(m)) =
+          std::numeric_limits<float>::infinity();
+      }
+    }
+    medoidIndices->at(k) =
+      truncated ? estimates.index_min() : lcbs.index_min();
     medoids->unsafe_col(k) = data.unsafe_col((*medoidIndices)(k));
 
     // don't need to do this on final iteration
-    #pragma omp parallel for if (this->parallelize)
+    #pragma omp parallel for if (this->parallelize) \
+      num_threads(this->threadCount())
     for (size_t i = 0; i < N; i++) {
         float cost = KMedoids::cachedLoss(
           data,
-          distMat,
           i,
           (*medoidIndices)(k),
-          0);  // 0 for MISC
+          0,  // 0 for MISC
+          loss);
         if (cost < bestDistances(i)) {
             bestDistances(i) = cost;
         }
     }
     // use difference of loss for sigma and sampling, not absolute
     useAbsolute = false;
+    KMedoids::reportProgress("build", k + 1);
   }
 }
 
-arma::fmat BanditPAM::swapSigma(
+template <typename LossFunction>
+void BanditPAM::swapSigma(
   const arma::fmat& data,
-  std::optional<std::reference_wrapper<const arma::fmat>> distMat,
+  const arma::uvec& referencePoints,
   const arma::frowvec* bestDistances,
   const arma::frowvec* secondBestDistances,
-  const arma::urowvec* assignments) {
-  size_t N = data.n_cols;
-  size_t K = nMedoids;
-  arma::fmat updated_sigma(K, N, arma::fill::zeros);
-  arma::uvec referencePoints;
-  // TODO(@motiwari): Make this wraparound properly
-  //  as last batch_size elements are dropped
-  if (usePerm) {
-    if ((permutationIdx + batchSize - 1) >= N) {
-      permutationIdx = 0;
+  const arma::urowvec* assignments,
+  SwapArms* arms,
+  const LossFunction& loss) {
+  const size_t N = data.n_cols;
+  const size_t K = nMedoids;
+  const size_t R = referencePoints.n_elem;
+
+  if (useCuda) {
+    arma::vec sums;
+    arma::vec sumSquares;
+    arma::mat sumAdjustments;
+    arma::mat sumSquareAdjustments;
+    cuda.swapSums(
+      arma::regspace<arma::uvec>(0, N - 1),
+      referencePoints,
+      K,
+      &sums,
+      &sumSquares,
+      &sumAdjustments,
+      &sumSquareAdjustments);
+    for (size_t t = 0; t < N; t++) {
+      for (size_t k = 0; k < K; k++) {
+        arms->arm(k, t).sigma = sampleStddev(
+          sums(t) + sumAdjustments(k, t),
+          sumSquares(t) + sumSquareAdjustments(k, t),
+          R);
+      }
     }
-    // inclusive of both indices
-    referencePoints = permutation.subvec(
-      permutationIdx,
-      permutationIdx + batchSize - 1);
-    permutationIdx += batchSize;
-  } else {
-    referencePoints = arma::randperm(N, batchSize);
+    // 0 for MISC when estimating sigma
+    KMedoids::localCounters().distanceComputations[0] += N * R;
+    return;
   }
 
-  arma::fvec sample(batchSize);
-  // for each considered swap
-  #pragma omp parallel for if (this->parallelize)
-  for (size_t i = 0; i < K * N; i++) {
-    // extract data point of swap
-    size_t n = i / K;
-    size_t k = i % K;
-
-    // calculate change in loss for some subset of the data
-    for (size_t j = 0; j < batchSize; j++) {
-      // 0 for MISC when estimating sigma
-      float cost =
-          KMedoids::cachedLoss(data, distMat, n, referencePoints(j), 0);
-
-      if (k == (*assignments)(referencePoints(j))) {
-        if (cost < (*secondBestDistances)(referencePoints(j))) {
-          sample(j) = cost;
-        } else {
-          sample(j) = (*secondBestDistances)(referencePoints(j));
-        }
-      } else {
-        if (cost < (*bestDistances)(referencePoints(j))) {
-          sample(j) = cost;
-        } else {
-          sample(j) = (*bestDistances)(referencePoints(j));
-        }
+  // The samples of arms (k, n) differ across k only at the reference points
+  // assigned to medoid k, so the distances of each n are computed once and
+  // shared by all K arms: every arm starts from the sums for "point n is not
+  // swapped in for a reference point's medoid", and the reference points
+  // assigned to k adjust the sums of arm k. Each thread owns a block of
+  // targets and keeps its sums in its own workspace.
+  const size_t tileTargets = KMedoids::numTileTargets(N);
+  const size_t numBlocks = (N + tileTargets - 1) / tileTargets;
+  #pragma omp parallel for if (this->parallelize) \
+    num_threads(this->threadCount())
+  for (size_t block = 0; block < numBlocks; block++) {
+    const size_t tStart = block * tileTargets;
+    const size_t T = std::min(N, tStart + tileTargets) - tStart;
+    TileWorkspace& tileWorkspace = KMedoids::localTileWorkspace();
+    tileWorkspace.targets.set_size(T);
+    for (size_t t = 0; t < T; t++) {
+      tileWorkspace.targets(t) = tStart + t;
+    }
+    // 0 for MISC when estimating sigma
+    KMedoids::cachedLossTile(
+      data,
+      tileWorkspace.targets,
+      referencePoints,
+      0,
+      loss,
+      &tileWorkspace.tile);
+
+    arma::vec& sums = tileWorkspace.sums;
+    arma::vec& sumSquares = tileWorkspace.sumSquares;
+    arma::mat& sumAdjustments = tileWorkspace.sumAdjustments;
+    arma::mat& sumSquareAdjustments = tileWorkspace.sumSquareAdjustments;
+    sums.zeros(T);
+    sumSquares.zeros(T);
+    sumAdjustments.zeros(K, T);
+    sumSquareAdjustments.zeros(K, T);
+    for (size_t r = 0; r < R; r++) {
+      const arma::uword j = referencePoints(r);
+      const size_t k = (*assignments)(j);
+      const float bestDistance = (*bestDistances)(j);
+      const float secondBestDistance = (*secondBestDistances)(j);
+      const float weight = weights(j);
+      for (size_t t = 0; t < T; t++) {
+        const float cost = tileWorkspace.tile(t, r);
+        // Sample for the arms whose medoid is not assigned to j, and for
+        // the arm whose medoid is
+        const double sample =
+          weight * ((cost < bestDistance ? cost : bestDistance) - bestDistance);
+        const double assignedSample = weight
+          * ((cost < secondBestDistance ? cost : secondBestDistance)
+            - bestDistance);
+        sums(t) += sample;
+        sumSquares(t) += sample * sample;
+        sumAdjustments(k, t) += assignedSample - sample;
+        sumSquareAdjustments(k, t) +=
+          assignedSample * assignedSample - sample * sample;
+      }
+    }
+    for (size_t t = 0; t < T; t++) {
+      for (size_t k = 0; k < K; k++) {
+        arms->arm(k, tStart + t).sigma = sampleStddev(
+          sums(t) + sumAdjustments(k, t),
+          sumSquares(t) + sumSquareAdjustments(k, t),
+          R);
       }
-      sample(j) -= (*bestDistances)(referencePoints(j));
     }
-    updated_sigma(k, n) = arma::stddev(sample);
   }
-  return updated_sigma;
 }
 
-arma::fmat BanditPAM::swapTarget(
+template <typename LossFunction>
+void BanditPAM::swapTarget(
   const arma::fmat& data,
-  std::optional<std::reference_wrapper<const arma::fmat>> distMat,
-  const arma::urowvec* medoidIndices,
+  const arma::uvec& referencePoints,
   const arma::uvec* targets,
   const arma::frowvec* bestDistances,
   const arma::frowvec* secondBestDistances,
   const arma::urowvec* assignments,
-  const size_t exact = 0) {
-  const size_t N = data.n_cols;
+  arma::fmat* results,
+  arma::fmat* partials,
+  const LossFunction& loss) {
   const size_t T = targets->n_rows;
-  arma::fmat results(nMedoids, T, arma::fill::zeros);
+  const size_t R = referencePoints.n_elem;
+  results->zeros(nMedoids, T);
+  // As in buildTarget, each rank only samples its shard of the reference
+  // points
+  size_t shardBegin;
+  size_t shardEnd;
+  communicator.shard(R, &shardBegin, &shardEnd);
+
+  if (useCuda) {
+    if (shardEnd > shardBegin) {
+      arma::vec sums;
+      arma::mat adjustments;
+      cuda.swapSums(
+        *targets,
+        arma::uvec(referencePoints.subvec(shardBegin, shardEnd - 1)),
+        nMedoids,
+        &sums,
+        nullptr,
+        &adjustments,
+        nullptr);
+      for (size_t t = 0; t < T; t++) {
+        for (size_t k = 0; k < nMedoids; k++) {
+          (*results)(k, t) = sums(t) + adjustments(k, t);
+        }
+      }
+      // 2 for SWAP
+      KMedoids::localCounters().distanceComputations[2] +=
+        T * (shardEnd - shardBegin);
+    }
+    communicator.allReduceSum(results->memptr(), results->n_elem);
+    *results /= R;
+    return;
+  }
 
   // Targets should be a list of indices for target CANDIDATE points
   // Then update all corresponding EXISTING MEDOID indices targets.
@@ -342,87 +721,115 @@ arma::fmat BanditPAM::swapTarget(
   // virtual arms.
   // A jagged array might also do the trick.
 
-
-  size_t tmpBatchSize = batchSize;
-  if (exact > 0) {
-    tmpBatchSize = N;
+  // Distances are evaluated in tiles of targets x reference points, split
+  // into tasks as in buildTarget
+  const size_t tileTargets = KMedoids::numTileTargets(T);
+  const size_t numBlocks = (T + tileTargets - 1) / tileTargets;
+  const size_t shardSize = shardEnd - shardBegin;
+  const size_t chunkReferences =
+    BanditPAM::numChunkReferences(numBlocks, shardSize);
+  const size_t numChunks = std::max(
+    static_cast<size_t>(1),
+    (shardSize + chunkReferences - 1) / chunkReferences);
+  if (numChunks > 1) {
+    BanditPAM::zeroPartials(nMedoids * T, numChunks, partials);
   }
-
-  arma::uvec referencePoints;
-  // TODO(@motiwari): Make this wraparound properly
-  //  as last batch_size elements are dropped
-  // TODO(@motiwari): Break this duplicated code into a function
-  if (usePerm) {
-    if ((permutationIdx + tmpBatchSize - 1) >= N) {
-      permutationIdx = 0;
+  const auto evaluateTask = [&](const size_t task) {
+    const size_t block = task / numChunks;
+    const size_t chunk = task % numChunks;
+    // A view of this chunk's nMedoids x T sums, without copying
+    arma::fmat sums(
+      numChunks > 1 ? partials->colptr(chunk) : results->memptr(),
+      nMedoids,
+      T,
+      false,
+      true);
+    const size_t tStart = block * tileTargets;
+    const size_t tEnd = std::min(T, tStart + tileTargets);
+    const size_t chunkBegin = shardBegin + chunk * chunkReferences;
+    const size_t chunkEnd = std::min(shardEnd, chunkBegin + chunkReferences);
+    TileWorkspace& tileWorkspace = KMedoids::localTileWorkspace();
+    tileWorkspace.targets.set_size(tEnd - tStart);
+    for (size_t t = tStart; t < tEnd; t++) {
+      tileWorkspace.targets(t - tStart) = (*targets)(t);
     }
-    // inclusive of both indices
-    referencePoints = permutation.subvec(
-      permutationIdx,
-      permutationIdx + tmpBatchSize - 1);
-    permutationIdx += tmpBatchSize;
-  } else {
-    referencePoints = arma::randperm(N, tmpBatchSize);
-  }
-
-  // TODO(@motiwari): Declare variables outside of loops
-  #pragma omp parallel for if (this->parallelize)
-  for (size_t i = 0; i < T; i++) {
-    // TODO(@motiwari): pragma omp parallel for?
-    for (size_t j = 0; j < tmpBatchSize; j++) {
-      float cost =
-          KMedoids::cachedLoss(
-              data,
-              distMat,
-              (*targets)(i),
-              referencePoints(j),
-              2);  // 2 for SWAP
-      size_t k = (*assignments)(referencePoints(j));
-      if (cost < (*bestDistances)(referencePoints(j))) {
-          // We might be able to change this to .eachrow(every column but k)
-          // since arma does this in-place and it should not introduce
-          // complexity
-          results.col(i) += cost - (*bestDistances)(referencePoints(j));
+    const arma::fmat& tile = tileWorkspace.tile;
+    for (size_t rStart = chunkBegin; rStart < chunkEnd;
+      rStart += maxTileReferences) {
+      const size_t rEnd = std::min(chunkEnd, rStart + maxTileReferences);
+      tileWorkspace.referencePoints.set_size(rEnd - rStart);
+      for (size_t r = rStart; r < rEnd; r++) {
+        tileWorkspace.referencePoints(r - rStart) = referencePoints(r);
       }
-
-      // If cost < bd, this second term will subtract off the "new cost"
-      // added by the all-column call above inside the if
-      results(k, i) +=
-        std::fmin(cost, (*secondBestDistances)(referencePoints(j))) -
-          std::fmin(cost, (*bestDistances)(referencePoints(j)));
+      KMedoids::cachedLossTile(
+        data,
+        tileWorkspace.targets,
+        tileWorkspace.referencePoints,
+        2,  // 2 for SWAP
+        loss,
+        &tileWorkspace.tile);
+      for (size_t r = 0; r < tile.n_cols; r++) {
+        const arma::uword j = referencePoints(rStart + r);
+        const size_t k = (*assignments)(j);
+        const float bestDistance = (*bestDistances)(j);
+        const float secondBestDistance = (*secondBestDistances)(j);
+        const float weight = weights(j);
+        for (size_t t = 0; t < tile.n_rows; t++) {
+          const size_t i = tStart + t;
+          const float cost = tile(t, r);
+          if (cost < bestDistance) {
+            // We might be able to change this to .eachrow(every column but
+            // k) since arma does this in-place and it should not introduce
+            // complexity
+            sums.col(i) += weight * (cost - bestDistance);
+          }
+
+          // If cost < bd, this second term will subtract off the "new cost"
+          // added by the all-column call above inside the if
+          sums(k, i) += weight * (std::fmin(cost, secondBestDistance) -
+            std::fmin(cost, bestDistance));
+        }
+      }
+    }
+  };
+  BanditPAM::runTasks(numBlocks * numChunks, evaluateTask);
+  for (size_t chunk = 0; numChunks > 1 && chunk < numChunks; chunk++) {
+    const float* sums = partials->colptr(chunk);
+    for (size_t e = 0; e < results->n_elem; e++) {
+      (*results)(e) += sums[e];
     }
   }
+  communicator.allReduceSum(results->memptr(), results->n_elem);
   // TODO(@motiwari): we can probably avoid this division
   //  if we look at total loss, not average loss
-  results /= tmpBatchSize;
-  return results;
+  *results /= R;
 }
 
+template <typename LossFunction>
 void BanditPAM::swap(
   const arma::fmat& data,
-  std::optional<std::reference_wrapper<const arma::fmat>> distMat,
   arma::urowvec* medoidIndices,
   arma::fmat* medoids,
-  arma::urowvec* assignments) {
+  arma::urowvec* assignments,
+  BanditWorkspace* workspace,
+  const LossFunction& loss) {
   size_t N = data.n_cols;
   size_t p = N;
 
-  arma::fmat sigma(nMedoids, N, arma::fill::zeros);
-
   arma::frowvec bestDistances(N);
   arma::frowvec secondBestDistances(N);
   bool swapPerformed = true;
-  arma::umat candidates(nMedoids, N, arma::fill::ones);
-  arma::umat exactMask(nMedoids, N, arma::fill::zeros);
-  arma::fmat estimates(nMedoids, N, arma::fill::zeros);
-  arma::fmat lcbs(nMedoids, N);
-  arma::fmat ucbs(nMedoids, N);
-  arma::umat numSamples(nMedoids, N, arma::fill::zeros);
+  SwapArms& arms = workspace->arms;
+  arma::uvec& referencePoints = workspace->referencePoints;
+  arma::uvec& targets = workspace->targets;
+  arma::uvec& exactTargets = workspace->exactTargets;
+  arma::fmat& results = workspace->swapResults;
+  // Assume swapConfidence is given in logspace
+  const float adjust = swapConfidence + std::log(static_cast<float>(p));
 
   // calculate quantities needed for swap, bestDistances and sigma
   calcBestDistancesSwap(
     data,
-    distMat,
     medoidIndices,
     &bestDistances,
     &secondBestDistances,
@@ -430,126 +837,152 @@ void BanditPAM::swap(
     swapPerformed);
 
   // continue making swaps while loss is decreasing
-  while (swapPerformed && steps < maxIter) {
+  while (swapPerformed && steps < maxIter && !KMedoids::budgetExhausted()) {
     steps++;
     permutationIdx = 0;
-
-    sigma = swapSigma(
-      data,
-      distMat,
-      &bestDistances,
-      &secondBestDistances,
-      assignments);
+    profile.swapSteps.emplace_back();
+    ScopedPhaseTimer stepTimer(&profile.swapSteps.back());
 
     // Reset variables when starting a new swap
-    candidates.fill(1);
-    exactMask.fill(0);
-    estimates.fill(0);
-    numSamples.fill(0);
+    arms.reset(nMedoids, N, KMedoids::threadCount());
+    {
+      ScopedPhaseTimer timer(&profile.sigma);
+      BanditPAM::sampleReferencePoints(N, batchSize, &referencePoints);
+      swapSigma(
+        data,
+        referencePoints,
+        &bestDistances,
+        &secondBestDistances,
+        assignments,
+        &arms,
+        loss);
+    }
 
     // while there is at least one candidate (float comparison issues)
-    while (arma::accu(candidates) > 1.5) {
+    while (arms.getNumCandidates() > 1 && !KMedoids::budgetExhausted()) {
+      profile.swapArmsPerRound.push_back(arms.getNumCandidates());
+      const std::vector<uint32_t>& activeColumns = arms.getActiveColumns();
+      const size_t roundBatch =
+        BanditPAM::roundBatchSize(activeColumns.size(), N);
+
       // compute exactly if it's been samples more than N times and
-      // hasn't been computed exactly already
-      arma::umat compute_exactly =
-        ((numSamples + batchSize) >= N) != (exactMask);
-
-      // Get unique candidate medoids from the candidates (second index)
-      // Store all k x T in estimates
-      // TODO(@motiwari): Move this declaration outside loop
-      // Need unique values over second index
-      // Sum the different columns
-      // if any index appears in at least one, compute it exactly
-      // TODO(@motiwari): make sure we're only computing exactly
-      // for the relevant candidates
-      arma::uvec compute_exactly_targets =
-        arma::find(arma::sum(compute_exactly, 0) >= 1);
-
-      if (compute_exactly_targets.size() > 0) {
-        arma::fmat result = swapTarget(
-          data,
-          distMat,
-          medoidIndices,
-          &compute_exactly_targets,
-          &bestDistances,
-          &secondBestDistances,
-          assignments,
-          N);
+      // hasn't been computed exactly already. Active columns always have a
+      // candidate, so they have not been computed exactly yet.
+      size_t numExact = 0;
+      for (const uint32_t n : activeColumns) {
+        numExact += arms.getNumSamples(n) + roundBatch >= N;
+      }
 
-        // result will be k x T
+      if (numExact > 0) {
+        exactTargets.set_size(numExact);
+        size_t idx = 0;
+        for (const uint32_t n : activeColumns) {
+          if (arms.getNumSamples(n) + roundBatch >= N) {
+            exactTargets(idx++) = n;
+          }
+        }
+        {
+          ScopedPhaseTimer timer(&profile.exactTargets);
+          // These arms survived every round so far, and are likely to be
+          // evaluated again
+          KMedoids::admitCacheColumns(exactTargets);
+          BanditPAM::sampleReferencePoints(N, N, &referencePoints);
+          swapTarget(
+            data,
+            referencePoints,
+            &exactTargets,
+            &bestDistances,
+            &secondBestDistances,
+            assignments,
+            &results,
+            &workspace->partials,
+            loss);
+        }
+
+        // results will be k x T
         // Now update the correct indices
-        estimates.cols(compute_exactly_targets) = result;
-        ucbs.cols(compute_exactly_targets) = result;
-        lcbs.cols(compute_exactly_targets) = result;
-        exactMask.cols(compute_exactly_targets).fill(1);
-        numSamples.cols(compute_exactly_targets) += N;
-        candidates = (lcbs < ucbs.min()) && (exactMask == 0);
+        for (size_t t = 0; t < numExact; t++) {
+          const size_t n = exactTargets(t);
+          for (size_t k = 0; k < nMedoids; k++) {
+            arms.arm(k, n).estimate = results(k, t);
+          }
+          arms.addSamples(n, N);
+          arms.setExact(n);
+        }
+        arms.eliminate(adjust);
       }
-      if (arma::accu(candidates) < precision) {
+      if (arms.getNumCandidates() == 0) {
         break;
       }
 
-      // candidate_targets should be of size T
-      // Sum the different columns
-      // if any index appears in at least one column, sample it
-      arma::uvec candidate_targets = arma::find(arma::sum(candidates, 0) >= 1);
+      // Sample every column that still holds a candidate
+      targets.set_size(activeColumns.size());
+      for (size_t t = 0; t < activeColumns.size(); t++) {
+        targets(t) = activeColumns[t];
+      }
 
-      // result will be k x T
-      arma::fmat result = swapTarget(
-        data,
-        distMat,
-        medoidIndices,
-        &candidate_targets,
-        &bestDistances,
-        &secondBestDistances,
-        assignments,
-        0);
-
-      // candidate_targets should be of size T, 1
-      estimates.cols(candidate_targets) =
-        ((numSamples.cols(candidate_targets)
-        % estimates.cols(candidate_targets))
-        + (result * batchSize)) / (batchSize +
-          numSamples.cols(candidate_targets));
-
-      // numSamples should be k x N
-      // select the T of N columns that are candidates
-      numSamples.cols(candidate_targets) += batchSize;
-
-      arma::fmat adjust(nMedoids, candidate_targets.size());
-      // TODO(@motiwari): Move this ::fill to the previous line
-      adjust.fill(p);
-      // Assume swapConfidence is given in logspace
-      adjust = swapConfidence + arma::log(adjust);
-      arma::fmat confBoundDelta = sigma.cols(candidate_targets) %
-        arma::sqrt(adjust / numSamples.cols(candidate_targets));
-      ucbs.cols(candidate_targets) = estimates.cols(candidate_targets)
-        + confBoundDelta;
-      lcbs.cols(candidate_targets) = estimates.cols(candidate_targets)
-        - confBoundDelta;
-
-      candidates = (lcbs < ucbs.min()) && (exactMask == 0);
+      // results will be k x T
+      {
+        ScopedPhaseTimer timer(&profile.targets);
+        BanditPAM::sampleReferencePoints(N, roundBatch, &referencePoints);
+        swapTarget(
+          data,
+          referencePoints,
+          &targets,
+          &bestDistances,
+          &secondBestDistances,
+          assignments,
+          &results,
+          &workspace->partials,
+          loss);
+      }
+
+      // update the running average of the candidate arms, and find the
+      // minimum upper confidence bound of the candidates along the way
+      float candidateMinUcb = std::numeric_limits<float>::infinity();
+      #pragma omp parallel for reduction(min:candidateMinUcb) \
+        if (this->parallelize) num_threads(this->threadCount())
+      for (size_t t = 0; t < targets.n_elem; t++) {
+        const size_t n = targets(t);
+        const float numSamples = arms.getNumSamples(n);
+        arms.addSamples(n, roundBatch);
+        for (size_t k = 0; k < nMedoids; k++) {
+          if (arms.isCandidate(k, n)) {
+            float& estimate = arms.arm(k, n).estimate;
+            estimate = ((numSamples * estimate) + (results(k, t) * roundBatch))
+              / (roundBatch + numSamples);
+            candidateMinUcb = std::min(
+              candidateMinUcb,
+              arms.upperConfidenceBound(k, n, adjust));
+          }
+        }
+      }
+
+      arms.eliminate(adjust, candidateMinUcb);
     }
 
-    // Perform the medoid switch
-    arma::uword newMedoid = lcbs.index_min();
+    // Perform the medoid switch, unless the step ran out of time before
+    // the best swap was identified
+    const bool identified = arms.getNumCandidates() <= 1;
+    size_t newMedoid = arms.bestArm(adjust);
     size_t k = newMedoid % nMedoids;
     size_t n = newMedoid / nMedoids;
-    swapPerformed = (*medoidIndices)(k) != n;
+    swapPerformed = identified && (*medoidIndices)(k) != n;
 
     if (swapPerformed) {
       (*medoidIndices)(k) = n;
       medoids->col(k) = data.col((*medoidIndices)(k));
     }
 
-    calcBestDistancesSwap(
+    updateBestDistancesSwap(
       data,
-      distMat,
       medoidIndices,
+      k,
       &bestDistances,
       &secondBestDistances,
       assignments,
       swapPerformed);
+    KMedoids::reportProgress("swap", steps);
   }
 }
 }  // namespace km
@@ -14,47 +14,36 @@
 
 namespace km {
 void BanditPAM_orig::fitBanditPAM_orig(
-  const arma::fmat& inputData,
-  std::optional<std::reference_wrapper<const arma::fmat>> distMat) {
-  data = arma::trans(inputData);
-
+  const arma::fmat& data) {
   // Note: even if we are using a distance matrix, we compute the permutation
   // in the block below because it is used elsewhere in the call stack
   // TODO(@motiwari): Remove need for data or permutation through when using
   //  a distance matrix
   if (this->useCache) {
-    size_t n = data.n_cols;
-    size_t m = fmin(n, cacheWidth);
-    cache = new float[n * m];
-
-    #pragma omp parallel for if (this->parallelize)
-    for (size_t idx = 0; idx < m*n; idx++) {
-      cache[idx] = -1;  // TODO(@motiwari): need better value here
-    }
-
-    permutation = arma::randperm(n);
+    permutation = arma::randperm(data.n_cols);
     permutationIdx = 0;
-    reindex = {};  // TODO(@motiwari): Can this intialization be removed?
-    // TODO(@motiwari): Can we parallelize this?
-    for (size_t counter = 0; counter < m; counter++) {
-      reindex[permutation[counter]] = counter;
-    }
+    KMedoids::initializeCache(data.n_cols);
 }
 
   arma::fmat medoidMatrix(data.n_rows, nMedoids);
   arma::urowvec medoidIndices(nMedoids);
   steps = 0;
-  BanditPAM_orig::build(data, distMat, &medoidIndices, &medoidMatrix);
+  {
+    ScopedPhaseTimer timer(&profile.build);
+    BanditPAM_orig::build(data, &medoidIndices, &medoidMatrix);
+  }
 
   medoidIndicesBuild = medoidIndices;
   arma::urowvec assignments(data.n_cols);
 
-  BanditPAM_orig::swap(
-      data,
-      distMat,
-      &medoidIndices,
-      &medoidMatrix,
-      &assignments);
+  {
+    ScopedPhaseTimer timer(&profile.swap);
+    BanditPAM_orig::swap(
+        data,
+        &medoidIndices,
+        &medoidMatrix,
+        &assignments);
+  }
 
   medoidIndicesFinal = medoidIndices;
   labels = assignments;
@@ -62,7 +51,6 @@ void BanditPAM_orig::fitBanditPAM_orig(
 
 arma::frowvec BanditPAM_orig::buildSigma(
   const arma::fmat& data,
-  std::optional<std::reference_wrapper<const arma::fmat>> distMat,
   const arma::frowvec& bestDistances,
   const bool useAbsolute) {
   size_t N = data.n_cols;
@@ -84,12 +72,13 @@ arma::frowvec BanditPAM_orig::buildSigma(
 
   arma::fvec sample(batchSize);
   arma::frowvec updated_sigma(N);
-  #pragma omp parallel for if (this->parallelize)
+  #pragma omp parallel for if (this->parallelize) \
+    num_threads(this->threadCount())
   for (size_t i = 0; i < N; i++) {
     for (size_t j = 0; j < batchSize; j++) {
       // 0 for MISC
       float cost =
-          KMedoids::cachedLoss(data, distMat, i, referencePoints(j), 0);
+          KMedoids::cachedLoss(data, i, referencePoints(j), 0);
       if (useAbsolute) {
         sample(j) = cost;
       } else {
@@ -105,7 +94,6 @@ arma::frowvec BanditPAM_orig::buildSigma(
 
 arma::frowvec BanditPAM_orig::buildTarget(
   const arma::fmat& data,
-  std::optional<std::reference_wrapper<const arma::fmat>> distMat,
   const arma::uvec* target,
   const arma::frowvec* bestDistances,
   const bool useAbsolute,
@@ -132,14 +120,14 @@ arma::frowvec BanditPAM_orig::buildTarget(
     referencePoints = arma::randperm(N, tmpBatchSize);
   }
 
-  #pragma omp parallel for if (this->parallelize)
+  #pragma omp parallel for if (this->parallelize) \
+    num_threads(this->threadCount())
   for (size_t i = 0; i < target->n_rows; i++) {
     float total = 0;
     for (size_t j = 0; j < referencePoints.n_rows; j++) {
       float cost =
           KMedoids::cachedLoss(
               data,
-              distMat,
               (*target)(i),
               referencePoints(j),
               1);  // 1 for BUILD
@@ -158,7 +146,6 @@ arma::frowvec BanditPAM_orig::buildTarget(
 
 void BanditPAM_orig::build(
   const arma::fmat& data,
-  std::optional<std::reference_wrapper<const arma::fmat>> distMat,
   arma::urowvec* medoidIndices,
   arma::fmat* medoids) {
   size_t N = data.n_cols;
@@ -185,7 +172,7 @@ void BanditPAM_orig::build(
     exactMask.fill(0);
     estimates.fill(0);
     // compute std dev amongst batch of reference points
-    sigma = buildSigma(data, distMat, bestDistances, useAbsolute);
+    sigma = buildSigma(data, bestDistances, useAbsolute);
 
     while (arma::sum(candidates) > precision) {
       // TODO(@motiwari): Do not need a matrix for this comparison,
@@ -196,7 +183,6 @@ void BanditPAM_orig::build(
         arma::uvec targets = find(compute_exactly);
         arma::frowvec result = buildTarget(
           data,
-          distMat,
           &targets,
           &bestDistances,
           useAbsolute,
@@ -214,7 +200,6 @@ void BanditPAM_orig::build(
       arma::uvec targets = arma::find(candidates);
       arma::frowvec result = buildTarget(
         data,
-        distMat,
         &targets,
         &bestDistances,
         useAbsolute,
@@ -241,11 +226,11 @@ void BanditPAM_orig::build(
     medoids->unsafe_col(k) = data.unsafe_col((*medoidIndices)(k));
 
     // don't need to do this on final iteration
-    #pragma omp parallel for if (this->parallelize)
+    #pragma omp parallel for if (this->parallelize) \
+      num_threads(this->threadCount())
     for (size_t i = 0; i < N; i++) {
       float cost = KMedoids::cachedLoss(
         data,
-        distMat,
         i,
         (*medoidIndices)(k),
         0);  // 0 for MISC
@@ -260,7 +245,6 @@ void BanditPAM_orig::build(
 
 arma::fmat BanditPAM_orig::swapSigma(
   const arma::fmat& data,
-  std::optional<std::reference_wrapper<const arma::fmat>> distMat,
   const arma::frowvec* bestDistances,
   const arma::frowvec* secondBestDistances,
   const arma::urowvec* assignments) {
@@ -285,7 +269,8 @@ arma::fmat BanditPAM_orig::swapSigma(
 
   arma::fvec sample(batchSize);
   // for each considered swap
-  #pragma omp parallel for if (this->parallelize)
+  #pragma omp parallel for if (this->parallelize) \
+    num_threads(this->threadCount())
   for (size_t i = 0; i < K * N; i++) {
     // extract data point of swap
     size_t n = i / K;
@@ -295,7 +280,7 @@ arma::fmat BanditPAM_orig::swapSigma(
     for (size_t j = 0; j < batchSize; j++) {
       // 0 for MISC when estimating sigma
       float cost =
-          KMedoids::cachedLoss(data, distMat, n, referencePoints(j), 0);
+          KMedoids::cachedLoss(data, n, referencePoints(j), 0);
 
       if (k == (*assignments)(referencePoints(j))) {
         if (cost < (*secondBestDistances)(referencePoints(j))) {
@@ -319,7 +304,6 @@ arma::fmat BanditPAM_orig::swapSigma(
 
 arma::fvec BanditPAM_orig::swapTarget(
   const arma::fmat& data,
-  std::optional<std::reference_wrapper<const arma::fmat>> distMat,
   const arma::urowvec* medoidIndices,
   const arma::uvec* targets,
   const arma::frowvec* bestDistances,
@@ -352,7 +336,8 @@ arma::fvec BanditPAM_orig::swapTarget(
   }
 
   // TODO(@motiwari): Declare variables outside of loops
-  #pragma omp parallel for if (this->parallelize)
+  #pragma omp parallel for if (this->parallelize) \
+    num_threads(this->threadCount())
   for (size_t i = 0; i < targets->n_rows; i++) {
     float total = 0;
     // extract data point of swap
@@ -362,7 +347,7 @@ arma::fvec BanditPAM_orig::swapTarget(
     for (size_t j = 0; j < tmpBatchSize; j++) {
       // 2 for SWAP
       float cost =
-          KMedoids::cachedLoss(data, distMat, n, referencePoints(j), 2);
+          KMedoids::cachedLoss(data, n, referencePoints(j), 2);
       if (k == (*assignments)(referencePoints(j))) {
         if (cost < (*secondBestDistances)(referencePoints(j))) {
           total += cost;
@@ -387,7 +372,6 @@ arma::fvec BanditPAM_orig::swapTarget(
 
 void BanditPAM_orig::swap(
   const arma::fmat& data,
-  std::optional<std::reference_wrapper<const arma::fmat>> distMat,
   arma::urowvec* medoidIndices,
   arma::fmat* medoids,
   arma::urowvec* assignments) {
@@ -409,7 +393,6 @@ void BanditPAM_orig::swap(
   // calculate quantities needed for swap, bestDistances and sigma
   calcBestDistancesSwap(
     data,
-    distMat,
     medoidIndices,
     &bestDistances,
     &secondBestDistances,
@@ -423,7 +406,6 @@ void BanditPAM_orig::swap(
 
     sigma = swapSigma(
       data,
-      distMat,
       &bestDistances,
       &secondBestDistances,
       assignments);
@@ -445,7 +427,6 @@ void BanditPAM_orig::swap(
       if (targets.size() > 0) {
         arma::fvec result = swapTarget(
           data,
-          distMat,
           medoidIndices,
           &targets,
           &bestDistances,
@@ -465,7 +446,6 @@ void BanditPAM_orig::swap(
       targets = arma::find(candidates);
       arma::fvec result = swapTarget(
           data,
-          distMat,
           medoidIndices,
           &targets,
           &bestDistances,
@@ -502,7 +482,6 @@ void BanditPAM_orig::swap(
     }
     calcBestDistancesSwap(
       data,
-      distMat,
       medoidIndices,
       &bestDistances,
       &secondBestDistances,
@@ -0,0 +1,107 @@
+/**
+ * @file communicator.cpp
+ * @date 2026-10-14
+ *
+ * Contains the MPI calls used by distributed fits, which compile to a
+ * single rank when BanditPAM is built without MPI.
+ */
+
+#include "communicator.hpp"
+
+#include <algorithm>
+#include <climits>
+#include <cstdlib>
+#include <stdexcept>
+
+#ifdef BANDITPAM_USE_MPI
+#include <mpi.h>
+#endif
+
+namespace km {
+namespace {
+#ifdef BANDITPAM_USE_MPI
+// Finalizes MPI at exit if BanditPAM was the one to initialize it
+void finalizeMPI() {
+  int finalized = 0;
+  MPI_Finalized(&finalized);
+  if (!finalized) {
+    MPI_Finalize();
+  }
+}
+#endif
+}  // namespace
+
+bool Communicator::isAvailable() {
+#ifdef BANDITPAM_USE_MPI
+  return true;
+#else
+  return false;
+#endif
+}
+
+void Communicator::join() {
+#ifdef BANDITPAM_USE_MPI
+  int initialized = 0;
+  MPI_Initialized(&initialized);
+  if (!initialized) {
+    // Only the thread that calls into BanditPAM makes MPI calls, never from
+    // within parallel regions
+    int provided = 0;
+    MPI_Init_thread(nullptr, nullptr, MPI_THREAD_FUNNELED, &provided);
+    std::atexit(finalizeMPI);
+  }
+  int worldRank = 0;
+  int worldSize = 1;
+  MPI_Comm_rank(MPI_COMM_WORLD, &worldRank);
+  MPI_Comm_size(MPI_COMM_WORLD, &worldSize);
+  rank = worldRank;
+  size = worldSize;
+  joined = true;
+#else
+  throw std::invalid_argument(
+    "Distributed fits require BanditPAM to be built with MPI support");
+#endif
+}
+
+void Communicator::leave() {
+  joined = false;
+  rank = 0;
+  size = 1;
+}
+
+void Communicator::allReduceSum(float* values, const size_t n) const {
+  if (size == 1) {
+    return;
+  }
+#ifdef BANDITPAM_USE_MPI
+  // MPI counts are ints, so very large arrays are reduced in chunks
+  for (size_t start = 0; start < n; start += INT_MAX) {
+    const int count = static_cast<int>(std::min<size_t>(INT_MAX, n - start));
+    MPI_Allreduce(
+      MPI_IN_PLACE,
+      values + start,
+      count,
+      MPI_FLOAT,
+      MPI_SUM,
+      MPI_COMM_WORLD);
+  }
+#else
+  // A build without MPI only ever has one rank
+  (void) values;
+  (void) n;
+#endif
+}
+
+bool Communicator::anyRank(const bool value) const {
+  if (size == 1) {
+    return value;
+  }
+#ifdef BANDITPAM_USE_MPI
+  int local = value ? 1 : 0;
+  MPI_Allreduce(MPI_IN_PLACE, &local, 1, MPI_INT, MPI_LOR, MPI_COMM_WORLD);
+  return local != 0;
+#else
+  return value;
+#endif
+}
+}  // namespace km
@@ -0,0 +1,77 @@
+/**
+ * @file cuda_backend.cpp
+ * @date 2026-10-14
+ *
+ * Contains the CUDA backend of builds without CUDA support, which is never
+ * available. Builds with -DBANDITPAM_CUDA=ON use cuda_backend.cu instead.
+ */
+
+#include "cuda_backend.hpp"
+
+#include <stdexcept>
+
+#ifndef BANDITPAM_USE_CUDA
+namespace km {
+namespace {
+// Thrown by every member of the backend other than isAvailable()
+[[noreturn]] void unavailable() {
+  throw std::invalid_argument(
+    "The CUDA backend requires BanditPAM to be built with CUDA support");
+}
+}  // namespace
+
+struct CudaBackend::Device {};
+
+bool CudaBackend::isAvailable() {
+  return false;
+}
+
+CudaBackend::CudaBackend() = default;
+
+CudaBackend::~CudaBackend() = default;
+
+void CudaBackend::reset(
+  const arma::fmat& /* points */,
+  const arma::frowvec& /* weights */,
+  const CudaLoss /* loss */,
+  const size_t /* p */) {
+  unavailable();
+}
+
+void CudaBackend::release() {
+  device.reset();
+}
+
+void CudaBackend::setBestDistances(const arma::frowvec& /* bestDistances */) {
+  unavailable();
+}
+
+void CudaBackend::assign(
+  const arma::urowvec& /* medoidIndices */,
+  arma::frowvec* /* bestDistances */,
+  arma::frowvec* /* secondBestDistances */,
+  arma::urowvec* /* assignments */) {
+  unavailable();
+}
+
+void CudaBackend::buildSums(
+  const arma::uvec& /* targets */,
+  const arma::uvec& /* referencePoints */,
+  const bool /* useAbsolute */,
+  arma::vec* /* sums */,
+  arma::vec* /* sumSquares */) {
+  unavailable();
+}
+
+void CudaBackend::swapSums(
+  const arma::uvec& /* targets */,
+  const arma::uvec& /* referencePoints */,
+  const size_t /* nMedoids */,
+  arma::vec* /* sums */,
+  arma::vec* /* sumSquares */,
+  arma::mat* /* adjustments */,
+  arma::mat* /* squareAdjustments */) {
+  unavailable();
+}
+}  // namespace km
+#endif
@@ -0,0 +1,563 @@
+/**
+ * @file cuda_backend.cu
+ * @date 2026-10-14
+ *
+ * Contains the CUDA kernels of the bandit rounds of BanditPAM and of the
+ * assignment of the points to their medoids.
+ */
+
+#include "cuda_backend.hpp"
+
+#include <cuda_runtime.h>
+
+#include <cmath>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace km {
+namespace {
+// Threads per block of every kernel
+constexpr int threadsPerBlock = 128;
+
+// Features of a reference point or medoid that a block stages in shared
+// memory at a time
+constexpr int featureChunk = 256;
+
+// Throws if the given CUDA call failed
+void check(const cudaError_t status) {
+  if (status != cudaSuccess) {
+    throw std::runtime_error(
+      std::string("CUDA error: ") + cudaGetErrorString(status));
+  }
+}
+
+/**
+ * @brief A buffer in device memory that keeps its allocation when resized
+ * to the same or a smaller size
+ */
+template <typename T>
+class DeviceArray {
+ public:
+  DeviceArray() = default;
+
+  ~DeviceArray() {
+    cudaFree(data);
+  }
+
+  DeviceArray(const DeviceArray&) = delete;
+
+  DeviceArray& operator=(const DeviceArray&) = delete;
+
+  void resize(const size_t n) {
+    if (n > capacity) {
+      cudaFree(data);
+      data = nullptr;
+      capacity = 0;
+      check(cudaMalloc(&data, n * sizeof(T)));
+      capacity = n;
+    }
+    size = n;
+  }
+
+  void upload(const T* values, const size_t n) {
+    resize(n);
+    check(cudaMemcpy(data, values, n * sizeof(T), cudaMemcpyHostToDevice));
+  }
+
+  void download(T* values) const {
+    check(cudaMemcpy(values, data, size * sizeof(T), cudaMemcpyDeviceToHost));
+  }
+
+  void zero() {
+    check(cudaMemset(data, 0, size * sizeof(T)));
+  }
+
+  /// The device memory
+  T* data = nullptr;
+
+  /// Number of elements in use
+  size_t size = 0;
+
+ private:
+  /// Number of elements allocated
+  size_t capacity = 0;
+};
+
+/**
+ * @brief The distance of a fit, computed feature by feature as in the
+ * metrics of quantized_matrix.hpp
+ */
+struct DeviceMetric {
+  /// The distance to compute
+  CudaLoss loss;
+
+  /// The value of p of an Lp distance
+  float p;
+
+  /// The L2 norm of each point, for the cosine distance
+  const float* norms;
+
+  __device__ float step(const float total, const float x, const float y)
+    const {
+    switch (loss) {
+      case CudaLoss::l1:
+        return total + fabsf(x - y);
+      case CudaLoss::l2:
+        return total + (x - y) * (x - y);
+      case CudaLoss::lp:
+        return total + powf(fabsf(x - y), p);
+      case CudaLoss::lInf:
+        return fmaxf(total, fabsf(x - y));
+      default:
+        return total + x * y;
+    }
+  }
+
+  __device__ float finish(const float total, const size_t i, const size_t j)
+    const {
+    switch (loss) {
+      case CudaLoss::l2:
+        return sqrtf(total);
+      case CudaLoss::lp:
+        return powf(total, 1.0f / p);
+      case CudaLoss::cosine:
+        return 1 - total / (norms[i] * norms[j]);
+      default:
+        return total;
+    }
+  }
+};
+
+/**
+ * @brief Returns the distance between the point owned by the calling
+ * thread and point j, which the whole block computes together
+ *
+ * Every thread of the block must call it with the same j, since the
+ * features of j are staged in shared memory.
+ */
+__device__ float blockDistance(
+  const DeviceMetric& metric,
+  const float* points,
+  const size_t d,
+  const bool active,
+  const size_t i,
+  const size_t j,
+  float* staged) {
+  const float* x = points + i * d;
+  const float* y = points + j * d;
+  float total = 0;
+  for (size_t start = 0; start < d; start += featureChunk) {
+    const size_t count = min(static_cast<size_t>(featureChunk), d - start);
+    __syncthreads();
+    for (size_t f = threadIdx.x; f < count; f += blockDim.x) {
+      staged[f] = y[start + f];
+    }
+    __syncthreads();
+    if (active) {
+      for (size_t f = 0; f < count; f++) {
+        total = metric.step(total, x[start + f], staged[f]);
+      }
+    }
+  }
+  return active ? metric.finish(total, i, j) : 0;
+}
+
+// The L2 norm of each point
+__global__ void normsKernel(
+  const float* points,
+  const size_t d,
+  const size_t n,
+  float* norms) {
+  const size_t i = blockIdx.x * static_cast<size_t>(blockDim.x)
+    + threadIdx.x;
+  if (i >= n) {
+    return;
+  }
+  float total = 0;
+  for (size_t f = 0; f < d; f++) {
+    total += points[i * d + f] * points[i * d + f];
+  }
+  norms[i] = sqrtf(total);
+}
+
+// The best and second best medoid of each point; ties are broken towards
+// lower medoid indices, as on the host
+__global__ void assignKernel(
+  const DeviceMetric metric,
+  const float* points,
+  const size_t d,
+  const size_t n,
+  const uint32_t* medoids,
+  const size_t K,
+  float* best,
+  float* second,
+  uint32_t* assignments) {
+  __shared__ float staged[featureChunk];
+  const size_t i = blockIdx.x * static_cast<size_t>(blockDim.x)
+    + threadIdx.x;
+  const bool active = i < n;
+  float bestCost = INFINITY;
+  float secondCost = INFINITY;
+  uint32_t assignment = 0;
+  for (size_t k = 0; k < K; k++) {
+    const float cost =
+      blockDistance(metric, points, d, active, i, medoids[k], staged);
+    if (cost < bestCost) {
+      secondCost = bestCost;
+      bestCost = cost;
+      assignment = static_cast<uint32_t>(k);
+    } else if (cost < secondCost) {
+      secondCost = cost;
+    }
+  }
+  if (active) {
+    best[i] = bestCost;
+    second[i] = secondCost;
+    assignments[i] = assignment;
+  }
+}
+
+// The sums of the BUILD samples of each target
+__global__ void buildSumsKernel(
+  const DeviceMetric metric,
+  const float* points,
+  const size_t d,
+  const uint32_t* targets,
+  const size_t T,
+  const uint32_t* references,
+  const size_t R,
+  const float* weights,
+  const float* best,
+  const bool useAbsolute,
+  double* sums,
+  double* sumSquares) {
+  __shared__ float staged[featureChunk];
+  const size_t t = blockIdx.x * static_cast<size_t>(blockDim.x)
+    + threadIdx.x;
+  const bool active = t < T;
+  const size_t i = active ? targets[t] : 0;
+  double sum = 0;
+  double sumSquare = 0;
+  for (size_t r = 0; r < R; r++) {
+    const size_t j = references[r];
+    const float cost =
+      blockDistance(metric, points, d, active, i, j, staged);
+    const double sample = weights[j]
+      * (useAbsolute ? cost : fminf(cost, best[j]) - best[j]);
+    sum += sample;
+    sumSquare += sample * sample;
+  }
+  if (active) {
+    sums[t] = sum;
+    if (sumSquares) {
+      sumSquares[t] = sumSquare;
+    }
+  }
+}
+
+// The sums of the SWAP samples of each target, and the adjustments of each
+// arm, stored medoid-major so that the writes of a warp are coalesced
+__global__ void swapSumsKernel(
+  const DeviceMetric metric,
+  const float* points,
+  const size_t d,
+  const uint32_t* targets,
+  const size_t T,
+  const uint32_t* references,
+  const size_t R,
+  const float* weights,
+  const float* best,
+  const float* second,
+  const uint32_t* assignments,
+  double* sums,
+  double* sumSquares,
+  double* adjustments,
+  double* squareAdjustments) {
+  __shared__ float staged[featureChunk];
+  const size_t t = blockIdx.x * static_cast<size_t>(blockDim.x)
+    + threadIdx.x;
+  const bool active = t < T;
+  const size_t i = active ? targets[t] : 0;
+  double sum = 0;
+  double sumSquare = 0;
+  for (size_t r = 0; r < R; r++) {
+    const size_t j = references[r];
+    const float cost =
+      blockDistance(metric, points, d, active, i, j, staged);
+    if (!active) {
+      continue;
+    }
+    // Sample for the arms whose medoid is not assigned to j, and for the
+    // arm whose medoid is
+    const double sample = weights[j] * (fminf(cost, best[j]) - best[j]);
+    const double assignedSample =
+      weights[j] * (fminf(cost, second[j]) - best[j]);
+    const size_t slot = assignments[j] * T + t;
+    sum += sample;
+    sumSquare += sample * sample;
+    adjustments[slot] += assignedSample - sample;
+    if (squareAdjustments) {
+      squareAdjustments[slot] +=
+        assignedSample * assignedSample - sample * sample;
+    }
+  }
+  if (active) {
+    sums[t] = sum;
+    if (sumSquares) {
+      sumSquares[t] = sumSquare;
+    }
+  }
+}
+
+// Number of blocks that cover n threads
+unsigned int numBlocks(const size_t n) {
+  return static_cast<unsigned int>(
+    (n + threadsPerBlock - 1) / threadsPerBlock);
+}
+
+// Converts indices to the 32 bits used on the device
+std::vector<uint32_t> toDeviceIndices(
+  const arma::uword* indices,
+  const size_t n) {
+  return std::vector<uint32_t>(indices, indices + n);
+}
+}  // namespace
+
+struct CudaBackend::Device {
+  /// Number of features
+  size_t d = 0;
+
+  /// Number of points
+  size_t n = 0;
+
+  /// The distance of the fit
+  DeviceMetric metric{CudaLoss::l2, 2, nullptr};
+
+  /// The data, one point per column as on the host
+  DeviceArray<float> points;
+
+  /// The L2 norm of each point, for the cosine distance
+  DeviceArray<float> norms;
+
+  /// Weight of each point
+  DeviceArray<float> weights;
+
+  /// Distance from each point to its closest medoid
+  DeviceArray<float> best;
+
+  /// Distance from each point to its second closest medoid
+  DeviceArray<float> second;
+
+  /// Closest medoid of each point
+  DeviceArray<uint32_t> assignments;
+
+  /// Indices of the medoids, targets and reference points of a call
+  DeviceArray<uint32_t> medoids;
+  DeviceArray<uint32_t> targets;
+  DeviceArray<uint32_t> references;
+
+  /// Results of a call
+  DeviceArray<double> sums;
+  DeviceArray<double> sumSquares;
+  DeviceArray<double> adjustments;
+  DeviceArray<double> squareAdjustments;
+
+  /// Uploads the targets and reference points of a call
+  void uploadIndices(
+    const arma::uvec& targetIndices,
+    const arma::uvec& referenceIndices) {
+    const std::vector<uint32_t> hostTargets =
+      toDeviceIndices(targetIndices.memptr(), targetIndices.n_elem);
+    const std::vector<uint32_t> hostReferences =
+      toDeviceIndices(referenceIndices.memptr(), referenceIndices.n_elem);
+    targets.upload(hostTargets.data(), hostTargets.size());
+    references.upload(hostReferences.data(), hostReferences.size());
+  }
+};
+
+bool CudaBackend::isAvailable() {
+  int count = 0;
+  return cudaGetDeviceCount(&count) == cudaSuccess && count > 0;
+}
+
+CudaBackend::CudaBackend() = default;
+
+CudaBackend::~CudaBackend() = default;
+
+void CudaBackend::reset(
+  const arma::fmat& points,
+  const arma::frowvec& weights,
+  const CudaLoss loss,
+  const size_t p) {
+  if (!device) {
+    device = std::make_unique<Device>();
+  }
+  device->d = points.n_rows;
+  device->n = points.n_cols;
+  device->points.upload(points.memptr(), points.n_elem);
+  device->weights.upload(weights.memptr(), weights.n_elem);
+  device->best.resize(device->n);
+  device->second.resize(device->n);
+  device->assignments.resize(device->n);
+  device->metric = DeviceMetric{loss, static_cast<float>(p), nullptr};
+  if (loss == CudaLoss::cosine) {
+    device->norms.resize(device->n);
+    normsKernel<<<numBlocks(device->n), threadsPerBlock>>>(
+      device->points.data,
+      device->d,
+      device->n,
+      device->norms.data);
+    check(cudaGetLastError());
+    device->metric.norms = device->norms.data;
+  }
+}
+
+void CudaBackend::release() {
+  device.reset();
+}
+
+void CudaBackend::setBestDistances(const arma::frowvec& bestDistances) {
+  device->best.upload(bestDistances.memptr(), bestDistances.n_elem);
+}
+
+void CudaBackend::assign(
+  const arma::urowvec& medoidIndices,
+  arma::frowvec* bestDistances,
+  arma::frowvec* secondBestDistances,
+  arma::urowvec* assignments) {
+  const size_t n = device->n;
+  const std::vector<uint32_t> hostMedoids =
+    toDeviceIndices(medoidIndices.memptr(), medoidIndices.n_elem);
+  device->medoids.upload(hostMedoids.data(), hostMedoids.size());
+  assignKernel<<<numBlocks(n), threadsPerBlock>>>(
+    device->metric,
+    device->points.data,
+    device->d,
+    n,
+    device->medoids.data,
+    hostMedoids.size(),
+    device->best.data,
+    device->second.data,
+    device->assignments.data);
+  check(cudaGetLastError());
+
+  bestDistances->set_size(n);
+  secondBestDistances->set_size(n);
+  device->best.download(bestDistances->memptr());
+  device->second.download(secondBestDistances->memptr());
+  std::vector<uint32_t> hostAssignments(n);
+  device->assignments.download(hostAssignments.data());
+  assignments->set_size(n);
+  for (size_t i = 0; i < n; i++) {
+    (*assignments)(i) = hostAssignments[i];
+  }
+}
+
+void CudaBackend::buildSums(
+  const arma::uvec& targets,
+  const arma::uvec& referencePoints,
+  const bool useAbsolute,
+  arma::vec* sums,
+  arma::vec* sumSquares) {
+  const size_t T = targets.n_elem;
+  sums->zeros(T);
+  if (sumSquares) {
+    sumSquares->zeros(T);
+  }
+  if (T == 0) {
+    return;
+  }
+  device->uploadIndices(targets, referencePoints);
+  device->sums.resize(T);
+  device->sumSquares.resize(sumSquares ? T : 0);
+  buildSumsKernel<<<numBlocks(T), threadsPerBlock>>>(
+    device->metric,
+    device->points.data,
+    device->d,
+    device->targets.data,
+    T,
+    device->references.data,
+    referencePoints.n_elem,
+    device->weights.data,
+    device->best.data,
+    useAbsolute,
+    device->sums.data,
+    sumSquares ? device->sumSquares.data : nullptr);
+  check(cudaGetLastError());
+  device->sums.download(sums->memptr());
+  if (sumSquares) {
+    device->sumSquares.download(sumSquares->memptr());
+  }
+}
+
+void CudaBackend::swapSums(
+  const arma::uvec& targets,
+  const arma::uvec& referencePoints,
+  const size_t nMedoids,
+  arma::vec* sums,
+  arma::vec* sumSquares,
+  arma::mat* adjustments,
+  arma::mat* squareAdjustments) {
+  const size_t T = targets.n_elem;
+  sums->zeros(T);
+  adjustments->zeros(nMedoids, T);
+  if (sumSquares) {
+    sumSquares->zeros(T);
+  }
+  if (squareAdjustments) {
+    squareAdjustments->zeros(nMedoids, T);
+  }
+  if (T == 0) {
+    return;
+  }
+  device->uploadIndices(targets, referencePoints);
+  device->sums.resize(T);
+  device->sumSquares.resize(sumSquares ? T : 0);
+  device->adjustments.resize(nMedoids * T);
+  device->adjustments.zero();
+  device->squareAdjustments.resize(squareAdjustments ? nMedoids * T : 0);
+  if (squareAdjustments) {
+    device->squareAdjustments.zero();
+  }
+  swapSumsKernel<<<numBlocks(T), threadsPerBlock>>>(
+    device->metric,
+    device->points.data,
+    device->d,
+    device->targets.data,
+    T,
+    device->references.data,
+    referencePoints.n_elem,
+    device->weights.data,
+    device->best.data,
+    device->second.data,
+    device->assignments.data,
+    device->sums.data,
+    sumSquares ? device->sumSquares.data : nullptr,
+    device->adjustments.data,
+    squareAdjustments ? device->squareAdjustments.data : nullptr);
+  check(cudaGetLastError());
+  device->sums.download(sums->memptr());
+  if (sumSquares) {
+    device->sumSquares.download(sumSquares->memptr());
+  }
+
+  // The device stores the adjustments medoid-major, the host target-major
+  std::vector<double> hostAdjustments(nMedoids * T);
+  device->adjustments.download(hostAdjustments.data());
+  for (size_t k = 0; k < nMedoids; k++) {
+    for (size_t t = 0; t < T; t++) {
+      (*adjustments)(k, t) = hostAdjustments[k * T + t];
+    }
+  }
+  if (squareAdjustments) {
+    device->squareAdjustments.download(hostAdjustments.data());
+    for (size_t k = 0; k < nMedoids; k++) {
+      for (size_t t = 0; t < T; t++) {
+        (*squareAdjustments)(k, t) = hostAdjustments[k * T + t];
+      }
+    }
+  }
+}
+}  // namespace km
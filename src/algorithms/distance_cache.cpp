@@ -0,0 +1,252 @@
+/**
+ * @file distance_cache.cpp
+ * @date 2026-10-14
+ *
+ * Contains the allocation and reset logic of the distance cache used by
+ * BanditPAM, and the format of the files it can be attached to.
+ */
+
+#include "distance_cache.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <new>
+#include <stdexcept>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define KM_HAVE_MMAP 1
+#endif
+
+namespace km {
+namespace {
+// Tables at least this large are mapped directly, so that they can be backed
+// by transparent huge pages
+constexpr size_t hugePageSize = 2 << 20;
+
+// Smaller tables are aligned to cache lines
+constexpr std::align_val_t cacheLineAlignment{64};
+
+// Every cache file starts with these bytes
+constexpr char fileMagic[8] = {'B', 'P', 'A', 'M', 'C', 'A', 'C', 'H'};
+
+// Bumped whenever the layout of cache files changes
+constexpr uint64_t fileVersion = 1;
+
+/**
+ * Layout of a cache file: this header, the m cached points as uint64 at
+ * pointsOffset, and the n x m slots in row-major order at slotsOffset(m).
+ * Values are in the byte order of the machine that wrote the file.
+ */
+struct FileHeader {
+  char magic[8];
+  uint64_t version;
+  uint64_t fingerprint;
+  uint64_t n;
+  uint64_t m;
+};
+
+// Offset of the cached points in a cache file
+constexpr size_t pointsOffset = 64;
+
+static_assert(sizeof(FileHeader) <= pointsOffset, "Cache header too large");
+static_assert(
+  sizeof(std::atomic<float>) == sizeof(float),
+  "Cache files store slots as plain floats");
+
+// Returns the offset of the slots in a cache file, aligned to a cache line
+size_t slotsOffset(const size_t m) {
+  return (pointsOffset + m * sizeof(uint64_t) + 63) / 64 * 64;
+}
+}  // namespace
+
+DistanceCache::~DistanceCache() {
+  DistanceCache::release();
+}
+
+void DistanceCache::reset(
+  const size_t n,
+  const size_t m,
+  const int numThreads) {
+  const size_t numSlots = n * m;
+  const size_t bytes = numSlots * sizeof(std::atomic<float>);
+  // The slots of an attached file must not be overwritten
+  if (fileMapping) {
+    DistanceCache::release();
+  }
+  if (bytes > allocatedBytes) {
+    DistanceCache::release();
+#ifdef __linux__
+    if (bytes >= hugePageSize) {
+      void* memory = mmap(
+        nullptr,
+        bytes,
+        PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS,
+        -1,
+        0);
+      if (memory == MAP_FAILED) {
+        throw std::bad_alloc();
+      }
+      // Only a hint; the cache works without huge pages
+      madvise(memory, bytes, MADV_HUGEPAGE);
+      slots = static_cast<std::atomic<float>*>(memory);
+      mapped = true;
+    }
+#endif
+    if (!mapped) {
+      slots = static_cast<std::atomic<float>*>(
+        ::operator new(bytes, cacheLineAlignment));
+    }
+    allocatedBytes = bytes;
+  }
+  width = m;
+
+  // The slots are (re)constructed here, which is also where their pages are
+  // first touched
+  const float empty = std::numeric_limits<float>::quiet_NaN();
+  #pragma omp parallel for schedule(static) if (numThreads > 1) \
+    num_threads(numThreads)
+  for (size_t idx = 0; idx < numSlots; idx++) {
+    new (&slots[idx]) std::atomic<float>(empty);
+  }
+}
+
+bool DistanceCache::attach(
+  const std::string& path,
+  const size_t n,
+  const size_t m,
+  const uint64_t fingerprint,
+  std::vector<uint64_t>* points,
+  const int numThreads) {
+  DistanceCache::release();
+#ifdef KM_HAVE_MMAP
+  const size_t offset = slotsOffset(m);
+  const size_t bytes = offset + n * m * sizeof(float);
+  const auto mapFile = [bytes](const int descriptor) -> char* {
+    void* memory = mmap(
+      nullptr,
+      bytes,
+      PROT_READ | PROT_WRITE,
+      MAP_SHARED,
+      descriptor,
+      0);
+    // The mapping stays valid after the descriptor is closed
+    close(descriptor);
+    return memory == MAP_FAILED ? nullptr : static_cast<char*>(memory);
+  };
+
+  // Attach the existing file if it holds the distances of this fit
+  const int existing = open(path.c_str(), O_RDWR);
+  if (existing >= 0) {
+    struct stat status;
+    char* memory = nullptr;
+    if (fstat(existing, &status) == 0
+      && static_cast<size_t>(status.st_size) == bytes) {
+      memory = mapFile(existing);
+    } else {
+      close(existing);
+    }
+    if (memory) {
+      FileHeader header;
+      std::memcpy(&header, memory, sizeof(header));
+      if (std::memcmp(header.magic, fileMagic, sizeof(fileMagic)) == 0
+        && header.version == fileVersion
+        && header.fingerprint == fingerprint
+        && header.n == n
+        && header.m == m) {
+        points->resize(m);
+        std::memcpy(
+          points->data(),
+          memory + pointsOffset,
+          m * sizeof(uint64_t));
+        fileMapping = memory;
+        fileBytes = bytes;
+        slots = reinterpret_cast<std::atomic<float>*>(memory + offset);
+        width = m;
+        allocatedBytes = n * m * sizeof(float);
+        return true;
+      }
+      munmap(memory, bytes);
+    }
+  }
+
+  // Otherwise write a new file next to it, and publish it by renaming it
+  const std::string temporary = path + ".tmp." + std::to_string(getpid());
+  const int created = open(
+    temporary.c_str(),
+    O_RDWR | O_CREAT | O_TRUNC,
+    0644);
+  if (created < 0) {
+    throw std::invalid_argument("Cannot create cache file: " + path);
+  }
+  if (ftruncate(created, bytes) != 0) {
+    close(created);
+    std::remove(temporary.c_str());
+    throw std::invalid_argument("Cannot create cache file: " + path);
+  }
+  char* memory = mapFile(created);
+  if (!memory) {
+    std::remove(temporary.c_str());
+    throw std::invalid_argument("Cannot map cache file: " + path);
+  }
+  FileHeader header;
+  std::memcpy(header.magic, fileMagic, sizeof(fileMagic));
+  header.version = fileVersion;
+  header.fingerprint = fingerprint;
+  header.n = n;
+  header.m = m;
+  std::memcpy(memory, &header, sizeof(header));
+  std::memcpy(memory + pointsOffset, points->data(), m * sizeof(uint64_t));
+  std::atomic<float>* fileSlots =
+    reinterpret_cast<std::atomic<float>*>(memory + offset);
+  const float empty = std::numeric_limits<float>::quiet_NaN();
+  const size_t numSlots = n * m;
+  #pragma omp parallel for schedule(static) if (numThreads > 1) \
+    num_threads(numThreads)
+  for (size_t idx = 0; idx < numSlots; idx++) {
+    new (&fileSlots[idx]) std::atomic<float>(empty);
+  }
+  if (std::rename(temporary.c_str(), path.c_str()) != 0) {
+    munmap(memory, bytes);
+    std::remove(temporary.c_str());
+    throw std::invalid_argument("Cannot create cache file: " + path);
+  }
+  fileMapping = memory;
+  fileBytes = bytes;
+  slots = fileSlots;
+  width = m;
+  allocatedBytes = numSlots * sizeof(float);
+  return false;
+#else
+  throw std::invalid_argument(
+    "Cache files are not supported on this platform");
+#endif
+}
+
+void DistanceCache::release() {
+  if (slots == nullptr) {
+    return;
+  }
+#ifdef KM_HAVE_MMAP
+  if (fileMapping) {
+    munmap(fileMapping, fileBytes);
+  } else if (mapped) {
+    munmap(slots, allocatedBytes);
+  }
+#endif
+  if (!mapped && !fileMapping) {
+    ::operator delete(slots, cacheLineAlignment);
+  }
+  slots = nullptr;
+  width = 0;
+  allocatedBytes = 0;
+  mapped = false;
+  fileMapping = nullptr;
+  fileBytes = 0;
+}
+}  // namespace km
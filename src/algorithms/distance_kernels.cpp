@@ -0,0 +1,494 @@
+/**
+ * @file distance_kernels.cpp
+ * @date 2026-10-14
+ *
+ * Contains the vectorized distance kernels used by the loss policies and
+ * the runtime selection of the best kernels for the current CPU.
+ */
+
+#include "distance_kernels.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define BANDITPAM_X86_KERNELS
+#include <immintrin.h>
+#endif
+
+#if defined(__aarch64__)
+#define BANDITPAM_NEON_KERNELS
+#include <arm_neon.h>
+#endif
+
+namespace km {
+namespace {
+// Portable kernels. The simd pragmas allow the compiler to vectorize the
+// reductions for whatever baseline instruction set the library targets.
+float l1Scalar(const float* x, const float* y, size_t d) {
+  float total = 0;
+  #pragma omp simd reduction(+:total)
+  for (size_t k = 0; k < d; k++) {
+    total += std::fabs(x[k] - y[k]);
+  }
+  return total;
+}
+
+float l2SquaredScalar(const float* x, const float* y, size_t d) {
+  float total = 0;
+  #pragma omp simd reduction(+:total)
+  for (size_t k = 0; k < d; k++) {
+    const float diff = x[k] - y[k];
+    total += diff * diff;
+  }
+  return total;
+}
+
+float lInfScalar(const float* x, const float* y, size_t d) {
+  float maximum = 0;
+  #pragma omp simd reduction(max:maximum)
+  for (size_t k = 0; k < d; k++) {
+    maximum = std::max(maximum, std::fabs(x[k] - y[k]));
+  }
+  return maximum;
+}
+
+float dotScalar(const float* x, const float* y, size_t d) {
+  float total = 0;
+  #pragma omp simd reduction(+:total)
+  for (size_t k = 0; k < d; k++) {
+    total += x[k] * y[k];
+  }
+  return total;
+}
+
+float cosineScalar(const float* x, const float* y, size_t d) {
+  float dot = 0;
+  float xSquaredNorm = 0;
+  float ySquaredNorm = 0;
+  #pragma omp simd reduction(+:dot, xSquaredNorm, ySquaredNorm)
+  for (size_t k = 0; k < d; k++) {
+    dot += x[k] * y[k];
+    xSquaredNorm += x[k] * x[k];
+    ySquaredNorm += y[k] * y[k];
+  }
+  return 1 - dot / (std::sqrt(xSquaredNorm) * std::sqrt(ySquaredNorm));
+}
+
+#ifdef BANDITPAM_X86_KERNELS
+// AVX2 + FMA kernels. Two accumulators are used to hide the latency of the
+// dependent adds; the remainder is handled with scalar code.
+__attribute__((target("avx2,fma")))
+float horizontalSumAvx2(__m256 v) {
+  __m128 sums = _mm_add_ps(
+    _mm256_castps256_ps128(v),
+    _mm256_extractf128_ps(v, 1));
+  sums = _mm_add_ps(sums, _mm_movehl_ps(sums, sums));
+  sums = _mm_add_ss(sums, _mm_movehdup_ps(sums));
+  return _mm_cvtss_f32(sums);
+}
+
+__attribute__((target("avx2,fma")))
+float horizontalMaxAvx2(__m256 v) {
+  __m128 maxima = _mm_max_ps(
+    _mm256_castps256_ps128(v),
+    _mm256_extractf128_ps(v, 1));
+  maxima = _mm_max_ps(maxima, _mm_movehl_ps(maxima, maxima));
+  maxima = _mm_max_ss(maxima, _mm_movehdup_ps(maxima));
+  return _mm_cvtss_f32(maxima);
+}
+
+__attribute__((target("avx2,fma")))
+float l1Avx2(const float* x, const float* y, size_t d) {
+  const __m256 signMask = _mm256_set1_ps(-0.0f);
+  __m256 acc0 = _mm256_setzero_ps();
+  __m256 acc1 = _mm256_setzero_ps();
+  size_t k = 0;
+  for (; k + 16 <= d; k += 16) {
+    __m256 diff0 = _mm256_sub_ps(
+      _mm256_loadu_ps(x + k),
+      _mm256_loadu_ps(y + k));
+    __m256 diff1 = _mm256_sub_ps(
+      _mm256_loadu_ps(x + k + 8),
+      _mm256_loadu_ps(y + k + 8));
+    acc0 = _mm256_add_ps(acc0, _mm256_andnot_ps(signMask, diff0));
+    acc1 = _mm256_add_ps(acc1, _mm256_andnot_ps(signMask, diff1));
+  }
+  for (; k + 8 <= d; k += 8) {
+    __m256 diff = _mm256_sub_ps(_mm256_loadu_ps(x + k), _mm256_loadu_ps(y + k));
+    acc0 = _mm256_add_ps(acc0, _mm256_andnot_ps(signMask, diff));
+  }
+  float total = horizontalSumAvx2(_mm256_add_ps(acc0, acc1));
+  for (; k < d; k++) {
+    total += std::fabs(x[k] - y[k]);
+  }
+  return total;
+}
+
+__attribute__((target("avx2,fma")))
+float l2SquaredAvx2(const float* x, const float* y, size_t d) {
+  __m256 acc0 = _mm256_setzero_ps();
+  __m256 acc1 = _mm256_setzero_ps();
+  size_t k = 0;
+  for (; k + 16 <= d; k += 16) {
+    __m256 diff0 = _mm256_sub_ps(
+      _mm256_loadu_ps(x + k),
+      _mm256_loadu_ps(y + k));
+    __m256 diff1 = _mm256_sub_ps(
+      _mm256_loadu_ps(x + k + 8),
+      _mm256_loadu_ps(y + k + 8));
+    acc0 = _mm256_fmadd_ps(diff0, diff0, acc0);
+    acc1 = _mm256_fmadd_ps(diff1, diff1, acc1);
+  }
+  for (; k + 8 <= d; k += 8) {
+    __m256 diff = _mm256_sub_ps(_mm256_loadu_ps(x + k), _mm256_loadu_ps(y + k));
+    acc0 = _mm256_fmadd_ps(diff, diff, acc0);
+  }
+  float total = horizontalSumAvx2(_mm256_add_ps(acc0, acc1));
+  for (; k < d; k++) {
+    const float diff = x[k] - y[k];
+    total += diff * diff;
+  }
+  return total;
+}
+
+__attribute__((target("avx2,fma")))
+float lInfAvx2(const float* x, const float* y, size_t d) {
+  const __m256 signMask = _mm256_set1_ps(-0.0f);
+  __m256 acc = _mm256_setzero_ps();
+  size_t k = 0;
+  for (; k + 8 <= d; k += 8) {
+    __m256 diff = _mm256_sub_ps(_mm256_loadu_ps(x + k), _mm256_loadu_ps(y + k));
+    acc = _mm256_max_ps(acc, _mm256_andnot_ps(signMask, diff));
+  }
+  float maximum = horizontalMaxAvx2(acc);
+  for (; k < d; k++) {
+    maximum = std::max(maximum, std::fabs(x[k] - y[k]));
+  }
+  return maximum;
+}
+
+__attribute__((target("avx2,fma")))
+float dotAvx2(const float* x, const float* y, size_t d) {
+  __m256 acc0 = _mm256_setzero_ps();
+  __m256 acc1 = _mm256_setzero_ps();
+  size_t k = 0;
+  for (; k + 16 <= d; k += 16) {
+    acc0 = _mm256_fmadd_ps(
+      _mm256_loadu_ps(x + k),
+      _mm256_loadu_ps(y + k),
+      acc0);
+    acc1 = _mm256_fmadd_ps(
+      _mm256_loadu_ps(x + k + 8),
+      _mm256_loadu_ps(y + k + 8),
+      acc1);
+  }
+  for (; k + 8 <= d; k += 8) {
+    acc0 = _mm256_fmadd_ps(
+      _mm256_loadu_ps(x + k),
+      _mm256_loadu_ps(y + k),
+      acc0);
+  }
+  float total = horizontalSumAvx2(_mm256_add_ps(acc0, acc1));
+  for (; k < d; k++) {
+    total += x[k] * y[k];
+  }
+  return total;
+}
+
+__attribute__((target("avx2,fma")))
+float cosineAvx2(const float* x, const float* y, size_t d) {
+  __m256 dotAcc = _mm256_setzero_ps();
+  __m256 xAcc = _mm256_setzero_ps();
+  __m256 yAcc = _mm256_setzero_ps();
+  size_t k = 0;
+  for (; k + 8 <= d; k += 8) {
+    __m256 xv = _mm256_loadu_ps(x + k);
+    __m256 yv = _mm256_loadu_ps(y + k);
+    dotAcc = _mm256_fmadd_ps(xv, yv, dotAcc);
+    xAcc = _mm256_fmadd_ps(xv, xv, xAcc);
+    yAcc = _mm256_fmadd_ps(yv, yv, yAcc);
+  }
+  float dot = horizontalSumAvx2(dotAcc);
+  float xSquaredNorm = horizontalSumAvx2(xAcc);
+  float ySquaredNorm = horizontalSumAvx2(yAcc);
+  for (; k < d; k++) {
+    dot += x[k] * y[k];
+    xSquaredNorm += x[k] * x[k];
+    ySquaredNorm += y[k] * y[k];
+  }
+  return 1 - dot / (std::sqrt(xSquaredNorm) * std::sqrt(ySquaredNorm));
+}
+
+// AVX-512 kernels. The remainder is handled with a masked load, so there is
+// no scalar tail.
+// NOTE: GCC's AVX-512 reduction intrinsics trigger spurious
+// -Wmaybe-uninitialized warnings, so they are silenced for these kernels
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+__attribute__((target("avx512f")))
+__mmask16 tailMaskAvx512(size_t remaining) {
+  return static_cast<__mmask16>((1u << remaining) - 1);
+}
+
+__attribute__((target("avx512f")))
+float l1Avx512(const float* x, const float* y, size_t d) {
+  __m512 acc0 = _mm512_setzero_ps();
+  __m512 acc1 = _mm512_setzero_ps();
+  size_t k = 0;
+  for (; k + 32 <= d; k += 32) {
+    __m512 diff0 = _mm512_sub_ps(
+      _mm512_loadu_ps(x + k),
+      _mm512_loadu_ps(y + k));
+    __m512 diff1 = _mm512_sub_ps(
+      _mm512_loadu_ps(x + k + 16),
+      _mm512_loadu_ps(y + k + 16));
+    acc0 = _mm512_add_ps(acc0, _mm512_abs_ps(diff0));
+    acc1 = _mm512_add_ps(acc1, _mm512_abs_ps(diff1));
+  }
+  for (; k + 16 <= d; k += 16) {
+    __m512 diff = _mm512_sub_ps(_mm512_loadu_ps(x + k), _mm512_loadu_ps(y + k));
+    acc0 = _mm512_add_ps(acc0, _mm512_abs_ps(diff));
+  }
+  if (k < d) {
+    const __mmask16 mask = tailMaskAvx512(d - k);
+    __m512 diff = _mm512_sub_ps(
+      _mm512_maskz_loadu_ps(mask, x + k),
+      _mm512_maskz_loadu_ps(mask, y + k));
+    acc1 = _mm512_add_ps(acc1, _mm512_abs_ps(diff));
+  }
+  return _mm512_reduce_add_ps(_mm512_add_ps(acc0, acc1));
+}
+
+__attribute__((target("avx512f")))
+float l2SquaredAvx512(const float* x, const float* y, size_t d) {
+  __m512 acc0 = _mm512_setzero_ps();
+  __m512 acc1 = _mm512_setzero_ps();
+  size_t k = 0;
+  for (; k + 32 <= d; k += 32) {
+    __m512 diff0 = _mm512_sub_ps(
+      _mm512_loadu_ps(x + k),
+      _mm512_loadu_ps(y + k));
+    __m512 diff1 = _mm512_sub_ps(
+      _mm512_loadu_ps(x + k + 16),
+      _mm512_loadu_ps(y + k + 16));
+    acc0 = _mm512_fmadd_ps(diff0, diff0, acc0);
+    acc1 = _mm512_fmadd_ps(diff1, diff1, acc1);
+  }
+  for (; k + 16 <= d; k += 16) {
+    __m512 diff = _mm512_sub_ps(_mm512_loadu_ps(x + k), _mm512_loadu_ps(y + k));
+    acc0 = _mm512_fmadd_ps(diff, diff, acc0);
+  }
+  if (k < d) {
+    const __mmask16 mask = tailMaskAvx512(d - k);
+    __m512 diff = _mm512_sub_ps(
+      _mm512_maskz_loadu_ps(mask, x + k),
+      _mm512_maskz_loadu_ps(mask, y + k));
+    acc1 = _mm512_fmadd_ps(diff, diff, acc1);
+  }
+  return _mm512_reduce_add_ps(_mm512_add_ps(acc0, acc1));
+}
+
+__attribute__((target("avx512f")))
+float lInfAvx512(const float* x, const float* y, size_t d) {
+  __m512 acc = _mm512_setzero_ps();
+  size_t k = 0;
+  for (; k + 16 <= d; k += 16) {
+    __m512 diff = _mm512_sub_ps(_mm512_loadu_ps(x + k), _mm512_loadu_ps(y + k));
+    acc = _mm512_max_ps(acc, _mm512_abs_ps(diff));
+  }
+  if (k < d) {
+    const __mmask16 mask = tailMaskAvx512(d - k);
+    __m512 diff = _mm512_sub_ps(
+      _mm512_maskz_loadu_ps(mask, x + k),
+      _mm512_maskz_loadu_ps(mask, y + k));
+    acc = _mm512_max_ps(acc, _mm512_abs_ps(diff));
+  }
+  return _mm512_reduce_max_ps(acc);
+}
+
+__attribute__((target("avx512f")))
+float dotAvx512(const float* x, const float* y, size_t d) {
+  __m512 acc0 = _mm512_setzero_ps();
+  __m512 acc1 = _mm512_setzero_ps();
+  size_t k = 0;
+  for (; k + 32 <= d; k += 32) {
+    acc0 = _mm512_fmadd_ps(
+      _mm512_loadu_ps(x + k),
+      _mm512_loadu_ps(y + k),
+      acc0);
+    acc1 = _mm512_fmadd_ps(
+      _mm512_loadu_ps(x + k + 16),
+      _mm512_loadu_ps(y + k + 16),
+      acc1);
+  }
+  for (; k + 16 <= d; k += 16) {
+    acc0 = _mm512_fmadd_ps(
+      _mm512_loadu_ps(x + k),
+      _mm512_loadu_ps(y + k),
+      acc0);
+  }
+  if (k < d) {
+    const __mmask16 mask = tailMaskAvx512(d - k);
+    acc1 = _mm512_fmadd_ps(
+      _mm512_maskz_loadu_ps(mask, x + k),
+      _mm512_maskz_loadu_ps(mask, y + k),
+      acc1);
+  }
+  return _mm512_reduce_add_ps(_mm512_add_ps(acc0, acc1));
+}
+
+__attribute__((target("avx512f")))
+float cosineAvx512(const float* x, const float* y, size_t d) {
+  __m512 dotAcc = _mm512_setzero_ps();
+  __m512 xAcc = _mm512_setzero_ps();
+  __m512 yAcc = _mm512_setzero_ps();
+  size_t k = 0;
+  for (; k + 16 <= d; k += 16) {
+    __m512 xv = _mm512_loadu_ps(x + k);
+    __m512 yv = _mm512_loadu_ps(y + k);
+    dotAcc = _mm512_fmadd_ps(xv, yv, dotAcc);
+    xAcc = _mm512_fmadd_ps(xv, xv, xAcc);
+    yAcc = _mm512_fmadd_ps(yv, yv, yAcc);
+  }
+  if (k < d) {
+    const __mmask16 mask = tailMaskAvx512(d - k);
+    __m512 xv = _mm512_maskz_loadu_ps(mask, x + k);
+    __m512 yv = _mm512_maskz_loadu_ps(mask, y + k);
+    dotAcc = _mm512_fmadd_ps(xv, yv, dotAcc);
+    xAcc = _mm512_fmadd_ps(xv, xv, xAcc);
+    yAcc = _mm512_fmadd_ps(yv, yv, yAcc);
+  }
+  const float dot = _mm512_reduce_add_ps(dotAcc);
+  const float xSquaredNorm = _mm512_reduce_add_ps(xAcc);
+  const float ySquaredNorm = _mm512_reduce_add_ps(yAcc);
+  return 1 - dot / (std::sqrt(xSquaredNorm) * std::sqrt(ySquaredNorm));
+}
+#pragma GCC diagnostic pop
+#endif  // BANDITPAM_X86_KERNELS
+
+#ifdef BANDITPAM_NEON_KERNELS
+// NEON kernels. NEON is part of the aarch64 baseline, so these are selected
+// at compile time rather than at runtime.
+float l1Neon(const float* x, const float* y, size_t d) {
+  float32x4_t acc0 = vdupq_n_f32(0);
+  float32x4_t acc1 = vdupq_n_f32(0);
+  size_t k = 0;
+  for (; k + 8 <= d; k += 8) {
+    acc0 = vaddq_f32(acc0, vabdq_f32(vld1q_f32(x + k), vld1q_f32(y + k)));
+    acc1 = vaddq_f32(
+      acc1,
+      vabdq_f32(vld1q_f32(x + k + 4), vld1q_f32(y + k + 4)));
+  }
+  float total = vaddvq_f32(vaddq_f32(acc0, acc1));
+  for (; k < d; k++) {
+    total += std::fabs(x[k] - y[k]);
+  }
+  return total;
+}
+
+float l2SquaredNeon(const float* x, const float* y, size_t d) {
+  float32x4_t acc0 = vdupq_n_f32(0);
+  float32x4_t acc1 = vdupq_n_f32(0);
+  size_t k = 0;
+  for (; k + 8 <= d; k += 8) {
+    float32x4_t diff0 = vsubq_f32(vld1q_f32(x + k), vld1q_f32(y + k));
+    float32x4_t diff1 = vsubq_f32(vld1q_f32(x + k + 4), vld1q_f32(y + k + 4));
+    acc0 = vfmaq_f32(acc0, diff0, diff0);
+    acc1 = vfmaq_f32(acc1, diff1, diff1);
+  }
+  float total = vaddvq_f32(vaddq_f32(acc0, acc1));
+  for (; k < d; k++) {
+    const float diff = x[k] - y[k];
+    total += diff * diff;
+  }
+  return total;
+}
+
+float lInfNeon(const float* x, const float* y, size_t d) {
+  float32x4_t acc = vdupq_n_f32(0);
+  size_t k = 0;
+  for (; k + 4 <= d; k += 4) {
+    acc = vmaxq_f32(acc, vabdq_f32(vld1q_f32(x + k), vld1q_f32(y + k)));
+  }
+  float maximum = vmaxvq_f32(acc);
+  for (; k < d; k++) {
+    maximum = std::max(maximum, std::fabs(x[k] - y[k]));
+  }
+  return maximum;
+}
+
+float dotNeon(const float* x, const float* y, size_t d) {
+  float32x4_t acc0 = vdupq_n_f32(0);
+  float32x4_t acc1 = vdupq_n_f32(0);
+  size_t k = 0;
+  for (; k + 8 <= d; k += 8) {
+    acc0 = vfmaq_f32(acc0, vld1q_f32(x + k), vld1q_f32(y + k));
+    acc1 = vfmaq_f32(acc1, vld1q_f32(x + k + 4), vld1q_f32(y + k + 4));
+  }
+  float total = vaddvq_f32(vaddq_f32(acc0, acc1));
+  for (; k < d; k++) {
+    total += x[k] * y[k];
+  }
+  return total;
+}
+
+float cosineNeon(const float* x, const float* y, size_t d) {
+  float32x4_t dotAcc = vdupq_n_f32(0);
+  float32x4_t xAcc = vdupq_n_f32(0);
+  float32x4_t yAcc = vdupq_n_f32(0);
+  size_t k = 0;
+  for (; k + 4 <= d; k += 4) {
+    float32x4_t xv = vld1q_f32(x + k);
+    float32x4_t yv = vld1q_f32(y + k);
+    dotAcc = vfmaq_f32(dotAcc, xv, yv);
+    xAcc = vfmaq_f32(xAcc, xv, xv);
+    yAcc = vfmaq_f32(yAcc, yv, yv);
+  }
+  float dot = vaddvq_f32(dotAcc);
+  float xSquaredNorm = vaddvq_f32(xAcc);
+  float ySquaredNorm = vaddvq_f32(yAcc);
+  for (; k < d; k++) {
+    dot += x[k] * y[k];
+    xSquaredNorm += x[k] * x[k];
+    ySquaredNorm += y[k] * y[k];
+  }
+  return 1 - dot / (std::sqrt(xSquaredNorm) * std::sqrt(ySquaredNorm));
+}
+#endif  // BANDITPAM_NEON_KERNELS
+
+DistanceKernels selectDistanceKernels() {
+#ifdef BANDITPAM_X86_KERNELS
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f")) {
+    return {
+      "avx512",
+      l1Avx512,
+      l2SquaredAvx512,
+      lInfAvx512,
+      dotAvx512,
+      cosineAvx512};
+  }
+  if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+    return {"avx2", l1Avx2, l2SquaredAvx2, lInfAvx2, dotAvx2, cosineAvx2};
+  }
+#endif
+#ifdef BANDITPAM_NEON_KERNELS
+  return {"neon", l1Neon, l2SquaredNeon, lInfNeon, dotNeon, cosineNeon};
+#endif
+  return {
+    "scalar",
+    l1Scalar,
+    l2SquaredScalar,
+    lInfScalar,
+    dotScalar,
+    cosineScalar};
+}
+}  // namespace
+
+const DistanceKernels& distanceKernels() {
+  static const DistanceKernels kernels = selectDistanceKernels();
+  return kernels;
+}
+}  // namespace km
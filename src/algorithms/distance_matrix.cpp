@@ -0,0 +1,120 @@
+/**
+ * @file distance_matrix.cpp
+ * @date 2026-10-14
+ *
+ * Contains the validation and packing of user-provided distance matrices.
+ */
+
+#include "distance_matrix.hpp"
+
+#include <cmath>
+#include <stdexcept>
+
+namespace km {
+namespace {
+// Largest finite float16
+constexpr float maxFloat16 = 65504.0f;
+}  // namespace
+
+void DistanceMatrix::reset(
+  const arma::fmat& distMat,
+  const size_t n,
+  const std::string& precision,
+  const int numThreads) {
+  DistanceMatrix::release();
+  const size_t numPairs = n * (n - 1) / 2;
+  const bool isFull = distMat.n_rows == n && distMat.n_cols == n;
+  const bool isCondensed = !isFull
+    && (distMat.n_rows == 1 || distMat.n_cols == 1)
+    && distMat.n_elem == numPairs;
+  if (!isFull && !isCondensed) {
+    // TODO(@motiwari): Change this to an assertion that is properly raised
+    throw std::invalid_argument("Malformed distance matrix provided");
+  }
+  this->n = n;
+
+  if (precision == "float32") {
+    storage = isFull ? Storage::full : Storage::condensed;
+    values = distMat.memptr();
+    return;
+  } else if (precision == "float16") {
+    storage = Storage::float16;
+  } else if (precision == "bfloat16") {
+    storage = Storage::bfloat16;
+  } else {
+    throw std::invalid_argument(
+      "Distance matrix precision must be float32, float16 or bfloat16");
+  }
+
+  packed.resize(numPairs);
+  const bool half = storage == Storage::float16;
+  const float* source = distMat.memptr();
+  bool overflow = false;
+  // Row i of the condensed distances holds the pairs (i, j) for j > i; for a
+  // full matrix those are read from column i, which is contiguous
+  #pragma omp parallel for schedule(dynamic) reduction(||:overflow) \
+    if (numThreads > 1) num_threads(numThreads)
+  for (size_t i = 0; i < n; i++) {
+    if (i + 1 == n) {
+      continue;
+    }
+    const size_t start = DistanceMatrix::condensedIndex(i, i + 1);
+    const float* row = isFull ? source + n * i + i + 1 : source + start;
+    for (size_t offset = 0; offset < n - i - 1; offset++) {
+      const float distance = row[offset];
+      if (half) {
+        overflow = overflow || !(distance <= maxFloat16);
+        packed[start + offset] = toFloat16(distance);
+      } else {
+        packed[start + offset] = toBFloat16(distance);
+      }
+    }
+  }
+  if (overflow) {
+    DistanceMatrix::release();
+    throw std::invalid_argument(
+      "Distances exceed the range of float16; use bfloat16 instead");
+  }
+}
+
+void DistanceMatrix::release() {
+  std::vector<uint16_t>().swap(packed);
+  values = nullptr;
+  n = 0;
+  storage = Storage::full;
+}
+
+uint16_t DistanceMatrix::toFloat16(const float value) {
+  uint32_t bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+  const uint16_t sign = (bits >> 16) & 0x8000;
+  const uint32_t magnitude = bits & 0x7FFFFFFF;
+  if (magnitude > 0x7F800000) {
+    // NaN, kept quiet
+    return sign | 0x7E00;
+  } else if (magnitude >= 0x477FF000) {
+    // At least 65520, which rounds past the largest float16
+    return sign | 0x7C00;
+  } else if (magnitude < 0x38800000) {
+    // Below 2^-14, the float16 is subnormal: round value * 2^24 to an
+    // integer, ties to even
+    float absolute;
+    std::memcpy(&absolute, &magnitude, sizeof(absolute));
+    return sign | static_cast<uint16_t>(std::nearbyint(absolute * 16777216.0f));
+  }
+  // Rebias the exponent from 127 to 15 and round the mantissa from 23 to 10
+  // bits; a carry out of the mantissa correctly increments the exponent
+  const uint32_t rebiased = magnitude - 0x38000000;
+  return sign
+    | static_cast<uint16_t>((rebiased + 0xFFF + ((rebiased >> 13) & 1)) >> 13);
+}
+
+uint16_t DistanceMatrix::toBFloat16(const float value) {
+  uint32_t bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+  if ((bits & 0x7FFFFFFF) > 0x7F800000) {
+    return static_cast<uint16_t>((bits >> 16) | 0x40);
+  }
+  return static_cast<uint16_t>((bits + 0x7FFF + ((bits >> 16) & 1)) >> 16);
+}
+}  // namespace km
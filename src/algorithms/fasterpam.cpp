@@ -0,0 +1,172 @@
+/**
+ * @file fasterpam.cpp
+ * @date 2026-10-14
+ *
+ * Contains a C++ implementation of the eager swapping of FasterPAM
+ * from the paper: Erich Schubert and Peter J. Rousseeuw: Fast and Eager
+ * k-Medoids Clustering: O(k) Runtime Improvement of the PAM, CLARA, and
+ * CLARANS Algorithms. (https://arxiv.org/pdf/2008.05171.pdf).
+ */
+
+#include "fasterpam.hpp"
+
+#include <armadillo>
+#include <algorithm>
+
+namespace km {
+void FasterPAM::fitFasterPAM(
+  const arma::fmat& data,
+  std::optional<std::reference_wrapper<const arma::urowvec>> initialMedoids) {
+  if (this->useCache) {
+    KMedoids::initializeCandidateCache(data.n_cols);
+  }
+
+  arma::urowvec medoidIndices(nMedoids);
+  if (initialMedoids) {
+    medoidIndices = initialMedoids->get();
+  } else {
+    ScopedPhaseTimer timer(&profile.build);
+    FastPAM1::buildFastPAM1(data, &medoidIndices);
+  }
+  steps = 0;
+  medoidIndicesBuild = medoidIndices;
+  arma::urowvec assignments(data.n_cols);
+  KMedoids::dispatchLossFn([&](const auto& loss) {
+    FasterPAM::swapFasterPAM(
+      data, &medoidIndices, &assignments, loss);
+  });
+  medoidIndicesFinal = medoidIndices;
+  labels = assignments;
+}
+
+template <typename LossFunction>
+void FasterPAM::swapFasterPAM(
+  const arma::fmat& data,
+  arma::urowvec* medoidIndices,
+  arma::urowvec* assignments,
+  const LossFunction& loss) {
+  const size_t N = data.n_cols;
+  arma::frowvec bestDistances(N);
+  arma::frowvec secondBestDistances(N);
+  arma::frowvec deltaTD(nMedoids);
+  std::vector<bool> isMedoid(N, false);
+  for (size_t k = 0; k < nMedoids; k++) {
+    isMedoid[(*medoidIndices)(k)] = true;
+  }
+
+  KMedoids::calcBestDistancesSwap(
+    data,
+    medoidIndices,
+    &bestDistances,
+    &secondBestDistances,
+    assignments);
+
+  arma::uvec candidates;
+  arma::fmat distances;
+  // The next candidate to visit, and the last one that was swapped in
+  size_t position = 0;
+  size_t lastSwap = N;
+  bool converged = false;
+  while (!converged && steps < maxIter && !KMedoids::budgetExhausted()) {
+    steps++;
+    profile.swapSteps.emplace_back();
+    ScopedPhaseTimer swapTimer(&profile.swap);
+    ScopedPhaseTimer stepTimer(&profile.swapSteps.back());
+
+    bool swapPerformed = false;
+    for (size_t visited = 0;
+      visited < N && !converged && !KMedoids::budgetExhausted();) {
+      const size_t C = std::min(candidatesPerTile, N - visited);
+      candidates.set_size(C);
+      for (size_t c = 0; c < C; c++) {
+        candidates(c) = (position + c) % N;
+      }
+      // Distances do not depend on the medoids, so the tile stays valid
+      // when one of its candidates is swapped in
+      FasterPAM::candidateTile(data, candidates, loss, &distances);
+
+      for (size_t c = 0; c < C; c++) {
+        const size_t candidate = candidates(c);
+        if (candidate == lastSwap) {
+          // A full cycle of candidates without an improving swap
+          converged = true;
+          break;
+        }
+        if (isMedoid[candidate]) {
+          continue;
+        }
+
+        // deltaTD(m) is the change in loss of the points assigned to medoid
+        // m if m is replaced by the candidate; shared is the change of the
+        // points that move to the candidate whichever medoid is removed
+        const float* candidateDistances = distances.colptr(c);
+        float shared = 0;
+        deltaTD.zeros();
+        for (size_t j = 0; j < N; j++) {
+          const float dij = candidateDistances[j];
+          if (dij < bestDistances(j)) {
+            shared += weights(j) * (dij - bestDistances(j));
+          } else {
+            deltaTD((*assignments)(j)) += weights(j)
+              * (std::min(dij, secondBestDistances(j)) - bestDistances(j));
+          }
+        }
+        const arma::uword swapOut = deltaTD.index_min();
+        if (deltaTD(swapOut) + shared < 0) {
+          isMedoid[(*medoidIndices)(swapOut)] = false;
+          isMedoid[candidate] = true;
+          (*medoidIndices)(swapOut) = candidate;
+          KMedoids::updateBestDistancesSwap(
+            data,
+            medoidIndices,
+            swapOut,
+            &bestDistances,
+            &secondBestDistances,
+            assignments);
+          lastSwap = candidate;
+          swapPerformed = true;
+        }
+      }
+      visited += C;
+      position = (position + C) % N;
+    }
+    if (!swapPerformed) {
+      converged = true;
+    }
+    KMedoids::reportProgress("swap", steps);
+  }
+  averageLoss = KMedoids::weightedMean(bestDistances);
+}
+
+template <typename LossFunction>
+void FasterPAM::candidateTile(
+  const arma::fmat& data,
+  const arma::uvec& candidates,
+  const LossFunction& loss,
+  arma::fmat* distances) {
+  const size_t N = data.n_cols;
+  distances->set_size(N, candidates.n_elem);
+  const size_t tileTargets = KMedoids::numTileTargets(N);
+  const size_t numBlocks = (N + tileTargets - 1) / tileTargets;
+  #pragma omp parallel for if (this->parallelize) \
+    num_threads(this->threadCount())
+  for (size_t block = 0; block < numBlocks; block++) {
+    const size_t tStart = block * tileTargets;
+    const size_t T = std::min(N, tStart + tileTargets) - tStart;
+    TileWorkspace& workspace = KMedoids::localTileWorkspace();
+    workspace.targets.set_size(T);
+    for (size_t t = 0; t < T; t++) {
+      workspace.targets(t) = tStart + t;
+    }
+    // 2 for SWAP
+    KMedoids::cachedLossTile(
+      data,
+      workspace.targets,
+      candidates,
+      2,
+      loss,
+      &workspace.tile);
+    distances->rows(tStart, tStart + T - 1) = workspace.tile;
+  }
+}
+}  // namespace km
@@ -13,24 +13,37 @@
 #include "fastpam1.hpp"
 
 #include <armadillo>
+#include <algorithm>
 #include <unordered_map>
 
 namespace km {
 void FastPAM1::fitFastPAM1(
-  const arma::fmat& inputData,
-  std::optional<std::reference_wrapper<const arma::fmat>> distMat) {
-  data = inputData;
-  data = arma::trans(data);
+  const arma::fmat& data,
+  std::optional<std::reference_wrapper<const arma::urowvec>> initialMedoids) {
+  if (this->useCache) {
+    KMedoids::initializeCandidateCache(data.n_cols);
+  }
+
   arma::urowvec medoidIndices(nMedoids);
-  FastPAM1::buildFastPAM1(data, distMat, &medoidIndices);
+  if (initialMedoids) {
+    medoidIndices = initialMedoids->get();
+  } else {
+    ScopedPhaseTimer timer(&profile.build);
+    FastPAM1::buildFastPAM1(data, &medoidIndices);
+  }
   steps = 0;
   medoidIndicesBuild = medoidIndices;
   arma::urowvec assignments(data.n_cols);
   size_t iter = 0;
   bool medoidChange = true;
-  while (iter < maxIter && medoidChange) {
+  while (iter < maxIter && medoidChange && !KMedoids::budgetExhausted()) {
     auto previous{medoidIndices};
-    FastPAM1::swapFastPAM1(data, distMat, &medoidIndices, &assignments);
+    profile.swapSteps.emplace_back();
+    {
+      ScopedPhaseTimer swapTimer(&profile.swap);
+      ScopedPhaseTimer stepTimer(&profile.swapSteps.back());
+      FastPAM1::swapFastPAM1(data, &medoidIndices, &assignments);
+    }
     medoidChange = arma::any(medoidIndices != previous);
     iter++;
   }
@@ -41,58 +54,45 @@ void FastPAM1::fitFastPAM1(
 
 void FastPAM1::buildFastPAM1(
   const arma::fmat& data,
-  std::optional<std::reference_wrapper<const arma::fmat>> distMat,
   arma::urowvec* medoidIndices
 ) {
-  size_t N = data.n_cols;
-  arma::frowvec estimates(N, arma::fill::zeros);
+  const size_t N = data.n_cols;
   arma::frowvec bestDistances(N);
   bestDistances.fill(std::numeric_limits<float>::infinity());
-  arma::frowvec sigma(N);
-  float minDistance = std::numeric_limits<float>::infinity();
-  int best = 0;
-  float total = 0;
-  float cost = 0;
+  arma::frowvec totals(N);
 
-  // TODO(@motiwari): pragma omp parallel for?
-  for (size_t k = 0; k < nMedoids; k++) {
-    minDistance = std::numeric_limits<float>::infinity();
-    best = 0;
-    // fixes a base datapoint
-    // TODO(@motiwari): pragma omp parallel for?
-    for (size_t i = 0; i < data.n_cols; i++) {
-      total = 0;
-      // TODO(@motiwari): pragma omp parallel for?
-      for (size_t j = 0; j < data.n_cols; j++) {
-        // computes distance between base and all other points
-        cost = (this->*lossFn)(data, i, j);
-        // compares this with the cached best distance
-        if (bestDistances(j) < cost) {
-          cost = bestDistances(j);
-        }
-        total += cost;
-      }
-      if (total < minDistance) {
-        minDistance = total;
-        best = i;
-      }
-    }
-    (*medoidIndices)(k) = best;
+  KMedoids::dispatchLossFn([&](const auto& loss) {
+    for (size_t k = 0; k < nMedoids; k++) {
+      // The loss of each candidate, with the distance to every point capped
+      // at the distance to its closest medoid so far; 1 for BUILD
+      KMedoids::candidateDistances(data, 1, loss,
+        [&](const size_t i, const float* distances) {
+          float total = 0;
+          for (size_t j = 0; j < N; j++) {
+            total += weights(j) * std::min(distances[j], bestDistances(j));
+          }
+          totals(i) = total;
+        });
+      // The lowest index among ties, as in a serial scan
+      (*medoidIndices)(k) = totals.index_min();
 
-    // update the medoid assignment and best_distance for this datapoint
-    // TODO(@motiwari): pragma omp parallel for?
-    for (size_t l = 0; l < N; l++) {
-      cost = (this->*lossFn)(data, l, (*medoidIndices)(k));
-      if (cost < bestDistances(l)) {
-        bestDistances(l) = cost;
+      // update the medoid assignment and best_distance for this datapoint
+      #pragma omp parallel for if (this->parallelize) \
+        num_threads(this->threadCount())
+      for (size_t l = 0; l < N; l++) {
+        const float cost = KMedoids::cachedLoss(
+          data, l, (*medoidIndices)(k), 1, loss);
+        if (cost < bestDistances(l)) {
+          bestDistances(l) = cost;
+        }
       }
+      KMedoids::reportProgress("build", k + 1);
     }
-  }
+  });
 }
 
 void FastPAM1::swapFastPAM1(
   const arma::fmat& data,
-  std::optional<std::reference_wrapper<const arma::fmat>> distMat,
   arma::urowvec* medoidIndices,
   arma::urowvec* assignments
 ) {
@@ -102,85 +102,98 @@ void FastPAM1::swapFastPAM1(
   size_t N = data.n_cols;
   size_t iter = 0;
   bool swapPerformed = true;
-  arma::fmat sigma(nMedoids, N, arma::fill::zeros);
   arma::frowvec bestDistances(N);
   arma::frowvec secondBestDistances(N);
-  arma::frowvec deltaTD(nMedoids, arma::fill::zeros);
+  // The best change in loss when each point is swapped in, and the medoid
+  // it would then replace
+  arma::frowvec candidateChanges(N);
+  arma::urowvec candidateSwapOuts(N);
+  // Each thread accumulates the changes of its candidates in its own copy
+  std::vector<arma::frowvec> deltaTDs(
+    KMedoids::threadSlots(), arma::frowvec(nMedoids));
 
   // calculate quantities needed for swap, bestDistances and sigma
   KMedoids::calcBestDistancesSwap(
     data,
-    distMat,
     medoidIndices,
     &bestDistances,
     &secondBestDistances,
     assignments,
     swapPerformed);
 
-  float di = 0;
-  float dij = 0;
-
-  while (swapPerformed && iter < maxIter) {
-    iter++;
-    // TODO(@motiwari): pragma omp parallel for?
-    for (size_t i = 0; i < data.n_cols; i++) {
-      di = bestDistances(i);
+  KMedoids::dispatchLossFn([&](const auto& loss) {
+    while (swapPerformed && iter < maxIter && !KMedoids::budgetExhausted()) {
+      iter++;
+      // 2 for SWAP
+      KMedoids::candidateDistances(data, 2, loss,
+        [&](const size_t i, const float* distances) {
+          arma::frowvec& deltaTD = deltaTDs[omp_get_thread_num()];
+          const float di = bestDistances(i);
 
-      // Consider making point i a medoid.
-      // The total loss then contains at least one term, -di,
-      // because the loss contribution for point i is reduced from di to 0
-      deltaTD.fill(-di);
-      // TODO(@motiwari): pragma omp parallel for?
-      for (size_t j = 0; j < data.n_cols; j++) {
-        if (j != i) {
-          dij = (this->*lossFn)(data, i, j);
-          if (dij < bestDistances(j)) {
-            // Case 1: point i becomes the closest medoid for point j,
-            // regardless of which medoid j was previously assigned to. deltaTD
-            // will be negative across ALL possible medoid indices m
-            deltaTD += (dij -  bestDistances(j));
-          } else if (dij < secondBestDistances(j)) {
-            // Case 2: i. If point i is closer than the second best
-            // medoid but further than the best medoid (enforced by failing
-            // the condition for the above if condition), point i will
-            // become the closest medoid only when we remove its associated
-            // medoid and add point i
-            deltaTD.at((*assignments)(j)) += (dij - bestDistances(j));
-          }  else {
-            // Case 3: dij > secondBestDistances(j). Then the loss for point j
-            // will not change for any medoid swapped out except for its
-            // assignment, in which case it moves to its second nearest medoid
-            deltaTD.at((*assignments)(j)) +=
-              (secondBestDistances(j) - bestDistances(j));
+          // Consider making point i a medoid.
+          // The total loss then contains at least one term, -di,
+          // because the loss contribution for point i is reduced from di to 0
+          deltaTD.fill(-weights(i) * di);
+          for (size_t j = 0; j < N; j++) {
+            if (j == i) {
+              continue;
+            }
+            const float dij = distances[j];
+            const float weight = weights(j);
+            if (dij < bestDistances(j)) {
+              // Case 1: point i becomes the closest medoid for point j,
+              // regardless of which medoid j was previously assigned to.
+              // deltaTD will be negative across ALL possible medoid indices m
+              deltaTD += weight * (dij - bestDistances(j));
+            } else if (dij < secondBestDistances(j)) {
+              // Case 2: i. If point i is closer than the second best
+              // medoid but further than the best medoid (enforced by failing
+              // the condition for the above if condition), point i will
+              // become the closest medoid only when we remove its associated
+              // medoid and add point i
+              deltaTD((*assignments)(j)) += weight * (dij - bestDistances(j));
+            } else {
+              // Case 3: dij > secondBestDistances(j). Then the loss for point
+              // j will not change for any medoid swapped out except for its
+              // assignment, in which case it moves to its second nearest
+              // medoid
+              deltaTD((*assignments)(j)) +=
+                weight * (secondBestDistances(j) - bestDistances(j));
+            }
           }
-        }
-      }
 
-      // Determine the best medoid to swap out
-      arma::uword swapOut = deltaTD.index_min();
+          // Determine the best medoid to swap out
+          candidateSwapOuts(i) = deltaTD.index_min();
+          candidateChanges(i) = deltaTD(candidateSwapOuts(i));
+        });
+
       // If the loss change is better than the best loss change so far,
-      // Update our running best statistics
-      if (deltaTD.min() < bestChange) {
-        bestChange = deltaTD.min();
-        swapIn = i;
-        medoidToSwap = swapOut;
+      // Update our running best statistics. Candidates are visited in
+      // order, so ties are broken as in a serial scan
+      for (size_t i = 0; i < N; i++) {
+        if (candidateChanges(i) < bestChange) {
+          bestChange = candidateChanges(i);
+          swapIn = i;
+          medoidToSwap = candidateSwapOuts(i);
+        }
       }
-    }
 
-    // Update the loss and perform the swap if the loss would be improved
-    if (bestChange < 0) {
-      (*medoidIndices)(medoidToSwap) = swapIn;
-      calcBestDistancesSwap(
-        data,
-        distMat,
-        medoidIndices,
-        &bestDistances,
-        &secondBestDistances,
-        assignments,
-        swapPerformed);
-    } else {
-      swapPerformed = false;
+      // Update the loss and perform the swap if the loss would be improved
+      if (bestChange < 0) {
+        (*medoidIndices)(medoidToSwap) = swapIn;
+        updateBestDistancesSwap(
+          data,
+          medoidIndices,
+          medoidToSwap,
+          &bestDistances,
+          &secondBestDistances,
+          assignments,
+          swapPerformed);
+      } else {
+        swapPerformed = false;
+      }
+      KMedoids::reportProgress("swap", iter);
     }
-  }
+  });
 }
 }  // namespace km
@@ -0,0 +1,72 @@
+/**
+ * @file fit_profile.cpp
+ * @date 2026-10-14
+ *
+ * Contains the timers used to profile the phases of a fit, and the JSON
+ * export of the resulting profile.
+ */
+
+#include "fit_profile.hpp"
+
+#include <sstream>
+
+namespace km {
+namespace {
+void writeTiming(std::ostringstream* out, const PhaseTiming& timing) {
+  *out << "{\"wall_ms\": " << timing.wallMilliseconds
+    << ", \"cpu_ms\": " << timing.cpuMilliseconds
+    << ", \"calls\": " << timing.calls << "}";
+}
+
+void writeCounts(std::ostringstream* out, const std::vector<size_t>& counts) {
+  *out << "[";
+  for (size_t i = 0; i < counts.size(); i++) {
+    *out << (i > 0 ? ", " : "") << counts[i];
+  }
+  *out << "]";
+}
+}  // namespace
+
+ScopedPhaseTimer::ScopedPhaseTimer(PhaseTiming* timing):
+  timing(timing),
+  wallStart(std::chrono::steady_clock::now()),
+  cpuStart(std::clock()) {}
+
+ScopedPhaseTimer::~ScopedPhaseTimer() {
+  const std::chrono::duration<double, std::milli> wall =
+    std::chrono::steady_clock::now() - wallStart;
+  timing->wallMilliseconds += wall.count();
+  timing->cpuMilliseconds +=
+    1000.0 * (std::clock() - cpuStart) / CLOCKS_PER_SEC;
+  timing->calls++;
+}
+
+void FitProfile::clear() {
+  *this = FitProfile();
+}
+
+std::string FitProfile::toJson() const {
+  std::ostringstream out;
+  out << "{\"build\": ";
+  writeTiming(&out, build);
+  out << ", \"swap\": ";
+  writeTiming(&out, swap);
+  out << ", \"swap_steps\": [";
+  for (size_t i = 0; i < swapSteps.size(); i++) {
+    out << (i > 0 ? ", " : "");
+    writeTiming(&out, swapSteps[i]);
+  }
+  out << "], \"sigma\": ";
+  writeTiming(&out, sigma);
+  out << ", \"targets\": ";
+  writeTiming(&out, targets);
+  out << ", \"exact_targets\": ";
+  writeTiming(&out, exactTargets);
+  out << ", \"build_arms_per_round\": ";
+  writeCounts(&out, buildArmsPerRound);
+  out << ", \"swap_arms_per_round\": ";
+  writeCounts(&out, swapArmsPerRound);
+  out << "}";
+  return out.str();
+}
+}  // namespace km
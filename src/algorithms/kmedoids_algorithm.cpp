@@ -7,16 +7,56 @@
 
 #include <omp.h>
 #include <armadillo>
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstring>
+#include <limits>
 #include <unordered_map>
 #include <regex>
 
 #include "kmedoids_algorithm.hpp"
 #include "fastpam1.hpp"
+#include "fasterpam.hpp"
 #include "pam.hpp"
 #include "banditpam.hpp"
 #include "banditpam_orig.hpp"
 
 namespace km {
+namespace {
+// Relative margin by which a triangle inequality bound must exceed a
+// distance to skip it, which absorbs the rounding of the distances
+constexpr float pruningTolerance = 1e-3f;
+
+// Hashes the bytes of a column, so that exact duplicates collide
+struct ColumnHash {
+  const arma::fmat* points;
+
+  size_t operator()(const size_t i) const {
+    const unsigned char* bytes =
+      reinterpret_cast<const unsigned char*>(points->colptr(i));
+    // FNV-1a
+    size_t hash = 14695981039346656037ULL;
+    for (size_t b = 0; b < points->n_rows * sizeof(float); b++) {
+      hash = (hash ^ bytes[b]) * 1099511628211ULL;
+    }
+    return hash;
+  }
+};
+
+// Compares the bytes of two columns, consistently with ColumnHash
+struct ColumnEqual {
+  const arma::fmat* points;
+
+  bool operator()(const size_t i, const size_t j) const {
+    return std::memcmp(
+      points->colptr(i),
+      points->colptr(j),
+      points->n_rows * sizeof(float)) == 0;
+  }
+};
+}  // namespace
+
 // NOTE: The order of arguments in this constructor must match that of the
 // arguments in kmedoids_pywrapper.cpp, otherwise undefined behavior can
 // result (variables being initialized with others' values)
@@ -45,6 +85,7 @@ KMedoids::KMedoids(
   // Though we initialize seed from the given parameter,
   // we need to call setSeed to pass it to arma
   KMedoids::setSeed(seed);
+  KMedoids::resetCounters();
 }
 
 KMedoids::~KMedoids() {}
@@ -52,48 +93,714 @@ KMedoids::~KMedoids() {}
 void KMedoids::fit(
   const arma::fmat& inputData,
   const std::string& loss,
+  std::optional<std::reference_wrapper<const arma::fmat>> distMat,
+  std::optional<std::reference_wrapper<const arma::urowvec>> initialMedoids,
+  std::optional<std::reference_wrapper<const arma::frowvec>> weights) {
+  // The algorithms use one datapoint per column; the transposed copy is
+  // released when the fit returns
+  KMedoids::fitTransposed(
+    arma::trans(inputData), loss, distMat, initialMedoids, weights);
+}
+
+void KMedoids::fitTransposed(
+  const arma::fmat& points,
+  const std::string& loss,
+  std::optional<std::reference_wrapper<const arma::fmat>> distMat,
+  std::optional<std::reference_wrapper<const arma::urowvec>> initialMedoids,
+  std::optional<std::reference_wrapper<const arma::frowvec>> weights) {
+  if (collapseDuplicates && !distMat && !sparsePoints && points.n_cols > 0) {
+    KMedoids::fitCollapsed(points, loss, initialMedoids, weights);
+  } else {
+    KMedoids::fitPoints(points, loss, distMat, initialMedoids, weights);
+  }
+}
+
+void KMedoids::fitPoints(
+  const arma::fmat& points,
+  const std::string& loss,
+  std::optional<std::reference_wrapper<const arma::fmat>> distMat,
+  std::optional<std::reference_wrapper<const arma::urowvec>> initialMedoids,
+  std::optional<std::reference_wrapper<const arma::frowvec>> pointWeights) {
+  try {
+    KMedoids::prepareFit(points, loss, distMat, pointWeights);
+    if (initialMedoids) {
+      KMedoids::checkInitialMedoids(initialMedoids->get(), points.n_cols);
+    }
+    if (pointWeights && algorithm == "BanditPAM_orig") {
+      throw std::invalid_argument(
+        "Weights are not supported by BanditPAM_orig");
+    }
+    if (algorithm == "PAM") {
+      static_cast<PAM*>(this)->fitPAM(points, initialMedoids);
+    } else if (algorithm == "BanditPAM") {
+      static_cast<BanditPAM*>(this)->fitBanditPAM(
+        points, initialMedoids);
+    } else if (algorithm == "BanditPAM_orig") {
+      if (initialMedoids) {
+        throw std::invalid_argument(
+          "Initial medoids are not supported by BanditPAM_orig");
+      }
+      static_cast<BanditPAM_orig*>(this)->fitBanditPAM_orig(points);
+    } else if (algorithm == "FastPAM1") {
+      static_cast<FastPAM1*>(this)->fitFastPAM1(
+        points, initialMedoids);
+    } else if (algorithm == "FasterPAM") {
+      static_cast<FasterPAM*>(this)->fitFasterPAM(
+        points, initialMedoids);
+    }
+    KMedoids::finishFit(points);
+    KMedoids::mergeCounters();
+    totalSwapTime = static_cast<size_t>(profile.swap.wallMilliseconds);
+    medoidPoints = points.cols(medoidIndicesFinal);
+    KMedoids::releaseFitState();
+  } catch (std::invalid_argument& e) {
+    KMedoids::releaseFitState();
+    std::cout << e.what() << std::endl;
+    std::cout << "Error: Clustering did not run." << std::endl;
+    throw;
+  } catch (...) {
+    KMedoids::releaseFitState();
+    throw;
+  }
+}
+
+void KMedoids::fitCollapsed(
+  const arma::fmat& points,
+  const std::string& loss,
+  std::optional<std::reference_wrapper<const arma::urowvec>> initialMedoids,
+  std::optional<std::reference_wrapper<const arma::frowvec>> pointWeights) {
+  const size_t N = points.n_cols;
+  if (pointWeights && pointWeights->get().n_elem != N) {
+    throw std::invalid_argument("There must be one weight per point");
+  }
+  // The first copy of each distinct point represents all of its copies
+  std::unordered_map<size_t, size_t, ColumnHash, ColumnEqual> distinct(
+    N, ColumnHash{&points}, ColumnEqual{&points});
+  arma::uvec inverse(N);
+  std::vector<arma::uword> representatives;
+  std::vector<float> counts;
+  for (size_t i = 0; i < N; i++) {
+    const auto inserted = distinct.emplace(i, representatives.size());
+    if (inserted.second) {
+      representatives.push_back(i);
+      counts.push_back(0);
+    }
+    const size_t u = inserted.first->second;
+    inverse(i) = u;
+    counts[u] += pointWeights ? pointWeights->get()(i) : 1;
+  }
+  if (representatives.size() == N) {
+    KMedoids::fitPoints(
+      points, loss, std::nullopt, initialMedoids, pointWeights);
+    return;
+  }
+
+  const arma::uvec distinctIndices(representatives);
+  const arma::fmat distinctPoints = points.cols(distinctIndices);
+  const arma::frowvec distinctWeights(counts);
+  std::optional<arma::urowvec> distinctMedoids;
+  std::optional<std::reference_wrapper<const arma::urowvec>> distinctMedoidsRef;
+  if (initialMedoids) {
+    KMedoids::checkInitialMedoids(initialMedoids->get(), N);
+    distinctMedoids.emplace(initialMedoids->get().n_elem);
+    for (size_t k = 0; k < distinctMedoids->n_elem; k++) {
+      (*distinctMedoids)(k) = inverse(initialMedoids->get()(k));
+    }
+    distinctMedoidsRef = std::cref(*distinctMedoids);
+  }
+  KMedoids::fitPoints(
+    distinctPoints,
+    loss,
+    std::nullopt,
+    distinctMedoidsRef,
+    std::cref(distinctWeights));
+
+  // The weighted loss of the distinct points is already the loss of the data
+  for (size_t k = 0; k < medoidIndicesBuild.n_elem; k++) {
+    medoidIndicesBuild(k) = distinctIndices(medoidIndicesBuild(k));
+  }
+  for (size_t k = 0; k < medoidIndicesFinal.n_elem; k++) {
+    medoidIndicesFinal(k) = distinctIndices(medoidIndicesFinal(k));
+  }
+  const arma::urowvec distinctLabels = labels;
+  labels.set_size(N);
+  for (size_t i = 0; i < N; i++) {
+    labels(i) = distinctLabels(inverse(i));
+  }
+}
+
+void KMedoids::fitSparse(
+  const arma::sp_fmat& inputData,
+  const std::string& loss,
+  std::optional<std::reference_wrapper<const arma::urowvec>> initialMedoids,
+  std::optional<std::reference_wrapper<const arma::frowvec>> weights) {
+  KMedoids::fitSparseTransposed(
+    arma::sp_fmat(arma::trans(inputData)), loss, initialMedoids, weights);
+}
+
+void KMedoids::fitSparseTransposed(
+  const arma::sp_fmat& points,
+  const std::string& loss,
+  std::optional<std::reference_wrapper<const arma::urowvec>> initialMedoids,
+  std::optional<std::reference_wrapper<const arma::frowvec>> weights) {
+  if (algorithm == "BanditPAM_orig") {
+    throw std::invalid_argument(
+      "Sparse data is not supported by BanditPAM_orig");
+  }
+  // The sparse loss policies read the compressed columns directly
+  points.sync();
+  // Only the number of points of the dense data is used, so it needs no
+  // memory
+  const arma::fmat shape(0, points.n_cols);
+  sparsePoints = &points;
+  try {
+    KMedoids::fitTransposed(
+      shape, loss, std::nullopt, initialMedoids, weights);
+  } catch (...) {
+    sparsePoints = nullptr;
+    throw;
+  }
+  sparsePoints = nullptr;
+
+  // The medoids are kept dense, as for dense data, so that predict() and
+  // transform() apply unchanged
+  medoidPoints.zeros(points.n_rows, medoidIndicesFinal.n_elem);
+  for (size_t k = 0; k < medoidIndicesFinal.n_elem; k++) {
+    const SparseColumn medoid = sparseColumn(points, medoidIndicesFinal(k));
+    for (size_t nz = 0; nz < medoid.nnz; nz++) {
+      medoidPoints(medoid.rows[nz], k) = medoid.values[nz];
+    }
+  }
+}
+
+void KMedoids::fitRange(
+  const arma::fmat& inputData,
+  const std::string& loss,
+  const size_t kMin,
+  const size_t kMax,
   std::optional<std::reference_wrapper<const arma::fmat>> distMat) {
-  numMiscDistanceComputations = 0;
-  numBuildDistanceComputations = 0;
-  numSwapDistanceComputations = 0;
-  numCacheWrites = 0;
-  numCacheHits = 0;
-  numCacheMisses = 0;
+  KMedoids::fitRangeTransposed(
+    arma::trans(inputData), loss, kMin, kMax, distMat);
+}
 
-  if (distMat) {  // User has provided a distance matrix
-    if (distMat.value().get().n_cols != distMat.value().get().n_rows) {
-      // TODO(@motiwari): Change this to an assertion that is properly raised
-      throw std::invalid_argument("Malformed distance matrix provided");
+void KMedoids::fitRangeTransposed(
+  const arma::fmat& points,
+  const std::string& loss,
+  const size_t kMin,
+  const size_t kMax,
+  std::optional<std::reference_wrapper<const arma::fmat>> distMat) {
+  if (kMin == 0 || kMin > kMax) {
+    throw std::invalid_argument("Invalid range of medoids");
+  }
+  if (kMax > points.n_cols) {
+    throw std::invalid_argument(
+      "Number of medoids cannot exceed the number of points");
+  }
+  rangeResults.clear();
+
+  if (algorithm != "BanditPAM") {
+    for (size_t k = kMin; k <= kMax; k++) {
+      KMedoids::setNMedoids(k);
+      KMedoids::fitTransposed(points, loss, distMat);
+      rangeResults.push_back(FitResult{
+        k,
+        medoidIndicesBuild,
+        medoidIndicesFinal,
+        labels,
+        steps,
+        averageLoss,
+        profile.swap.wallMilliseconds});
+    }
+    return;
+  }
+
+  try {
+    KMedoids::prepareFit(points, loss, distMat);
+    static_cast<BanditPAM*>(this)->fitBanditPAMRange(
+      points, kMin, kMax, &rangeResults);
+    KMedoids::finishFit(points);
+    KMedoids::mergeCounters();
+    // Consistent with steps, which are those of kMax
+    totalSwapTime =
+      static_cast<size_t>(rangeResults.back().swapMilliseconds);
+    medoidPoints = points.cols(medoidIndicesFinal);
+    KMedoids::releaseFitState();
+  } catch (std::invalid_argument& e) {
+    KMedoids::releaseFitState();
+    std::cout << e.what() << std::endl;
+    std::cout << "Error: Clustering did not run." << std::endl;
+    throw;
+  } catch (...) {
+    KMedoids::releaseFitState();
+    throw;
+  }
+}
+
+const std::vector<FitResult>& KMedoids::getRangeResults() const {
+  return rangeResults;
+}
+
+void KMedoids::fitClara(
+  const arma::fmat& inputData,
+  const std::string& loss,
+  const size_t numSamples,
+  const size_t sampleSize,
+  const size_t refineIter) {
+  KMedoids::fitClaraImpl(
+    inputData, false, loss, numSamples, sampleSize, refineIter);
+}
+
+void KMedoids::fitClaraTransposed(
+  const arma::fmat& points,
+  const std::string& loss,
+  const size_t numSamples,
+  const size_t sampleSize,
+  const size_t refineIter) {
+  KMedoids::fitClaraImpl(
+    points, true, loss, numSamples, sampleSize, refineIter);
+}
+
+void KMedoids::fitClaraImpl(
+  const arma::fmat& data,
+  const bool transposed,
+  const std::string& loss,
+  const size_t numSamples,
+  size_t sampleSize,
+  const size_t refineIter) {
+  const size_t N = transposed ? data.n_cols : data.n_rows;
+  const size_t d = transposed ? data.n_rows : data.n_cols;
+  if (numSamples == 0) {
+    throw std::invalid_argument("Number of samples must be positive");
+  }
+  if (N < nMedoids) {
+    throw std::invalid_argument(
+      "Number of medoids cannot exceed the number of points");
+  }
+  if (sampleSize == 0) {
+    // The sample size recommended for FastCLARA by Schubert and Rousseeuw
+    sampleSize = 80 + 4 * nMedoids;
+  }
+  sampleSize = std::max(nMedoids, std::min(N, sampleSize));
+  // A sample of every point is the same each time
+  const size_t samples = sampleSize == N ? 1 : numSamples;
+
+  // Each fit resets the counters, so they are added up across fits here
+  std::array<size_t, 7> counts = {};
+
+  arma::urowvec bestMedoids;
+  arma::urowvec bestBuildMedoids;
+  arma::urowvec bestLabels(N);
+  arma::urowvec sampleLabels(N);
+  arma::fmat bestMedoidPoints;
+  double bestLoss = std::numeric_limits<double>::infinity();
+  size_t bestSteps = 0;
+  arma::fmat sample(d, sampleSize);
+  RandomStream stream(seed, claraSampleStream);
+  for (size_t s = 0; s < samples; s++) {
+    // The best medoids so far, followed by distinct random points. Points
+    // are drawn with replacement and duplicates redrawn, which is cheap as
+    // long as the sample is much smaller than the data.
+    std::vector<arma::uword> indices(
+      bestMedoids.begin(), bestMedoids.end());
+    std::unordered_map<arma::uword, bool> drawn;
+    for (const arma::uword medoid : indices) {
+      drawn[medoid] = true;
     }
+    while (indices.size() < sampleSize) {
+      const arma::uword index = stream.below(N);
+      if (!drawn[index]) {
+        drawn[index] = true;
+        indices.push_back(index);
+      }
+    }
+    // Sorted, so the full data is read in order when gathering the sample
+    std::sort(indices.begin(), indices.end());
+    #pragma omp parallel for if (this->parallelize) \
+      num_threads(this->threadCount())
+    for (size_t i = 0; i < sampleSize; i++) {
+      if (transposed) {
+        sample.col(i) = data.col(indices[i]);
+      } else {
+        for (size_t j = 0; j < d; j++) {
+          sample(j, i) = data(indices[i], j);
+        }
+      }
+    }
+
+    KMedoids::fitTransposed(sample, loss, std::nullopt);
+    KMedoids::addCountersTo(&counts);
+
+    // Score the medoids of the sample on the full data in a single pass.
+    // Each batch writes its own partial sum, so the total does not depend
+    // on the number of threads.
+    const size_t numBatches = (N + maxTileTargets - 1) / maxTileTargets;
+    std::vector<double> batchLosses(numBatches, 0);
+    KMedoids::medoidDistanceBatches(
+      data,
+      transposed,
+      [&](const size_t start, const arma::fmat& tile) {
+        double total = 0;
+        for (size_t b = 0; b < tile.n_rows; b++) {
+          const arma::uword nearest = tile.row(b).index_min();
+          sampleLabels(start + b) = nearest;
+          total += tile(b, nearest);
+        }
+        batchLosses[start / maxTileTargets] = total;
+      });
+    double sampleLoss = 0;
+    for (const double batchLoss : batchLosses) {
+      sampleLoss += batchLoss;
+    }
+    if (sampleLoss < bestLoss) {
+      bestLoss = sampleLoss;
+      bestMedoids.set_size(nMedoids);
+      bestBuildMedoids.set_size(nMedoids);
+      for (size_t k = 0; k < nMedoids; k++) {
+        bestMedoids(k) = indices[medoidIndicesFinal(k)];
+        bestBuildMedoids(k) = indices[medoidIndicesBuild(k)];
+      }
+      bestLabels = sampleLabels;
+      bestMedoidPoints = medoidPoints;
+      bestSteps = steps;
+    }
+  }
+
+  medoidIndicesBuild = bestBuildMedoids;
+  medoidIndicesFinal = bestMedoids;
+  labels = bestLabels;
+  medoidPoints = bestMedoidPoints;
+  averageLoss = bestLoss / N;
+  steps = bestSteps;
+
+  if (refineIter > 0) {
+    const size_t savedMaxIter = maxIter;
+    maxIter = refineIter;
+    try {
+      if (transposed) {
+        KMedoids::fitTransposed(
+          data, loss, std::nullopt, std::cref(bestMedoids));
+      } else {
+        KMedoids::fit(data, loss, std::nullopt, std::cref(bestMedoids));
+      }
+    } catch (...) {
+      maxIter = savedMaxIter;
+      throw;
+    }
+    maxIter = savedMaxIter;
+    KMedoids::addCountersTo(&counts);
+    // The refined fit starts from the sampled medoids
+    medoidIndicesBuild = bestBuildMedoids;
+  }
+
+  KMedoids::setCounters(counts);
+}
+
+void KMedoids::fitRestarts(
+  const arma::fmat& inputData,
+  const std::string& loss,
+  const size_t nRestarts,
+  std::optional<std::reference_wrapper<const arma::fmat>> distMat) {
+  KMedoids::fitRestartsTransposed(
+    arma::trans(inputData), loss, nRestarts, distMat);
+}
+
+void KMedoids::fitRestartsTransposed(
+  const arma::fmat& points,
+  const std::string& loss,
+  const size_t nRestarts,
+  std::optional<std::reference_wrapper<const arma::fmat>> distMat) {
+  if (nRestarts == 0) {
+    throw std::invalid_argument("Number of restarts must be positive");
+  }
+  restartResults.clear();
+  const size_t baseSeed = seed;
+  std::array<size_t, 7> counts = {};
+
+  arma::urowvec bestBuildMedoids;
+  arma::urowvec bestMedoids;
+  arma::urowvec bestLabels;
+  arma::fmat bestMedoidPoints;
+  FitProfile bestProfile;
+  float bestLoss = std::numeric_limits<float>::infinity();
+  size_t bestSteps = 0;
+  // The first restart fills the cache, and the later ones cache the same
+  // points, so they reuse its distances
+  cachedPoints.reset();
+  reuseCache = true;
+  try {
+    for (size_t r = 0; r < nRestarts; r++) {
+      KMedoids::setSeed(baseSeed + r);
+      KMedoids::fitTransposed(points, loss, distMat);
+      KMedoids::addCountersTo(&counts);
+      restartResults.push_back(RestartResult{
+        baseSeed + r,
+        medoidIndicesFinal,
+        steps,
+        averageLoss,
+        profile.swap.wallMilliseconds,
+        numMiscDistanceComputations + numBuildDistanceComputations
+          + numSwapDistanceComputations,
+        numCacheHits});
+      if (averageLoss < bestLoss) {
+        bestLoss = averageLoss;
+        bestBuildMedoids = medoidIndicesBuild;
+        bestMedoids = medoidIndicesFinal;
+        bestLabels = labels;
+        bestMedoidPoints = medoidPoints;
+        bestProfile = profile;
+        bestSteps = steps;
+      }
+    }
+  } catch (...) {
+    reuseCache = false;
+    KMedoids::setSeed(baseSeed);
+    throw;
+  }
+  reuseCache = false;
+  KMedoids::setSeed(baseSeed);
+
+  medoidIndicesBuild = bestBuildMedoids;
+  medoidIndicesFinal = bestMedoids;
+  labels = bestLabels;
+  medoidPoints = bestMedoidPoints;
+  profile = bestProfile;
+  averageLoss = bestLoss;
+  steps = bestSteps;
+  KMedoids::setCounters(counts);
+}
+
+const std::vector<RestartResult>& KMedoids::getRestartResults() const {
+  return restartResults;
+}
+
+void KMedoids::addCountersTo(std::array<size_t, 7>* totals) const {
+  (*totals)[0] += numMiscDistanceComputations;
+  (*totals)[1] += numBuildDistanceComputations;
+  (*totals)[2] += numSwapDistanceComputations;
+  (*totals)[3] += numCacheWrites;
+  (*totals)[4] += numCacheHits;
+  (*totals)[5] += numCacheMisses;
+  (*totals)[6] += totalSwapTime;
+}
+
+void KMedoids::setCounters(const std::array<size_t, 7>& totals) {
+  numMiscDistanceComputations = totals[0];
+  numBuildDistanceComputations = totals[1];
+  numSwapDistanceComputations = totals[2];
+  numCacheWrites = totals[3];
+  numCacheHits = totals[4];
+  numCacheMisses = totals[5];
+  totalSwapTime = totals[6];
+}
+
+arma::urowvec KMedoids::predict(const arma::fmat& newData) {
+  arma::urowvec predictions(newData.n_rows);
+  KMedoids::medoidDistanceBatches(
+    newData,
+    false,
+    [&predictions](const size_t start, const arma::fmat& tile) {
+      for (size_t b = 0; b < tile.n_rows; b++) {
+        predictions(start + b) = tile.row(b).index_min();
+      }
+    });
+  return predictions;
+}
+
+arma::urowvec KMedoids::predictTransposed(const arma::fmat& points) {
+  arma::urowvec predictions(points.n_cols);
+  KMedoids::medoidDistanceBatches(
+    points,
+    true,
+    [&predictions](const size_t start, const arma::fmat& tile) {
+      for (size_t b = 0; b < tile.n_rows; b++) {
+        predictions(start + b) = tile.row(b).index_min();
+      }
+    });
+  return predictions;
+}
+
+arma::fmat KMedoids::transform(const arma::fmat& newData) {
+  arma::fmat distances(newData.n_rows, medoidIndicesFinal.n_elem);
+  KMedoids::medoidDistanceBatches(
+    newData,
+    false,
+    [&distances](const size_t start, const arma::fmat& tile) {
+      distances.rows(start, start + tile.n_rows - 1) = tile;
+    });
+  return distances;
+}
+
+arma::fmat KMedoids::transformTransposed(const arma::fmat& points) {
+  arma::fmat distances(points.n_cols, medoidIndicesFinal.n_elem);
+  KMedoids::medoidDistanceBatches(
+    points,
+    true,
+    [&distances](const size_t start, const arma::fmat& tile) {
+      distances.rows(start, start + tile.n_rows - 1) = tile;
+    });
+  return distances;
+}
+
+void KMedoids::finishFit(
+  const arma::fmat& points) {
+  if (!quantizedPoints && !truncated) {
+    return;
+  }
+  if (quantizedPoints) {
+    quantizedPoints = nullptr;
+    quantized.release();
+    // The norms and cached distances are those of the quantized points
+    KMedoids::computeNorms(points);
+    reindex.assign(points.n_cols, -1);
+    medoidDistances.reset();
+  }
+  arma::frowvec bestDistances(points.n_cols);
+  arma::frowvec secondBestDistances(points.n_cols);
+  KMedoids::calcBestDistancesSwap(
+    points,
+    &medoidIndicesFinal,
+    &bestDistances,
+    &secondBestDistances,
+    &labels,
+    false);
+}
+
+void KMedoids::releaseFitState() {
+  distances.release();
+  cuda.release();
+  quantizedPoints = nullptr;
+  quantized.release();
+  medoidDistances.reset();
+  useMedoidDistances = false;
+}
+
+bool KMedoids::budgetExhausted() {
+  if (!truncated && timeBudget > 0) {
+    // The ranks agree on the decision, since their allReduceSum calls must
+    // pair up round by round
+    truncated = communicator.anyRank(
+      std::chrono::steady_clock::now() >= deadline);
+  }
+  return truncated;
+}
+
+void KMedoids::reportProgress(const std::string& phase, const size_t step) {
+  if (progressCallback) {
+    progressCallback(phase, step);
+  }
+}
+
+void KMedoids::checkInitialMedoids(
+  const arma::urowvec& initialMedoids,
+  const size_t n) const {
+  if (initialMedoids.n_elem != nMedoids) {
+    throw std::invalid_argument(
+      "Number of initial medoids must equal the number of medoids");
+  }
+  if (arma::any(initialMedoids >= n)) {
+    throw std::invalid_argument("Initial medoid index out of range");
+  }
+  const arma::urowvec distinctMedoids = arma::unique(initialMedoids);
+  if (distinctMedoids.n_elem != nMedoids) {
+    throw std::invalid_argument("Initial medoids must be distinct");
+  }
+}
+
+void KMedoids::prepareFit(
+  const arma::fmat& points,
+  const std::string& loss,
+  std::optional<std::reference_wrapper<const arma::fmat>> distMat,
+  std::optional<std::reference_wrapper<const arma::frowvec>> pointWeights) {
+  // Armadillo's generator is per thread and a fit may run on a thread other
+  // than the one that set the seed (e.g., fit_async), so seed it here
+  arma::arma_rng::set_seed(seed);
+  KMedoids::resetCounters();
+  profile.clear();
+  truncated = false;
+  deadline = std::chrono::steady_clock::now()
+    + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+      std::chrono::duration<double, std::milli>(timeBudget));
+
+  if (distMat) {  // User has provided a distance matrix
+    // Checks the shape once, so that lookups need no bounds checks
+    distances.reset(
+      distMat.value().get(),
+      points.n_cols,
+      distMatPrecision,
+      KMedoids::threadCount());
     useDistMat = true;
   } else {
     // In case the user is running a new problem without a distance matrix
     // after running a distance matrix problem
+    distances.release();
     useDistMat = false;
   }
 
-  if (inputData.n_rows == 0) {
+  if (points.n_cols == 0) {
     // TODO(@motiwari): Change this to an assertion that is properly raised
     throw std::invalid_argument("Dataset is empty");
   }
-  batchSize = fmin(inputData.n_rows, batchSize);
+  batchSize = fmin(points.n_cols, batchSize);
 
-  try {
-    KMedoids::setLossFn(loss);
-    if (algorithm == "PAM") {
-      static_cast<PAM*>(this)->fitPAM(inputData, distMat);
-    } else if (algorithm == "BanditPAM") {
-      static_cast<BanditPAM*>(this)->fitBanditPAM(inputData, distMat);
-    } else if (algorithm == "BanditPAM_orig") {
-      static_cast<BanditPAM_orig*>(this)->fitBanditPAM_orig(inputData, distMat);
-    } else if (algorithm == "FastPAM1") {
-      static_cast<FastPAM1*>(this)->fitFastPAM1(inputData, distMat);
+  if (pointWeights) {
+    const arma::frowvec& given = pointWeights->get();
+    if (given.n_elem != points.n_cols) {
+      throw std::invalid_argument("There must be one weight per point");
     }
-  } catch (std::invalid_argument& e) {
-    std::cout << e.what() << std::endl;
-    std::cout << "Error: Clustering did not run." << std::endl;
-    throw e;
+    double total = 0;
+    for (size_t i = 0; i < given.n_elem; i++) {
+      // Also rejects NaN
+      if (!(given(i) >= 0
+        && given(i) < std::numeric_limits<float>::infinity())) {
+        throw std::invalid_argument("Weights must be finite and non-negative");
+      }
+      total += given(i);
+    }
+    if (total <= 0) {
+      throw std::invalid_argument("Weights must not all be zero");
+    }
+    weights = given * static_cast<float>(points.n_cols / total);
+  } else {
+    weights.ones(points.n_cols);
+  }
+
+  KMedoids::setLossFn(loss);
+  if (dataPrecision == "float32" || useDistMat || sparsePoints) {
+    quantized.release();
+    quantizedPoints = nullptr;
+  } else {
+    quantized.reset(points, dataPrecision, KMedoids::threadCount());
+    quantizedPoints = &quantized;
   }
+  KMedoids::computeNorms(points);
+  useCuda = backend == "cuda" && !useDistMat && !sparsePoints
+    && !quantizedPoints;
+  if (useCuda) {
+    CudaLoss cudaLoss = CudaLoss::lp;
+    if (lossFn == &KMedoids::manhattan
+      || (lossFn == &KMedoids::LP && lp == 1)) {
+      cudaLoss = CudaLoss::l1;
+    } else if (lossFn == &KMedoids::LP && lp == 2) {
+      cudaLoss = CudaLoss::l2;
+    } else if (lossFn == &KMedoids::LINF) {
+      cudaLoss = CudaLoss::lInf;
+    } else if (lossFn == &KMedoids::cos) {
+      cudaLoss = CudaLoss::cosine;
+    }
+    cuda.reset(points, weights, cudaLoss, lp);
+  } else {
+    cuda.release();
+  }
+  useMedoidDistances = useCache && !useDistMat && !useCuda;
+  medoidDistances.reset();
+  persistCache = !cacheFile.empty() && useCache && !useDistMat
+    && !sparsePoints;
+  if (persistCache) {
+    dataFingerprint = KMedoids::cacheFingerprint(points);
+  }
+  // Every point is uncached until an algorithm initializes the cache; the
+  // algorithms that never do still look points up in reindex
+  reindex.assign(points.n_cols, -1);
 }
 
 arma::urowvec KMedoids::getMedoidsBuild() const {
@@ -199,6 +906,92 @@ void KMedoids::setCacheWidth(size_t newCacheWidth) {
   cacheWidth = newCacheWidth;
 }
 
+size_t KMedoids::getCacheBudget() const {
+  return cacheBudget;
+}
+
+void KMedoids::setCacheBudget(size_t newCacheBudget) {
+  cacheBudget = newCacheBudget;
+}
+
+std::string KMedoids::getCacheFile() const {
+  return cacheFile;
+}
+
+void KMedoids::setCacheFile(const std::string& newCacheFile) {
+  cacheFile = newCacheFile;
+}
+
+std::string KMedoids::getCacheAdmission() const {
+  return cacheAdmission;
+}
+
+void KMedoids::setCacheAdmission(const std::string& newCacheAdmission) {
+  if (newCacheAdmission != "permutation" && newCacheAdmission != "survivors") {
+    throw std::invalid_argument(
+      "Cache admission must be permutation or survivors");
+  }
+  cacheAdmission = newCacheAdmission;
+}
+
+std::string KMedoids::getDistMatPrecision() const {
+  return distMatPrecision;
+}
+
+void KMedoids::setDistMatPrecision(const std::string& newDistMatPrecision) {
+  if (newDistMatPrecision != "float32" && newDistMatPrecision != "float16" &&
+    newDistMatPrecision != "bfloat16") {
+    throw std::invalid_argument(
+      "Distance matrix precision must be float32, float16 or bfloat16");
+  }
+  distMatPrecision = newDistMatPrecision;
+}
+
+std::string KMedoids::getDataPrecision() const {
+  return dataPrecision;
+}
+
+void KMedoids::setDataPrecision(const std::string& newDataPrecision) {
+  if (newDataPrecision != "float32" && newDataPrecision != "float16" &&
+    newDataPrecision != "bfloat16" && newDataPrecision != "int8") {
+    throw std::invalid_argument(
+      "Data precision must be float32, float16, bfloat16 or int8");
+  }
+  dataPrecision = newDataPrecision;
+}
+
+double KMedoids::getTimeBudget() const {
+  return timeBudget;
+}
+
+void KMedoids::setTimeBudget(double newTimeBudget) {
+  if (!(newTimeBudget >= 0)) {
+    throw std::invalid_argument("Time budget must be non-negative");
+  }
+  timeBudget = newTimeBudget;
+}
+
+bool KMedoids::getTruncated() const {
+  return truncated;
+}
+
+void KMedoids::setProgressCallback(
+  std::function<void(const std::string&, size_t)> newProgressCallback) {
+  progressCallback = std::move(newProgressCallback);
+}
+
+bool KMedoids::getDistributed() const {
+  return communicator.isJoined();
+}
+
+void KMedoids::setDistributed(bool newDistributed) {
+  if (newDistributed) {
+    communicator.join();
+  } else {
+    communicator.leave();
+  }
+}
+
 bool KMedoids::getParallelize() const {
   return parallelize;
 }
@@ -208,6 +1001,72 @@ void KMedoids::setParallelize(bool newParallelize) {
   parallelize = newParallelize;
 }
 
+bool KMedoids::getCollapseDuplicates() const {
+  return collapseDuplicates;
+}
+
+void KMedoids::setCollapseDuplicates(const bool newCollapseDuplicates) {
+  collapseDuplicates = newCollapseDuplicates;
+}
+
+size_t KMedoids::getNumThreads() const {
+  return numThreads;
+}
+
+void KMedoids::setNumThreads(const size_t newNumThreads) {
+  numThreads = newNumThreads;
+}
+
+std::string KMedoids::getSchedule() const {
+  return schedule;
+}
+
+void KMedoids::setSchedule(const std::string& newSchedule) {
+  if (newSchedule != "static" && newSchedule != "dynamic" &&
+    newSchedule != "adaptive") {
+    throw std::invalid_argument(
+      "Schedule must be static, dynamic or adaptive");
+  }
+  schedule = newSchedule;
+}
+
+std::string KMedoids::getBackend() const {
+  return backend;
+}
+
+void KMedoids::setBackend(const std::string& newBackend) {
+  if (newBackend != "cpu" && newBackend != "cuda") {
+    throw std::invalid_argument("Backend must be cpu or cuda");
+  }
+  if (newBackend == "cuda" && !CudaBackend::isAvailable()) {
+    throw std::invalid_argument(
+      "The CUDA backend requires BanditPAM to be built with CUDA support "
+      "and a GPU");
+  }
+  backend = newBackend;
+}
+
+int KMedoids::threadCount() const {
+  if (!parallelize) {
+    return 1;
+  }
+  return numThreads > 0 ? static_cast<int>(numThreads) : omp_get_max_threads();
+}
+
+size_t KMedoids::threadSlots() const {
+  return std::max(KMedoids::threadCount(), omp_get_max_threads());
+}
+
+void KMedoids::reserveThreadBuffers() {
+  const size_t slots = KMedoids::threadSlots();
+  if (threadCounters.size() < slots) {
+    threadCounters.resize(slots);
+  }
+  if (tileWorkspaces.size() < slots) {
+    tileWorkspaces.resize(slots);
+  }
+}
+
 size_t KMedoids::getDistanceComputations(const bool includeMisc) const {
     if (includeMisc) {
         return numMiscDistanceComputations +
@@ -248,7 +1107,14 @@ size_t KMedoids::getTotalSwapTime() const {
 }
 
 float KMedoids::getTimePerSwap() const {
-  return totalSwapTime / steps;
+  if (steps == 0) {
+    return 0;
+  }
+  return static_cast<float>(totalSwapTime) / steps;
+}
+
+const FitProfile& KMedoids::getProfile() const {
+  return profile;
 }
 
 void KMedoids::setLossFn(std::string loss) {
@@ -291,119 +1157,548 @@ std::string KMedoids::getLossFn() const {
 }
 
 
+void KMedoids::initializeCache(const size_t n) {
+  reindex.assign(n, -1);
+  admitSurvivors = false;
+  if (!useCache) {
+    return;
+  }
+
+  size_t m = std::min(n, cacheWidth);
+  if (cacheBudget > 0) {
+    m = std::min(m, cacheBudget / (n * sizeof(std::atomic<float>)));
+  }
+  if (persistCache) {
+    // A file that is reattached keeps the points it was created with, which
+    // are moved to the front of the permutation as for a reused cache
+    std::vector<uint64_t> points(
+      permutation.begin(),
+      permutation.begin() + m);
+    cache.attach(
+      cacheFile,
+      n,
+      m,
+      dataFingerprint,
+      &points,
+      KMedoids::threadCount());
+    cachedPoints.set_size(m);
+    for (size_t counter = 0; counter < m; counter++) {
+      if (points[counter] >= n || reindex[points[counter]] >= 0) {
+        cache.release();
+        throw std::invalid_argument("Corrupt cache file: " + cacheFile);
+      }
+      reindex[points[counter]] = counter;
+      cachedPoints(counter) = points[counter];
+    }
+    std::stable_partition(
+      permutation.begin(),
+      permutation.end(),
+      [this](const arma::uword point) { return reindex[point] >= 0; });
+    return;
+  }
+  admitSurvivors = cacheAdmission == "survivors";
+  if (reuseCache && !cachedPoints.is_empty() && cache.getWidth() == m) {
+    // A previous fit on the same data filled the cache for these points, so
+    // it is kept. The points are moved to the front of the permutation, so
+    // they are still sampled first, each group in the order of this fit.
+    // Columns left free by the previous fit can still be admitted.
+    for (size_t counter = 0; counter < cachedPoints.n_elem; counter++) {
+      reindex[cachedPoints(counter)] = counter;
+    }
+    std::stable_partition(
+      permutation.begin(),
+      permutation.end(),
+      [this](const arma::uword point) { return reindex[point] >= 0; });
+    return;
+  }
+  cache.reset(n, m, KMedoids::threadCount());
+  // Surviving arms are admitted to the second half of the columns
+  const size_t numPermuted = admitSurvivors ? m - m / 2 : m;
+  cachedPoints.set_size(numPermuted);
+
+  #pragma omp parallel for if (this->parallelize) \
+    num_threads(this->threadCount())
+  for (size_t counter = 0; counter < numPermuted; counter++) {
+    reindex[permutation[counter]] = counter;
+    cachedPoints(counter) = permutation[counter];
+  }
+}
+
+void KMedoids::initializeCandidateCache(const size_t n) {
+  if (this->useDistMat) {
+    reindex.assign(n, -1);
+    admitSurvivors = false;
+    return;
+  }
+  permutation.set_size(n);
+  for (size_t i = 0; i < n; i++) {
+    permutation(i) = i;
+  }
+  permutationIdx = 0;
+  KMedoids::initializeCache(n);
+}
+
+void KMedoids::resetCounters() {
+  numMiscDistanceComputations = 0;
+  numBuildDistanceComputations = 0;
+  numSwapDistanceComputations = 0;
+  numCacheWrites = 0;
+  numCacheHits = 0;
+  numCacheMisses = 0;
+  threadCounters.assign(KMedoids::threadSlots(), ThreadCounters());
+  KMedoids::reserveThreadBuffers();
+}
+
+void KMedoids::mergeCounters() {
+  for (ThreadCounters& counters : threadCounters) {
+    numMiscDistanceComputations += counters.distanceComputations[0];
+    numBuildDistanceComputations += counters.distanceComputations[1];
+    numSwapDistanceComputations += counters.distanceComputations[2];
+    numCacheWrites += counters.cacheWrites;
+    numCacheHits += counters.cacheHits;
+    numCacheMisses += counters.cacheMisses;
+    counters = ThreadCounters();
+  }
+}
+
+size_t KMedoids::numTileTargets(const size_t numTargets) const {
+  const size_t targetsPerBlock = (numTargets + tileBlocks - 1) / tileBlocks;
+  return std::max(minTileTargets, std::min(maxTileTargets, targetsPerBlock));
+}
+
+uint64_t KMedoids::cacheFingerprint(const arma::fmat& points) const {
+  const size_t N = points.n_cols;
+  std::vector<uint64_t> columnHashes(N);
+  const ColumnHash columnHash{&points};
+  #pragma omp parallel for if (this->parallelize) \
+    num_threads(this->threadCount())
+  for (size_t i = 0; i < N; i++) {
+    columnHashes[i] = columnHash(i);
+  }
+  // FNV-1a over the shape, the column hashes and the settings
+  uint64_t hash = 14695981039346656037ULL;
+  const auto mix = [&hash](const uint64_t value) {
+    hash = (hash ^ value) * 1099511628211ULL;
+  };
+  mix(points.n_rows);
+  mix(N);
+  for (const uint64_t value : columnHashes) {
+    mix(value);
+  }
+  const std::string settings = KMedoids::getLossFn() + "/" + dataPrecision;
+  for (const char c : settings) {
+    mix(static_cast<unsigned char>(c));
+  }
+  return hash;
+}
+
+void KMedoids::computeNorms(const arma::fmat& points) {
+  const bool useCosine = (lossFn == &KMedoids::cos);
+  const bool useL2 = (lossFn == &KMedoids::LP) && (lp == 2);
+  if (!useCosine && !useL2) {
+    norms.reset();
+    squaredNorms.reset();
+    return;
+  }
+
+  // Reduce each contiguous column in place, so that no temporary of the
+  // size of the data is created
+  const DistanceKernels& kernels = distanceKernels();
+  squaredNorms.set_size(points.n_cols);
+  #pragma omp parallel for if (this->parallelize) \
+    num_threads(this->threadCount())
+  for (size_t i = 0; i < points.n_cols; i++) {
+    if (sparsePoints) {
+      const SparseColumn point = sparseColumn(*sparsePoints, i);
+      squaredNorms(i) = sparseDot(point, point);
+    } else if (quantizedPoints) {
+      squaredNorms(i) = quantizedPoints->reduce(i, i, QuantizedDot{});
+    } else {
+      const float* point = points.colptr(i);
+      squaredNorms(i) = kernels.dot(point, point, points.n_rows);
+    }
+  }
+  if (useCosine) {
+    norms = arma::sqrt(squaredNorms);
+  } else {
+    norms.reset();
+  }
+  if (!useL2) {
+    squaredNorms.reset();
+  }
+}
+
+void KMedoids::syncMedoidDistances(
+  const arma::fmat& data,
+  const arma::urowvec* medoidIndices) {
+  if (!useMedoidDistances) {
+    return;
+  }
+  const size_t N = data.n_cols;
+  const size_t K = medoidIndices->n_cols;
+  if (medoidDistances.n_rows != N || medoidDistances.n_cols != K) {
+    // The table counts against the cache: it has no more columns than
+    // cacheWidth, and with a budget it only gets what the cache leaves over
+    const size_t tableBytes = N * K * sizeof(float);
+    const size_t cacheBytes =
+      N * cache.getWidth() * sizeof(std::atomic<float>);
+    if (K > cacheWidth ||
+      (cacheBudget > 0 && cacheBytes + tableBytes > cacheBudget)) {
+      useMedoidDistances = false;
+      medoidDistances.reset();
+      return;
+    }
+    medoidDistances.set_size(N, K);
+    medoidDistances.fill(std::numeric_limits<float>::quiet_NaN());
+    medoidDistancePoints = *medoidIndices;
+    return;
+  }
+  for (size_t k = 0; k < K; k++) {
+    if (medoidDistancePoints(k) != (*medoidIndices)(k)) {
+      medoidDistances.col(k).fill(std::numeric_limits<float>::quiet_NaN());
+      medoidDistancePoints(k) = (*medoidIndices)(k);
+    }
+  }
+}
+
+template <typename LossFunction>
+float KMedoids::medoidLoss(
+  const arma::fmat& data,
+  const arma::urowvec* medoidIndices,
+  const size_t i,
+  const size_t k,
+  const LossFunction& loss) {
+  if (!useMedoidDistances || medoidDistances.n_cols != medoidIndices->n_cols) {
+    // 0 for MISC
+    return KMedoids::cachedLoss(
+      data,
+      i,
+      (*medoidIndices)(k),
+      0,
+      loss);
+  }
+  float& distance = medoidDistances(i, k);
+  if (std::isnan(distance)) {
+    // 0 for MISC
+    distance = KMedoids::cachedLoss(
+      data,
+      i,
+      (*medoidIndices)(k),
+      0,
+      loss);
+  } else {
+    KMedoids::localCounters().cacheHits++;
+  }
+  return distance;
+}
+
+void KMedoids::admitCacheColumns(const arma::uvec& points) {
+  if (!admitSurvivors) {
+    return;
+  }
+  size_t numAdmitted = cachedPoints.n_elem;
+  const size_t width = cache.getWidth();
+  for (size_t t = 0; t < points.n_elem && numAdmitted < width; t++) {
+    if (reindex[points(t)] < 0) {
+      reindex[points(t)] = numAdmitted;
+      cachedPoints.resize(numAdmitted + 1);
+      cachedPoints(numAdmitted++) = points(t);
+    }
+  }
+}
+
+template <typename LossFunction>
+void KMedoids::computeMedoidTable(
+  const arma::fmat& data,
+  const arma::urowvec* medoidIndices,
+  const LossFunction& loss) {
+  // The cosine distance and user-provided distances need not satisfy the
+  // triangle inequality, and with two medoids there is nothing to skip
+  const size_t K = medoidIndices->n_cols;
+  if (useDistMat || lossFn == &KMedoids::cos || K <= 2) {
+    medoidTable.reset();
+    return;
+  }
+  medoidTable.set_size(K, K);
+  #pragma omp parallel for if (this->parallelize) \
+    num_threads(this->threadCount())
+  for (size_t k = 0; k < K; k++) {
+    medoidTable(k, k) = 0;
+    for (size_t l = 0; l < k; l++) {
+      const float cost = KMedoids::medoidLoss(
+        data,
+        medoidIndices,
+        (*medoidIndices)(k),
+        l,
+        loss);
+      medoidTable(k, l) = cost;
+      medoidTable(l, k) = cost;
+    }
+  }
+}
+
+template <typename LossFunction>
+void KMedoids::scanMedoids(
+  const arma::fmat& data,
+  const arma::urowvec* medoidIndices,
+  const size_t i,
+  const LossFunction& loss,
+  arma::frowvec* bestDistances,
+  arma::frowvec* secondBestDistances,
+  arma::urowvec* assignments) {
+  const size_t K = medoidIndices->n_cols;
+  float best = std::numeric_limits<float>::infinity();
+  float second = std::numeric_limits<float>::infinity();
+
+  // The two smallest distances computed so far, in any order, bound the
+  // final second best distance from above
+  const bool prune = medoidTable.n_rows == K;
+  size_t anchor = 0;
+  float anchorCost = 0;
+  float firstBound = std::numeric_limits<float>::infinity();
+  float secondBound = std::numeric_limits<float>::infinity();
+  if (prune) {
+    anchor = (*assignments)(i) < K ? (*assignments)(i) : 0;
+    anchorCost = KMedoids::medoidLoss(
+      data,
+      medoidIndices,
+      i,
+      anchor,
+      loss);
+    firstBound = anchorCost;
+  }
+  for (size_t k = 0; k < K; k++) {
+    float cost = anchorCost;
+    if (!prune || k != anchor) {
+      if (prune) {
+        const float lowerBound = std::fabs(medoidTable(anchor, k) - anchorCost);
+        if (lowerBound - secondBound
+          > pruningTolerance * (medoidTable(anchor, k) + anchorCost)) {
+          continue;
+        }
+      }
+      cost = KMedoids::medoidLoss(data, medoidIndices, i, k, loss);
+      if (cost < firstBound) {
+        secondBound = firstBound;
+        firstBound = cost;
+      } else if (cost < secondBound) {
+        secondBound = cost;
+      }
+    }
+    if (cost < best) {
+      secondAssignments(i) = (*assignments)(i);
+      (*assignments)(i) = k;
+      second = best;
+      best = cost;
+    } else if (cost < second) {
+      secondAssignments(i) = k;
+      second = cost;
+    }
+  }
+  (*bestDistances)(i) = best;
+  (*secondBestDistances)(i) = second;
+}
+
 void KMedoids::calcBestDistancesSwap(
   const arma::fmat& data,
-  std::optional<std::reference_wrapper<const arma::fmat>> distMat,
   const arma::urowvec* medoidIndices,
   arma::frowvec* bestDistances,
   arma::frowvec* secondBestDistances,
   arma::urowvec* assignments,
   const bool swapPerformed) {
-  #pragma omp parallel for if (this->parallelize)
-  for (size_t i = 0; i < data.n_cols; i++) {
-    float best = std::numeric_limits<float>::infinity();
-    float second = std::numeric_limits<float>::infinity();
-    for (size_t k = 0; k < medoidIndices->n_cols; k++) {
-      // 0 for MISC
-      float cost =
-          KMedoids::cachedLoss(data, distMat, i, (*medoidIndices)(k), 0);
-      if (cost < best) {
-        (*assignments)(i) = k;
-        second = best;
-        best = cost;
-      } else if (cost < second) {
-        second = cost;
+  if (useCuda) {
+    // The results also stay on the device for the next bandit rounds
+    medoidTable.reset();
+    cuda.assign(
+      *medoidIndices,
+      bestDistances,
+      secondBestDistances,
+      assignments);
+    // 0 for MISC
+    KMedoids::localCounters().distanceComputations[0] +=
+      data.n_cols * medoidIndices->n_cols;
+  } else {
+    secondAssignments.set_size(data.n_cols);
+    KMedoids::syncMedoidDistances(data, medoidIndices);
+    KMedoids::dispatchLossFn([&](const auto& loss) {
+      KMedoids::computeMedoidTable(data, medoidIndices, loss);
+      #pragma omp parallel for if (this->parallelize) \
+        num_threads(this->threadCount())
+      for (size_t i = 0; i < data.n_cols; i++) {
+        KMedoids::scanMedoids(
+          data,
+          medoidIndices,
+          i,
+          loss,
+          bestDistances,
+          secondBestDistances,
+          assignments);
       }
-    }
-    (*bestDistances)(i) = best;
-    (*secondBestDistances)(i) = second;
+    });
   }
 
   if (!swapPerformed) {
     // We have converged; update the final loss
-    averageLoss = arma::accu(*bestDistances) / data.n_cols;
+    averageLoss = KMedoids::weightedMean(*bestDistances);
   }
 }
 
-float KMedoids::calcLoss(
+void KMedoids::updateBestDistancesSwap(
   const arma::fmat& data,
-  std::optional<std::reference_wrapper<const arma::fmat>> distMat,
-  const arma::urowvec* medoidIndices) {
-  float total = 0;
-  // TODO(@motiwari): is this parallel loop accumulating properly?
-  #pragma omp parallel for if (this->parallelize)
-  for (size_t i = 0; i < data.n_cols; i++) {
-    float cost = std::numeric_limits<float>::infinity();
-    for (size_t k = 0; k < nMedoids; k++) {
-      float currCost = KMedoids::cachedLoss(
+  const arma::urowvec* medoidIndices,
+  const size_t swappedMedoid,
+  arma::frowvec* bestDistances,
+  arma::frowvec* secondBestDistances,
+  arma::urowvec* assignments,
+  const bool swapPerformed) {
+  if (!swapPerformed) {
+    // We have converged; update the final loss
+    averageLoss = KMedoids::weightedMean(*bestDistances);
+    return;
+  }
+  if (useCuda) {
+    // A full assignment on the device costs less than copying the state of
+    // an incremental one back and forth
+    KMedoids::calcBestDistancesSwap(
+      data,
+      medoidIndices,
+      bestDistances,
+      secondBestDistances,
+      assignments);
+    return;
+  }
+
+  const size_t newMedoid = (*medoidIndices)(swappedMedoid);
+  // Only the column of the swapped medoid is emptied
+  KMedoids::syncMedoidDistances(data, medoidIndices);
+  KMedoids::dispatchLossFn([&](const auto& loss) {
+    // Only the row and column of the new medoid change
+    const bool prune = medoidTable.n_rows == medoidIndices->n_cols;
+    if (prune) {
+      for (size_t k = 0; k < medoidTable.n_rows; k++) {
+        const float cost = k == swappedMedoid ? 0 : KMedoids::medoidLoss(
+          data, medoidIndices, newMedoid, k, loss);
+        medoidTable(k, swappedMedoid) = cost;
+        medoidTable(swappedMedoid, k) = cost;
+      }
+    }
+    #pragma omp parallel for if (this->parallelize) \
+      num_threads(this->threadCount())
+    for (size_t i = 0; i < data.n_cols; i++) {
+      if ((*assignments)(i) == swappedMedoid
+        || secondAssignments(i) == swappedMedoid) {
+        // Lost its best or second best medoid, so it needs a full rescan
+        KMedoids::scanMedoids(
+          data,
+          medoidIndices,
+          i,
+          loss,
+          bestDistances,
+          secondBestDistances,
+          assignments);
+        continue;
+      }
+
+      // The new medoid cannot become the best or second best medoid if the
+      // triangle inequality puts it beyond the second best distance
+      if (prune) {
+        const float between = medoidTable((*assignments)(i), swappedMedoid);
+        const float lowerBound = std::fabs(between - (*bestDistances)(i));
+        if (lowerBound - (*secondBestDistances)(i)
+          > pruningTolerance * (between + (*bestDistances)(i))) {
+          continue;
+        }
+      }
+
+      // Ties are broken towards lower medoid indices, as in a full rescan
+      float cost = KMedoids::medoidLoss(
         data,
-        distMat,
+        medoidIndices,
         i,
-        (*medoidIndices)(k),
-        0);  // 0 for Misc
-      if (currCost < cost) {
-        cost = currCost;
+        swappedMedoid,
+        loss);
+      if (cost < (*bestDistances)(i)
+        || (cost == (*bestDistances)(i)
+          && swappedMedoid < (*assignments)(i))) {
+        secondAssignments(i) = (*assignments)(i);
+        (*secondBestDistances)(i) = (*bestDistances)(i);
+        (*assignments)(i) = swappedMedoid;
+        (*bestDistances)(i) = cost;
+      } else if (cost < (*secondBestDistances)(i)
+        || (cost == (*secondBestDistances)(i)
+          && swappedMedoid < secondAssignments(i))) {
+        secondAssignments(i) = swappedMedoid;
+        (*secondBestDistances)(i) = cost;
       }
     }
-    total += cost;
-  }
+  });
+}
+
+float KMedoids::calcLoss(
+  const arma::fmat& data,
+  const arma::urowvec* medoidIndices) {
+  // Each thread only writes the costs of its own points, which are added up
+  // in order below, so the loss is the same for any number of threads
+  arma::frowvec costs(data.n_cols);
+  KMedoids::reserveThreadBuffers();
+  KMedoids::syncMedoidDistances(data, medoidIndices);
+  KMedoids::dispatchLossFn([&](const auto& loss) {
+    #pragma omp parallel for if (this->parallelize) \
+      num_threads(this->threadCount())
+    for (size_t i = 0; i < data.n_cols; i++) {
+      float cost = std::numeric_limits<float>::infinity();
+      for (size_t k = 0; k < nMedoids; k++) {
+        float currCost = KMedoids::medoidLoss(
+          data,
+          medoidIndices,
+          i,
+          k,
+          loss);
+        if (currCost < cost) {
+          cost = currCost;
+        }
+      }
+      costs(i) = cost;
+    }
+  });
 
   // Returns average distance
-  return total/data.n_cols;
+  return KMedoids::weightedMean(costs);
+}
+
+float KMedoids::weightedMean(const arma::frowvec& bestDistances) const {
+  double total = 0;
+  for (size_t i = 0; i < bestDistances.n_elem; i++) {
+    total += weights(i) * bestDistances(i);
+  }
+  return total / bestDistances.n_elem;
 }
 
 float KMedoids::cachedLoss(
   const arma::fmat& data,
-  std::optional<std::reference_wrapper<const arma::fmat>> distMat,
   const size_t i,
   const size_t j,
   const size_t category,
   const bool useCacheFunctionOverride
   ) {
-    // TODO(@motiwari): Change category to an enum
-    if (category == 0) {  // MISC
-        numMiscDistanceComputations++;
-    } else if (category == 1) {  // BUILD
-        numBuildDistanceComputations++;
-    } else if (category == 2) {  // SWAP
-        numSwapDistanceComputations++;
-    } else {
-        // TODO(@motiwari): Throw exception
-    }
-
-  if (this->useDistMat) {
-    return distMat.value().get().at(i, j);
-  }
-
-  if (!useCache) {
-    return (this->*lossFn)(data, i, j);
-  }
-
-  // TODO(@motiwari): Should infer n and m from the size of the cache
-  size_t n = data.n_cols;
-  size_t m = fmin(n, cacheWidth);
-
-  // test this is one of the early points in the permutation
-  if (reindex.find(j) != reindex.end()) {
-    // TODO(@motiwari): Potential race condition with shearing?
-    // T1 begins to write to cache and then T2 access in the middle of write?
-    if (cache[(m*i) + reindex[j]] == -1) {
-      numCacheWrites++;
-      cache[(m*i) + reindex[j]] = (this->*lossFn)(data, i, j);
-    }
-    numCacheHits++;
-    return cache[m*i + reindex[j]];
-  }
-
-  numCacheMisses++;
-  return (this->*lossFn)(data, i, j);
+  // Resolves the loss function on every call; hot loops should dispatch
+  // once via dispatchLossFn and use the templated overload instead
+  return KMedoids::cachedLoss(
+    data,
+    i,
+    j,
+    category,
+    [this](const arma::fmat& points, const size_t x, const size_t y) {
+      return (this->*lossFn)(points, x, y);
+    });
 }
 
 void KMedoids::checkAlgorithm(const std::string& algorithm) const {
   if ((algorithm != "BanditPAM") &&
       (algorithm != "BanditPAM_orig") &&
       (algorithm != "PAM") &&
-      (algorithm != "FastPAM1")) {
+      (algorithm != "FastPAM1") &&
+      (algorithm != "FasterPAM")) {
     // TODO(@motiwari): Better error type
     throw "unrecognized algorithm";
   }
@@ -416,26 +1711,32 @@ float KMedoids::getAverageLoss() const {
 float KMedoids::LP(const arma::fmat& data,
   const size_t i,
   const size_t j) const {
-  return arma::norm(data.col(i) - data.col(j), lp);
+  if (lp == 1) {
+    return L1Loss{}(data, i, j);
+  } else if (lp == 2) {
+    return L2Loss{}(data, i, j);
+  }
+  return LPLoss{lp}(data, i, j);
 }
 
 float KMedoids::LINF(
   const arma::fmat& data,
   const size_t i,
   const size_t j) const {
-  return arma::max(arma::abs(data.col(i) - data.col(j)));
+  return LInfLoss{}(data, i, j);
 }
 
 float KMedoids::cos(const arma::fmat& data,
   const size_t i,
   const size_t j) const {
-  return 1 - (arma::dot(data.col(i), data.col(j))
-    / (arma::norm(data.col(i)) * arma::norm(data.col(j))));
+  // The baseline algorithms do not precompute norms, so use the fused
+  // kernel that computes them alongside the dot product
+  return distanceKernels().cosine(data.colptr(i), data.colptr(j), data.n_rows);
 }
 
 float KMedoids::manhattan(const arma::fmat& data,
   const size_t i,
   const size_t j) const {
-  return arma::accu(arma::abs(data.col(i) - data.col(j)));
+  return L1Loss{}(data, i, j);
 }
 }  // namespace km
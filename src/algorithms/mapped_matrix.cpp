@@ -0,0 +1,184 @@
+/**
+ * @file mapped_matrix.cpp
+ * @date 2026-10-14
+ *
+ * Contains the parsing and memory-mapping of float32 .npy files.
+ */
+
+#include "mapped_matrix.hpp"
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define KM_HAVE_MMAP 1
+#endif
+
+namespace km {
+namespace {
+// Every .npy file starts with these bytes, followed by the format version
+constexpr char npyMagic[] = "\x93NUMPY";
+constexpr size_t npyMagicSize = 6;
+
+/**
+ * @brief Returns the text after the given key of the header dictionary,
+ * with leading spaces removed.
+ */
+std::string valueOf(
+  const std::string& header,
+  const std::string& key,
+  const std::string& path) {
+  const size_t position = header.find("'" + key + "'");
+  if (position == std::string::npos) {
+    throw std::invalid_argument("Missing " + key + " in .npy header: " + path);
+  }
+  size_t start = header.find(':', position);
+  if (start == std::string::npos) {
+    throw std::invalid_argument("Malformed .npy header: " + path);
+  }
+  start = header.find_first_not_of(' ', start + 1);
+  return start == std::string::npos ? std::string() : header.substr(start);
+}
+}  // namespace
+
+MappedMatrix::MappedMatrix(const std::string& path) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file) {
+    throw std::invalid_argument("Cannot open file: " + path);
+  }
+  file.seekg(0, std::ios::end);
+  const size_t fileSize = file.tellg();
+  file.seekg(0, std::ios::beg);
+
+  // The magic string, the version, and the little-endian length of the
+  // header: 2 bytes in version 1.0, and 4 bytes in versions 2.0 and 3.0
+  unsigned char preamble[12] = {0};
+  file.read(reinterpret_cast<char*>(preamble), 10);
+  if (!file || std::memcmp(preamble, npyMagic, npyMagicSize) != 0) {
+    throw std::invalid_argument("Not a .npy file: " + path);
+  }
+  const unsigned int majorVersion = preamble[6];
+  size_t headerSize = 0;
+  size_t headerStart = 0;
+  if (majorVersion == 1) {
+    headerSize = preamble[8] | (preamble[9] << 8);
+    headerStart = 10;
+  } else if (majorVersion == 2 || majorVersion == 3) {
+    file.read(reinterpret_cast<char*>(preamble) + 10, 2);
+    headerSize = static_cast<size_t>(preamble[8])
+      | (static_cast<size_t>(preamble[9]) << 8)
+      | (static_cast<size_t>(preamble[10]) << 16)
+      | (static_cast<size_t>(preamble[11]) << 24);
+    headerStart = 12;
+  } else {
+    throw std::invalid_argument("Unsupported .npy version: " + path);
+  }
+  std::string header(headerSize, '\0');
+  file.read(&header[0], headerSize);
+  if (!file) {
+    throw std::invalid_argument("Truncated .npy header: " + path);
+  }
+  MappedMatrix::parseHeader(header.data(), header.size(), path);
+  dataOffset = headerStart + headerSize;
+
+  const size_t dataSize = rows * cols * sizeof(float);
+  if (fileSize < dataOffset + dataSize) {
+    throw std::invalid_argument("Truncated .npy data: " + path);
+  }
+
+  float* data = nullptr;
+#ifdef KM_HAVE_MMAP
+  if (dataSize > 0) {
+    const int descriptor = open(path.c_str(), O_RDONLY);
+    if (descriptor >= 0) {
+      void* memory =
+        mmap(nullptr, fileSize, PROT_READ, MAP_SHARED, descriptor, 0);
+      // The mapping stays valid after the descriptor is closed
+      close(descriptor);
+      if (memory != MAP_FAILED) {
+        mapping = memory;
+        mappingSize = fileSize;
+        data = reinterpret_cast<float*>(
+          static_cast<char*>(mapping) + dataOffset);
+      }
+    }
+  }
+#endif
+  if (!data) {
+    buffer.resize(rows * cols);
+    file.seekg(dataOffset, std::ios::beg);
+    file.read(reinterpret_cast<char*>(buffer.data()), dataSize);
+    if (!file) {
+      throw std::invalid_argument("Cannot read .npy data: " + path);
+    }
+    data = buffer.data();
+  }
+
+  // The view is only ever exposed as const, so the read-only mapping is
+  // never written through
+  if (fortranOrder) {
+    view.emplace(data, rows, cols, false, true);
+  } else {
+    view.emplace(data, cols, rows, false, true);
+  }
+}
+
+MappedMatrix::~MappedMatrix() {
+  view.reset();
+#ifdef KM_HAVE_MMAP
+  if (mapping) {
+    munmap(mapping, mappingSize);
+  }
+#endif
+}
+
+void MappedMatrix::parseHeader(
+  const char* header,
+  const size_t size,
+  const std::string& path) {
+  const std::string text(header, size);
+
+  const std::string descr = valueOf(text, "descr", path);
+  if (descr.compare(0, 5, "'<f4'") != 0) {
+    throw std::invalid_argument(
+      "Only float32 ('<f4') .npy files are supported: " + path);
+  }
+
+  const std::string order = valueOf(text, "fortran_order", path);
+  fortranOrder = order.compare(0, 4, "True") == 0;
+
+  // The shape is a tuple such as (N, d), (N,) or ()
+  const std::string shape = valueOf(text, "shape", path);
+  const size_t end = shape.find(')');
+  if (shape.empty() || shape[0] != '(' || end == std::string::npos) {
+    throw std::invalid_argument("Malformed shape in .npy header: " + path);
+  }
+  std::vector<size_t> dimensions;
+  size_t position = 1;
+  while (position < end) {
+    const size_t digits = shape.find_first_of("0123456789", position);
+    if (digits == std::string::npos || digits > end) {
+      break;
+    }
+    size_t length = 0;
+    dimensions.push_back(std::stoull(shape.substr(digits), &length));
+    position = digits + length;
+  }
+  if (dimensions.size() == 1) {
+    rows = dimensions[0];
+    cols = 1;
+  } else if (dimensions.size() == 2) {
+    rows = dimensions[0];
+    cols = dimensions[1];
+  } else {
+    throw std::invalid_argument(
+      "Only 1-D and 2-D .npy arrays are supported: " + path);
+  }
+}
+}  // namespace km
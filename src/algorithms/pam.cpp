@@ -11,26 +11,41 @@
 #include "pam.hpp"
 
 #include <armadillo>
+#include <algorithm>
 #include <unordered_map>
 
 namespace km {
 void PAM::fitPAM(
-  const arma::fmat& inputData,
-  std::optional<std::reference_wrapper<const arma::fmat>> distMat) {
-  data = arma::trans(inputData);
+  const arma::fmat& data,
+  std::optional<std::reference_wrapper<const arma::urowvec>> initialMedoids) {
+  if (this->useCache) {
+    KMedoids::initializeCandidateCache(data.n_cols);
+  }
+
   arma::urowvec medoidIndices(nMedoids);
-  PAM::buildPAM(data, distMat, &medoidIndices);
+  if (initialMedoids) {
+    medoidIndices = initialMedoids->get();
+  } else {
+    ScopedPhaseTimer timer(&profile.build);
+    PAM::buildPAM(data, &medoidIndices);
+  }
   steps = 0;
   medoidIndicesBuild = medoidIndices;
   arma::urowvec assignments(data.n_cols);
 
   size_t i = 0;
   bool medoidChange = true;
-  while (i < maxIter && medoidChange) {
+  while (i < maxIter && medoidChange && !KMedoids::budgetExhausted()) {
     auto previous(medoidIndices);
-    PAM::swapPAM(data, distMat, &medoidIndices, &assignments);
+    profile.swapSteps.emplace_back();
+    {
+      ScopedPhaseTimer swapTimer(&profile.swap);
+      ScopedPhaseTimer stepTimer(&profile.swapSteps.back());
+      PAM::swapPAM(data, &medoidIndices, &assignments);
+    }
     medoidChange = arma::any(medoidIndices != previous);
     i++;
+    KMedoids::reportProgress("swap", i);
   }
   medoidIndicesFinal = medoidIndices;
   labels = assignments;
@@ -39,45 +54,44 @@ void PAM::fitPAM(
 
 void PAM::buildPAM(
   const arma::fmat& data,
-  std::optional<std::reference_wrapper<const arma::fmat>> distMat,
   arma::urowvec* medoidIndices) {
-  size_t N = data.n_cols;
-  arma::frowvec estimates(N, arma::fill::zeros);
+  const size_t N = data.n_cols;
   arma::frowvec bestDistances(N);
   bestDistances.fill(std::numeric_limits<float>::infinity());
-  for (size_t k = 0; k < nMedoids; k++) {
-    float minDistance = std::numeric_limits<float>::infinity();
-    size_t best = 0;
-    for (size_t i = 0; i < data.n_cols; i++) {
-      float total = 0;
-      for (size_t j = 0; j < data.n_cols; j++) {
-        float cost = (this->*lossFn)(data, i, j);
-        // compares this with the cached best distance
-        if (bestDistances(j) < cost) {
-          cost = bestDistances(j);
-        }
-        total += cost;
-      }
-      if (total < minDistance) {
-        minDistance = total;
-        best = i;
-      }
-    }
-    (*medoidIndices)(k) = best;
+  arma::frowvec totals(N);
+
+  KMedoids::dispatchLossFn([&](const auto& loss) {
+    for (size_t k = 0; k < nMedoids; k++) {
+      // 1 for BUILD
+      KMedoids::candidateDistances(data, 1, loss,
+        [&](const size_t i, const float* distances) {
+          float total = 0;
+          for (size_t j = 0; j < N; j++) {
+            // compares this with the cached best distance
+            total += weights(j) * std::min(distances[j], bestDistances(j));
+          }
+          totals(i) = total;
+        });
+      // The lowest index among ties, as in a serial scan
+      (*medoidIndices)(k) = totals.index_min();
 
-    // update the medoid assignment and best_distance for this datapoint
-    for (size_t l = 0; l < N; l++) {
-      float cost = (this->*lossFn)(data, l, (*medoidIndices)(k));
-      if (cost < bestDistances(l)) {
-        bestDistances(l) = cost;
+      // update the medoid assignment and best_distance for this datapoint
+      #pragma omp parallel for if (this->parallelize) \
+        num_threads(this->threadCount())
+      for (size_t l = 0; l < N; l++) {
+        const float cost = KMedoids::cachedLoss(
+          data, l, (*medoidIndices)(k), 1, loss);
+        if (cost < bestDistances(l)) {
+          bestDistances(l) = cost;
+        }
       }
+      KMedoids::reportProgress("build", k + 1);
     }
-  }
+  });
 }
 
 void PAM::swapPAM(
   const arma::fmat& data,
-  std::optional<std::reference_wrapper<const arma::fmat>> distMat,
   arma::urowvec* medoidIndices,
   arma::urowvec* assignments) {
   float minDistance = std::numeric_limits<float>::infinity();
@@ -86,40 +100,44 @@ void PAM::swapPAM(
   size_t N = data.n_cols;
   arma::frowvec bestDistances(N);
   arma::frowvec secondBestDistances(N);
+  // The total loss when each medoid (row) is replaced by each point (column)
+  arma::fmat totals(nMedoids, N);
 
   KMedoids::calcBestDistancesSwap(
     data,
-    distMat,
     medoidIndices,
     &bestDistances,
     &secondBestDistances,
     assignments);
 
-  for (size_t k = 0; k < nMedoids; k++) {
-    for (size_t i = 0; i < data.n_cols; i++) {
-      float total = 0;
-      for (size_t j = 0; j < data.n_cols; j++) {
-        // compute distance between base point and every other datapoint
-        float cost = (this->*lossFn)(data, i, j);
-        // if x_j is NOT assigned to k: compares this with
-        //   the cached best distance
-        // if x_j is assigned to k: compares this with
-        //   the cached second best distance
-        if ((*assignments)(j) != k) {
-          if (bestDistances(j) < cost) {
-            cost = bestDistances(j);
-          }
-        } else {
-          if (secondBestDistances(j) < cost) {
-            cost = secondBestDistances(j);
+  // The distances to each candidate are computed once and reused for every
+  // medoid it could replace; 2 for SWAP
+  KMedoids::dispatchLossFn([&](const auto& loss) {
+    KMedoids::candidateDistances(data, 2, loss,
+      [&](const size_t i, const float* distances) {
+        for (size_t k = 0; k < nMedoids; k++) {
+          float total = 0;
+          for (size_t j = 0; j < N; j++) {
+            // if x_j is NOT assigned to k: compares this with
+            //   the cached best distance
+            // if x_j is assigned to k: compares this with
+            //   the cached second best distance
+            const float cap = (*assignments)(j) != k
+              ? bestDistances(j) : secondBestDistances(j);
+            total += weights(j) * std::min(distances[j], cap);
           }
+          totals(k, i) = total;
         }
-        total += cost;
-      }
-      // if total distance for new base point is better than
-      // that of the medoid, update the best index identified so far
-      if (total < minDistance) {
-        minDistance = total;
+      });
+  });
+
+  // if total distance for new base point is better than
+  // that of the medoid, update the best index identified so far; the scan
+  // order breaks ties as before
+  for (size_t k = 0; k < nMedoids; k++) {
+    for (size_t i = 0; i < N; i++) {
+      if (totals(k, i) < minDistance) {
+        minDistance = totals(k, i);
         best = i;
         medoidToSwap = k;
       }
@@ -0,0 +1,111 @@
+/**
+ * @file quantized_matrix.cpp
+ * @date 2026-10-14
+ *
+ * Contains the quantization of the data into float16, bfloat16 or int8.
+ */
+
+#include "quantized_matrix.hpp"
+
+#include <stdexcept>
+
+namespace km {
+namespace {
+// Largest finite float16
+constexpr float maxFloat16 = 65504.0f;
+}  // namespace
+
+void QuantizedMatrix::reset(
+  const arma::fmat& points,
+  const std::string& precision,
+  const int numThreads) {
+  QuantizedMatrix::release();
+  if (precision == "float16") {
+    storage = Storage::float16;
+  } else if (precision == "bfloat16") {
+    storage = Storage::bfloat16;
+  } else if (precision == "int8") {
+    storage = Storage::int8;
+  } else {
+    throw std::invalid_argument(
+      "Data precision must be float32, float16, bfloat16 or int8");
+  }
+  d = points.n_rows;
+  const size_t N = points.n_cols;
+
+  if (storage == Storage::int8) {
+    // Symmetric quantization, so that a zero feature stays exactly zero and
+    // inner products need no offsets
+    std::vector<float> maxima(d, 0);
+    #pragma omp parallel if (numThreads > 1) num_threads(numThreads)
+    {
+      std::vector<float> localMaxima(d, 0);
+      #pragma omp for nowait
+      for (size_t i = 0; i < N; i++) {
+        const float* point = points.colptr(i);
+        for (size_t k = 0; k < d; k++) {
+          localMaxima[k] = std::max(localMaxima[k], std::fabs(point[k]));
+        }
+      }
+      #pragma omp critical
+      for (size_t k = 0; k < d; k++) {
+        maxima[k] = std::max(maxima[k], localMaxima[k]);
+      }
+    }
+    scales.resize(d);
+    std::vector<float> inverseScales(d);
+    for (size_t k = 0; k < d; k++) {
+      scales[k] = maxima[k] / 127;
+      inverseScales[k] = maxima[k] > 0 ? 127 / maxima[k] : 0;
+    }
+
+    bytes.resize(N * d);
+    #pragma omp parallel for if (numThreads > 1) num_threads(numThreads)
+    for (size_t i = 0; i < N; i++) {
+      const float* point = points.colptr(i);
+      int8_t* quantized = bytes.data() + i * d;
+      for (size_t k = 0; k < d; k++) {
+        const float steps = std::nearbyint(point[k] * inverseScales[k]);
+        quantized[k] = static_cast<int8_t>(
+          std::min(127.0f, std::max(-127.0f, steps)));
+      }
+    }
+    return;
+  }
+
+  halves.resize(N * d);
+  const bool half = storage == Storage::float16;
+  bool overflow = false;
+  #pragma omp parallel for reduction(||:overflow) if (numThreads > 1) \
+    num_threads(numThreads)
+  for (size_t i = 0; i < N; i++) {
+    const float* point = points.colptr(i);
+    uint16_t* quantized = halves.data() + i * d;
+    for (size_t k = 0; k < d; k++) {
+      if (half) {
+        overflow = overflow || !(std::fabs(point[k]) <= maxFloat16);
+        quantized[k] = DistanceMatrix::toFloat16(point[k]);
+      } else {
+        quantized[k] = DistanceMatrix::toBFloat16(point[k]);
+      }
+    }
+  }
+  if (overflow) {
+    QuantizedMatrix::release();
+    throw std::invalid_argument(
+      "Data exceeds the range of float16; use bfloat16 instead");
+  }
+}
+
+void QuantizedMatrix::release() {
+  std::vector<uint16_t>().swap(halves);
+  std::vector<int8_t>().swap(bytes);
+  std::vector<float>().swap(scales);
+  d = 0;
+}
+
+size_t QuantizedMatrix::getPackedBytes() const {
+  return halves.size() * sizeof(uint16_t) + bytes.size() * sizeof(int8_t)
+    + scales.size() * sizeof(float);
+}
+}  // namespace km
@@ -0,0 +1,65 @@
+/**
+ * @file random_stream.cpp
+ * @date 2026-10-14
+ *
+ * Contains the counter-based random streams of the fits.
+ */
+
+#include "random_stream.hpp"
+
+#include <unordered_set>
+
+namespace km {
+namespace {
+// Increment of SplitMix64, the golden ratio in 64 bits
+constexpr uint64_t golden = 0x9E3779B97F4A7C15ULL;
+
+// The finalizer of SplitMix64, a bijection that mixes every input bit into
+// every output bit
+uint64_t mix(uint64_t x) {
+  x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+  return x ^ (x >> 31);
+}
+}  // namespace
+
+RandomStream::RandomStream(const uint64_t seed, const uint64_t stream)
+  : key(mix(mix(seed) + golden * (stream + 1))) {}
+
+uint64_t RandomStream::at(const uint64_t position) const {
+  return mix(key + golden * (position + 1));
+}
+
+uint64_t RandomStream::next() {
+  return RandomStream::at(counter++);
+}
+
+uint64_t RandomStream::below(const uint64_t n) {
+  // Draws below the threshold would make the smallest 2^64 mod n values more
+  // likely, so they are redrawn
+  const uint64_t threshold = (0 - n) % n;
+  uint64_t draw = RandomStream::next();
+  while (draw < threshold) {
+    draw = RandomStream::next();
+  }
+  return draw % n;
+}
+
+void RandomStream::sample(
+  const size_t n,
+  const size_t count,
+  arma::uvec* indices) {
+  indices->set_size(count);
+  std::unordered_set<arma::uword> drawn(2 * count);
+  size_t idx = 0;
+  for (size_t j = n - count; j < n; j++) {
+    arma::uword index = RandomStream::below(j + 1);
+    if (!drawn.insert(index).second) {
+      // j cannot have been drawn yet, so it takes the place of the repeat
+      index = j;
+      drawn.insert(j);
+    }
+    (*indices)(idx++) = index;
+  }
+}
+}  // namespace km
@@ -0,0 +1,167 @@
+/**
+ * @file swap_arms.cpp
+ * @date 2026-10-14
+ *
+ * Contains the bookkeeping of the arms of a BanditPAM SWAP step: candidate
+ * elimination, exact arms and the selection of the best arm.
+ */
+
+#include "swap_arms.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+
+namespace km {
+void SwapArms::reset(
+  const size_t numMedoids,
+  const size_t numPoints,
+  const int numThreads) {
+  this->numMedoids = numMedoids;
+  this->numThreads = numThreads;
+  wordsPerColumn = (numMedoids + 63) / 64;
+
+  arms.assign(numMedoids * numPoints, Arm{0, 0});
+  numSamples.assign(numPoints, 0);
+  columnCandidates.assign(numPoints, numMedoids);
+  exactBits.assign((numPoints + 63) / 64, 0);
+
+  // Set the bits of the numMedoids arms at the start of each column
+  candidateBits.assign(numPoints * wordsPerColumn, ~uint64_t{0});
+  if (numMedoids % 64 != 0) {
+    const uint64_t lastWord = (uint64_t{1} << (numMedoids % 64)) - 1;
+    for (size_t n = 0; n < numPoints; n++) {
+      candidateBits[(n + 1) * wordsPerColumn - 1] = lastWord;
+    }
+  }
+
+  activeColumns.resize(numPoints);
+  std::iota(activeColumns.begin(), activeColumns.end(), 0);
+  numCandidates = numMedoids * numPoints;
+  frozenMinUcb = std::numeric_limits<float>::infinity();
+}
+
+void SwapArms::setExact(const size_t n) {
+  exactBits[n / 64] |= uint64_t{1} << (n % 64);
+  for (size_t w = 0; w < wordsPerColumn; w++) {
+    candidateBits[n * wordsPerColumn + w] = 0;
+  }
+  numCandidates -= columnCandidates[n];
+  columnCandidates[n] = 0;
+
+  // Exact arms have equal lower and upper confidence bounds
+  for (size_t k = 0; k < numMedoids; k++) {
+    frozenMinUcb = std::min(frozenMinUcb, arm(k, n).estimate);
+  }
+}
+
+float SwapArms::confidenceWidth(
+  const size_t k,
+  const size_t n,
+  const float adjust) const {
+  if (numSamples[n] == 0) {
+    return std::numeric_limits<float>::infinity();
+  }
+  return arms[n * numMedoids + k].sigma * std::sqrt(adjust / numSamples[n]);
+}
+
+void SwapArms::eliminate(const float adjust) {
+  const size_t numActive = activeColumns.size();
+  float candidateMinUcb = std::numeric_limits<float>::infinity();
+  #pragma omp parallel for reduction(min:candidateMinUcb) \
+    if (this->numThreads > 1) num_threads(this->numThreads)
+  for (size_t c = 0; c < numActive; c++) {
+    const size_t n = activeColumns[c];
+    for (size_t k = 0; k < numMedoids; k++) {
+      if (isCandidate(k, n)) {
+        candidateMinUcb =
+          std::min(candidateMinUcb, upperConfidenceBound(k, n, adjust));
+      }
+    }
+  }
+  SwapArms::eliminate(adjust, candidateMinUcb);
+}
+
+void SwapArms::eliminate(const float adjust, const float candidateMinUcb) {
+  const size_t numActive = activeColumns.size();
+  const float minUcb = std::min(frozenMinUcb, candidateMinUcb);
+
+  // Each column's candidate bits start on their own word, so columns can be
+  // updated in parallel
+  size_t numEliminated = 0;
+  float newFrozenMinUcb = frozenMinUcb;
+  #pragma omp parallel for reduction(+:numEliminated) \
+    reduction(min:newFrozenMinUcb) if (this->numThreads > 1) \
+    num_threads(this->numThreads)
+  for (size_t c = 0; c < numActive; c++) {
+    const size_t n = activeColumns[c];
+    for (size_t k = 0; k < numMedoids; k++) {
+      if (!isCandidate(k, n)) {
+        continue;
+      }
+      const float estimate = arms[n * numMedoids + k].estimate;
+      const float width = confidenceWidth(k, n, adjust);
+      if (!(estimate - width < minUcb)) {
+        candidateBits[n * wordsPerColumn + k / 64] &=
+          ~(uint64_t{1} << (k % 64));
+        columnCandidates[n]--;
+        numEliminated++;
+        newFrozenMinUcb = std::min(newFrozenMinUcb, estimate + width);
+      }
+    }
+  }
+  numCandidates -= numEliminated;
+  frozenMinUcb = newFrozenMinUcb;
+  SwapArms::removeInactiveColumns();
+}
+
+void SwapArms::removeInactiveColumns() {
+  activeColumns.erase(
+    std::remove_if(
+      activeColumns.begin(),
+      activeColumns.end(),
+      [this](const uint32_t n) { return columnCandidates[n] == 0; }),
+    activeColumns.end());
+}
+
+size_t SwapArms::bestArm(const float adjust) const {
+  // An eliminated arm of an active column keeps the estimate it had when it
+  // was eliminated, while the sample count of its column keeps growing, so
+  // its bound would be overstated; only candidate and exact arms compete
+  size_t best = 0;
+  float bestLcb = std::numeric_limits<float>::infinity();
+  bool found = false;
+  for (size_t n = 0; n < numSamples.size(); n++) {
+    const bool exact = isExact(n);
+    const bool useEstimate = exact || numSamples[n] == 0;
+    for (size_t k = 0; k < numMedoids; k++) {
+      if (!exact && !isCandidate(k, n)) {
+        continue;
+      }
+      const float estimate = arms[n * numMedoids + k].estimate;
+      const float lcb = useEstimate
+        ? estimate : estimate - confidenceWidth(k, n, adjust);
+      if (!found || lcb < bestLcb) {
+        bestLcb = lcb;
+        best = n * numMedoids + k;
+        found = true;
+      }
+    }
+  }
+  if (found) {
+    return best;
+  }
+
+  // Every arm was eliminated, e.g., among ties with no spread: the best
+  // estimate is the best guess
+  float bestEstimate = std::numeric_limits<float>::infinity();
+  for (size_t a = 0; a < arms.size(); a++) {
+    if (a == 0 || arms[a].estimate < bestEstimate) {
+      bestEstimate = arms[a].estimate;
+      best = a;
+    }
+  }
+  return best;
+}
+}  // namespace km
@@ -0,0 +1,635 @@
+/**
+ * @file bench.cpp
+ * @date 2026-10-14
+ *
+ * Defines a benchmark program for the hot paths of BanditPAM, run on
+ * synthetic data so that results are comparable across machines and
+ * commits.
+ *
+ * Usage (from home repo directory):
+ * ./src/build/BanditPAM_bench [-n 1000,4000] [-d 16,128] [-k 5,10]
+ *   [-t 1,8] [-r 3] [-b kernels,cache,swap,fit] [-a BanditPAM,FasterPAM]
+ *
+ * For every combination of N points, d features, k medoids and threads, it
+ * benchmarks:
+ *  - kernels: each distance kernel of distance_kernels.hpp
+ *  - cache: cachedLoss() when writing, hitting and missing the cache, and
+ *    cachedLossTile() without the cache
+ *  - swap: calcBestDistancesSwap() for k medoids spread over the points
+ *  - fit: fitTransposed() with each algorithm, plus, for BanditPAM, the time
+ *    spent in buildTarget() and swapTarget(), as recorded by the fit profile
+ *
+ * The kernels and the cache do not depend on k, so they only run for the
+ * first k.
+ *
+ * Each result is printed as one JSON object per line with the keys
+ * benchmark, n, d, k, threads, the benchmark's own parameters, seconds (the
+ * best of the repeats), distances and distances_per_second. The first line
+ * describes the machine. The keys of a record never change meaning, so the
+ * output of two runs can be joined to find regressions.
+ */
+
+#include <omp.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "distance_kernels.hpp"
+#include "kmedoids_algorithm.hpp"
+
+namespace {
+/// Version of the record format, bumped when the meaning of a key changes
+constexpr size_t schemaVersion = 1;
+
+/// Number of pairs per point evaluated by the kernel benchmarks
+constexpr size_t pairsPerPoint = 64;
+
+/// Receives the results of the kernels, so that they are not optimized away
+volatile float sink = 0;
+
+/**
+ * @brief One line of output, written as a flat JSON object with its keys in
+ * insertion order
+ */
+class Record {
+ public:
+  explicit Record(const std::string& benchmark) {
+    text("benchmark", benchmark);
+  }
+
+  Record& text(const std::string& key, const std::string& value) {
+    write(key) << "\"" << value << "\"";
+    return *this;
+  }
+
+  Record& count(const std::string& key, const size_t value) {
+    write(key) << value;
+    return *this;
+  }
+
+  Record& number(const std::string& key, const double value) {
+    write(key) << value;
+    return *this;
+  }
+
+  /**
+   * @brief Adds the time, the distance count and the throughput of a run
+   *
+   * @param seconds Wall-clock seconds of the run
+   * @param distances Number of distances the run computed or looked up
+   */
+  Record& throughput(const double seconds, const size_t distances) {
+    number("seconds", seconds);
+    count("distances", distances);
+    return number(
+      "distances_per_second",
+      seconds > 0 ? distances / seconds : 0);
+  }
+
+  void print() const {
+    std::cout << "{" << fields.str() << "}" << std::endl;
+  }
+
+ private:
+  std::ostringstream& write(const std::string& key) {
+    if (!empty) {
+      fields << ", ";
+    }
+    empty = false;
+    fields.precision(6);
+    fields << "\"" << key << "\": ";
+    return fields;
+  }
+
+  /// The fields written so far
+  std::ostringstream fields;
+
+  /// Whether no field has been written yet
+  bool empty = true;
+};
+
+/**
+ * @brief Parameters of one point of the benchmark grid
+ */
+struct Case {
+  /// Number of points
+  size_t n;
+
+  /// Number of features
+  size_t d;
+
+  /// Number of medoids
+  size_t k;
+
+  /// Number of threads
+  size_t threads;
+
+  /**
+   * @brief Returns a record of the given benchmark for this case
+   *
+   * @param benchmark Name of the benchmark
+   */
+  Record record(const std::string& benchmark) const {
+    Record out(benchmark);
+    out.count("n", n).count("d", d).count("k", k).count("threads", threads);
+    return out;
+  }
+};
+
+/**
+ * @brief Returns the best wall-clock time of the given function over a
+ * number of runs
+ *
+ * @param repeats Number of runs
+ * @param setup Function called untimed before each run
+ * @param function Function to time
+ *
+ * @returns The smallest time of a run in seconds
+ */
+template <typename Setup, typename Function>
+double bestSeconds(const size_t repeats, Setup&& setup, Function&& function) {
+  double best = std::numeric_limits<double>::infinity();
+  for (size_t repeat = 0; repeat < std::max<size_t>(1, repeats); repeat++) {
+    setup();
+    const auto start = std::chrono::steady_clock::now();
+    function();
+    const std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+    best = std::min(best, elapsed.count());
+  }
+  return best;
+}
+
+/**
+ * @brief Same as bestSeconds(repeats, setup, function), without a setup
+ */
+template <typename Function>
+double bestSeconds(const size_t repeats, Function&& function) {
+  return bestSeconds(repeats, []() {}, function);
+}
+
+/**
+ * @brief Generates k Gaussian clusters of points with a fixed seed, so that
+ * every run benchmarks the same data
+ *
+ * @param n Number of points
+ * @param d Number of features
+ * @param k Number of clusters
+ *
+ * @returns The points, one per column
+ */
+arma::fmat syntheticData(const size_t n, const size_t d, const size_t k) {
+  std::mt19937_64 generator(n * 1000003 + d * 1009 + k);
+  std::normal_distribution<float> normal(0, 1);
+  arma::fmat centers(d, k);
+  for (size_t e = 0; e < d * k; e++) {
+    centers.memptr()[e] = 10 * normal(generator);
+  }
+  arma::fmat points(d, n);
+  for (size_t i = 0; i < n; i++) {
+    const float* center = centers.colptr(i % k);
+    float* point = points.colptr(i);
+    for (size_t f = 0; f < d; f++) {
+      point[f] = center[f] + normal(generator);
+    }
+  }
+  return points;
+}
+
+/**
+ * @brief Splits a comma-separated list
+ *
+ * @param list The list, e.g., "1,2,4"
+ *
+ * @returns The items of the list
+ */
+std::vector<std::string> splitList(const std::string& list) {
+  std::vector<std::string> items;
+  std::stringstream stream(list);
+  std::string item;
+  while (std::getline(stream, item, ',')) {
+    if (!item.empty()) {
+      items.push_back(item);
+    }
+  }
+  return items;
+}
+
+/**
+ * @brief Parses a comma-separated list of sizes
+ *
+ * @param list The list, e.g., "1000,4000"
+ *
+ * @returns The sizes of the list
+ */
+std::vector<size_t> parseSizes(const std::string& list) {
+  std::vector<size_t> sizes;
+  for (const std::string& item : splitList(list)) {
+    sizes.push_back(std::stoul(item));
+  }
+  return sizes;
+}
+
+/**
+ * @brief Gives the benchmarks access to the internals of KMedoids
+ */
+class BenchKMedoids : public km::KMedoids {
+ public:
+  /**
+   * @brief Prepares a fit on the given points, as the algorithms do, with
+   * the first cacheWidth points cached
+   *
+   * @param points Points to benchmark, one per column
+   * @param loss Loss function to use
+   * @param threads Number of threads
+   * @param cached Whether to use the cache
+   */
+  void prepare(
+    const arma::fmat& points,
+    const std::string& loss,
+    const size_t threads,
+    const bool cached) {
+    KMedoids::setNumThreads(threads);
+    KMedoids::setUseCache(cached);
+    KMedoids::setCacheWidth(points.n_cols / 2);
+    KMedoids::prepareFit(points, loss, std::nullopt);
+    permutation = arma::regspace<arma::uvec>(0, points.n_cols - 1);
+    KMedoids::initializeCache(points.n_cols);
+  }
+
+  /**
+   * @brief Calls cachedLoss() for every point and the given range of
+   * reference points
+   *
+   * @param points Points to benchmark, one per column
+   * @param referenceBegin First reference point
+   * @param referenceEnd One past the last reference point
+   *
+   * @returns The number of distances looked up
+   */
+  size_t cachedLosses(
+    const arma::fmat& points,
+    const size_t referenceBegin,
+    const size_t referenceEnd) {
+    KMedoids::resetCounters();
+    float total = 0;
+    KMedoids::dispatchLossFn([&](const auto& loss) {
+      #pragma omp parallel for reduction(+:total) if (this->parallelize) \
+        num_threads(this->threadCount())
+      for (size_t i = 0; i < points.n_cols; i++) {
+        for (size_t j = referenceBegin; j < referenceEnd; j++) {
+          // 0 for MISC
+          total += KMedoids::cachedLoss(points, i, j, 0, loss);
+        }
+      }
+    });
+    sink = total;
+    KMedoids::mergeCounters();
+    return KMedoids::getDistanceComputations(true);
+  }
+
+  /**
+   * @brief Calls cachedLossTile() for tiles of every point against every
+   * point, one block of targets per thread
+   *
+   * @param points Points to benchmark, one per column
+   *
+   * @returns The number of distances computed
+   */
+  size_t cachedLossTiles(const arma::fmat& points) {
+    KMedoids::resetCounters();
+    const size_t N = points.n_cols;
+    const size_t tileTargets = KMedoids::numTileTargets(N);
+    const size_t numBlocks = (N + tileTargets - 1) / tileTargets;
+    KMedoids::dispatchLossFn([&](const auto& loss) {
+      #pragma omp parallel for if (this->parallelize) \
+        num_threads(this->threadCount())
+      for (size_t block = 0; block < numBlocks; block++) {
+        km::TileWorkspace& tileWorkspace = KMedoids::localTileWorkspace();
+        const size_t tStart = block * tileTargets;
+        const size_t tEnd = std::min(N, tStart + tileTargets);
+        tileWorkspace.targets = arma::regspace<arma::uvec>(tStart, tEnd - 1);
+        for (size_t rStart = 0; rStart < N; rStart += maxTileReferences) {
+          const size_t rEnd = std::min(N, rStart + maxTileReferences);
+          tileWorkspace.referencePoints =
+            arma::regspace<arma::uvec>(rStart, rEnd - 1);
+          KMedoids::cachedLossTile(
+            points,
+            tileWorkspace.targets,
+            tileWorkspace.referencePoints,
+            0,  // 0 for MISC
+            loss,
+            &tileWorkspace.tile);
+        }
+      }
+    });
+    KMedoids::mergeCounters();
+    return KMedoids::getDistanceComputations(true);
+  }
+
+  /**
+   * @brief Assigns every point to the given medoids
+   *
+   * @param points Points to benchmark, one per column
+   * @param medoids Indices of the medoids
+   *
+   * @returns The number of distances computed
+   */
+  size_t bestDistances(
+    const arma::fmat& points,
+    const arma::urowvec& medoids) {
+    KMedoids::resetCounters();
+    arma::frowvec best(points.n_cols);
+    arma::frowvec secondBest(points.n_cols);
+    arma::urowvec assignments(points.n_cols);
+    KMedoids::calcBestDistancesSwap(
+      points,
+      &medoids,
+      &best,
+      &secondBest,
+      &assignments);
+    KMedoids::mergeCounters();
+    return KMedoids::getDistanceComputations(true);
+  }
+};
+
+/**
+ * @brief Benchmarks each distance kernel on pairsPerPoint pairs per point
+ *
+ * @param points Points to benchmark, one per column
+ * @param benchCase Parameters of the benchmark
+ * @param repeats Number of runs, of which the best is reported
+ */
+void benchKernels(
+  const arma::fmat& points,
+  const Case& benchCase,
+  const size_t repeats) {
+  const km::DistanceKernels& kernels = km::distanceKernels();
+  const std::vector<std::pair<std::string,
+    float (*)(const float*, const float*, size_t)>> named = {
+    {"l1", kernels.l1},
+    {"l2_squared", kernels.l2Squared},
+    {"linf", kernels.lInf},
+    {"dot", kernels.dot},
+    {"cosine", kernels.cosine}};
+  const size_t N = points.n_cols;
+  const size_t d = points.n_rows;
+  for (const auto& [name, kernel] : named) {
+    const double seconds = bestSeconds(repeats, [&]() {
+      float total = 0;
+      #pragma omp parallel for reduction(+:total) \
+        num_threads(static_cast<int>(benchCase.threads))
+      for (size_t i = 0; i < N; i++) {
+        for (size_t p = 1; p <= pairsPerPoint; p++) {
+          total += kernel(points.colptr(i), points.colptr((i + p) % N), d);
+        }
+      }
+      sink = total;
+    });
+    benchCase.record("kernel")
+      .text("kernel", name)
+      .text("isa", kernels.name)
+      .throughput(seconds, N * pairsPerPoint)
+      .print();
+  }
+}
+
+/**
+ * @brief Benchmarks cachedLoss() when writing, hitting and missing the
+ * cache, and cachedLossTile() without the cache
+ *
+ * @param points Points to benchmark, one per column, of which the first half
+ * is cached
+ * @param benchCase Parameters of the benchmark
+ * @param repeats Number of runs, of which the best is reported
+ */
+void benchCache(
+  const arma::fmat& points,
+  const Case& benchCase,
+  const size_t repeats) {
+  const size_t N = points.n_cols;
+  const size_t half = N / 2;
+  BenchKMedoids kmed;
+  size_t distances = 0;
+  double seconds = bestSeconds(
+    repeats,
+    [&]() { kmed.prepare(points, "L2", benchCase.threads, true); },
+    [&]() { distances = kmed.cachedLosses(points, 0, half); });
+  benchCase.record("cached_loss")
+    .text("path", "write")
+    .count("cache_writes", kmed.getCacheWrites())
+    .throughput(seconds, distances)
+    .print();
+
+  // The cache was filled by the last write run
+  seconds = bestSeconds(repeats, [&]() {
+    distances = kmed.cachedLosses(points, 0, half);
+  });
+  benchCase.record("cached_loss")
+    .text("path", "hit")
+    .count("cache_hits", kmed.getCacheHits())
+    .throughput(seconds, distances)
+    .print();
+
+  seconds = bestSeconds(repeats, [&]() {
+    distances = kmed.cachedLosses(points, half, N);
+  });
+  benchCase.record("cached_loss")
+    .text("path", "miss")
+    .count("cache_misses", kmed.getCacheMisses())
+    .throughput(seconds, distances)
+    .print();
+
+  kmed.prepare(points, "L2", benchCase.threads, false);
+  seconds = bestSeconds(repeats, [&]() {
+    distances = kmed.cachedLossTiles(points);
+  });
+  benchCase.record("cached_loss_tile")
+    .text("path", "uncached")
+    .throughput(seconds, distances)
+    .print();
+}
+
+/**
+ * @brief Benchmarks calcBestDistancesSwap() for k medoids spread over the
+ * points
+ *
+ * @param points Points to benchmark, one per column
+ * @param benchCase Parameters of the benchmark
+ * @param repeats Number of runs, of which the best is reported
+ */
+void benchBestDistances(
+  const arma::fmat& points,
+  const Case& benchCase,
+  const size_t repeats) {
+  const size_t N = points.n_cols;
+  arma::urowvec medoids(benchCase.k);
+  for (size_t k = 0; k < benchCase.k; k++) {
+    medoids(k) = (k * N) / benchCase.k;
+  }
+  BenchKMedoids kmed;
+  kmed.setNMedoids(benchCase.k);
+  kmed.prepare(points, "L2", benchCase.threads, false);
+  size_t distances = 0;
+  const double seconds = bestSeconds(repeats, [&]() {
+    distances = kmed.bestDistances(points, medoids);
+  });
+  benchCase.record("calc_best_distances_swap")
+    .throughput(seconds, distances)
+    .print();
+}
+
+/**
+ * @brief Benchmarks complete fits of the given algorithm
+ *
+ * @param points Points to benchmark, one per column
+ * @param benchCase Parameters of the benchmark
+ * @param algorithm Algorithm to fit with
+ * @param repeats Number of runs, of which the best is reported
+ */
+void benchFit(
+  const arma::fmat& points,
+  const Case& benchCase,
+  const std::string& algorithm,
+  const size_t repeats) {
+  km::KMedoids kmed(benchCase.k, algorithm);
+  kmed.setNumThreads(benchCase.threads);
+  const double seconds = bestSeconds(repeats, [&]() {
+    kmed.fitTransposed(points, "L2", std::nullopt);
+  });
+  benchCase.record("fit")
+    .text("algorithm", algorithm)
+    .count("steps", kmed.getSteps())
+    .number("average_loss", kmed.getAverageLoss())
+    .throughput(seconds, kmed.getDistanceComputations(true))
+    .print();
+
+  if (algorithm == "BanditPAM") {
+    // buildTarget() and swapTarget() are timed by the targets and
+    // exact_targets phases of the profile of the last run; distances of
+    // BUILD and SWAP also include the few that estimate sigma
+    const km::FitProfile& profile = kmed.getProfile();
+    benchCase.record("bandit_targets")
+      .text("algorithm", algorithm)
+      .count("calls", profile.targets.calls + profile.exactTargets.calls)
+      .throughput(
+        (profile.targets.wallMilliseconds
+          + profile.exactTargets.wallMilliseconds) / 1000,
+        kmed.getBuildDistanceComputations()
+          + kmed.getSwapDistanceComputations())
+      .print();
+  }
+}
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  const size_t maxThreads = static_cast<size_t>(omp_get_max_threads());
+  std::vector<size_t> ns = {1000, 4000};
+  std::vector<size_t> ds = {16, 128};
+  std::vector<size_t> ks = {5, 10};
+  std::vector<size_t> threadCounts = {1, maxThreads};
+  std::vector<std::string> groups = {"kernels", "cache", "swap", "fit"};
+  std::vector<std::string> algorithms = {
+    "BanditPAM", "BanditPAM_orig", "PAM", "FastPAM1", "FasterPAM"};
+  size_t repeats = 3;
+  const int ARGUMENT_ERROR_CODE = 1;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "n:d:k:t:r:b:a:")) != -1) {
+    switch (opt) {
+      // numbers of points
+      case 'n':
+        ns = parseSizes(optarg);
+        break;
+      // numbers of features
+      case 'd':
+        ds = parseSizes(optarg);
+        break;
+      // numbers of medoids
+      case 'k':
+        ks = parseSizes(optarg);
+        break;
+      // numbers of threads
+      case 't':
+        threadCounts = parseSizes(optarg);
+        break;
+      // runs per benchmark, of which the best is reported
+      case 'r':
+        repeats = std::stoul(optarg);
+        break;
+      // groups of benchmarks to run
+      case 'b':
+        groups = splitList(optarg);
+        break;
+      // algorithms to fit
+      case 'a':
+        algorithms = splitList(optarg);
+        break;
+      default:
+        std::cout << "unknown option: " << static_cast<char>(optopt)
+          << std::endl;
+        return ARGUMENT_ERROR_CODE;
+    }
+  }
+  std::sort(threadCounts.begin(), threadCounts.end());
+  threadCounts.erase(
+    std::unique(threadCounts.begin(), threadCounts.end()),
+    threadCounts.end());
+  for (size_t& threads : threadCounts) {
+    threads = std::min(std::max<size_t>(1, threads), maxThreads);
+  }
+  const auto runs = [&groups](const std::string& group) {
+    return std::find(groups.begin(), groups.end(), group) != groups.end();
+  };
+
+  Record("machine")
+    .count("schema", schemaVersion)
+    .count("max_threads", maxThreads)
+    .text("isa", km::distanceKernels().name)
+    .print();
+  for (const size_t n : ns) {
+    for (const size_t d : ds) {
+      for (const size_t k : ks) {
+        if (n < 2 || k == 0 || k >= n) {
+          continue;
+        }
+        const arma::fmat points = syntheticData(n, d, k);
+        // The kernels and the cache do not depend on k
+        const bool firstK = k == ks.front();
+        for (const size_t threads : threadCounts) {
+          const Case benchCase{n, d, k, threads};
+          try {
+            if (runs("kernels") && firstK) {
+              benchKernels(points, benchCase, repeats);
+            }
+            if (runs("cache") && firstK) {
+              benchCache(points, benchCase, repeats);
+            }
+            if (runs("swap")) {
+              benchBestDistances(points, benchCase, repeats);
+            }
+            if (runs("fit")) {
+              for (const std::string& algorithm : algorithms) {
+                benchFit(points, benchCase, algorithm, repeats);
+              }
+            }
+          } catch (std::invalid_argument& e) {
+            std::cout << e.what() << std::endl;
+            return ARGUMENT_ERROR_CODE;
+          }
+        }
+      }
+    }
+  }
+  return 0;
+}
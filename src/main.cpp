@@ -7,6 +7,14 @@
  *
  * Usage (from home repo directory):
  * ./src/build/BanditPAM -f [path/to/input] -k [number of clusters]
+ *
+ * Pass -j [path/to/profile.json] to also write the timing profile of the run,
+ * and -d [path/to/distances] to use a precomputed distance matrix. Pass -m
+ * to shard the compute of the fit over MPI ranks, e.g., with mpirun; every
+ * rank loads the whole input, and only rank 0 prints the results.
+ *
+ * Inputs ending in .npy must be float32 NumPy files; they are memory-mapped
+ * instead of parsed. Other inputs are loaded with arma::fmat::load.
  */
 
 #include <unistd.h>
@@ -14,10 +22,23 @@
 #include <exception>
 #include <filesystem>
 
+#include "communicator.hpp"
 #include "kmedoids_algorithm.hpp"
+#include "mapped_matrix.hpp"
+
+namespace {
+bool isNpy(const std::string& path) {
+  const std::string extension = ".npy";
+  return path.size() >= extension.size() &&
+    path.compare(path.size() - extension.size(), extension.size(), extension)
+      == 0;
+}
+}  // namespace
 
 int main(int argc, char* argv[]) {
     std::string input_name;
+    std::string profile_name;
+    std::string dist_mat_name;
     size_t k;
     int opt;
     int prev_ind;
@@ -33,10 +54,11 @@ int main(int argc, char* argv[]) {
     int seed = 0;
     int num_data = 0;
     bool parallelize = false;
+    bool distributed = false;
 
     // TODO(@motiwari): Use a variadic function signature for this instead
     while (prev_ind = optind,
-        (opt = getopt(argc, argv, "f:l:k:v:s:cpnw:")) != -1) {
+        (opt = getopt(argc, argv, "f:l:k:v:s:cpnw:j:d:m")) != -1) {
         if ( optind == prev_ind + 2 && *optarg == '-' ) {
         opt = ':';
         --optind;
@@ -75,6 +97,18 @@ int main(int argc, char* argv[]) {
             case 'w':
                 parallelize = true;
                 break;
+            // path to write the timing profile to, as JSON
+            case 'j':
+                profile_name = optarg;
+                break;
+            // path to a precomputed distance matrix
+            case 'd':
+                dist_mat_name = optarg;
+                break;
+            // shard the compute of the fit over MPI ranks
+            case 'm':
+                distributed = true;
+                break;
             case '?':
                 printf("unknown option: %c\n", optopt);
                 return ARGUMENT_ERROR_CODE;
@@ -91,14 +125,34 @@ int main(int argc, char* argv[]) {
       } else if (!std::filesystem::exists(input_name)) {
         throw std::invalid_argument(
           "Error: The file does not exist");
+      } else if (!dist_mat_name.empty() &&
+        !std::filesystem::exists(dist_mat_name)) {
+        throw std::invalid_argument(
+          "Error: The distance matrix file does not exist");
+      } else if (!dist_mat_name.empty() && num_data != 0) {
+        throw std::invalid_argument(
+          "Error: -n cannot be combined with a distance matrix");
       }
     } catch (std::invalid_argument& e) {
       std::cout << e.what() << std::endl;
       return ARGUMENT_ERROR_CODE;
     }
 
+    // A mapped .npy file is used in place unless only a prefix is wanted
+    std::optional<km::MappedMatrix> mapped_data;
     arma::fmat data;
-    data.load(input_name);
+    if (isNpy(input_name)) {
+      mapped_data.emplace(input_name);
+      if (num_data != 0) {
+        const arma::fmat& view = mapped_data->getView();
+        data = mapped_data->isTransposed()
+          ? arma::fmat(arma::trans(view))
+          : view;
+        mapped_data.reset();
+      }
+    } else {
+      data.load(input_name);
+    }
 
     if (num_data < 0) {
         throw std::invalid_argument(
@@ -107,6 +161,21 @@ int main(int argc, char* argv[]) {
         data.resize(num_data, data.n_cols);
     }
 
+    // Distance matrices are symmetric, so the transposed view of a C-ordered
+    // .npy file can be used as is
+    std::optional<km::MappedMatrix> mapped_dist_mat;
+    arma::fmat dist_mat;
+    std::optional<std::reference_wrapper<const arma::fmat>> dist_mat_ref;
+    if (!dist_mat_name.empty()) {
+      if (isNpy(dist_mat_name)) {
+        mapped_dist_mat.emplace(dist_mat_name);
+        dist_mat_ref = std::cref(mapped_dist_mat->getView());
+      } else {
+        dist_mat.load(dist_mat_name);
+        dist_mat_ref = std::cref(dist_mat);
+      }
+    }
+
     km::KMedoids kmed(
       k,
       "BanditPAM",
@@ -118,7 +187,26 @@ int main(int argc, char* argv[]) {
       1000,  // Cache Width
       parallelize,
       seed);
-    kmed.fit(data, loss, {});
+    km::Communicator communicator;
+    if (distributed) {
+      try {
+        communicator.join();
+        kmed.setDistributed(true);
+      } catch (std::invalid_argument& e) {
+        std::cout << e.what() << std::endl;
+        return ARGUMENT_ERROR_CODE;
+      }
+    }
+    if (mapped_data && mapped_data->isTransposed()) {
+      kmed.fitTransposed(mapped_data->getView(), loss, dist_mat_ref);
+    } else if (mapped_data) {
+      kmed.fit(mapped_data->getView(), loss, dist_mat_ref);
+    } else {
+      kmed.fit(data, loss, dist_mat_ref);
+    }
+    if (communicator.getRank() != 0) {
+      return 0;
+    }
     for (auto medoid : kmed.getMedoidsFinal()) {
       std::cout << medoid << ",";
     }
@@ -126,4 +214,8 @@ int main(int argc, char* argv[]) {
     std::cout << "Num Swap Steps: " << kmed.getSteps() << "\n";
     std::cout << "Total Swap Milliseconds: " << kmed.getTotalSwapTime() << "\n";
     std::cout << "Average Swap Milliseconds: " << kmed.getTimePerSwap() << "\n";
+    if (!profile_name.empty()) {
+      std::ofstream profile_file(profile_name);
+      profile_file << kmed.getProfile().toJson() << "\n";
+    }
 }
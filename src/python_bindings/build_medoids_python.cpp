@@ -25,6 +25,6 @@ pybind11::array_t<arma::uword> km::KMedoidsWrapper::getMedoidsBuildPython() {
 
 void build_medoids_python(pybind11::class_<KMedoidsWrapper> *cls) {
   cls->def_property_readonly("build_medoids",
-    &KMedoidsWrapper::getMedoidsBuildPython);
+    guarded(&KMedoidsWrapper::getMedoidsBuildPython));
 }
 }  // namespace km
@@ -44,45 +44,45 @@ size_t km::KMedoidsWrapper::getCacheMissesPython() {
 
 void distance_computations_python(pybind11::class_<km::KMedoidsWrapper> *cls) {
   cls->def("getDistanceComputations",
-           &KMedoidsWrapper::getDistanceComputationsPython);
+           guarded(&KMedoidsWrapper::getDistanceComputationsPython));
 }
 
 void misc_distance_computations_python(
     pybind11::class_<km::KMedoidsWrapper> *cls) {
     cls->def_property_readonly(
       "misc_distance_computations",
-      &KMedoidsWrapper::getMiscDistanceComputationsPython);
+      guarded(&KMedoidsWrapper::getMiscDistanceComputationsPython));
 }
 
 void build_distance_computations_python(
     pybind11::class_<km::KMedoidsWrapper> *cls) {
     cls->def_property_readonly(
       "build_distance_computations",
-      &KMedoidsWrapper::getBuildDistanceComputationsPython);
+      guarded(&KMedoidsWrapper::getBuildDistanceComputationsPython));
 }
 
 void swap_distance_computations_python(
     pybind11::class_<km::KMedoidsWrapper> *cls) {
     cls->def_property_readonly(
       "swap_distance_computations",
-      &KMedoidsWrapper::getSwapDistanceComputationsPython);
+      guarded(&KMedoidsWrapper::getSwapDistanceComputationsPython));
 }
 
 void cache_writes_python(pybind11::class_<km::KMedoidsWrapper> *cls) {
   cls->def_property_readonly(
       "cache_writes",
-      &KMedoidsWrapper::getCacheWritesPython);
+      guarded(&KMedoidsWrapper::getCacheWritesPython));
 }
 
 void cache_hits_python(pybind11::class_<km::KMedoidsWrapper> *cls) {
   cls->def_property_readonly(
       "cache_hits",
-      &KMedoidsWrapper::getCacheHitsPython);
+      guarded(&KMedoidsWrapper::getCacheHitsPython));
 }
 
 void cache_misses_python(pybind11::class_<km::KMedoidsWrapper> *cls) {
   cls->def_property_readonly(
       "cache_misses",
-      &KMedoidsWrapper::getCacheMisses);
+      guarded(&KMedoidsWrapper::getCacheMisses));
 }
 }  // namespace km
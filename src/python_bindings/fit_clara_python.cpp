@@ -0,0 +1,39 @@
+/**
+ * @file fit_clara_python.cpp
+ * @date 2026-10-14
+ *
+ * Defines the function fitClaraPython in KMedoidsWrapper class
+ * which is used in Python bindings.
+ */
+
+#include <pybind11/pybind11.h>
+#include <pybind11/numpy.h>
+#include <carma>
+#include <armadillo>
+#include <optional>
+
+#include "kmedoids_pywrapper.hpp"
+
+namespace km {
+void km::KMedoidsWrapper::fitClaraPython(
+  const pybind11::array_t<float>& inputData,
+  const std::string& loss,
+  const size_t numSamples,
+  const size_t sampleSize,
+  const size_t refineIter) {
+  std::optional<arma::fmat> points;
+  KMedoidsWrapper::transposedView(inputData, &points);
+  pybind11::gil_scoped_release release;
+  KMedoids::fitClaraTransposed(
+    *points, loss, numSamples, sampleSize, refineIter);
+}
+
+void fit_clara_python(pybind11::class_<KMedoidsWrapper> *cls) {
+  cls->def("fit_clara", guarded(&KMedoidsWrapper::fitClaraPython),
+    pybind11::arg("data"),
+    pybind11::arg("loss"),
+    pybind11::arg("n_samples") = 5,
+    pybind11::arg("sample_size") = 0,
+    pybind11::arg("refine_iter") = 0);
+}
+}  // namespace km
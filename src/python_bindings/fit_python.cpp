@@ -17,7 +17,7 @@
 
 namespace km {
 void km::KMedoidsWrapper::fitPython(
-  const pybind11::array_t<float>& inputData,
+  const pybind11::object& inputData,
   const std::string& loss,
   pybind11::kwargs kw) {
   // throw an error if the number of medoids is not specified in either
@@ -40,20 +40,218 @@ void km::KMedoidsWrapper::fitPython(
     KMedoids::setNMedoids(pybind11::cast<int>(kw["k"]));
   }
 
-  // TODO(@motiwari): Add a comment here explaining the massaging, cleanup
+  // Warm start from the given medoids, which also set k if it was not given
+  std::optional<arma::urowvec> initialMedoids;
+  if ((kw.size() != 0) && (kw.contains("initial_medoids"))) {
+    initialMedoids = carma::arr_to_row<arma::uword>(
+      pybind11::cast<pybind11::array_t<arma::uword>>(kw["initial_medoids"]));
+    if (!kw.contains("k")) {
+      KMedoids::setNMedoids(initialMedoids->n_elem);
+    }
+  }
+  std::optional<std::reference_wrapper<const arma::urowvec>> initialMedoidsRef;
+  if (initialMedoids) {
+    initialMedoidsRef = std::cref(*initialMedoids);
+  }
+
+  // Per-point weights, e.g., the number of copies of each point
+  std::optional<arma::frowvec> weights;
+  if ((kw.size() != 0) && (kw.contains("weights"))) {
+    weights = carma::arr_to_row<float>(
+      pybind11::cast<pybind11::array_t<float>>(kw["weights"]));
+  }
+  std::optional<std::reference_wrapper<const arma::frowvec>> weightsRef;
+  if (weights) {
+    weightsRef = std::cref(*weights);
+  }
+
+  // SciPy sparse matrices are the only inputs with a getnnz method
+  if (pybind11::hasattr(inputData, "getnnz")) {
+    if ((kw.size() != 0) && (kw.contains("dist_mat"))) {
+      throw pybind11::value_error(
+        "Error: dist_mat cannot be combined with sparse data.");
+    }
+    std::optional<arma::sp_fmat> sparsePoints;
+    KMedoidsWrapper::sparseTransposedView(inputData, &sparsePoints);
+    pybind11::gil_scoped_release release;
+    KMedoids::fitSparseTransposed(
+      *sparsePoints, loss, initialMedoidsRef, weightsRef);
+    return;
+  }
+
+  // The data is viewed with one point per column, without a copy when the
+  // array is C-contiguous float32
+  const auto array = pybind11::cast<const pybind11::array_t<float>>(inputData);
+  std::optional<arma::fmat> points;
+  KMedoidsWrapper::transposedView(array, &points);
   if ((kw.size() != 0) && (kw.contains("dist_mat"))) {
-    const pybind11::array_t<float>& distMat =
+    // Kept alive while the view is used, in case it had to be converted
+    const pybind11::array_t<float> distMatArray =
       pybind11::cast<const pybind11::array_t<float>>(kw["dist_mat"]);
-    const arma::fmat& tmp_array = carma::arr_to_mat<float>(distMat);
-    KMedoids::fit(carma::arr_to_mat<float>(inputData), loss,
-      std::make_optional<std::reference_wrapper<const arma::fmat>>(tmp_array));
+    std::optional<arma::fmat> distMat;
+    KMedoidsWrapper::matrixView(distMatArray, &distMat);
+    pybind11::gil_scoped_release release;
+    KMedoids::fitTransposed(*points, loss,
+      std::make_optional<std::reference_wrapper<const arma::fmat>>(*distMat),
+      initialMedoidsRef,
+      weightsRef);
   } else {
     // TODO(@motiwari): change std::nullopt to nullopt?
-    KMedoids::fit(carma::arr_to_mat<float>(inputData), loss, std::nullopt);
+    pybind11::gil_scoped_release release;
+    KMedoids::fitTransposed(
+      *points, loss, std::nullopt, initialMedoidsRef, weightsRef);
+  }
+}
+
+pybind11::object km::KMedoidsWrapper::fitAsyncPython(
+  const pybind11::object& self,
+  const pybind11::object& inputData,
+  const std::string& loss,
+  pybind11::kwargs kw) {
+  // The fit runs on a thread of its own; since it releases the GIL, other
+  // Python threads and other fits run alongside it. The object stays in use
+  // until the fit is done, so calls on it meanwhile are rejected.
+  KMedoidsWrapper& wrapper = self.cast<KMedoidsWrapper&>();
+  wrapper.acquire();
+  pybind11::object executor;
+  pybind11::object future;
+  try {
+    executor = pybind11::module::import(
+      "concurrent.futures").attr("ThreadPoolExecutor")(1);
+    const pybind11::object task = pybind11::cpp_function(
+      [self, inputData, loss, kw]() {
+        KMedoidsWrapper& fitted = self.cast<KMedoidsWrapper&>();
+        try {
+          fitted.fitPython(inputData, loss, kw);
+        } catch (...) {
+          fitted.release();
+          throw;
+        }
+        fitted.release();
+        return self;
+      });
+    future = executor.attr("submit")(task);
+  } catch (...) {
+    // The task was not submitted, so it will not release the object
+    wrapper.release();
+    throw;
+  }
+  // The worker thread exits once the fit is done
+  executor.attr("shutdown")(pybind11::arg("wait") = false);
+  return future;
+}
+
+void km::KMedoidsWrapper::acquire() {
+  if (inUse.exchange(true)) {
+    throw pybind11::value_error(
+      "Error: this object is in use by another call, e.g., a fit_async "
+      "that is not done.");
+  }
+}
+
+void km::KMedoidsWrapper::release() {
+  inUse.store(false);
+}
+
+void km::KMedoidsWrapper::transposedView(
+  const pybind11::array_t<float>& inputData,
+  std::optional<arma::fmat>* points) {
+  if (inputData.ndim() == 0 || inputData.ndim() > 2) {
+    throw pybind11::value_error("Error: data must be a 1-D or 2-D array.");
+  }
+  const size_t N = inputData.shape(0);
+  const size_t d = inputData.ndim() == 2 ? inputData.shape(1) : 1;
+  // Only read through the view
+  float* buffer = const_cast<float*>(inputData.data());
+  if (inputData.flags() & pybind11::array::c_style) {
+    // Each row of a C-contiguous array is a contiguous point, so the buffer
+    // already has the layout of a d x N column-major matrix
+    points->emplace(buffer, d, N, false, true);
+  } else if (inputData.flags() & pybind11::array::f_style) {
+    const arma::fmat view(buffer, N, d, false, true);
+    points->emplace(arma::trans(view));
+  } else if (inputData.ndim() == 1) {
+    points->emplace(d, N);
+    const auto view = inputData.unchecked<1>();
+    for (size_t i = 0; i < N; i++) {
+      (**points)(0, i) = view(i);
+    }
+  } else {
+    points->emplace(d, N);
+    const auto view = inputData.unchecked<2>();
+    for (size_t i = 0; i < N; i++) {
+      for (size_t j = 0; j < d; j++) {
+        (**points)(j, i) = view(i, j);
+      }
+    }
+  }
+}
+
+void km::KMedoidsWrapper::matrixView(
+  const pybind11::array_t<float>& matrix,
+  std::optional<arma::fmat>* view) {
+  if (matrix.ndim() != 1 && matrix.ndim() != 2) {
+    throw pybind11::value_error("Error: dist_mat must be a 1-D or 2-D array.");
+  }
+  const size_t rows = matrix.shape(0);
+  const size_t cols = matrix.ndim() == 2 ? matrix.shape(1) : 1;
+  if (matrix.ndim() == 1) {
+    // A condensed distance matrix, aliased when contiguous
+    if (matrix.flags() & pybind11::array::c_style) {
+      view->emplace(const_cast<float*>(matrix.data()), rows, 1, false, true);
+    } else {
+      view->emplace(rows, 1);
+      const auto elements = matrix.unchecked<1>();
+      for (size_t i = 0; i < rows; i++) {
+        (**view)(i, 0) = elements(i);
+      }
+    }
+  } else if (matrix.flags() & pybind11::array::f_style) {
+    // Only read through the view
+    view->emplace(const_cast<float*>(matrix.data()), rows, cols, false, true);
+  } else {
+    view->emplace(rows, cols);
+    const auto elements = matrix.unchecked<2>();
+    for (size_t i = 0; i < rows; i++) {
+      for (size_t j = 0; j < cols; j++) {
+        (**view)(i, j) = elements(i, j);
+      }
+    }
+  }
+}
+
+void km::KMedoidsWrapper::sparseTransposedView(
+  const pybind11::object& matrix,
+  std::optional<arma::sp_fmat>* points) {
+  pybind11::object csr = matrix.attr("tocsr")();
+  // Row indices must be sorted and unique within each row; the caller's
+  // matrix is left unchanged
+  if (!pybind11::cast<bool>(csr.attr("has_canonical_format"))) {
+    csr = csr.attr("copy")();
+    csr.attr("sum_duplicates")();
   }
+  const pybind11::tuple shape = csr.attr("shape");
+  const size_t N = pybind11::cast<size_t>(shape[0]);
+  const size_t d = pybind11::cast<size_t>(shape[1]);
+  using Indices = pybind11::array_t<arma::uword,
+    pybind11::array::c_style | pybind11::array::forcecast>;
+  using Values = pybind11::array_t<float,
+    pybind11::array::c_style | pybind11::array::forcecast>;
+  const Indices indptr = pybind11::cast<Indices>(csr.attr("indptr"));
+  const Indices indices = pybind11::cast<Indices>(csr.attr("indices"));
+  const Values values = pybind11::cast<Values>(csr.attr("data"));
+  // Only read while they are copied into the sparse matrix
+  const arma::uvec colPtrs(
+    const_cast<arma::uword*>(indptr.data()), indptr.size(), false, true);
+  const arma::uvec rowIndices(
+    const_cast<arma::uword*>(indices.data()), indices.size(), false, true);
+  const arma::fvec nonZeros(
+    const_cast<float*>(values.data()), values.size(), false, true);
+  points->emplace(rowIndices, colPtrs, nonZeros, d, N);
 }
 
 void fit_python(pybind11::class_<KMedoidsWrapper> *cls) {
-  cls->def("fit", &KMedoidsWrapper::fitPython);
+  cls->def("fit", guarded(&KMedoidsWrapper::fitPython));
+  cls->def("fit_async", &KMedoidsWrapper::fitAsyncPython);
 }
 }  // namespace km
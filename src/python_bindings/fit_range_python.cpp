@@ -0,0 +1,73 @@
+/**
+ * @file fit_range_python.cpp
+ * @date 2026-10-14
+ *
+ * Defines the function fitRangePython in KMedoidsWrapper class
+ * which is used in Python bindings.
+ */
+
+#include <pybind11/pybind11.h>
+#include <pybind11/stl.h>
+#include <pybind11/numpy.h>
+#include <carma>
+#include <armadillo>
+#include <optional>
+
+#include "kmedoids_pywrapper.hpp"
+
+namespace km {
+namespace {
+pybind11::array_t<arma::uword> rowToArray(const arma::urowvec& row) {
+  if (row.size() > 1) {
+    return carma::row_to_arr<arma::uword>(row).squeeze();
+  } else {
+    return carma::row_to_arr<arma::uword>(row);
+  }
+}
+}  // namespace
+
+pybind11::list km::KMedoidsWrapper::fitRangePython(
+  const pybind11::array_t<float>& inputData,
+  const std::string& loss,
+  const size_t kMin,
+  const size_t kMax,
+  pybind11::kwargs kw) {
+  std::optional<arma::fmat> points;
+  KMedoidsWrapper::transposedView(inputData, &points);
+  if ((kw.size() != 0) && (kw.contains("dist_mat"))) {
+    // Kept alive while the view is used, in case it had to be converted
+    const pybind11::array_t<float> distMatArray =
+      pybind11::cast<const pybind11::array_t<float>>(kw["dist_mat"]);
+    std::optional<arma::fmat> distMat;
+    KMedoidsWrapper::matrixView(distMatArray, &distMat);
+    pybind11::gil_scoped_release release;
+    KMedoids::fitRangeTransposed(*points, loss, kMin, kMax,
+      std::make_optional<std::reference_wrapper<const arma::fmat>>(*distMat));
+  } else {
+    pybind11::gil_scoped_release release;
+    KMedoids::fitRangeTransposed(*points, loss, kMin, kMax, std::nullopt);
+  }
+
+  pybind11::list results;
+  for (const FitResult& fitResult : KMedoids::getRangeResults()) {
+    pybind11::dict result;
+    result["k"] = fitResult.k;
+    result["build_medoids"] = rowToArray(fitResult.medoidsBuild);
+    result["medoids"] = rowToArray(fitResult.medoidsFinal);
+    result["labels"] = rowToArray(fitResult.labels);
+    result["steps"] = fitResult.steps;
+    result["average_loss"] = fitResult.loss;
+    result["swap_ms"] = fitResult.swapMilliseconds;
+    results.append(result);
+  }
+  return results;
+}
+
+void fit_range_python(pybind11::class_<KMedoidsWrapper> *cls) {
+  cls->def("fit_range", guarded(&KMedoidsWrapper::fitRangePython),
+    pybind11::arg("data"),
+    pybind11::arg("loss"),
+    pybind11::arg("k_min"),
+    pybind11::arg("k_max"));
+}
+}  // namespace km
@@ -0,0 +1,71 @@
+/**
+ * @file fit_restarts_python.cpp
+ * @date 2026-10-14
+ *
+ * Defines the function fitRestartsPython in KMedoidsWrapper class
+ * which is used in Python bindings.
+ */
+
+#include <pybind11/pybind11.h>
+#include <pybind11/stl.h>
+#include <pybind11/numpy.h>
+#include <carma>
+#include <armadillo>
+#include <optional>
+
+#include "kmedoids_pywrapper.hpp"
+
+namespace km {
+namespace {
+pybind11::array_t<arma::uword> rowToArray(const arma::urowvec& row) {
+  if (row.size() > 1) {
+    return carma::row_to_arr<arma::uword>(row).squeeze();
+  } else {
+    return carma::row_to_arr<arma::uword>(row);
+  }
+}
+}  // namespace
+
+pybind11::list km::KMedoidsWrapper::fitRestartsPython(
+  const pybind11::array_t<float>& inputData,
+  const std::string& loss,
+  const size_t nRestarts,
+  pybind11::kwargs kw) {
+  std::optional<arma::fmat> points;
+  KMedoidsWrapper::transposedView(inputData, &points);
+  if ((kw.size() != 0) && (kw.contains("dist_mat"))) {
+    // Kept alive while the view is used, in case it had to be converted
+    const pybind11::array_t<float> distMatArray =
+      pybind11::cast<const pybind11::array_t<float>>(kw["dist_mat"]);
+    std::optional<arma::fmat> distMat;
+    KMedoidsWrapper::matrixView(distMatArray, &distMat);
+    pybind11::gil_scoped_release release;
+    KMedoids::fitRestartsTransposed(*points, loss, nRestarts,
+      std::make_optional<std::reference_wrapper<const arma::fmat>>(*distMat));
+  } else {
+    pybind11::gil_scoped_release release;
+    KMedoids::fitRestartsTransposed(*points, loss, nRestarts);
+  }
+
+  pybind11::list results;
+  for (const RestartResult& restartResult : KMedoids::getRestartResults()) {
+    pybind11::dict result;
+    result["seed"] = restartResult.seed;
+    result["medoids"] = rowToArray(restartResult.medoidsFinal);
+    result["steps"] = restartResult.steps;
+    result["average_loss"] = restartResult.loss;
+    result["swap_ms"] = restartResult.swapMilliseconds;
+    result["distance_computations"] = restartResult.distanceComputations;
+    result["cache_hits"] = restartResult.cacheHits;
+    results.append(result);
+  }
+  return results;
+}
+
+void fit_restarts_python(pybind11::class_<KMedoidsWrapper> *cls) {
+  cls->def("fit_restarts", guarded(&KMedoidsWrapper::fitRestartsPython),
+    pybind11::arg("data"),
+    pybind11::arg("loss"),
+    pybind11::arg("n_restarts"));
+}
+}  // namespace km
@@ -7,6 +7,7 @@
  */
 
 #include <pybind11/pybind11.h>
+#include <pybind11/functional.h>
 #include <pybind11/stl.h>
 #include <pybind11/numpy.h>
 #include <carma>
@@ -49,27 +50,73 @@ PYBIND11_MODULE(banditpam, m) {
 
   // Properties
   cls.def_property("n_medoids",
-    &KMedoidsWrapper::getNMedoids, &KMedoidsWrapper::setNMedoids);
+    guarded(&KMedoidsWrapper::getNMedoids),
+    guarded(&KMedoidsWrapper::setNMedoids));
   cls.def_property("algorithm",
-    &KMedoidsWrapper::getAlgorithm, &KMedoidsWrapper::setAlgorithm);
+    guarded(&KMedoidsWrapper::getAlgorithm),
+    guarded(&KMedoidsWrapper::setAlgorithm));
   cls.def_property("max_iter",
-    &KMedoidsWrapper::getMaxIter, &KMedoidsWrapper::setMaxIter);
+    guarded(&KMedoidsWrapper::getMaxIter),
+    guarded(&KMedoidsWrapper::setMaxIter));
   cls.def_property("build_confidence",
-    &KMedoidsWrapper::getBuildConfidence, &KMedoidsWrapper::setBuildConfidence);
+    guarded(&KMedoidsWrapper::getBuildConfidence),
+    guarded(&KMedoidsWrapper::setBuildConfidence));
   cls.def_property("swap_confidence",
-    &KMedoidsWrapper::getSwapConfidence, &KMedoidsWrapper::setSwapConfidence);
+    guarded(&KMedoidsWrapper::getSwapConfidence),
+    guarded(&KMedoidsWrapper::setSwapConfidence));
   cls.def_property("use_cache",
-    &KMedoidsWrapper::getUseCache, &KMedoidsWrapper::setUseCache);
+    guarded(&KMedoidsWrapper::getUseCache),
+    guarded(&KMedoidsWrapper::setUseCache));
   cls.def_property("use_perm",
-    &KMedoidsWrapper::getUsePerm, &KMedoidsWrapper::setUsePerm);
+    guarded(&KMedoidsWrapper::getUsePerm),
+    guarded(&KMedoidsWrapper::setUsePerm));
   cls.def_property("cache_width",
-    &KMedoidsWrapper::getCacheWidth, &KMedoidsWrapper::setCacheWidth);
+    guarded(&KMedoidsWrapper::getCacheWidth),
+    guarded(&KMedoidsWrapper::setCacheWidth));
+  cls.def_property("cache_budget",
+    guarded(&KMedoidsWrapper::getCacheBudget),
+    guarded(&KMedoidsWrapper::setCacheBudget));
+  cls.def_property("cache_file",
+    guarded(&KMedoidsWrapper::getCacheFile),
+    guarded(&KMedoidsWrapper::setCacheFile));
+  cls.def_property("cache_admission",
+    guarded(&KMedoidsWrapper::getCacheAdmission),
+    guarded(&KMedoidsWrapper::setCacheAdmission));
+  cls.def_property("dist_mat_precision",
+    guarded(&KMedoidsWrapper::getDistMatPrecision),
+    guarded(&KMedoidsWrapper::setDistMatPrecision));
+  cls.def_property("data_precision",
+    guarded(&KMedoidsWrapper::getDataPrecision),
+    guarded(&KMedoidsWrapper::setDataPrecision));
+  cls.def_property("time_budget_ms",
+    guarded(&KMedoidsWrapper::getTimeBudget),
+    guarded(&KMedoidsWrapper::setTimeBudget));
+  cls.def_property_readonly("truncated",
+    guarded(&KMedoidsWrapper::getTruncated));
+  cls.def("set_progress_callback",
+    guarded(&KMedoidsWrapper::setProgressCallback),
+    pybind11::arg("callback"));
   cls.def_property("parallelize",
-    &KMedoidsWrapper::getParallelize, &KMedoidsWrapper::setParallelize);
+    guarded(&KMedoidsWrapper::getParallelize),
+    guarded(&KMedoidsWrapper::setParallelize));
+  cls.def_property("collapse_duplicates",
+    guarded(&KMedoidsWrapper::getCollapseDuplicates),
+    guarded(&KMedoidsWrapper::setCollapseDuplicates));
+  cls.def_property("num_threads",
+    guarded(&KMedoidsWrapper::getNumThreads),
+    guarded(&KMedoidsWrapper::setNumThreads));
+  cls.def_property("schedule",
+    guarded(&KMedoidsWrapper::getSchedule),
+    guarded(&KMedoidsWrapper::setSchedule));
+  cls.def_property("backend",
+    guarded(&KMedoidsWrapper::getBackend),
+    guarded(&KMedoidsWrapper::setBackend));
   cls.def_property("loss_function",
-    &KMedoidsWrapper::getLossFn, &KMedoidsWrapper::setLossFn);
+    guarded(&KMedoidsWrapper::getLossFn),
+    guarded(&KMedoidsWrapper::setLossFn));
   cls.def_property("seed",
-    &KMedoidsWrapper::getSeed, &KMedoidsWrapper::setSeed);
+    guarded(&KMedoidsWrapper::getSeed),
+    guarded(&KMedoidsWrapper::setSeed));
 
   // Other functions
   medoids_python(&cls);
@@ -77,6 +124,10 @@ PYBIND11_MODULE(banditpam, m) {
   labels_python(&cls);
   steps_python(&cls);
   fit_python(&cls);
+  fit_range_python(&cls);
+  fit_clara_python(&cls);
+  fit_restarts_python(&cls);
+  predict_python(&cls);
   loss_python(&cls);
 
   // Cache functions
@@ -91,5 +142,6 @@ PYBIND11_MODULE(banditpam, m) {
   // Swap timing functions
   time_per_swap_python(&cls);
   total_swap_time_python(&cls);
+  profile_python(&cls);
 }
 }  // namespace km
@@ -23,6 +23,7 @@ pybind11::array_t<arma::uword> km::KMedoidsWrapper::getLabelsPython() {
 }
 
 void labels_python(pybind11::class_<km::KMedoidsWrapper> *cls) {
-  cls->def_property_readonly("labels", &km::KMedoidsWrapper::getLabelsPython);
+  cls->def_property_readonly("labels",
+    guarded(&km::KMedoidsWrapper::getLabelsPython));
 }
 }  // namespace km
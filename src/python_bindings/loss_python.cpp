@@ -19,6 +19,7 @@ float km::KMedoidsWrapper::getLossPython() {
 }
 
 void loss_python(pybind11::class_<KMedoidsWrapper> *cls) {
-  cls->def_property_readonly("average_loss", &KMedoidsWrapper::getLossPython);
+  cls->def_property_readonly("average_loss",
+    guarded(&KMedoidsWrapper::getLossPython));
 }
 }  // namespace km
@@ -25,6 +25,6 @@ pybind11::array_t<arma::uword> km::KMedoidsWrapper::getMedoidsFinalPython() {
 
 void medoids_python(pybind11::class_<km::KMedoidsWrapper> *cls) {
   cls->def_property_readonly("medoids",
-    &KMedoidsWrapper::getMedoidsFinalPython);
+    guarded(&KMedoidsWrapper::getMedoidsFinalPython));
 }
 }  // namespace km
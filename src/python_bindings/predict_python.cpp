@@ -0,0 +1,48 @@
+/**
+ * @file predict_python.cpp
+ * @date 2026-10-14
+ *
+ * Defines the functions predictPython and transformPython in
+ * KMedoidsWrapper class which are used in Python bindings.
+ */
+
+#include <pybind11/pybind11.h>
+#include <pybind11/numpy.h>
+#include <carma>
+#include <armadillo>
+#include <optional>
+
+#include "kmedoids_pywrapper.hpp"
+
+namespace km {
+pybind11::array_t<arma::uword> km::KMedoidsWrapper::predictPython(
+  const pybind11::array_t<float>& newData) {
+  // Viewed with one point per column, without a copy when the array is
+  // C-contiguous float32, so that each batch is a contiguous slice
+  std::optional<arma::fmat> points;
+  KMedoidsWrapper::transposedView(newData, &points);
+  arma::urowvec assignments;
+  {
+    pybind11::gil_scoped_release release;
+    assignments = KMedoids::predictTransposed(*points);
+  }
+  return carma::row_to_arr<arma::uword>(assignments).squeeze();
+}
+
+pybind11::array_t<float> km::KMedoidsWrapper::transformPython(
+  const pybind11::array_t<float>& newData) {
+  std::optional<arma::fmat> points;
+  KMedoidsWrapper::transposedView(newData, &points);
+  arma::fmat distances;
+  {
+    pybind11::gil_scoped_release release;
+    distances = KMedoids::transformTransposed(*points);
+  }
+  return carma::mat_to_arr<float>(distances);
+}
+
+void predict_python(pybind11::class_<KMedoidsWrapper> *cls) {
+  cls->def("predict", guarded(&KMedoidsWrapper::predictPython));
+  cls->def("transform", guarded(&KMedoidsWrapper::transformPython));
+}
+}  // namespace km
@@ -0,0 +1,51 @@
+/**
+ * @file profile_python.cpp
+ * @date 2026-10-14
+ *
+ * Defines the function getProfilePython in KMedoidsWrapper class
+ * which is used in Python bindings.
+ */
+
+#include <pybind11/pybind11.h>
+#include <pybind11/stl.h>
+#include <carma>
+#include <armadillo>
+
+#include "kmedoids_pywrapper.hpp"
+
+namespace km {
+namespace {
+pybind11::dict timingToDict(const PhaseTiming& timing) {
+  pybind11::dict result;
+  result["wall_ms"] = timing.wallMilliseconds;
+  result["cpu_ms"] = timing.cpuMilliseconds;
+  result["calls"] = timing.calls;
+  return result;
+}
+}  // namespace
+
+pybind11::dict km::KMedoidsWrapper::getProfilePython() {
+  const FitProfile& profile = KMedoids::getProfile();
+  pybind11::list swapSteps;
+  for (const PhaseTiming& step : profile.swapSteps) {
+    swapSteps.append(timingToDict(step));
+  }
+
+  // Keys match those of FitProfile::toJson
+  pybind11::dict result;
+  result["build"] = timingToDict(profile.build);
+  result["swap"] = timingToDict(profile.swap);
+  result["swap_steps"] = swapSteps;
+  result["sigma"] = timingToDict(profile.sigma);
+  result["targets"] = timingToDict(profile.targets);
+  result["exact_targets"] = timingToDict(profile.exactTargets);
+  result["build_arms_per_round"] = profile.buildArmsPerRound;
+  result["swap_arms_per_round"] = profile.swapArmsPerRound;
+  return result;
+}
+
+void profile_python(pybind11::class_<KMedoidsWrapper> *cls) {
+  cls->def_property_readonly("profile",
+    guarded(&KMedoidsWrapper::getProfilePython));
+}
+}  // namespace km
@@ -19,6 +19,7 @@ int km::KMedoidsWrapper::getStepsPython() {
 }
 
 void steps_python(pybind11::class_<KMedoidsWrapper> *cls) {
-  cls->def_property_readonly("steps", &KMedoidsWrapper::getStepsPython);
+  cls->def_property_readonly("steps",
+    guarded(&KMedoidsWrapper::getStepsPython));
 }
 }  // namespace km
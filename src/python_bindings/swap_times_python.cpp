@@ -24,12 +24,12 @@ float km::KMedoidsWrapper::getTimePerSwapPython() {
 void total_swap_time_python(pybind11::class_<km::KMedoidsWrapper> *cls) {
   cls->def_property_readonly(
     "total_swap_time",
-    &KMedoidsWrapper::getTotalSwapTimePython);
+    guarded(&KMedoidsWrapper::getTotalSwapTimePython));
 }
 
 void time_per_swap_python(pybind11::class_<km::KMedoidsWrapper> *cls) {
   cls->def_property_readonly(
     "time_per_swap",
-    &KMedoidsWrapper::getTimePerSwapPython);
+    guarded(&KMedoidsWrapper::getTimePerSwapPython));
 }
 }  // namespace km
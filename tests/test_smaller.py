@@ -1,3 +1,6 @@
+import os
+import tempfile
+import threading
 import unittest
 import pandas as pd
 import numpy as np
@@ -113,6 +116,459 @@ class SmallerTests(unittest.TestCase):
             [16, 25, 31, 49, 63, 70, 82, 90, 94, 99]
         )
 
+    def test_profile(self):
+        """
+        Test that the profile of a fit has an entry for each SWAP step and
+        agrees with the reported total SWAP time
+        """
+        kmed = KMedoids(
+            n_medoids=5,
+            algorithm="BanditPAM",
+        )
+        kmed.fit(self.small_mnist, "L2")
+        profile = kmed.profile
+
+        self.assertEqual(len(profile["swap_steps"]), kmed.steps)
+        self.assertEqual(profile["build"]["calls"], 1)
+        self.assertEqual(int(profile["swap"]["wall_ms"]), kmed.total_swap_time)
+        self.assertTrue(len(profile["build_arms_per_round"]) > 0)
+
+    def test_warm_start(self):
+        """
+        Test that a fit warm-started from the medoids of a previous fit skips
+        BUILD and uses the given medoids as its BUILD medoids
+        """
+        for algorithm in ["BanditPAM", "FastPAM1"]:
+            kmed = KMedoids(n_medoids=5, algorithm=algorithm)
+            kmed.fit(self.small_mnist, "L2")
+            previous = kmed.medoids
+
+            warm = KMedoids(algorithm=algorithm)
+            warm.fit(self.small_mnist, "L2", initial_medoids=previous)
+            self.assertEqual(warm.n_medoids, 5)
+            self.assertEqual(warm.build_medoids.tolist(), previous.tolist())
+            self.assertEqual(warm.profile["build"]["calls"], 0)
+            self.assertLessEqual(warm.average_loss, kmed.average_loss + 1e-3)
+
+    def test_predict(self):
+        """
+        Test that transform returns the distances to the fitted medoids, and
+        that predict assigns each point to its nearest medoid
+        """
+        kmed = KMedoids(n_medoids=5, algorithm="BanditPAM")
+        kmed.fit(self.small_mnist, "L2")
+
+        distances = kmed.transform(self.small_mnist)
+        self.assertEqual(distances.shape, (len(self.small_mnist), 5))
+        expected = np.linalg.norm(
+            self.small_mnist[:, None, :]
+            - self.small_mnist[kmed.medoids][None, :, :],
+            axis=2,
+        )
+        np.testing.assert_allclose(distances, expected, rtol=1e-3, atol=1e-2)
+
+        predictions = kmed.predict(self.small_mnist)
+        nearest = expected[np.arange(len(expected)), predictions]
+        np.testing.assert_allclose(nearest, expected.min(axis=1), atol=1e-2)
+        self.assertEqual(predictions[kmed.medoids].tolist(), list(range(5)))
+
+    def test_data_layouts(self):
+        """
+        Test that C-ordered, Fortran-ordered and strided inputs, which are
+        ingested differently, give the same medoids, predictions and
+        distances
+        """
+        data = np.ascontiguousarray(self.small_mnist, dtype=np.float32)
+        padded = np.zeros((data.shape[0], 2 * data.shape[1]), np.float32)
+        padded[:, ::2] = data
+        layouts = [data, np.asfortranarray(data), padded[:, ::2]]
+        medoids = []
+        for layout in layouts:
+            kmed = KMedoids(n_medoids=5, algorithm="FastPAM1")
+            kmed.fit(layout, "L2")
+            medoids.append(kmed.medoids.tolist())
+        self.assertEqual(medoids[0], medoids[1])
+        self.assertEqual(medoids[0], medoids[2])
+
+        predictions = kmed.predict(data)
+        distances = kmed.transform(data)
+        for layout in layouts[1:]:
+            np.testing.assert_array_equal(kmed.predict(layout), predictions)
+            np.testing.assert_allclose(
+                kmed.transform(layout), distances, rtol=1e-6)
+
+    def test_fit_range(self):
+        """
+        Test that fitting a range of k runs BUILD once, and that the BUILD
+        medoids of each k are a prefix of those of the largest k
+        """
+        kmed = KMedoids(algorithm="BanditPAM")
+        results = kmed.fit_range(self.small_mnist, "L2", 2, 5)
+
+        self.assertEqual([r["k"] for r in results], [2, 3, 4, 5])
+        self.assertEqual(kmed.profile["build"]["calls"], 1)
+        largest = results[-1]["build_medoids"].tolist()
+        for result in results:
+            k = result["k"]
+            self.assertEqual(result["build_medoids"].tolist(), largest[:k])
+            self.assertEqual(len(result["medoids"]), k)
+        self.assertEqual(kmed.medoids.tolist(), results[-1]["medoids"].tolist())
+
+    def test_condensed_dist_mat(self):
+        """
+        Test that a condensed distance matrix gives the same medoids as the
+        full one, and that 16-bit storage gives a similar loss
+        """
+        data = self.small_mnist.astype(np.float32)
+        full = np.linalg.norm(
+            data[:, None, :] - data[None, :, :], axis=2
+        ).astype(np.float32)
+        condensed = full[np.triu_indices(len(data), k=1)]
+
+        kmed = KMedoids(n_medoids=5, algorithm="BanditPAM")
+        kmed.fit(data, "L2", dist_mat=full)
+        expected = kmed.medoids.tolist()
+        kmed.fit(data, "L2", dist_mat=condensed)
+        self.assertEqual(kmed.medoids.tolist(), expected)
+        loss = kmed.average_loss
+
+        for precision in ["float16", "bfloat16"]:
+            kmed.dist_mat_precision = precision
+            kmed.fit(data, "L2", dist_mat=condensed)
+            self.assertLessEqual(kmed.average_loss, 1.01 * loss)
+
+    def test_exact_parallel_dist_mat(self):
+        """
+        Test that PAM and FastPAM1 give the same medoids with and without
+        threads, and with a distance matrix of the same loss
+        """
+        data = self.small_mnist.astype(np.float32)
+        dist_mat = np.linalg.norm(
+            data[:, None, :] - data[None, :, :], axis=2
+        ).astype(np.float32)
+        for algorithm in ["PAM", "FastPAM1"]:
+            kmed = KMedoids(n_medoids=5, algorithm=algorithm)
+            kmed.fit(data, "L2")
+            expected = kmed.medoids.tolist()
+
+            serial = KMedoids(
+                n_medoids=5, algorithm=algorithm, parallelize=False
+            )
+            serial.fit(data, "L2")
+            self.assertEqual(serial.medoids.tolist(), expected)
+
+            kmed.fit(data, "L2", dist_mat=dist_mat)
+            self.assertEqual(kmed.medoids.tolist(), expected)
+
+    def test_fasterpam(self):
+        """
+        Test that FasterPAM, which swaps eagerly, reaches a loss as low as
+        that of FastPAM1 from the same BUILD medoids
+        """
+        fast = KMedoids(n_medoids=5, algorithm="FastPAM1")
+        fast.fit(self.small_mnist, "L2")
+        faster = KMedoids(n_medoids=5, algorithm="FasterPAM")
+        faster.fit(self.small_mnist, "L2")
+
+        self.assertEqual(
+            faster.build_medoids.tolist(), fast.build_medoids.tolist()
+        )
+        self.assertEqual(len(faster.profile["swap_steps"]), faster.steps)
+        self.assertLessEqual(faster.average_loss, 1.01 * fast.average_loss)
+
+    def test_fit_clara(self):
+        """
+        Test that fitting samples of the data finds medoids whose loss on the
+        whole data is close to that of a full fit, with and without
+        refining them
+        """
+        full = KMedoids(n_medoids=5, algorithm="BanditPAM")
+        full.fit(self.small_mnist, "L2")
+
+        kmed = KMedoids(n_medoids=5, algorithm="BanditPAM")
+        kmed.fit_clara(self.small_mnist, "L2", n_samples=3, sample_size=300)
+        self.assertEqual(len(kmed.medoids), 5)
+        self.assertEqual(len(kmed.labels), len(self.small_mnist))
+        self.assertLessEqual(kmed.average_loss, 1.1 * full.average_loss)
+
+        kmed.fit_clara(
+            self.small_mnist,
+            "L2",
+            n_samples=3,
+            sample_size=300,
+            refine_iter=10,
+        )
+        self.assertLessEqual(kmed.average_loss, 1.1 * full.average_loss)
+
+    def test_time_budget(self):
+        """
+        Test that a fit out of time still returns valid medoids with the loss
+        of those medoids, and that the progress callback sees every step
+        """
+        kmed = KMedoids(n_medoids=5, algorithm="BanditPAM")
+        calls = []
+        kmed.set_progress_callback(lambda phase, step: calls.append(phase))
+        kmed.fit(self.small_mnist, "L2")
+        self.assertFalse(kmed.truncated)
+        self.assertEqual(calls.count("build"), 5)
+        self.assertEqual(calls.count("swap"), kmed.steps)
+
+        kmed.time_budget_ms = 1e-6
+        kmed.fit(self.small_mnist, "L2")
+        self.assertTrue(kmed.truncated)
+        self.assertEqual(len(set(kmed.medoids.tolist())), 5)
+        distances = np.linalg.norm(
+            self.small_mnist[:, None, :]
+            - self.small_mnist[kmed.medoids][None, :, :],
+            axis=2,
+        )
+        self.assertAlmostEqual(
+            kmed.average_loss, distances.min(axis=1).mean(), places=2
+        )
+
+    def test_many_medoids(self):
+        """
+        Test that the labels and loss skip no closer medoid when the triangle
+        inequality prunes most point-to-medoid distances
+        """
+        for loss, order in [("L1", 1), ("L2", 2), ("inf", np.inf)]:
+            kmed = KMedoids(n_medoids=50, algorithm="FasterPAM")
+            kmed.fit(self.small_mnist, loss)
+            distances = np.linalg.norm(
+                self.small_mnist[:, None, :]
+                - self.small_mnist[kmed.medoids][None, :, :],
+                ord=order,
+                axis=2,
+            )
+            self.assertTrue(
+                np.allclose(
+                    distances[np.arange(len(kmed.labels)), kmed.labels],
+                    distances.min(axis=1),
+                    rtol=1e-3,
+                )
+            )
+            self.assertAlmostEqual(
+                kmed.average_loss / distances.min(axis=1).mean(), 1, places=3
+            )
+
+    def test_weights(self):
+        """
+        Test that integer weights and collapsed duplicates give the same loss
+        as fitting the repeated points
+        """
+        data = self.small_mnist
+        counts = np.arange(len(data)) % 3 + 1
+        repeated = np.repeat(data, counts, axis=0)
+        for algorithm in ["BanditPAM", "FasterPAM"]:
+            kmed = KMedoids(n_medoids=5, algorithm=algorithm)
+            kmed.fit(repeated, "L2")
+            weighted = KMedoids(n_medoids=5, algorithm=algorithm)
+            weighted.fit(data, "L2", weights=counts.astype(np.float32))
+            collapsed = KMedoids(n_medoids=5, algorithm=algorithm)
+            collapsed.collapse_duplicates = True
+            collapsed.fit(repeated, "L2")
+            self.assertEqual(len(collapsed.labels), len(repeated))
+            for other in [weighted, collapsed]:
+                self.assertAlmostEqual(
+                    other.average_loss / kmed.average_loss, 1, places=1
+                )
+
+    def test_fit_async(self):
+        """
+        Test that concurrent fits with their own thread counts find the same
+        medoids as a synchronous fit
+        """
+        kmed = KMedoids(n_medoids=5, algorithm="BanditPAM")
+        kmed.fit(self.small_mnist, "L2")
+        futures = []
+        for _ in range(2):
+            concurrent = KMedoids(n_medoids=5, algorithm="BanditPAM")
+            concurrent.num_threads = 1
+            futures.append(concurrent.fit_async(self.small_mnist, "L2"))
+        for future in futures:
+            fitted = future.result()
+            self.assertEqual(fitted.num_threads, 1)
+            self.assertEqual(
+                sorted(fitted.medoids.tolist()), sorted(kmed.medoids.tolist())
+            )
+
+    def test_fit_async_rejects_overlapping_calls(self):
+        """
+        Test that calls on an object whose fit_async is not done raise
+        instead of racing with the fit, and that it reseeds on its thread
+        """
+        kmed = KMedoids(n_medoids=5, algorithm="BanditPAM")
+        kmed.fit(self.small_mnist, "L2")
+        started = threading.Event()
+        resume = threading.Event()
+
+        def wait(phase, step):
+            started.set()
+            resume.wait()
+
+        concurrent = KMedoids(n_medoids=5, algorithm="BanditPAM")
+        concurrent.set_progress_callback(wait)
+        future = concurrent.fit_async(self.small_mnist, "L2")
+        started.wait()
+        with self.assertRaises(ValueError):
+            concurrent.fit_async(self.small_mnist, "L2")
+        with self.assertRaises(ValueError):
+            concurrent.fit(self.small_mnist, "L2")
+        with self.assertRaises(ValueError):
+            concurrent.predict(self.small_mnist)
+        with self.assertRaises(ValueError):
+            concurrent.medoids
+        resume.set()
+        fitted = future.result()
+        self.assertEqual(
+            sorted(fitted.medoids.tolist()), sorted(kmed.medoids.tolist())
+        )
+
+    def test_thread_determinism(self):
+        """
+        Test that fits give identical medoids and losses for any number of
+        threads, with and without the permutation
+        """
+        for use_perm in [True, False]:
+            serial = KMedoids(n_medoids=5, algorithm="BanditPAM")
+            serial.use_perm = use_perm
+            serial.num_threads = 1
+            serial.fit(self.small_mnist, "L2")
+            for num_threads in [2, 4]:
+                kmed = KMedoids(n_medoids=5, algorithm="BanditPAM")
+                kmed.use_perm = use_perm
+                kmed.num_threads = num_threads
+                kmed.fit(self.small_mnist, "L2")
+                self.assertEqual(
+                    kmed.medoids.tolist(), serial.medoids.tolist()
+                )
+                self.assertEqual(kmed.average_loss, serial.average_loss)
+
+    def test_schedule(self):
+        """
+        Test that the work schedules of the bandit rounds find medoids as
+        good as the static one, and that unknown schedules are rejected
+        """
+        kmed = KMedoids(n_medoids=5, algorithm="BanditPAM")
+        self.assertEqual(kmed.schedule, "dynamic")
+        kmed.schedule = "static"
+        kmed.fit(self.small_mnist, "L2")
+        for schedule in ["dynamic", "adaptive"]:
+            other = KMedoids(n_medoids=5, algorithm="BanditPAM")
+            other.schedule = schedule
+            other.fit(self.small_mnist, "L2")
+            self.assertLessEqual(other.average_loss, 1.01 * kmed.average_loss)
+        with self.assertRaises(ValueError):
+            kmed.schedule = "guided"
+
+    def test_backend(self):
+        """
+        Test that the CUDA backend, where available, finds medoids as good as
+        the CPU, and that unknown backends are rejected
+        """
+        kmed = KMedoids(n_medoids=5, algorithm="BanditPAM")
+        self.assertEqual(kmed.backend, "cpu")
+        with self.assertRaises(ValueError):
+            kmed.backend = "tpu"
+        kmed.fit(self.small_mnist, "L2")
+        other = KMedoids(n_medoids=5, algorithm="BanditPAM")
+        try:
+            other.backend = "cuda"
+        except ValueError:
+            self.skipTest("BanditPAM was built without CUDA support")
+        other.fit(self.small_mnist, "L2")
+        self.assertLessEqual(other.average_loss, 1.01 * kmed.average_loss)
+
+    def test_fit_restarts(self):
+        """
+        Test that restarts keep the best of their losses, and that the later
+        restarts reuse the distances cached by the first one
+        """
+        kmed = KMedoids(n_medoids=5, algorithm="BanditPAM")
+        results = kmed.fit_restarts(self.small_mnist, "L2", 4)
+        self.assertEqual([r["seed"] for r in results], [0, 1, 2, 3])
+        best = min(results, key=lambda r: r["average_loss"])
+        self.assertEqual(kmed.average_loss, best["average_loss"])
+        self.assertEqual(kmed.medoids.tolist(), best["medoids"].tolist())
+        self.assertEqual(kmed.seed, 0)
+
+        single = KMedoids(n_medoids=5, algorithm="BanditPAM")
+        single.fit(self.small_mnist, "L2")
+        self.assertLess(kmed.cache_writes, 4 * single.cache_writes)
+
+    def test_cache_file(self):
+        """
+        Test that a fit reattaching a cache file reuses its distances, and
+        that fits on other data replace the file
+        """
+        with tempfile.TemporaryDirectory() as directory:
+            path = os.path.join(directory, "cache.bin")
+            cold = KMedoids(n_medoids=5, algorithm="BanditPAM")
+            cold.cache_file = path
+            cold.fit(self.small_mnist, "L2")
+            self.assertTrue(os.path.exists(path))
+
+            warm = KMedoids(n_medoids=5, algorithm="BanditPAM")
+            warm.cache_file = path
+            warm.fit(self.small_mnist, "L2")
+            self.assertEqual(warm.medoids.tolist(), cold.medoids.tolist())
+            self.assertLess(warm.cache_writes, cold.cache_writes)
+
+            other = KMedoids(n_medoids=5, algorithm="BanditPAM")
+            other.cache_file = path
+            other.fit(np.ascontiguousarray(self.small_mnist[::-1]), "L2")
+            self.assertGreater(other.cache_writes, warm.cache_writes)
+
+    def test_cache_admission(self):
+        """
+        Test that admitting surviving arms to the cache finds medoids as good
+        as the permutation, and that unknown policies are rejected
+        """
+        kmed = KMedoids(n_medoids=5, algorithm="BanditPAM")
+        self.assertEqual(kmed.cache_admission, "permutation")
+        kmed.fit(self.small_mnist, "L2")
+        survivors = KMedoids(n_medoids=5, algorithm="BanditPAM")
+        survivors.cache_admission = "survivors"
+        survivors.fit(self.small_mnist, "L2")
+        self.assertLessEqual(
+            survivors.average_loss, 1.01 * kmed.average_loss)
+        self.assertGreater(survivors.cache_hits, 0)
+        with self.assertRaises(ValueError):
+            kmed.cache_admission = "lru"
+
+    def test_data_precision(self):
+        """
+        Test that quantized data gives medoids whose float32 loss is close to
+        that of the float32 data
+        """
+        full = KMedoids(n_medoids=5, algorithm="FastPAM1")
+        full.fit(self.small_mnist, "L2")
+        for precision in ["float16", "bfloat16", "int8"]:
+            kmed = KMedoids(n_medoids=5, algorithm="FastPAM1")
+            kmed.data_precision = precision
+            kmed.fit(self.small_mnist, "L2")
+            self.assertLessEqual(kmed.average_loss, 1.01 * full.average_loss)
+        with self.assertRaises(ValueError):
+            kmed.data_precision = "int4"
+
+    def test_sparse(self):
+        """
+        Test that sparse data gives the same medoids as the same data when
+        dense, for each of the losses with sparse kernels
+        """
+        try:
+            from scipy import sparse
+        except ImportError:
+            self.skipTest("SciPy is not installed")
+        data = self.small_mnist.astype(np.float32)
+        for loss in ["L1", "L2", "cos"]:
+            dense = KMedoids(n_medoids=5, algorithm="FastPAM1")
+            dense.fit(data, loss)
+            kmed = KMedoids(n_medoids=5, algorithm="FastPAM1")
+            kmed.fit(sparse.csr_matrix(data), loss)
+            self.assertEqual(kmed.medoids.tolist(), dense.medoids.tolist())
+            self.assertEqual(kmed.labels.tolist(), dense.labels.tolist())
+
     def test_edge_cases(self):
         """
         Test that BanditPAM raises errors on n_medoids being unspecified or